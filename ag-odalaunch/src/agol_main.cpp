@@ -1423,10 +1423,13 @@ int AGOL_MainWindow::QuerySingleServer(Server *server)
 
 void *AGOL_MainWindow::QueryAllServers(void *arg)
 {
-	size_t   count = 0;
-	size_t   serverCount = 0;
-	size_t   serversQueried = 0;
-	int      selectedNdx;
+	odalpapi::QueryEngine           engine;
+	odalpapi::QueryEngine::Result_t result;
+	size_t                          count = 0;
+	size_t                          serverCount = 0;
+	size_t                          pending;
+	unsigned int                    serverTimeout;
+	int                             selectedNdx;
 
 	MServer.GetLock();
 
@@ -1448,44 +1451,24 @@ void *AGOL_MainWindow::QueryAllServers(void *arg)
 	ClearList(ServInfoList);
 	UpdateQueriedLabelCompleted(0);
 
-	while(count < serverCount)
+	if(GuiConfig::Read("ServerTimeout", serverTimeout) || serverTimeout == 0)
+		serverTimeout = 500;
+
+	// Every server is queried at once from a single socket
+	engine.SetTimeout(serverTimeout);
+
+	for(size_t i = 0; i < serverCount; i++)
+		engine.Add(&QServer[i], (int32_t)i);
+
+	do
 	{
-		for(size_t i = 0; i < NUM_THREADS; i++)
-		{
-			if((!QServerThread.empty()) && ((QServerThread.size() - 1) >= i))
-			{
-				// If a thread is no longer running delete it
-				if(QServerThread[i]->IsRunning())
-					continue;
-				else
-				{
-					QServerThread[i]->Join(NULL);
-					delete QServerThread[i];
-					QServerThread.erase(QServerThread.begin() + i);
-					count++;
-				}
-			}
-			if(serversQueried < serverCount)
-			{
-				// Push a new thread onto the thread vector
-				QServerThread.push_back(new ODA_Thread());
+		pending = engine.Poll(50);
 
-				// Start the thread for a server query
-				QServerThread.back()->Create(this, (THREAD_FUNC_PTR)&AGOL_MainWindow::QueryServerThrEntry,
-					&QServer[serversQueried]);
+		while(engine.GetResult(result))
+			count++;
 
-				// Incremement the number of requested server queries
-				serversQueried++;
-			}
-		}
-#ifdef _XBOX
-		// This yield is required on Xbox. Without it the Xbox sometimes fails to give the other
-		// threads CPU time and that results in an unacceptably long query and an interface pause
-		// while this thread continuously queries the other threads for completion. -- Hyper_Eye
-		AG_Delay(1); // 1ms yield
-#endif
 		UpdateQueriedLabelCompleted(static_cast<int>(count));
-	}
+	} while(pending);
 
 	// Stop the server list automatic polling
 	StopServerListPoll();
@@ -1505,14 +1488,6 @@ void *AGOL_MainWindow::QueryAllServers(void *arg)
 	return NULL;
 }
 
-void *AGOL_MainWindow::QueryServerThrEntry(void *arg)
-{
-	if(arg)
-		QuerySingleServer((Server*)arg);
-
-	return NULL;
-}
-
 bool AGOL_MainWindow::CvarCompare(const Cvar_t &a, const Cvar_t &b)
 {
 	return a.Name < b.Name;
@@ -36,6 +36,7 @@
 #include "event_handler.h"
 #include "oda_thread.h"
 #include "net_packet.h"
+#include "net_query.h"
 #include "typedefs.h"
 
 using namespace odalpapi;
@@ -177,7 +178,6 @@ private:
 	void *QueryServer(void *arg);
 	int   QuerySingleServer(Server *server);
 	void *QueryAllServers(void *arg);
-	void *QueryServerThrEntry(void *arg);
 
 	// Comapre functions
 	static bool CvarCompare(const Cvar_t &a, const Cvar_t &b);
@@ -215,7 +215,6 @@ private:
 
 	// Threads
 	ODA_Thread                MasterThread;
-	std::vector<ODA_Thread*>  QServerThread;
 
 	bool                      StartupQuery;
 	bool                      WindowExited;
@@ -38,8 +38,6 @@
  */
 namespace agOdalaunch {
 
-const size_t NUM_THREADS = 5;
-
 class ODA_ThreadBase
 {
 public:
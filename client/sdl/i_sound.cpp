@@ -28,8 +28,12 @@
 #include <SDL_mixer.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <vector>
 
 #include "z_zone.h"
+#include "m_alloc.h"
+#include "c_dispatch.h"
 
 #include "i_system.h"
 #include "i_sound.h"
@@ -37,6 +41,7 @@
 #include "m_argv.h"
 #include "m_misc.h"
 #include "w_wad.h"
+#include "s_mixer.h"
 
 #ifdef _XBOX
 #include "i_xbox.h"
@@ -55,6 +60,7 @@ static int nextchannel = 0;
 EXTERN_CVAR (snd_sfxvolume)
 EXTERN_CVAR (snd_musicvolume)
 EXTERN_CVAR (snd_crossover)
+EXTERN_CVAR (snd_precache)
 
 CVAR_FUNC_IMPL(snd_samplerate)
 {
@@ -62,6 +68,7 @@ CVAR_FUNC_IMPL(snd_samplerate)
 	S_Init(snd_sfxvolume, snd_musicvolume);
 }
 
+
 #if 0
 
 /**
@@ -120,207 +127,433 @@ static void WriteWAV(char* filename, byte* data, uint32_t length, int samplerate
 
 #endif
 
-// [Russell] - Chocolate Doom's sound converter code, how awesome!
-static bool ConvertibleRatio(int freq1, int freq2)
-{
-    int ratio;
 
-    if (freq1 > freq2)
-    {
-        return ConvertibleRatio(freq2, freq1);
-    }
-    else if ((freq2 % freq1) != 0)
-    {
-        // Not in a direct ratio
+//
+// Locking between the game and the thread that mixes, the SDL audio
+// callback or the null backend's thread
+//
+static bool null_audio = false;
+static SDL_mutex* null_lock = NULL;
+static SDL_Thread* null_thread = NULL;
+static volatile bool null_running = false;
 
-        return false;
-    }
-    else
-    {
-        // Check the ratio is a power of 2
+static SoundMixer mixer;
 
-        ratio = freq2 / freq1;
+static void I_LockMixer()
+{
+	if (null_audio)
+		SDL_LockMutex(null_lock);
+	else
+		SDL_LockAudio();
+}
 
-        while ((ratio & 1) == 0)
-        {
-            ratio = ratio >> 1;
-        }
+static void I_UnlockMixer()
+{
+	if (null_audio)
+		SDL_UnlockMutex(null_lock);
+	else
+		SDL_UnlockAudio();
+}
 
-        return ratio == 1;
-    }
+//
+// I_MixSfx
+//
+// SDL_mixer post-mix hook, adds the sound effects to the music it has mixed.
+// Runs with the audio locked.
+//
+static void I_MixSfx(void* udata, Uint8* stream, int len)
+{
+	mixer.mix(reinterpret_cast<int16_t*>(stream), len / (2 * sizeof(int16_t)));
 }
 
-// Generic sound expansion function for any sample rate
+//
+// I_NullAudioThread
+//
+// Stands in for an audio device with -nullaudio, mixing into a buffer
+// nobody hears at the rate a device would ask for it, so sounds end when
+// they should and the mixer can be measured without audio hardware.
+//
+static int I_NullAudioThread(void* data)
+{
+	static const size_t FRAMES = 1024;
+	static int16_t buffer[FRAMES * 2];
+
+	const dtime_t period = I_ConvertTimeFromMs(1000) * FRAMES / mixer_freq;
+	dtime_t due = I_GetTime();
+
+	while (null_running)
+	{
+		memset(buffer, 0, sizeof(buffer));
+
+		SDL_LockMutex(null_lock);
+		mixer.mix(buffer, FRAMES);
+		SDL_UnlockMutex(null_lock);
+
+		due += period;
+		dtime_t now = I_GetTime();
+		if (due > now)
+			I_Sleep(due - now);
+		else
+			due = now;
+	}
+
+	return 0;
+}
 
-static void ExpandSoundData(byte* data, int samplerate, int bits, int length,
-                            Mix_Chunk* destination)
+//
+// I_DecodeSound
+//
+// Has SDL_mixer decode a sound lump that is not in the Doom format and
+// mixes it down to 16-bit mono at the output rate, the closest the mixer
+// has to the sound's own format.  The result is allocated with M_Malloc
+// so the precache thread can call this too.  Returns NULL if the lump can
+// not be decoded.
+//
+static int16_t* I_DecodeSound(byte* data, size_t size, uint32_t* length)
 {
-	Sint16* expanded = reinterpret_cast<Sint16*>(destination->abuf);
-	size_t samplecount = length / (bits / 8);
+	*length = 0;
 
-	// Generic expansion if conversion does not work:
-	//
-	// SDL's audio conversion only works for rate conversions that are
-	// powers of 2; if the two formats are not in a direct power of 2
-	// ratio, do this naive conversion instead.
+	if (null_audio || size < 8)
+		return NULL;
 
-	// number of samples in the converted sound
+	SDL_RWops* mem_op = SDL_RWFromMem(data, size);
+	if (!mem_op)
+		return NULL;
 
-	size_t expanded_length =
-	    (static_cast<uint64_t>(samplecount) * mixer_freq) / samplerate;
-	size_t expand_ratio = (samplecount << 8) / expanded_length;
+	Mix_Chunk* chunk = Mix_LoadWAV_RW(mem_op, 1);
+	if (!chunk)
+		return NULL;
 
-	for (size_t i = 0; i < expanded_length; ++i)
-	{
-		Sint16 sample;
-		int src;
+	// Loaded chunks are in the format the device was opened with
+	const int16_t* stereo = reinterpret_cast<const int16_t*>(chunk->abuf);
+	uint32_t frames = chunk->alen / (2 * sizeof(int16_t));
 
-		src = (i * expand_ratio) >> 8;
+	int16_t* mono = (int16_t*)M_Malloc(MAX<uint32_t>(frames, 1) * sizeof(int16_t));
+	for (uint32_t i = 0; i < frames; i++)
+		mono[i] = (int16_t)((stereo[i * 2] + stereo[i * 2 + 1]) / 2);
 
-		// [crispy] Handle 16 bit audio data
-		if (bits == 16)
+	Mix_FreeChunk(chunk);
+
+	*length = frames;
+	return mono;
+}
+
+//
+// Background decoding of the sounds that SDL_mixer has to decode, so an
+// Ogg or FLAC sound replacement wad does not stall the first time each
+// sound plays.  Doom format sounds are used as they are and never queued.
+//
+enum precache_state_t
+{
+	PRECACHE_QUEUED,
+	PRECACHE_DECODING,
+	PRECACHE_DONE
+};
+
+struct precache_job_t
+{
+	precache_state_t	state;
+	byte*				raw;
+	size_t				rawsize;
+	int16_t*			decoded;
+	uint32_t			length;
+};
+
+static SDL_Thread* precache_thread = NULL;
+static SDL_mutex* precache_lock = NULL;
+static SDL_cond* precache_cond = NULL;
+static volatile bool precache_running = false;
+
+// Indexed by sfx, NULL for sounds that are not queued.  Only the main
+// thread adds or removes jobs, the thread only changes their state.
+static std::vector<precache_job_t*> precache_jobs;
+static size_t precache_next = 0;
+
+static int I_PrecacheThread(void* data)
+{
+	SDL_LockMutex(precache_lock);
+
+	while (precache_running)
+	{
+		precache_job_t* job = NULL;
+
+		for (; precache_next < precache_jobs.size(); precache_next++)
 		{
-			sample = data[src * 2] | (data[src * 2 + 1] << 8);
+			if (precache_jobs[precache_next] &&
+			    precache_jobs[precache_next]->state == PRECACHE_QUEUED)
+			{
+				job = precache_jobs[precache_next];
+				break;
+			}
 		}
-		else
+
+		if (job == NULL)
 		{
-			sample = data[src] | (data[src] << 8);
-			sample -= 32768;
+			SDL_CondWait(precache_cond, precache_lock);
+			continue;
 		}
 
-		// expand mono->stereo
+		job->state = PRECACHE_DECODING;
+		SDL_UnlockMutex(precache_lock);
+
+		job->decoded = I_DecodeSound(job->raw, job->rawsize, &job->length);
+
+		SDL_LockMutex(precache_lock);
+		job->state = PRECACHE_DONE;
+		SDL_CondBroadcast(precache_cond);
+	}
+
+	SDL_UnlockMutex(precache_lock);
+	return 0;
+}
+
+static void I_FreePrecacheJob(precache_job_t* job)
+{
+	M_Free(job->raw);
+	M_Free(job->decoded);
+	delete job;
+}
+
+//
+// I_ClearPrecache
+//
+// Drops every queued sound, waiting for one being decoded to finish.
+//
+static void I_ClearPrecache()
+{
+	if (!precache_lock)
+		return;
+
+	SDL_LockMutex(precache_lock);
 
-		expanded[i * 2] = expanded[i * 2 + 1] = sample;
+	for (size_t i = 0; i < precache_jobs.size(); i++)
+	{
+		precache_job_t* job = precache_jobs[i];
+		if (job == NULL)
+			continue;
+
+		while (job->state == PRECACHE_DECODING)
+			SDL_CondWait(precache_cond, precache_lock);
+
+		I_FreePrecacheJob(job);
 	}
 
-	// Perform a low-pass filter on the upscaled sound to filter
-	// out high-frequency noise from the conversion process.
+	precache_jobs.clear();
+	precache_next = 0;
 
-	// Low-pass filter for cutoff frequency f:
-	//
-	// For sampling rate r, dt = 1 / r
-	// rc = 1 / 2*pi*f
-	// alpha = dt / (rc + dt)
+	SDL_UnlockMutex(precache_lock);
+}
 
-	// Filter to the half sample rate of the original sound effect
-	// (maximum frequency, by nyquist)
+//
+// I_TakePrecacheJob
+//
+// Removes the job for a sound from the queue, finishing it first if the
+// thread has not.  Returns NULL if the sound was never queued.
+//
+static precache_job_t* I_TakePrecacheJob(size_t index)
+{
+	if (!precache_lock)
+		return NULL;
 
-	float dt = 1.0f / mixer_freq;
-	float rc = 1.0f / (static_cast<float>(PI) * samplerate);
-	float alpha = dt / (rc + dt);
+	SDL_LockMutex(precache_lock);
 
-	// Both channels are processed in parallel, hence [i-2]:
+	precache_job_t* job = index < precache_jobs.size() ? precache_jobs[index] : NULL;
+	if (job)
+	{
+		while (job->state == PRECACHE_DECODING)
+			SDL_CondWait(precache_cond, precache_lock);
+
+		precache_jobs[index] = NULL;
+	}
+
+	SDL_UnlockMutex(precache_lock);
+
+	// Still queued, quicker to decode it here than to wait
+	if (job && job->state == PRECACHE_QUEUED)
+		job->decoded = I_DecodeSound(job->raw, job->rawsize, &job->length);
+
+	return job;
+}
 
-	for (size_t i = 2; i < expanded_length * 2; ++i)
+static void I_StartPrecacheThread()
+{
+	precache_lock = SDL_CreateMutex();
+	precache_cond = SDL_CreateCond();
+	precache_running = true;
+
+#ifdef SDL20
+	precache_thread = SDL_CreateThread(I_PrecacheThread, "sfxprecache", NULL);
+#else
+	precache_thread = SDL_CreateThread(I_PrecacheThread, NULL);
+#endif
+
+	if (!precache_thread)
 	{
-		expanded[i] = (Sint16)(alpha * expanded[i] + (1 - alpha) * expanded[i - 2]);
+		Printf(PRINT_WARNING, "I_InitSound: Unable to start sound precache thread: %s\n",
+		       SDL_GetError());
+		precache_running = false;
 	}
 }
 
-static Uint8 *perform_sdlmix_conv(Uint8 *data, Uint32 size, Uint32 *newsize)
+static void I_StopPrecacheThread()
 {
-    Mix_Chunk *chunk;
-    SDL_RWops *mem_op;
-    Uint8 *ret_data;
+	I_ClearPrecache();
 
-    // load, allocate and convert the format from memory
-    mem_op = SDL_RWFromMem(data, size);
+	if (precache_thread)
+	{
+		SDL_LockMutex(precache_lock);
+		precache_running = false;
+		SDL_CondBroadcast(precache_cond);
+		SDL_UnlockMutex(precache_lock);
 
-    if (!mem_op)
-    {
-        Printf(PRINT_HIGH,
-                "perform_sdlmix_conv - SDL_RWFromMem: %s\n", SDL_GetError());
+		SDL_WaitThread(precache_thread, NULL);
+		precache_thread = NULL;
+	}
 
-        return NULL;
-    }
+	if (precache_cond)
+		SDL_DestroyCond(precache_cond);
+	if (precache_lock)
+		SDL_DestroyMutex(precache_lock);
 
-    chunk = Mix_LoadWAV_RW(mem_op, 1);
+	precache_cond = NULL;
+	precache_lock = NULL;
+}
 
-    if (!chunk)
-    {
-        Printf(PRINT_HIGH,
-                "perform_sdlmix_conv - Mix_LoadWAV_RW: %s\n", Mix_GetError());
+static bool I_IsDoomSound(const byte* data, size_t size)
+{
+	return size >= 8 && ((data[1] << 8) | data[0]) == 3;
+}
 
-        return NULL;
-    }
+//
+// I_SetDoomSound
+//
+// Doom format sounds are 8-bit unsigned mono after an 8 byte header, the
+// mixer plays them straight from the cached lump.
+//
+static void I_SetDoomSound(sfxinfo_t* sfx, mixsound_t* snd, byte* data)
+{
+	snd->data = data + 8;
+	snd->bits = 8;
+	snd->rate = (data[3] << 8) | data[2];
 
-    // return the size
-    *newsize = chunk->alen;
+	if (snd->rate == 0)
+		snd->rate = 11025;
 
-    // allocate some space in the zone heap
-    ret_data = (Uint8 *)Z_Malloc(chunk->alen, PU_STATIC, NULL);
+	// [Russell] - Ignore doom's sound format length info
+	// if the lump is longer than the value, fixes exec.wad's ssg
+	snd->length = sfx->length - 8;
+}
 
-    // copy the converted data to the return buffer
-    memcpy(ret_data, chunk->abuf, chunk->alen);
+static void I_SetDecodedSound(mixsound_t* snd, int16_t* decoded, uint32_t length)
+{
+	if (decoded == NULL || length == 0)
+		return;
 
-    // clean up
-    Mix_FreeChunk(chunk);
-    chunk = NULL;
+	int16_t* samples = (int16_t*)Z_Malloc(length * sizeof(int16_t), PU_STATIC, NULL);
+	memcpy(samples, decoded, length * sizeof(int16_t));
 
-    return ret_data;
+	snd->data = samples;
+	snd->bits = 16;
+	snd->rate = mixer_freq;
+	snd->length = length;
 }
 
 static void getsfx (struct sfxinfo_struct *sfx)
 {
-    Uint32 samplerate;
-	Uint32 length ,expanded_length;
-	Uint8 *data;
-	Uint32 new_size = 0;
-	Mix_Chunk *chunk;
-
-    data = (Uint8 *)W_CacheLumpNum(sfx->lumpnum, PU_STATIC);
-    // [Russell] - ICKY QUICKY HACKY SPACKY *I HATE THIS SOUND MANAGEMENT SYSTEM!*
-    // get the lump size, shouldn't this be filled in elsewhere?
-    sfx->length = W_LumpLength(sfx->lumpnum);
-
-    // [Russell] is it not a doom sound lump?
-    if (((data[1] << 8) | data[0]) != 3)
-    {
-        chunk = (Mix_Chunk *)Z_Malloc(sizeof(Mix_Chunk), PU_STATIC, NULL);
-        chunk->allocated = 1;
-        if (sfx->length < 8) // too short to be anything of interest
-        {
-            // Let's hope SDL_Mixer checks alen before dereferencing abuf!
-            chunk->abuf = NULL;
-            chunk->alen = 0;
-        }
-        else
-        {
-            chunk->abuf = perform_sdlmix_conv(data, sfx->length, &new_size);
-            chunk->alen = new_size;
-        }
-        chunk->volume = MIX_MAX_VOLUME;
-
-        sfx->data = chunk;
-
-        Z_ChangeTag(data, PU_CACHE);
-
-        return;
-    }
-
-	samplerate = (data[3] << 8) | data[2];
-    length = (data[5] << 8) | data[4];
-
-    // [Russell] - Ignore doom's sound format length info
-    // if the lump is longer than the value, fixes exec.wad's ssg
-    length = (sfx->length - 8 > length) ? sfx->length - 8 : length;
-
-    expanded_length = (uint32_t) ((((uint64_t) length) * mixer_freq) / samplerate);
-
-    // Double up twice: 8 -> 16 bit and mono -> stereo
-
-    expanded_length *= 4;
-	
-	chunk = (Mix_Chunk *)Z_Malloc(sizeof(Mix_Chunk), PU_STATIC, NULL);
-    chunk->allocated = 1;
-    chunk->alen = expanded_length;
-	chunk->abuf = (Uint8*)Z_Malloc(expanded_length, PU_STATIC, NULL);
-    chunk->volume = MIX_MAX_VOLUME;
-
-    ExpandSoundData((byte*)data + 8, samplerate, 8, length, chunk);
-    sfx->data = chunk;
-    
-    Z_ChangeTag(data, PU_CACHE);
+	mixsound_t* snd = (mixsound_t*)Z_Malloc(sizeof(mixsound_t), PU_STATIC, NULL);
+	memset(snd, 0, sizeof(*snd));
+
+	// [Russell] - ICKY QUICKY HACKY SPACKY *I HATE THIS SOUND MANAGEMENT SYSTEM!*
+	// get the lump size, shouldn't this be filled in elsewhere?
+	sfx->length = W_LumpLength(sfx->lumpnum);
+
+	precache_job_t* job = I_TakePrecacheJob(sfx - S_sfx);
+
+	if (job)
+	{
+		I_SetDecodedSound(snd, job->decoded, job->length);
+		I_FreePrecacheJob(job);
+	}
+	else
+	{
+		byte* data = (byte*)W_CacheLumpNum(sfx->lumpnum, PU_STATIC);
+
+		if (I_IsDoomSound(data, sfx->length))
+		{
+			// The lump stays cached, it is the sound's data
+			I_SetDoomSound(sfx, snd, data);
+		}
+		else
+		{
+			uint32_t length;
+			int16_t* decoded = I_DecodeSound(data, sfx->length, &length);
+
+			if (decoded == NULL && !null_audio && sfx->length >= 8)
+				Printf(PRINT_HIGH, "getsfx: Unable to decode \"%s\": %s\n",
+				       sfx->name, Mix_GetError());
+
+			I_SetDecodedSound(snd, decoded, length);
+			M_Free(decoded);
+
+			Z_ChangeTag(data, PU_CACHE);
+		}
+	}
+
+	sfx->ms = snd->rate ? (unsigned int)((uint64_t)snd->length * 1000 / snd->rate) : 0;
+	sfx->data = snd;
+}
+
+//
+// I_PrecacheSounds
+//
+// Reads in every sound when a set of wads is loaded and hands the ones that
+// need decoding to the precache thread.  Does nothing unless snd_precache
+// is set.
+//
+void I_PrecacheSounds()
+{
+	I_ClearPrecache();
+
+	if (!sound_initialized || null_audio || !snd_precache || !precache_running)
+		return;
+
+	std::vector<precache_job_t*> jobs(numsfx, (precache_job_t*)NULL);
+	size_t queued = 0;
+
+	for (int i = 0; i < numsfx; i++)
+	{
+		sfxinfo_t* sfx = &S_sfx[i];
+		if (sfx->link || sfx->data || sfx->lumpnum < 0)
+			continue;
+
+		size_t size = W_LumpLength(sfx->lumpnum);
+		byte* data = (byte*)W_CacheLumpNum(sfx->lumpnum, PU_CACHE);
+
+		if (I_IsDoomSound(data, size))
+			continue;
+
+		precache_job_t* job = new precache_job_t;
+		job->state = PRECACHE_QUEUED;
+		job->raw = (byte*)M_Malloc(size);
+		job->rawsize = size;
+		job->decoded = NULL;
+		job->length = 0;
+		memcpy(job->raw, data, size);
+
+		jobs[i] = job;
+		queued++;
+	}
+
+	if (queued == 0)
+		return;
+
+	SDL_LockMutex(precache_lock);
+	precache_jobs.swap(jobs);
+	precache_next = 0;
+	SDL_CondBroadcast(precache_cond);
+	SDL_UnlockMutex(precache_lock);
+
+	DPrintf("I_PrecacheSounds: decoding %d sounds in the background\n", (int)queued);
 }
 
 //
@@ -338,6 +571,26 @@ void I_SetSfxVolume (float volume)
 }
 
 
+//
+// I_SoundGains
+//
+// Works out the left and right gains of a channel from its volume and
+// separation.  Separation scales each side the way Mix_SetPanning did.
+//
+static void I_SoundGains(float vol, int sep, int& left, int& right)
+{
+	sep = clamp(sep, 0, 255);
+
+	if(!snd_crossover)
+		sep = 255 - sep;
+
+	int volume = (int)((float)SoundMixer::UNITY_GAIN * basevolume * vol);
+
+	left = volume * sep / 255;
+	right = volume * (255 - sep) / 255;
+}
+
+
 //
 // I_StartSound
 //
@@ -352,7 +605,7 @@ int I_StartSound(int id, float vol, int sep, int pitch, bool loop)
 	if (!sound_initialized)
 		return -1;
 
-	Mix_Chunk *chunk = (Mix_Chunk *)S_sfx[id].data;
+	const mixsound_t* snd = (const mixsound_t*)S_sfx[id].data;
 	
 	// find a free channel, starting from the first after
 	// the last channel we used
@@ -371,13 +624,16 @@ int I_StartSound(int id, float vol, int sep, int pitch, bool loop)
 
 	nextchannel = channel;
 
-	// play sound
-	Mix_PlayChannelTimed(channel, chunk, loop ? -1 : 0, -1);
+	int left, right;
+	I_SoundGains(vol, sep, left, right);
 
-	channel_in_use[channel] = true;
+	// play sound, with its gains set before the mixer can get to it
+	I_LockMixer();
+	mixer.start(channel, snd, loop);
+	mixer.setGains(channel, left, right);
+	I_UnlockMixer();
 
-	// set seperation, etc.
-	I_UpdateSoundParams(channel, vol, sep, pitch);
+	channel_in_use[channel] = true;
 
 	return channel;
 }
@@ -390,7 +646,9 @@ void I_StopSound (int handle)
 
 	channel_in_use[handle] = false;
 
-	Mix_HaltChannel(handle);
+	I_LockMixer();
+	mixer.stop(handle);
+	I_UnlockMixer();
 }
 
 
@@ -400,7 +658,11 @@ int I_SoundIsPlaying (int handle)
 	if(!sound_initialized)
 		return 0;
 
-	return Mix_Playing(handle);
+	I_LockMixer();
+	bool playing = mixer.isPlaying(handle);
+	I_UnlockMixer();
+
+	return playing;
 }
 
 
@@ -409,21 +671,12 @@ void I_UpdateSoundParams (int handle, float vol, int sep, int pitch)
 	if(!sound_initialized)
 		return;
 
-	if(sep > 255)
-		sep = 255;
-
-	if(!snd_crossover)
-		sep = 255 - sep;
-
-	int volume = (int)((float)MIX_MAX_VOLUME * basevolume * vol);
-
-	if(volume < 0)
-		volume = 0;
-	if(volume > MIX_MAX_VOLUME)
-		volume = MIX_MAX_VOLUME;
+	int left, right;
+	I_SoundGains(vol, sep, left, right);
 
-	Mix_Volume(handle, volume);
-	Mix_SetPanning(handle, sep, 255-sep);
+	I_LockMixer();
+	mixer.setGains(handle, left, right);
+	I_UnlockMixer();
 }
 
 void I_LoadSound (struct sfxinfo_struct *sfx)
@@ -438,90 +691,241 @@ void I_LoadSound (struct sfxinfo_struct *sfx)
 	}
 }
 
-void I_InitSound()
+//
+// snd_mixbench
+//
+// Times the mixer with every channel playing, in C and with SSE2 where the
+// CPU has it.  Use with -nullaudio to measure it without audio hardware.
+//
+BEGIN_COMMAND (snd_mixbench)
 {
-	if (I_IsHeadless() || Args.CheckParm("-nosound"))
+	if (!sound_initialized)
+	{
+		Printf(PRINT_HIGH, "snd_mixbench: sound is not initialized\n");
 		return;
-		
-    #if defined(SDL12)
-    const char *driver = getenv("SDL_AUDIODRIVER");
+	}
 
-	if(!driver)
-		driver = "default";
-		
-    Printf(PRINT_HIGH, "I_InitSound: Initializing SDL's sound subsystem (%s)\n", driver);
-    #elif defined(SDL20)
-    Printf("I_InitSound: Initializing SDL's sound subsystem\n");
-    #endif
+	int seconds = argc > 1 ? MAX(atoi(argv[1]), 1) : 10;
 
-	if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+	// Any loaded sounds will do, repeated across the channels
+	std::vector<const mixsound_t*> sounds;
+	for (int i = 0; i < numsfx && sounds.size() < NUM_CHANNELS; i++)
 	{
-		Printf(PRINT_ERROR,
-               "I_InitSound: Unable to set up sound: %s\n", 
-               SDL_GetError());
-               
-		return;
-	}
+		if (S_sfx[i].link || S_sfx[i].lumpnum < 0)
+			continue;
 
-    #if defined(SDL20)
-	Printf("I_InitSound: Using SDL's audio driver (%s)\n", SDL_GetCurrentAudioDriver());
-	#endif
-	
-	const SDL_version *ver = Mix_Linked_Version();
+		I_LoadSound(&S_sfx[i]);
 
-	if(ver->major != MIX_MAJOR_VERSION
-		|| ver->minor != MIX_MINOR_VERSION)
+		const mixsound_t* snd = (const mixsound_t*)S_sfx[i].data;
+		if (snd && snd->length > 0)
+			sounds.push_back(snd);
+	}
+
+	if (sounds.empty())
 	{
-		Printf(PRINT_ERROR, "I_InitSound: SDL_mixer version conflict (%d.%d.%d vs %d.%d.%d dll)\n",
-			MIX_MAJOR_VERSION, MIX_MINOR_VERSION, MIX_PATCHLEVEL,
-			ver->major, ver->minor, ver->patch);
+		Printf(PRINT_HIGH, "snd_mixbench: no sounds to mix\n");
 		return;
 	}
 
-	if(ver->patch != MIX_PATCHLEVEL)
+	static int16_t buffer[SoundMixer::BLOCK_FRAMES * 2];
+	const uint64_t frames = (uint64_t)seconds * mixer_freq;
+
+	for (int pass = 0; pass < 2; pass++)
 	{
-		Printf(PRINT_WARNING, "I_InitSound: SDL_mixer version warning (%d.%d.%d vs %d.%d.%d dll)\n",
-			MIX_MAJOR_VERSION, MIX_MINOR_VERSION, MIX_PATCHLEVEL,
-			ver->major, ver->minor, ver->patch);
+		bool sse2 = pass == 1;
+#ifdef __SSE2__
+		if (sse2 && !SDL_HasSSE2())
+			break;
+#else
+		if (sse2)
+			break;
+#endif
+
+		SoundMixer bench;
+		bench.setOutputRate(mixer_freq);
+		bench.setSSE2(sse2);
+
+		for (int ch = 0; ch < NUM_CHANNELS; ch++)
+		{
+			bench.start(ch, sounds[ch % sounds.size()], true);
+			bench.setGains(ch, (ch * 37) % SoundMixer::UNITY_GAIN,
+			               SoundMixer::UNITY_GAIN - (ch * 37) % SoundMixer::UNITY_GAIN);
+		}
+
+		dtime_t start = I_GetTime();
+
+		for (uint64_t done = 0; done < frames; done += SoundMixer::BLOCK_FRAMES)
+		{
+			memset(buffer, 0, sizeof(buffer));
+			bench.mix(buffer, SoundMixer::BLOCK_FRAMES);
+		}
+
+		double ms = double(I_GetTime() - start) / I_ConvertTimeFromMs(1);
+
+		Printf(PRINT_HIGH, "snd_mixbench: %s, %d channels, %d s of audio at %d Hz in %.1f ms (%.0fx realtime)\n",
+		       sse2 ? "sse2" : "c", NUM_CHANNELS, seconds, mixer_freq, ms,
+		       ms > 0 ? seconds * 1000.0 / ms : 0.0);
 	}
+}
+END_COMMAND (snd_mixbench)
+
+//
+// I_InitNullAudio
+//
+// -nullaudio, sounds are mixed by a thread of our own instead of an audio
+// device.  Works without SDL_mixer and with -headless.
+//
+static bool I_InitNullAudio()
+{
+	Printf(PRINT_HIGH, "I_InitSound: Mixing without an audio device (-nullaudio)\n");
 
-	Printf(PRINT_HIGH, "I_InitSound: Initializing SDL_mixer\n");
+	null_audio = true;
+	mixer_freq = MAX((int)snd_samplerate, 8000);
+	mixer_format = AUDIO_S16SYS;
+	mixer_channels = 2;
+
+	mixer.setOutputRate(mixer_freq);
+
+	null_lock = SDL_CreateMutex();
+	null_running = true;
 
 #ifdef SDL20
-    // Apparently, when Mix_OpenAudio requests a certain number of channels
-    // and the device claims to not support that number of channels, instead
-    // of handling it automatically behind the scenes, Mixer might initialize
-    // with a broken audio buffer instead.  Using this function instead works
-    // around the problem.
-	if (Mix_OpenAudioDevice((int)snd_samplerate, AUDIO_S16SYS, 2, 1024, NULL,
-	                        SDL_AUDIO_ALLOW_FREQUENCY_CHANGE) < 0)
+	null_thread = SDL_CreateThread(I_NullAudioThread, "nullaudio", NULL);
 #else
-	if (Mix_OpenAudio((int)snd_samplerate, AUDIO_S16SYS, 2, 1024) < 0)
+	null_thread = SDL_CreateThread(I_NullAudioThread, NULL);
 #endif
+
+	if (!null_thread)
 	{
-		Printf(PRINT_ERROR,
-               "I_InitSound: Error initializing SDL_mixer: %s\n", 
-               Mix_GetError());
-		return;
+		Printf(PRINT_ERROR, "I_InitSound: Unable to start null audio thread: %s\n",
+		       SDL_GetError());
+		null_running = false;
+		SDL_DestroyMutex(null_lock);
+		null_lock = NULL;
+		return false;
 	}
 
-    if(!Mix_QuerySpec(&mixer_freq, &mixer_format, &mixer_channels))
-	{
-		Printf(PRINT_ERROR,
-               "I_InitSound: Error initializing SDL_mixer: %s\n", 
-               Mix_GetError());
+	return true;
+}
+
+void I_InitSound()
+{
+	if (Args.CheckParm("-nosound"))
 		return;
+
+	if (Args.CheckParm("-nullaudio"))
+	{
+		if (!I_InitNullAudio())
+			return;
 	}
-	
-	Printf("I_InitSound: Using %d channels (freq:%d, fmt:%d, chan:%d)\n",
-           Mix_AllocateChannels(NUM_CHANNELS),
-		   mixer_freq, mixer_format, mixer_channels);
+	else
+	{
+		if (I_IsHeadless())
+			return;
+
+		#if defined(SDL12)
+		const char *driver = getenv("SDL_AUDIODRIVER");
+
+		if(!driver)
+			driver = "default";
+			
+		Printf(PRINT_HIGH, "I_InitSound: Initializing SDL's sound subsystem (%s)\n", driver);
+		#elif defined(SDL20)
+		Printf("I_InitSound: Initializing SDL's sound subsystem\n");
+		#endif
+
+		if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+		{
+			Printf(PRINT_ERROR,
+				   "I_InitSound: Unable to set up sound: %s\n", 
+				   SDL_GetError());
+				   
+			return;
+		}
+
+		#if defined(SDL20)
+		Printf("I_InitSound: Using SDL's audio driver (%s)\n", SDL_GetCurrentAudioDriver());
+		#endif
+		
+		const SDL_version *ver = Mix_Linked_Version();
+
+		if(ver->major != MIX_MAJOR_VERSION
+			|| ver->minor != MIX_MINOR_VERSION)
+		{
+			Printf(PRINT_ERROR, "I_InitSound: SDL_mixer version conflict (%d.%d.%d vs %d.%d.%d dll)\n",
+				MIX_MAJOR_VERSION, MIX_MINOR_VERSION, MIX_PATCHLEVEL,
+				ver->major, ver->minor, ver->patch);
+			return;
+		}
+
+		if(ver->patch != MIX_PATCHLEVEL)
+		{
+			Printf(PRINT_WARNING, "I_InitSound: SDL_mixer version warning (%d.%d.%d vs %d.%d.%d dll)\n",
+				MIX_MAJOR_VERSION, MIX_MINOR_VERSION, MIX_PATCHLEVEL,
+				ver->major, ver->minor, ver->patch);
+		}
+
+		Printf(PRINT_HIGH, "I_InitSound: Initializing SDL_mixer\n");
+
+#ifdef SDL20
+		// Apparently, when Mix_OpenAudio requests a certain number of channels
+		// and the device claims to not support that number of channels, instead
+		// of handling it automatically behind the scenes, Mixer might initialize
+		// with a broken audio buffer instead.  Using this function instead works
+		// around the problem.
+		if (Mix_OpenAudioDevice((int)snd_samplerate, AUDIO_S16SYS, 2, 1024, NULL,
+		                        SDL_AUDIO_ALLOW_FREQUENCY_CHANGE) < 0)
+#else
+		if (Mix_OpenAudio((int)snd_samplerate, AUDIO_S16SYS, 2, 1024) < 0)
+#endif
+		{
+			Printf(PRINT_ERROR,
+				   "I_InitSound: Error initializing SDL_mixer: %s\n", 
+				   Mix_GetError());
+			return;
+		}
+
+		if(!Mix_QuerySpec(&mixer_freq, &mixer_format, &mixer_channels))
+		{
+			Printf(PRINT_ERROR,
+				   "I_InitSound: Error initializing SDL_mixer: %s\n", 
+				   Mix_GetError());
+			return;
+		}
+
+		// The mixer only writes 16-bit stereo
+		if (mixer_format != AUDIO_S16SYS || mixer_channels != 2)
+		{
+			Printf(PRINT_ERROR,
+				   "I_InitSound: Unsupported audio format (fmt:%d, chan:%d)\n",
+				   mixer_format, mixer_channels);
+			Mix_CloseAudio();
+			return;
+		}
+
+		mixer.setOutputRate(mixer_freq);
+
+		// Sound effects are mixed by us, SDL_mixer's channels are not used
+		Mix_SetPostMix(I_MixSfx, NULL);
+	}
+
+#ifdef __SSE2__
+	mixer.setSSE2(SDL_HasSSE2());
+#endif
+
+	Printf("I_InitSound: Using %d channels (freq:%d, fmt:%d, chan:%d%s)\n",
+	       NUM_CHANNELS, mixer_freq, mixer_format, mixer_channels,
+	       mixer.usingSSE2() ? ", sse2" : "");
 
 	atterm(I_ShutdownSound);
 
 	sound_initialized = true;
 
-	SDL_PauseAudio(0);
+	if (!null_audio)
+	{
+		SDL_PauseAudio(0);
+		I_StartPrecacheThread();
+	}
 
 	Printf("I_InitSound: sound module ready\n");
 
@@ -540,8 +944,28 @@ void STACK_ARGS I_ShutdownSound (void)
 
 	I_ShutdownMusic();
 
-	Mix_CloseAudio();
-	SDL_QuitSubSystem(SDL_INIT_AUDIO);
+	if (null_audio)
+	{
+		null_running = false;
+		SDL_WaitThread(null_thread, NULL);
+		SDL_DestroyMutex(null_lock);
+		null_thread = NULL;
+		null_lock = NULL;
+		null_audio = false;
+		mixer.stopAll();
+	}
+	else
+	{
+		I_StopPrecacheThread();
+
+		Mix_SetPostMix(NULL, NULL);
+		mixer.stopAll();
+
+		Mix_CloseAudio();
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+	}
+
+	sound_initialized = false;
 }
 
 
@@ -52,6 +52,10 @@ void I_SetChannels (int);
 // load a sound from disk
 void I_LoadSound (struct sfxinfo_struct *sfx);
 
+// Start decoding the sounds of the loaded wads in the background if
+// snd_precache is set
+void I_PrecacheSounds();
+
 // Starts a sound in a particular sound channel.
 int
 I_StartSound
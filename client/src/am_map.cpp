@@ -23,6 +23,7 @@
 
 
 #include <stdio.h>
+#include <vector>
 
 #include "doomdef.h"
 #include "g_level.h"
@@ -33,6 +34,7 @@
 #include "w_wad.h"
 #include "v_palette.h"
 #include "c_bind.h"
+#include "m_bbox.h"
 
 #include "m_cheat.h"
 #include "c_dispatch.h"
@@ -41,6 +43,7 @@
 
 // Needs access to LFB.
 #include "i_video.h"
+#include "i_system.h"
 #include "v_video.h"
 
 #include "v_text.h"
@@ -329,6 +332,53 @@ cheatseq_t cheat_amap = { cheat_amap_seq, 0 };
 
 static BOOL stopped = true;
 
+//
+// Linedefs are bucketed into a grid of 512 unit cells when the level is
+// loaded so that only the lines near the window are considered each frame,
+// and the part of their color that only depends on the special is worked
+// out once instead of per line per frame.
+//
+#define AM_GRIDSHIFT	(FRACBITS+9)
+
+enum amlineclass_t
+{
+	AMLC_WALL,			// one-sided
+	AMLC_EXITWALL,		// one-sided Exit_Normal or Exit_Secret
+	AMLC_TELEPORT,
+	AMLC_EXIT,
+	AMLC_LOCKED,		// Door_LockedRaise, key tells which glow
+	AMLC_TWOSIDED
+};
+
+enum
+{
+	AMKEY_BLUE,
+	AMKEY_YELLOW,
+	AMKEY_RED,
+	NUMAMKEYS
+};
+
+typedef struct {
+	byte cls;
+	byte key;
+	byte special;		// special the class was worked out from
+} amline_t;
+
+static std::vector<amline_t> am_lines;
+static std::vector<int> am_cellstart;	// first entry of each cell in am_celllines
+static std::vector<int> am_celllines;
+static int am_gridorgx, am_gridorgy;	// in cells
+static int am_gridw, am_gridh;
+
+// Clipped lines waiting to be drawn by AM_flushLines
+typedef struct {
+	fline_t fl;
+	am_color_t color;
+} amdrawline_t;
+
+static std::vector<amdrawline_t> am_batch;
+static unsigned int am_linesdrawn;		// for am_bench
+
 extern NetDemo netdemo;
 
 void AM_clearMarks();
@@ -385,6 +435,7 @@ BEGIN_COMMAND(am_togglefollow)
 	Printf(PRINT_HIGH, "%s\n", am_followplayer ? GStrings(AMSTR_FOLLOWON) : GStrings(AMSTR_FOLLOWOFF));
 } END_COMMAND(am_togglefollow)
 
+void AM_rotate (fixed_t *x, fixed_t *y, angle_t a);
 void AM_rotatePoint (fixed_t *x, fixed_t *y);
 
 bool AM_ClassicAutomapVisible()
@@ -710,7 +761,123 @@ void AM_LevelInit(void)
 	scale_ftom = FixedDiv(FRACUNIT, scale_mtof);
 }
 
+//
+// Works out the color class of a line from its special
+//
+static void AM_classifyLine(const line_t& line, amline_t& al)
+{
+	al.special = line.special;
+	al.key = AMKEY_RED;
+
+	if (!line.backsector)
+	{
+		if (line.special == Exit_Normal || line.special == Exit_Secret)
+			al.cls = AMLC_EXITWALL;
+		else
+			al.cls = AMLC_WALL;
+		return;
+	}
+
+	switch (line.special)
+	{
+	case Teleport:
+	case Teleport_NoFog:
+	case Teleport_NoStop:
+	case Teleport_Line:
+		al.cls = AMLC_TELEPORT;
+		break;
+	case Teleport_NewMap:
+	case Teleport_EndGame:
+	case Exit_Normal:
+	case Exit_Secret:
+		al.cls = AMLC_EXIT;
+		break;
+	case Door_LockedRaise:
+		al.cls = AMLC_LOCKED;
+		if (line.args[3] == (BCard | CardIsSkull))
+			al.key = AMKEY_BLUE;
+		else if (line.args[3] == (YCard | CardIsSkull))
+			al.key = AMKEY_YELLOW;
+		break;
+	default:
+		al.cls = AMLC_TWOSIDED;
+		break;
+	}
+}
+
+//
+// AM_SetupLevel
+//
+// Called after P_SetupLevel to build the line grid and color classes.
+//
+void AM_SetupLevel()
+{
+	am_lines.resize(numlines);
+	am_celllines.clear();
+	am_gridw = am_gridh = 0;
+
+	if (numlines == 0)
+	{
+		am_cellstart.assign(1, 0);
+		return;
+	}
+
+	fixed_t minx = MAXINT, miny = MAXINT;
+	fixed_t maxx = MININT, maxy = MININT;
+
+	for (int i = 0; i < numlines; i++)
+	{
+		const line_t& line = lines[i];
+
+		minx = MIN(minx, line.bbox[BOXLEFT]);
+		maxx = MAX(maxx, line.bbox[BOXRIGHT]);
+		miny = MIN(miny, line.bbox[BOXBOTTOM]);
+		maxy = MAX(maxy, line.bbox[BOXTOP]);
+
+		AM_classifyLine(line, am_lines[i]);
+	}
+
+	am_gridorgx = minx >> AM_GRIDSHIFT;
+	am_gridorgy = miny >> AM_GRIDSHIFT;
+	am_gridw = (maxx >> AM_GRIDSHIFT) - am_gridorgx + 1;
+	am_gridh = (maxy >> AM_GRIDSHIFT) - am_gridorgy + 1;
+
+	// Count the lines touching each cell, then fill them in
+	am_cellstart.assign(am_gridw * am_gridh + 1, 0);
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		std::vector<int> next;
+		if (pass == 1)
+		{
+			for (int c = 1; c <= am_gridw * am_gridh; c++)
+				am_cellstart[c] += am_cellstart[c - 1];
+			am_celllines.resize(am_cellstart.back());
+			next.assign(am_cellstart.begin(), am_cellstart.end() - 1);
+		}
 
+		for (int i = 0; i < numlines; i++)
+		{
+			const line_t& line = lines[i];
+			int x1 = (line.bbox[BOXLEFT] >> AM_GRIDSHIFT) - am_gridorgx;
+			int x2 = (line.bbox[BOXRIGHT] >> AM_GRIDSHIFT) - am_gridorgx;
+			int y1 = (line.bbox[BOXBOTTOM] >> AM_GRIDSHIFT) - am_gridorgy;
+			int y2 = (line.bbox[BOXTOP] >> AM_GRIDSHIFT) - am_gridorgy;
+
+			for (int y = y1; y <= y2; y++)
+			{
+				for (int x = x1; x <= x2; x++)
+				{
+					int cell = y * am_gridw + x;
+					if (pass == 0)
+						am_cellstart[cell + 1]++;
+					else
+						am_celllines[next[cell]++] = i;
+				}
+			}
+		}
+	}
+}
 
 
 //
@@ -1109,6 +1276,21 @@ void AM_drawFlineP (fline_t* fl, byte color)
 			fl->a.y += f_y;
 			fl->b.y += f_y;
 
+			// Most map lines are axis-aligned
+			if (fl->a.y == fl->b.y)
+			{
+				x = MIN(fl->a.x, fl->b.x);
+				memset(fb + fl->a.y * f_p + x, color, MAX(fl->a.x, fl->b.x) - x + 1);
+				return;
+			}
+			if (fl->a.x == fl->b.x)
+			{
+				y = MIN(fl->a.y, fl->b.y);
+				for (byte* dest = fb + y * f_p + fl->a.x; y <= MAX(fl->a.y, fl->b.y); y++, dest += f_p)
+					*dest = color;
+				return;
+			}
+
 			dx = fl->b.x - fl->a.x;
 			ax = 2 * (dx<0 ? -dx : dx);
 			sx = dx<0 ? -1 : 1;
@@ -1173,6 +1355,23 @@ void AM_drawFlineD(fline_t* fl, argb_t color)
 	fl->a.y += f_y;
 	fl->b.y += f_y;
 
+	// Most map lines are axis-aligned
+	if (fl->a.y == fl->b.y)
+	{
+		x = MIN(fl->a.x, fl->b.x);
+		argb_t* dest = (argb_t*)(fb + fl->a.y * f_p) + x;
+		for (int count = MAX(fl->a.x, fl->b.x) - x + 1; count > 0; count--)
+			*dest++ = color;
+		return;
+	}
+	if (fl->a.x == fl->b.x)
+	{
+		y = MIN(fl->a.y, fl->b.y);
+		for (byte* dest = fb + y * f_p + (fl->a.x << 2); y <= MAX(fl->a.y, fl->b.y); y++, dest += f_p)
+			*(argb_t*)dest = color;
+		return;
+	}
+
 	dx = fl->b.x - fl->a.x;
 	ax = 2 * (dx<0 ? -dx : dx);
 	sx = dx<0 ? -1 : 1;
@@ -1220,20 +1419,40 @@ void AM_drawFlineD(fline_t* fl, argb_t color)
 
 
 //
-// Clip lines, draw visible part sof lines.
+// Clip lines, queue the visible parts of lines for AM_flushLines.
 //
 void AM_drawMline (mline_t* ml, am_color_t color)
 {
-	static fline_t fl;
+	amdrawline_t dl;
 
-	if (AM_clipMline(ml, &fl))
+	if (AM_clipMline(ml, &dl.fl))
 	{
-		// draws it on frame buffer using fb coords
-		if (I_GetPrimarySurface()->getBitsPerPixel() == 8)
-			AM_drawFlineP(&fl, color.index);
-		else
-			AM_drawFlineD(&fl, color.rgb);
+		dl.color = color;
+		am_batch.push_back(dl);
+	}
+}
+
+//
+// Draws the queued lines on frame buffer using fb coords
+//
+void AM_flushLines()
+{
+	if (am_batch.empty())
+		return;
+
+	if (I_GetPrimarySurface()->getBitsPerPixel() == 8)
+	{
+		for (size_t i = 0; i < am_batch.size(); i++)
+			AM_drawFlineP(&am_batch[i].fl, am_batch[i].color.index);
 	}
+	else
+	{
+		for (size_t i = 0; i < am_batch.size(); i++)
+			AM_drawFlineD(&am_batch[i].fl, am_batch[i].color.rgb);
+	}
+
+	am_linesdrawn += am_batch.size();
+	am_batch.clear();
 }
 
 
@@ -1288,124 +1507,223 @@ void AM_drawGrid(am_color_t color)
 	}
 }
 
+//
+// Bounding box of the part of the map in the window, before rotation.
+//
+static void AM_getVisibleBox(fixed_t* box)
+{
+	if (!am_rotate)
+	{
+		box[BOXLEFT] = m_x;
+		box[BOXRIGHT] = m_x2;
+		box[BOXBOTTOM] = m_y;
+		box[BOXTOP] = m_y2;
+		return;
+	}
+
+	// Turn the window corners back the other way around the camera
+	const AActor* camera = displayplayer().camera;
+	const fixed_t cornerx[4] = { m_x, m_x2, m_x, m_x2 };
+	const fixed_t cornery[4] = { m_y, m_y, m_y2, m_y2 };
+
+	box[BOXLEFT] = box[BOXBOTTOM] = MAXINT;
+	box[BOXRIGHT] = box[BOXTOP] = MININT;
+
+	for (int i = 0; i < 4; i++)
+	{
+		fixed_t x = cornerx[i] - camera->x;
+		fixed_t y = cornery[i] - camera->y;
+		AM_rotate(&x, &y, camera->angle - ANG90);
+		x += camera->x;
+		y += camera->y;
+
+		box[BOXLEFT] = MIN(box[BOXLEFT], x);
+		box[BOXRIGHT] = MAX(box[BOXRIGHT], x);
+		box[BOXBOTTOM] = MIN(box[BOXBOTTOM], y);
+		box[BOXTOP] = MAX(box[BOXTOP], y);
+	}
+
+	// allow for rounding in the rotation
+	box[BOXLEFT] -= FRACUNIT;
+	box[BOXRIGHT] += FRACUNIT;
+	box[BOXBOTTOM] -= FRACUNIT;
+	box[BOXTOP] += FRACUNIT;
+}
+
+//
+// NES - Locked doors glow from a predefined color to either blue, yellow, or red.
+//
+static void AM_getLockColors(am_color_t* colors)
+{
+	static const int keyrgb[NUMAMKEYS][3] = {
+		{ 0, 0, 255 },		// AMKEY_BLUE
+		{ 255, 255, 0 },	// AMKEY_YELLOW
+		{ 255, 0, 0 }		// AMKEY_RED
+	};
+	const palette_t* pal = V_GetDefaultPalette();
+
+	for (int key = 0; key < NUMAMKEYS; key++)
+	{
+		int r = LockedColor.rgb.getr(), g = LockedColor.rgb.getg(), b = LockedColor.rgb.getb();
+
+		if (am_usecustomcolors)
+		{
+			int rdif = (keyrgb[key][0] - r) / 30;
+			int gdif = (keyrgb[key][1] - g) / 30;
+			int bdif = (keyrgb[key][2] - b) / 30;
+
+			if (lockglow < 30)
+			{
+				r += rdif * lockglow;
+				g += gdif * lockglow;
+				b += bdif * lockglow;
+			}
+			else if (lockglow < 60)
+			{
+				r += rdif * (60 - lockglow);
+				g += gdif * (60 - lockglow);
+				b += bdif * (60 - lockglow);
+			}
+		}
+
+		colors[key] = AM_BestColor(pal->basecolors, r, g, b);
+	}
+}
+
+//
+// Picks the color of a mapped line, returns false if it isn't drawn.
+//
+static bool AM_lineColor(const line_t& line, amline_t& al, bool specialcolors,
+                         const am_color_t* lockcolors, am_color_t& color)
+{
+	// ACS can change specials on the fly
+	if (al.special != line.special)
+		AM_classifyLine(line, al);
+
+	switch (al.cls)
+	{
+	case AMLC_WALL:
+		color = WallColor;
+		return true;
+	case AMLC_EXITWALL:
+		color = specialcolors ? ExitColor : WallColor;
+		return true;
+	case AMLC_TELEPORT:
+		if (specialcolors)
+		{
+			color = TeleportColor;
+			return true;
+		}
+		break;
+	case AMLC_EXIT:
+		if (specialcolors)
+		{
+			color = ExitColor;
+			return true;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (line.flags & ML_SECRET)
+	{ // secret door
+		color = cheating ? SecretWallColor : WallColor;
+		return true;
+	}
+
+	if (al.cls == AMLC_LOCKED)
+	{
+		color = lockcolors[al.key];
+		return true;
+	}
+
+	if (line.backsector->floorheight != line.frontsector->floorheight)
+		color = FDWallColor; // floor level change
+	else if (line.backsector->ceilingheight != line.frontsector->ceilingheight)
+		color = CDWallColor; // ceiling level change
+	else if (cheating)
+		color = TSWallColor;
+	else
+		return false;
+
+	return true;
+}
+
 //
 // Determines visible lines, draws them.
 // This is LineDef based, not LineSeg based.
 //
 void AM_drawWalls(void)
 {
-	int i, r, g, b;
-	static mline_t l;
-	float rdif, gdif, bdif;
-	const palette_t* pal = V_GetDefaultPalette();
+	const bool specialcolors = am_usecustomcolors || viewactive;
+	const bool allmap = consoleplayer().powers[pw_allmap] != 0;
+	am_color_t lockcolors[NUMAMKEYS];
+	fixed_t box[4];
+	mline_t l;
+
+	if (am_gridw == 0 || (int)am_lines.size() != numlines)
+		return;
 
-	for (i=0;i<numlines;i++) {
-		l.a.x = lines[i].v1->x;
-		l.a.y = lines[i].v1->y;
-		l.b.x = lines[i].v2->x;
-		l.b.y = lines[i].v2->y;
+	AM_getLockColors(lockcolors);
+	AM_getVisibleBox(box);
 
-		if (am_rotate) {
-			AM_rotatePoint (&l.a.x, &l.a.y);
-			AM_rotatePoint (&l.b.x, &l.b.y);
-		}
+	int x1 = clamp((box[BOXLEFT] >> AM_GRIDSHIFT) - am_gridorgx, 0, am_gridw - 1);
+	int x2 = clamp((box[BOXRIGHT] >> AM_GRIDSHIFT) - am_gridorgx, 0, am_gridw - 1);
+	int y1 = clamp((box[BOXBOTTOM] >> AM_GRIDSHIFT) - am_gridorgy, 0, am_gridh - 1);
+	int y2 = clamp((box[BOXTOP] >> AM_GRIDSHIFT) - am_gridorgy, 0, am_gridh - 1);
+
+	validcount++;
 
-		if (cheating || (lines[i].flags & ML_MAPPED))
+	for (int y = y1; y <= y2; y++)
+	{
+		for (int x = x1; x <= x2; x++)
 		{
-			if ((lines[i].flags & ML_DONTDRAW) && !cheating)
-				continue;
-            if (!lines[i].backsector &&
-                (((am_usecustomcolors || viewactive) &&
-                lines[i].special != Exit_Normal &&
-                lines[i].special != Exit_Secret) ||
-                (!am_usecustomcolors && !viewactive)))
-            {
-				AM_drawMline(&l, WallColor);
-			}
-			else
+			int cell = y * am_gridw + x;
+
+			for (int j = am_cellstart[cell]; j < am_cellstart[cell + 1]; j++)
 			{
-				if ((lines[i].special == Teleport ||
-					lines[i].special == Teleport_NoFog ||
-				    lines[i].special == Teleport_NoStop ||
-					lines[i].special == Teleport_Line) &&
-					(am_usecustomcolors || viewactive))
-				{ // teleporters
-					AM_drawMline(&l, TeleportColor);
-				}
-				else if ((lines[i].special == Teleport_NewMap ||
-						 lines[i].special == Teleport_EndGame ||
-						 lines[i].special == Exit_Normal ||
-						 lines[i].special == Exit_Secret) &&
-						 (am_usecustomcolors || viewactive))
-				{ // exit
-					AM_drawMline(&l, ExitColor);
-				}
-				else if (lines[i].flags & ML_SECRET)
-				{ // secret door
-					if (cheating)
-						AM_drawMline(&l, SecretWallColor);
-				    else
-						AM_drawMline(&l, WallColor);
-				}
-				else if (lines[i].special == Door_LockedRaise)
-				{
-				    // NES - Locked doors glow from a predefined color to either blue, yellow, or red.
-                    r = LockedColor.rgb.getr(), g = LockedColor.rgb.getg(), b = LockedColor.rgb.getb();
-
-                    if (am_usecustomcolors)
-					{
-                        if (lines[i].args[3] == (BCard | CardIsSkull)) {
-                            rdif = (0 - r)/30;
-                            gdif = (0 - g)/30;
-                            bdif = (255 - b)/30;
-                        } else if (lines[i].args[3] == (YCard | CardIsSkull)) {
-                            rdif = (255 - r)/30;
-                            gdif = (255 - g)/30;
-                            bdif = (0 - b)/30;
-                        } else {
-                            rdif = (255 - r)/30;
-                            gdif = (0 - g)/30;
-                            bdif = (0 - b)/30;
-                        }
-
-						if (lockglow < 30)
-						{
-							r += (int)rdif * lockglow;
-							g += (int)gdif * lockglow;
-							b += (int)bdif * lockglow;
-						}
-						else if (lockglow < 60)
-						{
-							r += (int)rdif * (60 - lockglow);
-							g += (int)gdif * (60 - lockglow);
-							b += (int)bdif * (60 - lockglow);
-						}
-				    }
+				int i = am_celllines[j];
+				line_t& line = lines[i];
 
-					AM_drawMline(&l, AM_BestColor(pal->basecolors, r, g, b));
-                }
-				else if (lines[i].backsector->floorheight
-					  != lines[i].frontsector->floorheight)
-				{
-					AM_drawMline(&l, FDWallColor); // floor level change
-				}
-				else if (lines[i].backsector->ceilingheight
-					  != lines[i].frontsector->ceilingheight)
+				// lines spanning several cells are listed in each
+				if (line.validcount == validcount)
+					continue;
+				line.validcount = validcount;
+
+				if (line.bbox[BOXRIGHT] < box[BOXLEFT] || line.bbox[BOXLEFT] > box[BOXRIGHT] ||
+				    line.bbox[BOXTOP] < box[BOXBOTTOM] || line.bbox[BOXBOTTOM] > box[BOXTOP])
+					continue;
+
+				am_color_t color;
+
+				if (cheating || (line.flags & ML_MAPPED))
 				{
-					AM_drawMline(&l, CDWallColor); // ceiling level change
+					if ((line.flags & ML_DONTDRAW) && !cheating)
+						continue;
+					if (!AM_lineColor(line, am_lines[i], specialcolors, lockcolors, color))
+						continue;
 				}
-				else if (cheating)
+				else if (allmap && !(line.flags & ML_DONTDRAW))
+					color = NotSeenColor;
+				else
+					continue;
+
+				l.a.x = line.v1->x;
+				l.a.y = line.v1->y;
+				l.b.x = line.v2->x;
+				l.b.y = line.v2->y;
+
+				if (am_rotate)
 				{
-					AM_drawMline(&l, TSWallColor);
+					AM_rotatePoint (&l.a.x, &l.a.y);
+					AM_rotatePoint (&l.b.x, &l.b.y);
 				}
+
+				AM_drawMline(&l, color);
 			}
 		}
-		else if (consoleplayer().powers[pw_allmap])
-		{
-			if (!(lines[i].flags & ML_DONTDRAW))
-				AM_drawMline(&l, NotSeenColor);
-		}
-    }
+	}
 }
 
 
@@ -1570,12 +1888,34 @@ void AM_drawThings (am_color_t color)
 	AActor*	 t;
 	mpoint_t p;
 	angle_t	 angle;
+	fixed_t	 box[4];
+
+	// Things are drawn up to 16 units from where they stand
+	AM_getVisibleBox(box);
+	box[BOXLEFT] -= 16<<FRACBITS;
+	box[BOXRIGHT] += 16<<FRACBITS;
+	box[BOXBOTTOM] -= 16<<FRACBITS;
+	box[BOXTOP] += 16<<FRACBITS;
+
+	int bl = (box[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT;
+	int br = (box[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT;
+	int bb = (box[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
+	int bt = (box[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT;
 
 	for (i=0;i<numsectors;i++)
 	{
-		t = sectors[i].thinglist;
-		while (t)
+		const sector_t* sec = &sectors[i];
+
+		if (sec->blockbox[BOXRIGHT] < bl || sec->blockbox[BOXLEFT] > br ||
+		    sec->blockbox[BOXTOP] < bb || sec->blockbox[BOXBOTTOM] > bt)
+			continue;
+
+		for (t = sec->thinglist; t; t = t->snext)
 		{
+			if (t->x < box[BOXLEFT] || t->x > box[BOXRIGHT] ||
+			    t->y < box[BOXBOTTOM] || t->y > box[BOXTOP])
+				continue;
+
 			p.x = t->x;
 			p.y = t->y;
 			angle = t->angle;
@@ -1587,7 +1927,6 @@ void AM_drawThings (am_color_t color)
 			}
 
 			AM_drawLineCharacter(thintriangle_guy, NUMTHINTRIANGLEGUYLINES, 16<<FRACBITS, angle, color, p.x, p.y);
-			t = t->snext;
 		}
 	}
 }
@@ -1674,6 +2013,8 @@ void AM_Drawer()
 	if (cheating==2)
 		AM_drawThings(ThingColor);
 
+	AM_flushLines();
+
 	if (!(viewactive && am_overlay < 2))
 		AM_drawCrosshair(XHairColor);
 
@@ -1800,4 +2141,80 @@ void AM_Drawer()
 	}
 }
 
+//
+// am_bench
+//
+// Draws the automap of the current level the given number of frames, zooming
+// between the whole map and close up around the player, and times it the way
+// -timedemo does.  The whole map is shown, things included, as with iddt.
+//
+BEGIN_COMMAND (am_bench)
+{
+	if (gamestate != GS_LEVEL || !displayplayer().camera)
+	{
+		Printf(PRINT_HIGH, "am_bench: not in a level\n");
+		return;
+	}
+
+	int frames = argc > 1 ? MAX(atoi(argv[1]), 1) : 1000;
+
+	bool wasactive = automapactive;
+	bool wasviewactive = viewactive;
+	fixed_t old_x = m_x, old_y = m_y, old_w = m_w, old_h = m_h;
+	fixed_t old_scale = scale_mtof;
+	int old_cheating = cheating;
+
+	if (!wasactive)
+		AM_Start();
+	viewactive = false;
+	AM_initColors(false);
+	cheating = 2;
+
+	const AActor* camera = displayplayer().camera;
+	fixed_t zoom = M_ZOOMIN;
+	scale_mtof = min_scale_mtof;
+	am_linesdrawn = 0;
+
+	dtime_t start = I_GetTime();
+
+	for (int i = 0; i < frames; i++)
+	{
+		scale_mtof = FixedMul(scale_mtof, zoom);
+		if (scale_mtof >= max_scale_mtof)
+			zoom = M_ZOOMOUT;
+		else if (scale_mtof <= min_scale_mtof)
+			zoom = M_ZOOMIN;
+		scale_ftom = FixedDiv(FRACUNIT, scale_mtof);
+
+		m_x = camera->x - m_w/2;
+		m_y = camera->y - m_h/2;
+
+		I_BeginUpdate();
+		AM_Drawer();
+		I_FinishUpdate();
+	}
+
+	double ms = double(I_GetTime() - start) / I_ConvertTimeFromMs(1);
+
+	Printf(PRINT_HIGH, "am_bench: timed %d frames in %.1f ms (%.1f fps), %u lines per frame\n",
+	       frames, ms, ms > 0 ? frames * 1000.0 / ms : 0.0, am_linesdrawn / frames);
+
+	m_x = old_x;
+	m_y = old_y;
+	m_w = old_w;
+	m_h = old_h;
+	m_x2 = m_x + m_w;
+	m_y2 = m_y + m_h;
+	scale_mtof = old_scale;
+	scale_ftom = FixedDiv(FRACUNIT, scale_mtof);
+	cheating = old_cheating;
+
+	if (!wasactive)
+		AM_Stop();
+	viewactive = wasviewactive;
+	if (wasactive)
+		AM_initColors(viewactive);
+}
+END_COMMAND (am_bench)
+
 VERSION_CONTROL (am_map_cpp, "$Id$")
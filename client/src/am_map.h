@@ -33,6 +33,9 @@
 #define AM_MSGEXITED (AM_MSGHEADER | ('x'<<8))
 
 
+// Called after a level is loaded.
+void AM_SetupLevel();
+
 // Called by main loop.
 BOOL AM_Responder(event_t* ev);
 
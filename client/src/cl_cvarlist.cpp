@@ -306,6 +306,10 @@ CVAR(cl_downloadsites,
 CVAR_RANGE_FUNC_DECL(cl_interp, "1", "Interpolate enemy player positions",
 					CVARTYPE_INT, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 4.0f)
 
+CVAR(				cl_autointerp, "1", "Hold back more than cl_interp tics of enemy player positions " \
+					"when updates from the server arrive unevenly",
+					CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
+
 CVAR_RANGE(			cl_prednudge,	"0.70", "Smooth out collisions",
 					CVARTYPE_FLOAT, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE, 0.05f, 1.0f)
 
@@ -315,6 +319,9 @@ CVAR(				cl_predictweapons, "1", "Draw weapon effects immediately",
 CVAR(				cl_netgraph, "0", "Show a graph of network related statistics",
 					CVARTYPE_BOOL, CVAR_NULL)
 
+CVAR(				debug_netmessages, "0", "Keep the server messages of each packet to list when one fails to parse",
+					CVARTYPE_BOOL, CVAR_NULL)
+
 CVAR(				cl_serverdownload, "1", "Enable or disable downloading game files and resources from the server" \
 											"(requires downloading enabled on server)",
 					CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
@@ -561,6 +568,9 @@ CVAR_RANGE_FUNC_DECL(snd_channels, "32", "Number of channels for sound effects",
                      CVARTYPE_BYTE, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE, 4.0f,
                      32.0f)
 
+CVAR(snd_precache, "0", "Decode sounds that are not in the Doom format in the background when wads are loaded",
+     CVARTYPE_BOOL, CVAR_CLIENTARCHIVE)
+
 //
 // C_GetDefaultMuiscSystem()
 //
@@ -664,6 +674,9 @@ CVAR(			r_loadicon, "1", "Display the disk icon when loading data from disk",
 CVAR_RANGE(		r_painintensity, "0.5", "Intensity of red pain effect",
 				CVARTYPE_FLOAT, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 1.0f)
 
+CVAR_FUNC_DECL(	r_texturecachesize, "64", "Maximum memory in megabytes used by composite textures (0 is unlimited)",
+				CVARTYPE_INT, CVAR_CLIENTARCHIVE | CVAR_NOENABLEDISABLE)
+
 CVAR(			r_viewsize, "0", "Set to the current video resolution",
 				CVARTYPE_STRING, CVAR_NOSET | CVAR_NOENABLEDISABLE)
 
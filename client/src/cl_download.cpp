@@ -16,7 +16,7 @@
 // GNU General Public License for more details.
 //
 // DESCRIPTION:
-//	HTTP Downloading.
+//	HTTP Downloading, and downloading from the game server itself.
 //
 //-----------------------------------------------------------------------------
 
@@ -29,10 +29,12 @@
 #include "cl_main.h"
 #include "cmdlib.h"
 #include "doomstat.h"
+#include "i_net.h"
 #include "i_system.h"
 #include "m_argv.h"
 #include "m_fileio.h"
 #include "w_ident.h"
+#include "w_wad.h"
 
 EXTERN_CVAR(cl_waddownloaddir)
 EXTERN_CVAR(waddirs)
@@ -86,6 +88,60 @@ static struct DownloadState
 	}
 } dlstate;
 
+/**
+ * @brief State of a download from the server we are connected to, which
+ *        sends the file in chunks over the game protocol.
+ */
+static struct ServerDownloadState
+{
+  private:
+	ServerDownloadState(const ServerDownloadState&);
+
+  public:
+	bool active;
+	OWantFile file;
+	std::string dest;
+	std::string part;
+	FILE* fh;
+	size_t length;
+	size_t chunksize;
+	size_t chunks;
+	std::vector<bool> have;
+	size_t base; // First chunk we don't hold yet.
+	size_t got;
+	bool dirty; // Chunks arrived since our last acknowledgement.
+	int lastack;
+	dtime_t start;
+	ServerDownloadState()
+	    : active(false), file(), dest(""), part(""), fh(NULL), length(0), chunksize(0),
+	      chunks(0), have(), base(0), got(0), dirty(false), lastack(0), start(0)
+	{
+	}
+	void Ready()
+	{
+		if (this->fh != NULL)
+		{
+			// Don't leave a half-written file lying around.
+			fclose(this->fh);
+			this->fh = NULL;
+			remove(this->part.c_str());
+		}
+		this->active = false;
+		this->file = OWantFile();
+		this->dest = "";
+		this->part = "";
+		this->length = 0;
+		this->chunksize = 0;
+		this->chunks = 0;
+		this->have.clear();
+		this->base = 0;
+		this->got = 0;
+		this->dirty = false;
+		this->lastack = 0;
+		this->start = 0;
+	}
+} svdlstate;
+
 /**
  * @brief Init the HTTP download system.
  */
@@ -123,7 +179,8 @@ void CL_DownloadShutdown()
  */
 bool CL_IsDownloading()
 {
-	return ::dlstate.state == STATE_CHECKING || ::dlstate.state == STATE_DOWNLOADING;
+	return ::dlstate.state == STATE_CHECKING || ::dlstate.state == STATE_DOWNLOADING ||
+	       ::svdlstate.active;
 }
 
 /**
@@ -203,6 +260,14 @@ bool CL_StopDownload()
 	if (!CL_IsDownloading())
 		return false;
 
+	if (::svdlstate.active)
+	{
+		// We are only connected for the sake of the download.
+		::svdlstate.Ready();
+		CL_QuitNetGame();
+		return true;
+	}
+
 	::dlstate.Ready();
 	return true;
 }
@@ -430,11 +495,284 @@ static void TickDownload()
 	}
 }
 
+/**
+ * @brief Start downloading a file from the server we connect to next.
+ *
+ * @param filename Filename of the WAD to download.
+ */
+bool CL_StartServerDownload(const OWantFile& filename)
+{
+	if (::svdlstate.active)
+	{
+		// Reconnecting to carry on with the same file is fine.
+		if (::svdlstate.file.getBasename() == filename.getBasename())
+			return true;
+
+		Printf(PRINT_WARNING, "Can't start download when download state is not ready.\n");
+		return false;
+	}
+
+	if (W_IsFilenameCommercialIWAD(filename.getBasename()))
+	{
+		Printf(PRINT_WARNING, "Refusing to download commercial IWAD file.\n");
+		return false;
+	}
+
+	if (W_IsFilehashCommercialIWAD(filename.getWantedHash()))
+	{
+		Printf(PRINT_WARNING, "Refusing to download renamed commercial IWAD file.\n");
+		return false;
+	}
+
+	::svdlstate.Ready();
+	::svdlstate.active = true;
+	::svdlstate.file = filename;
+	return true;
+}
+
+/**
+ * @brief Check if the next connection to the server is only for downloading.
+ */
+bool CL_IsServerDownloading()
+{
+	return ::svdlstate.active;
+}
+
+/**
+ * @brief Ask the server for the file.
+ */
+void CL_WriteServerDownloadRequest(buf_t* buf)
+{
+	MSG_WriteMarker(buf, clc_wantwad);
+	MSG_WriteString(buf, ::svdlstate.file.getBasename().c_str());
+	MSG_WriteString(buf, ::svdlstate.file.getWantedHash().c_str());
+	MSG_WriteLong(buf, 0);
+}
+
+static void ServerDownloadError(const char* msg)
+{
+	Printf(PRINT_WARNING, "Download error (%s).\n", msg);
+	::svdlstate.Ready();
+	CL_QuitNetGame();
+}
+
+/**
+ * @brief svc_wadinfo - The server is about to send us the file.
+ */
+void CL_ServerWadInfo()
+{
+	std::string name = MSG_ReadString();
+	size_t length = MSG_ReadLong();
+	size_t chunksize = (unsigned short)MSG_ReadShort();
+
+	// Ignore it if we didn't ask or already know.
+	if (!::svdlstate.active || ::svdlstate.fh != NULL)
+		return;
+
+	if (name != ::svdlstate.file.getBasename() || chunksize == 0)
+	{
+		ServerDownloadError("Server sent a different file than the one we asked for");
+		return;
+	}
+
+	// Figure out where our destination should be.
+	StringTokens dirs = GetDownloadDirs();
+	for (StringTokens::iterator it = dirs.begin(); it != dirs.end(); ++it)
+	{
+		// Ensure no path-traversal shenanegins are going on.
+		std::string dest = *it + PATHSEP + name;
+		M_CleanPath(dest);
+		if (dest.find(*it) != 0)
+		{
+			ServerDownloadError("Saved file tried to escape download directory");
+			return;
+		}
+
+		// We download to the partial file and move it later.
+		std::string part = dest + ".part";
+		::svdlstate.fh = fopen(part.c_str(), "wb+");
+		if (::svdlstate.fh != NULL)
+		{
+			::svdlstate.dest = dest;
+			::svdlstate.part = part;
+			break;
+		}
+
+		Printf(PRINT_WARNING, "Could not save to %s (%s)\n", dest.c_str(),
+		       strerror(errno));
+	}
+
+	if (::svdlstate.fh == NULL)
+	{
+		ServerDownloadError("No safe place to save file");
+		return;
+	}
+
+	::svdlstate.length = length;
+	::svdlstate.chunksize = chunksize;
+	::svdlstate.chunks = (length + chunksize - 1) / chunksize;
+	::svdlstate.have.assign(::svdlstate.chunks, false);
+	::svdlstate.base = 0;
+	::svdlstate.got = 0;
+	::svdlstate.dirty = true;
+	::svdlstate.lastack = gametic;
+	::svdlstate.start = I_GetTime();
+
+	std::string bytes;
+	StrFormatBytes(bytes, length);
+	Printf("Downloading %s (%s) from the server...\n", name.c_str(), bytes.c_str());
+}
+
+/**
+ * @brief svc_wadchunk - One piece of the file, in a packet of its own.
+ */
+void CL_ServerWadChunk()
+{
+	size_t offset = MSG_ReadLong();
+	size_t len = (unsigned short)MSG_ReadShort();
+	const void* data = MSG_ReadChunk(len);
+
+	if (data == NULL || ::svdlstate.fh == NULL)
+		return;
+
+	size_t chunk = offset / ::svdlstate.chunksize;
+	if (offset % ::svdlstate.chunksize != 0 || chunk >= ::svdlstate.chunks ||
+	    len != MIN(::svdlstate.chunksize, ::svdlstate.length - offset))
+		return;
+
+	// A chunk we hold already means our acknowledgement went missing, so
+	// send another either way.
+	::svdlstate.dirty = true;
+	if (::svdlstate.have[chunk])
+		return;
+
+	if (fseek(::svdlstate.fh, offset, SEEK_SET) != 0 ||
+	    fwrite(data, 1, len, ::svdlstate.fh) != len)
+	{
+		ServerDownloadError("Could not write to the downloaded file");
+		return;
+	}
+
+	::svdlstate.have[chunk] = true;
+	::svdlstate.got++;
+
+	while (::svdlstate.base < ::svdlstate.chunks && ::svdlstate.have[::svdlstate.base])
+		::svdlstate.base++;
+}
+
+static void WriteServerDownloadAck(buf_t* buf)
+{
+	// Everything below base, and which of the chunks after it we hold.
+	byte bits[32] = {0};
+	size_t count = 0;
+	for (size_t i = 0; i < sizeof(bits) * 8; i++)
+	{
+		size_t chunk = ::svdlstate.base + 1 + i;
+		if (chunk >= ::svdlstate.chunks)
+			break;
+
+		if (::svdlstate.have[chunk])
+		{
+			bits[i >> 3] |= 1 << (i & 7);
+			count = (i >> 3) + 1;
+		}
+	}
+
+	MSG_WriteMarker(buf, clc_wadack);
+	MSG_WriteLong(buf, ::svdlstate.base);
+	MSG_WriteByte(buf, count);
+	MSG_WriteChunk(buf, bits, count);
+
+	::svdlstate.dirty = false;
+	::svdlstate.lastack = gametic;
+}
+
+/**
+ * @brief Tell the server which chunks arrived, if any did since the last
+ *        time.  Resent every so often regardless in case it went missing.
+ */
+void CL_WriteServerDownloadAck(buf_t* buf)
+{
+	if (::svdlstate.fh == NULL)
+		return;
+
+	if (!::svdlstate.dirty && gametic - ::svdlstate.lastack < TICRATE / 2)
+		return;
+
+	WriteServerDownloadAck(buf);
+}
+
+static void TickServerDownload()
+{
+	if (NET_IsNullAdr(serveraddr))
+	{
+		// We were disconnected from the server before the file was done.
+		Printf(PRINT_WARNING, "Download of %s was interrupted.\n",
+		       ::svdlstate.file.getBasename().c_str());
+		::svdlstate.Ready();
+		return;
+	}
+
+	if (::svdlstate.fh == NULL || ::svdlstate.got < ::svdlstate.chunks)
+		return;
+
+	// Let the server know the last chunks arrived, this goes out along with
+	// our disconnect.
+	WriteServerDownloadAck(&net_buffer);
+
+	// Close the file so we can rename it.
+	fclose(::svdlstate.fh);
+	::svdlstate.fh = NULL;
+
+	// Verify that the file is what the server wants and is not a renamed
+	// commercial IWAD.
+	std::string actualHash = W_MD5(::svdlstate.part);
+	if (W_IsFilehashCommercialIWAD(actualHash))
+	{
+		remove(::svdlstate.part.c_str());
+		ServerDownloadError("Accidentally downloaded a commercial IWAD - file removed");
+		return;
+	}
+
+	std::string expectHash = ::svdlstate.file.getWantedHash();
+	if (!expectHash.empty() && expectHash != actualHash)
+	{
+		remove(::svdlstate.part.c_str());
+		ServerDownloadError(
+		    "Downloaded file is not the same as the server's file - file removed");
+		return;
+	}
+
+	if (rename(::svdlstate.part.c_str(), ::svdlstate.dest.c_str()) != 0)
+	{
+		std::string buf;
+		StrFormat(buf, "File %s could not be renamed to %s - %s",
+		          ::svdlstate.part.c_str(), ::svdlstate.dest.c_str(), strerror(errno));
+		remove(::svdlstate.part.c_str());
+		ServerDownloadError(buf.c_str());
+		return;
+	}
+
+	Printf("Saved to location \"%s\".\n", ::svdlstate.dest.c_str());
+
+	double seconds = double(I_ConvertTimeToMs(I_GetTime() - ::svdlstate.start)) / 1000.0;
+	std::string bytes;
+	StrFormatBytes(bytes, seconds > 0.0 ? size_t(::svdlstate.length / seconds)
+	                                    : ::svdlstate.length);
+	Printf("Download completed at %s/s.\n", bytes.c_str());
+
+	::svdlstate.Ready();
+	CL_Reconnect();
+}
+
 /**
  * @brief Service the download per-tick.
  */
 void CL_DownloadTick()
 {
+	if (::svdlstate.active)
+		TickServerDownload();
+
 	switch (::dlstate.state)
 	{
 	case STATE_CHECKING:
@@ -463,6 +801,9 @@ void CL_DownloadTick()
  */
 std::string CL_DownloadFilename()
 {
+	if (::svdlstate.active)
+		return ::svdlstate.dest;
+
 	if (::dlstate.state != STATE_DOWNLOADING)
 		return std::string("");
 
@@ -479,6 +820,14 @@ std::string CL_DownloadFilename()
  */
 OTransferProgress CL_DownloadProgress()
 {
+	if (::svdlstate.active)
+	{
+		OTransferProgress progress;
+		progress.dltotal = ::svdlstate.length;
+		progress.dlnow = MIN(::svdlstate.got * ::svdlstate.chunksize, ::svdlstate.length);
+		return progress;
+	}
+
 	if (::dlstate.state != STATE_DOWNLOADING)
 		return OTransferProgress();
 
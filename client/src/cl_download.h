@@ -26,6 +26,7 @@
 #include <string>
 #include <vector>
 
+#include "i_net.h"
 #include "otransfer.h"
 #include "m_resfile.h"
 
@@ -46,4 +47,12 @@ void CL_DownloadTick();
 std::string CL_DownloadFilename();
 OTransferProgress CL_DownloadProgress();
 
+// Downloading from the game server
+bool CL_StartServerDownload(const OWantFile& filename);
+bool CL_IsServerDownloading();
+void CL_WriteServerDownloadRequest(buf_t* buf);
+void CL_WriteServerDownloadAck(buf_t* buf);
+void CL_ServerWadInfo();
+void CL_ServerWadChunk();
+
 #endif
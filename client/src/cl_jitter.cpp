@@ -0,0 +1,129 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Interpolation delay estimate from server packet arrival times
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <math.h>
+
+#include "cl_jitter.h"
+#include "i_system.h"
+
+// Fraction of packets the delay has to cover, the rest get extrapolated
+static const float COVERED = 0.95f;
+
+// Lateness under this many tics is absorbed by rounding instead of adding
+// a whole tic of delay
+static const float SLACK = 0.25f;
+
+// How long the estimate has to stay below the current delay before the
+// delay comes down, so a single quiet spell does not undo it
+static const int LOWER_HOLD_MS = 2000;
+
+const int JitterEstimator::MAX_DELAY;
+const size_t JitterEstimator::WINDOW;
+
+JitterEstimator::JitterEstimator()
+{
+	reset();
+}
+
+void JitterEstimator::reset()
+{
+	mOffsetHead = mOffsetCount = 0;
+	mGapHead = mGapCount = 0;
+	mStarted = false;
+	mBaseTime = 0;
+	mBaseTic = mNewestTic = 0;
+	mDelay = 1;
+	mJitterTics = 0.0f;
+	mLowerSince = 0;
+}
+
+float JitterEstimator::percentile(const float* samples, size_t count, float fraction) const
+{
+	if (count == 0)
+		return 0.0f;
+
+	float sorted[WINDOW];
+	std::copy(samples, samples + count, sorted);
+
+	size_t n = MIN<size_t>(size_t(fraction * count), count - 1);
+	std::nth_element(sorted, sorted + n, sorted + count);
+	return sorted[n];
+}
+
+void JitterEstimator::addPacket(int svgametic, dtime_t arrival)
+{
+	static const double TIC_NS = double(I_ConvertTimeFromMs(1000)) / TICRATE;
+
+	if (!mStarted)
+	{
+		mStarted = true;
+		mBaseTime = arrival;
+		mBaseTic = mNewestTic = svgametic;
+	}
+
+	// Several packets can carry the same tic and late ones carry older tics,
+	// only a packet that moves the server forward says how far apart
+	// updates are
+	if (svgametic > mNewestTic)
+	{
+		mGaps[mGapHead] = float(svgametic - mNewestTic);
+		mGapHead = (mGapHead + 1) % WINDOW;
+		mGapCount = MIN(mGapCount + 1, WINDOW);
+		mNewestTic = svgametic;
+	}
+
+	mOffsets[mOffsetHead] = float((arrival - mBaseTime) / TIC_NS - (svgametic - mBaseTic));
+	mOffsetHead = (mOffsetHead + 1) % WINDOW;
+	mOffsetCount = MIN(mOffsetCount + 1, WINDOW);
+
+	float earliest = *std::min_element(mOffsets, mOffsets + mOffsetCount);
+	mJitterTics = percentile(mOffsets, mOffsetCount, COVERED) - earliest;
+
+	float gap = mGapCount ? percentile(mGaps, mGapCount, COVERED) : 1.0f;
+
+	int target = int(ceil(gap + mJitterTics - SLACK));
+	target = clamp(target, 1, JitterEstimator::MAX_DELAY);
+
+	if (target >= mDelay)
+	{
+		// Raise the delay straight away, stuttering costs more than a tic
+		mDelay = target;
+		mLowerSince = 0;
+	}
+	else if (mLowerSince == 0)
+	{
+		mLowerSince = arrival;
+	}
+	else if (arrival - mLowerSince >= I_ConvertTimeFromMs(LOWER_HOLD_MS))
+	{
+		mDelay--;
+		mLowerSince = 0;
+	}
+}
+
+float JitterEstimator::getJitter() const
+{
+	return mJitterTics * 1000.0f / TICRATE;
+}
+
+VERSION_CONTROL (cl_jitter_cpp, "$Id$")
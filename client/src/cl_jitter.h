@@ -0,0 +1,82 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Estimates how late updates from the server arrive so the client can hold
+//	back just enough tics of other players' snapshots to interpolate them.
+//
+//	Every packet is stamped with the server's gametic.  Comparing that with
+//	the time the packet arrived gives an offset that stays constant on a
+//	perfect connection.  How far an offset sits above the smallest one seen
+//	recently is how late that packet was, and the interpolation delay has to
+//	cover nearly all of that lateness plus the gap between updates.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __CL_JITTER_H__
+#define __CL_JITTER_H__
+
+#include "doomtype.h"
+#include "doomdef.h"
+
+class JitterEstimator
+{
+public:
+	JitterEstimator();
+
+	// Forget everything, for a new connection or after a level load stalls
+	// the connection
+	void reset();
+
+	// Record a packet stamped with svgametic that arrived at the given time
+	void addPacket(int svgametic, dtime_t arrival);
+
+	// Tics of other players' snapshots to hold back
+	int getDelay() const { return mDelay; }
+
+	// How late packets have been arriving, in milliseconds
+	float getJitter() const;
+
+	static const int MAX_DELAY = 4;
+
+private:
+	float percentile(const float* samples, size_t count, float fraction) const;
+
+	// About three seconds of packets at one per tic
+	static const size_t WINDOW = 3 * TICRATE;
+
+	// Arrival time less server gametic, in tics from the first packet
+	float		mOffsets[WINDOW];
+	size_t		mOffsetHead;
+	size_t		mOffsetCount;
+
+	// Tics between each update and the newest one before it
+	float		mGaps[WINDOW];
+	size_t		mGapHead;
+	size_t		mGapCount;
+
+	bool		mStarted;
+	dtime_t		mBaseTime;
+	int			mBaseTic;
+	int			mNewestTic;
+
+	int			mDelay;
+	float		mJitterTics;
+	dtime_t		mLowerSince;
+};
+
+#endif // __CL_JITTER_H__
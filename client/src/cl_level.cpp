@@ -569,6 +569,7 @@ void G_DoLoadLevel (int position)
 
  	SN_StopAllSequences (); // denis - todo - equivalent?
 	P_SetupLevel (level.mapname, position);
+	AM_SetupLevel();
 
 	// [AM] Prevent holding onto stale snapshots.
 	CL_ClearSectorSnapshots();
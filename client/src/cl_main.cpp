@@ -34,6 +34,7 @@
 #include "s_sound.h"
 #include "gi.h"
 #include "i_net.h"
+#include "i_netmsg.h"
 #include "i_system.h"
 #include "c_dispatch.h"
 #include "st_stuff.h"
@@ -57,6 +58,7 @@
 #include "p_snapshot.h"
 #include "p_lnspec.h"
 #include "cl_netgraph.h"
+#include "cl_jitter.h"
 #include "p_pspr.h"
 #include "d_netcmd.h"
 #include "g_levelstate.h"
@@ -73,6 +75,7 @@
 #include <map>
 #include <set>
 #include <sstream>
+#include <math.h>
 
 #ifdef _XBOX
 #include "i_xbox.h"
@@ -94,6 +97,7 @@ extern bool step_mode;
 short version = 0;
 int gameversion = 0;				// GhostlyDeath -- Bigger Game Version
 int gameversiontosend = 0;		// If the server is 0.4, let's fake our client info
+static bool server_waddownload = false;	// Server sends missing files itself
 
 buf_t     net_buffer(MAX_UDP_PACKET);
 
@@ -106,9 +110,17 @@ int       last_received;
 int       world_index = 0;
 float     world_index_accum = 0.0f;
 
+// last_svgametic is the server gametic of the packet being read, which is
+// what its snapshots are stamped with.  A packet that arrives late carries an
+// older gametic than one already read, so newest_svgametic keeps the latest
+// one for world_index to follow.
 int       last_svgametic = 0;
+int       newest_svgametic = 0;
 int       last_player_update = 0;
 
+// Sizes the interpolation delay from how unevenly packets arrive
+static JitterEstimator jitter;
+
 bool		recv_full_update = false;
 
 std::string connectpasshash = "";
@@ -136,13 +148,26 @@ bool forcenetdemosplit = false;		// need to split demo due to svc_reconnect
 
 NetCommand localcmds[MAXSAVETICS];
 
+// Newest of our ticcmds the server has received, 0 until it says, and the
+// share of our packets it reports missing
+int       cmd_acktic = 0;
+float     cmd_loss = 0.0f;
+
 extern NetGraph netgraph;
 
 // [SL] 2012-03-07 - Players that were teleported during the current gametic
 std::set<byte> teleported_players;
 
 // [SL] 2012-04-06 - moving sector snapshots received from the server
-std::map<unsigned short, SectorSnapshotManager> sector_snaps;
+//
+// Indexed by sector number so a sector's snapshots are found without a
+// search.  Only sectors that have moved recently have a container, and they
+// are listed in sector_snaps_active so they can be walked without looking at
+// every sector in the map.  A container holds NUM_SNAPSHOTS snapshots, so the
+// ones for sectors that stop moving are kept for reuse.
+static std::vector<SectorSnapshotManager*> sector_snaps;
+static std::vector<unsigned short> sector_snaps_active;
+static std::vector<SectorSnapshotManager*> sector_snaps_free;
 
 EXTERN_CVAR (sv_weaponstay)
 EXTERN_CVAR (sv_teamsinplay)
@@ -158,6 +183,7 @@ EXTERN_CVAR (mute_enemies)
 EXTERN_CVAR (cl_autoaim)
 
 EXTERN_CVAR (cl_interp)
+EXTERN_CVAR (cl_autointerp)
 EXTERN_CVAR (cl_serverdownload)
 EXTERN_CVAR (cl_forcedownload)
 
@@ -167,6 +193,7 @@ EXTERN_CVAR (r_forceteamcolor)
 
 EXTERN_CVAR (hud_revealsecrets)
 EXTERN_CVAR(debug_disconnect)
+EXTERN_CVAR(debug_netmessages)
 
 static argb_t enemycolor, teamcolor;
 
@@ -330,6 +357,21 @@ team_t D_TeamByName (const char *team);
 gender_t D_GenderByName (const char *gender);
 void AM_Stop();
 
+//
+// CL_InterpolationDelay
+//
+// The number of tics the client withholds for interpolation.  cl_interp is
+// the least it will use, with cl_autointerp the jitter estimate can raise it
+// to cover packets that arrive late.
+//
+static int CL_InterpolationDelay()
+{
+	if (!cl_interp || !cl_autointerp)
+		return cl_interp.asInt();
+
+	return clamp(jitter.getDelay(), cl_interp.asInt(), int(JitterEstimator::MAX_DELAY));
+}
+
 //
 // CL_CalculateWorldIndexSync
 //
@@ -338,7 +380,7 @@ void AM_Stop();
 //
 static int CL_CalculateWorldIndexSync()
 {
-	return last_svgametic ? last_svgametic - cl_interp : 0;
+	return newest_svgametic ? newest_svgametic - CL_InterpolationDelay() : 0;
 }
 
 //
@@ -404,6 +446,8 @@ void CL_QuitNetGame2(const char* file, const int line)
 
 	memset (&serveraddr, 0, sizeof(serveraddr));
 	connected = false;
+	cmd_acktic = 0;
+	cmd_loss = 0.0f;
 	gameaction = ga_fullconsole;
 	noservermsgs = false;
 	AM_Stop();
@@ -471,7 +515,7 @@ void CL_Reconnect(void)
 
 		P_ClearAllNetIds();
 	}
-	else if (lastconaddr.ip[0])
+	else if (!NET_IsNullAdr(lastconaddr))
 	{
 		serveraddr = lastconaddr;
 	}
@@ -658,6 +702,11 @@ extern BOOL advancedemo;
 QWORD nextstep = 0;
 int canceltics = 0;
 
+// Time at which input was last sampled for a ticcmd, used to measure the
+// latency until a frame showing the results of that input is presented.
+static dtime_t input_sample_time;
+static bool input_sample_pending;
+
 void CL_StepTics(unsigned int count)
 {
 	DObject::BeginFrame ();
@@ -669,6 +718,8 @@ void CL_StepTics(unsigned int count)
 			continue;
 
 		NetUpdate();
+		input_sample_time = I_GetTime();
+		input_sample_pending = true;
 
 		if (advancedemo)
 			D_DoAdvanceDemo();
@@ -701,8 +752,21 @@ void CL_StepTics(unsigned int count)
 //
 void CL_DisplayTics()
 {
+	static const double ONE_MS = double(I_ConvertTimeFromMs(1));
+
 	I_GetEvents(true);
+
+	dtime_t frame_start_time = I_GetTime();
 	D_Display();
+	dtime_t frame_end_time = I_GetTime();
+
+	netgraph.addFrameTime(float((frame_end_time - frame_start_time) / ONE_MS));
+
+	if (input_sample_pending)
+	{
+		netgraph.addInputLatency(float((frame_end_time - input_sample_time) / ONE_MS));
+		input_sample_pending = false;
+	}
 }
 
 //
@@ -947,8 +1011,7 @@ BEGIN_COMMAND (serverinfo)
     // Data
 	for (size_t i = 0; i < server_cvars.size(); i++)
 	{
-		cvar_t *dummy;
-		Cvar = cvar_t::FindCVar(server_cvars[i].c_str(), &dummy);
+		Cvar = cvar_t::FindCVar(server_cvars[i].c_str());
 
 		Printf( "%*s - %s\n",
 				MaxFieldLength,
@@ -1651,7 +1714,7 @@ int connecttimeout = 0;
 //
 void CL_RequestConnectInfo(void)
 {
-	if (!serveraddr.ip[0])
+	if (NET_IsNullAdr(serveraddr))
 		return;
 
 	gamestate = GS_CONNECTING;
@@ -1712,6 +1775,19 @@ static void QuitAndTryDownload(const OWantFile& missing_file)
 		return;
 	}
 
+	if (::server_waddownload && sv_downloadsites.str().empty())
+	{
+		// The server has no sites of its own but sends the file itself, so
+		// reconnect just to fetch it.
+		Printf(PRINT_HIGH, "Need to download \"%s\" from the server, reconnecting...\n",
+		       missing_file.getBasename().c_str());
+		CL_QuitNetGame();
+
+		if (CL_StartServerDownload(missing_file))
+			CL_Reconnect();
+		return;
+	}
+
 	if (sv_downloadsites.str().empty() && cl_downloadsites.str().empty())
 	{
 		// Nobody has any download sites configured.
@@ -1760,6 +1836,7 @@ bool CL_PrepareConnect(void)
 
 	bool recv_teamplay_stats = 0;
 	gameversiontosend = 0;
+	::server_waddownload = false;
 
 	byte playercount = MSG_ReadByte(); // players
 	MSG_ReadByte(); // max_players
@@ -1842,7 +1919,11 @@ bool CL_PrepareConnect(void)
 		for (l = 0; l < 3; l++)
 			MSG_ReadShort();
 		for (l = 0; l < 14; l++)
-			MSG_ReadBool();
+		{
+			bool value = MSG_ReadBool();
+			if (l == 10) // sv_waddownload
+				::server_waddownload = value;
+		}
 		for (l = 0; l < playercount; l++)
 		{
 			MSG_ReadShort();
@@ -1871,6 +1952,11 @@ bool CL_PrepareConnect(void)
 		int major, minor, patch;
 		BREAKVER(gameversion, major, minor, patch);
 		Printf(PRINT_HIGH, "> Server Version %i.%i.%i\n", major, minor, patch);
+
+		// Servers older than 0.9.4 advertise sv_waddownload but don't send
+		// svc_wadinfo and svc_wadchunk
+		if (gameversion < MAKEVER(0, 9, 4))
+			::server_waddownload = false;
 	}
 
 	// DEH/BEX Patch files
@@ -1915,8 +2001,14 @@ bool CL_PrepareConnect(void)
 			missing_file = missingfiles.front();
 		}
 
-		QuitAndTryDownload(missing_file);
-		return false;
+		// Unless we are back to fetch it from the server, in which case
+		// we connect only for that.
+		if (!::server_waddownload || !CL_IsServerDownloading() ||
+		    !CL_StartServerDownload(missing_file))
+		{
+			QuitAndTryDownload(missing_file);
+			return false;
+		}
 	}
 
 	recv_full_update = false;
@@ -1941,6 +2033,8 @@ bool CL_Connect(void)
 	//      messages.
 	MSG_WriteMarker(&net_buffer, clc_ack);
 	MSG_WriteLong(&net_buffer, 0);
+	if (CL_IsServerDownloading())
+		CL_WriteServerDownloadRequest(&net_buffer);
 	NET_SendPacket(::net_buffer, ::serveraddr);
 	Printf("Requesting server state...\n");
 
@@ -2022,7 +2116,7 @@ void CL_InitNetwork (void)
 
 void CL_TryToConnect(DWORD server_token)
 {
-	if (!serveraddr.ip[0])
+	if (NET_IsNullAdr(serveraddr))
 		return;
 
 	if (!connecttimeout)
@@ -2035,7 +2129,9 @@ void CL_TryToConnect(DWORD server_token)
 		MSG_WriteLong(&net_buffer, CHALLENGE); // send challenge
 		MSG_WriteLong(&net_buffer, server_token); // confirm server token
 		MSG_WriteShort(&net_buffer, version); // send client version
-		MSG_WriteByte(&net_buffer, 0); // send type of connection (play/spectate/rcon/download)
+		// send type of connection (play/spectate/rcon/download)
+		MSG_WriteByte(&net_buffer,
+		              CL_IsServerDownloading() ? CONNECT_DOWNLOAD : CONNECT_PLAY);
 
 		// GhostlyDeath -- Send more version info
 		if (gameversiontosend)
@@ -2373,18 +2469,42 @@ void CL_SaveSvGametic(void)
 {
 	byte t = MSG_ReadByte();
 
-	int newtic = (last_svgametic & 0xFFFFFF00) + t;
+	// Unwrap the byte against the newest gametic in either direction, a
+	// late packet can be from just before a wrap
+	int newtic = (newest_svgametic & 0xFFFFFF00) + t;
 
-	if (last_svgametic > newtic + 127)
+	if (newest_svgametic > newtic + 127)
 		newtic += 256;
+	else if (newtic > newest_svgametic + 128 && newtic >= 256)
+		newtic -= 256;
 
 	last_svgametic = newtic;
 
+	// Snapshots are kept by gametic, so a late packet only fills in its own
+	// slot and must not pull world_index back with it
+	if (newtic > newest_svgametic || newest_svgametic == 0)
+		newest_svgametic = newtic;
+
+	jitter.addPacket(newtic, I_GetTime());
+
 	#ifdef _WORLD_INDEX_DEBUG_
 	Printf(PRINT_HIGH, "Gametic %i, received world index %i\n", gametic, last_svgametic);
 	#endif	// _WORLD_INDEX_DEBUG_
 }
 
+//
+// CL_CmdAck
+//
+// The server acknowledges the newest ticcmd it has received from us and
+// reports how many of our packets go missing, which decides how many
+// ticcmds CL_SendCmd puts in each packet.
+//
+void CL_CmdAck()
+{
+	cmd_acktic = MSG_ReadUnVarint();
+	cmd_loss = MSG_ReadByte() / 255.0f;
+}
+
 //
 // CL_SendPingReply
 //
@@ -3047,7 +3167,65 @@ void CL_SoundOrigin(void)
 //
 void CL_ClearSectorSnapshots()
 {
-	sector_snaps.clear();
+	for (size_t i = 0; i < sector_snaps_active.size(); i++)
+	{
+		unsigned short sectornum = sector_snaps_active[i];
+		sector_snaps_free.push_back(sector_snaps[sectornum]);
+		sector_snaps[sectornum] = NULL;
+	}
+
+	sector_snaps_active.clear();
+	sector_snaps.assign(numsectors, NULL);
+}
+
+//
+// CL_GetSectorSnapshotManager
+//
+// Returns the SectorSnapshotManager for the sector.
+// Returns NULL if a snapshots aren't currently stored for the sector.
+//
+SectorSnapshotManager *CL_GetSectorSnapshotManager(sector_t *sector)
+{
+	if (!sector)
+		return NULL;
+
+	size_t sectornum = sector - sectors;
+	if (sectornum >= sector_snaps.size())
+		return NULL;
+
+	return sector_snaps[sectornum];
+}
+
+//
+// CL_AddSectorSnapshot
+//
+// Stores a snapshot received from the server for a sector, giving the sector
+// a container if it does not have one yet.
+//
+static void CL_AddSectorSnapshot(unsigned short sectornum, const SectorSnapshot &snap)
+{
+	if (sector_snaps.size() < (size_t)numsectors)
+		sector_snaps.resize(numsectors, NULL);
+
+	SectorSnapshotManager *mgr = sector_snaps[sectornum];
+	if (mgr == NULL)
+	{
+		if (sector_snaps_free.empty())
+		{
+			mgr = new SectorSnapshotManager;
+		}
+		else
+		{
+			mgr = sector_snaps_free.back();
+			sector_snaps_free.pop_back();
+			mgr->clearSnapshots();
+		}
+
+		sector_snaps[sectornum] = mgr;
+		sector_snaps_active.push_back(sectornum);
+	}
+
+	mgr->addSnapshot(snap);
 }
 
 //
@@ -3114,7 +3292,7 @@ void CL_UpdateSector(void)
 	P_ChangeSector(sector, false);
 
 	SectorSnapshot snap(last_svgametic, sector);
-	sector_snaps[sectornum].addSnapshot(snap);
+	CL_AddSectorSnapshot(sectornum, snap);
 }
 
 //
@@ -3267,7 +3445,7 @@ void CL_UpdateMovingSector(void)
 
 	snap.setSector(&sectors[sectornum]);
 
-	sector_snaps[sectornum].addSnapshot(snap);
+	CL_AddSectorSnapshot(sectornum, snap);
 }
 
 
@@ -3335,6 +3513,11 @@ void CL_ReadPacketHeader(void)
 {
 	unsigned int sequence = MSG_ReadLong();
 
+	// Download chunks don't take part in the reliable sequence, the
+	// download acknowledges them itself
+	if (MSG_BytesLeft() && MSG_NextByte() == svc_wadchunk)
+		return;
+
 	MSG_WriteMarker(&net_buffer, clc_ack);
 	MSG_WriteLong(&net_buffer, sequence);
 
@@ -3348,15 +3531,21 @@ void CL_ReadPacketHeader(void)
 
 void CL_GetServerSettings(void)
 {
-	cvar_t *var = NULL, *prev = NULL;
+	cvar_t *var = NULL;
+
+	// The server sends as many settings in a message as fit, their
+	// callbacks run once the whole message is read
+	cvar_t::BeginCallbackBatch();
 
-	// TODO: REMOVE IN 0.7 - We don't need this loop anymore
 	while (MSG_ReadByte() != 2)
 	{
+		if (net_message.overflowed)
+			break;
+
 		std::string CvarName = MSG_ReadString();
 		std::string CvarValue = MSG_ReadString();
 
-		var = cvar_t::FindCVar(CvarName.c_str(), &prev);
+		var = cvar_t::FindCVar(CvarName.c_str());
 
 		// GhostlyDeath <June 19, 2008> -- Read CVAR or dump it
 		if (var)
@@ -3377,6 +3566,8 @@ void CL_GetServerSettings(void)
 		}
 	}
 
+	cvar_t::EndCallbackBatch();
+
 	// Nes - update the skies in case sv_freelook is changed.
 	R_InitSkyMap();
 }
@@ -3684,6 +3875,11 @@ void CL_LoadMap()
 	// reset the world_index (force it to sync)
 	CL_ResyncWorldIndex();
 	last_svgametic = 0;
+	newest_svgametic = 0;
+
+	// Packets stall while the level loads, which says nothing about the
+	// connection
+	jitter.reset();
 
 	CTF_CheckFlags(consoleplayer());
 
@@ -3840,105 +4036,145 @@ void CL_LevelLocals()
 
 // client source (once)
 typedef void (*client_callback)();
-typedef std::map<svc_t, client_callback> cmdmap;
-cmdmap cmds;
+
+struct client_command_t
+{
+	client_callback handler;
+	const char *layout;		// NULL when only the handler knows the length
+};
+
+// Indexed by message id, a NULL handler is an unknown message
+static client_command_t cmds[svc_max + 1];
+
+// Messages parsed so far in the current packet, only recorded while
+// debug_netmessages is set
+static const size_t CMD_HISTORY = 32;
+static svc_t cmd_history[CMD_HISTORY];
+static size_t cmd_history_count;
+
+static void CL_SetCommand(svc_t id, client_callback handler)
+{
+	cmds[id].handler = handler;
+	cmds[id].layout = NET_SvcLayout(id);
+}
 
 //
-// CL_AllowPackets
+// CL_InitCommands
 //
 void CL_InitCommands(void)
 {
-	cmds[svc_abort]				= &CL_EndGame;
-	cmds[svc_loadmap]			= &CL_LoadMap;
-	cmds[svc_resetmap]			= &CL_ResetMap;
-	cmds[svc_playerinfo]		= &CL_PlayerInfo;
-	cmds[svc_consoleplayer]		= &CL_ConsolePlayer;
-	cmds[svc_playermembers]		= &CL_PlayerMembers;
-	cmds[svc_moveplayer]		= &CL_UpdatePlayer;
-	cmds[svc_updatelocalplayer]	= &CL_UpdateLocalPlayer;
-	cmds[svc_levellocals]		= &CL_LevelLocals;
-	cmds[svc_userinfo]			= &CL_SetupUserInfo;
-	cmds[svc_teammembers]		= &CL_TeamMembers;
-	cmds[svc_playerstate]		= &CL_UpdatePlayerState;
-
-	cmds[svc_updateping]		= &CL_UpdatePing;
-	cmds[svc_spawnmobj]			= &CL_SpawnMobj;
-	cmds[svc_mobjspeedangle]	= &CL_SetMobjSpeedAndAngle;
-	cmds[svc_mobjinfo]			= &CL_UpdateMobjInfo;
-	cmds[svc_explodemissile]	= &CL_ExplodeMissile;
-	cmds[svc_removemobj]		= &CL_RemoveMobj;
-
-	cmds[svc_killmobj]			= &CL_KillMobj;
-	cmds[svc_movemobj]			= &CL_MoveMobj;
-	cmds[svc_damagemobj]		= &CL_DamageMobj;
-	cmds[svc_corpse]			= &CL_Corpse;
-	cmds[svc_spawnplayer]		= &CL_SpawnPlayer;
-//	cmds[svc_spawnhiddenplayer]	= &CL_SpawnHiddenPlayer;
-	cmds[svc_damageplayer]		= &CL_DamagePlayer;
-	cmds[svc_firepistol]		= &CL_FirePistol;
-	cmds[svc_fireweapon]		= &CL_FireWeapon;
-
-	cmds[svc_fireshotgun]		= &CL_FireShotgun;
-	cmds[svc_firessg]			= &CL_FireSSG;
-	cmds[svc_firechaingun]		= &CL_FireChainGun;
-	cmds[svc_changeweapon]		= &CL_ChangeWeapon;
-	cmds[svc_railtrail]			= &CL_RailTrail;
-	cmds[svc_connectclient]		= &CL_ConnectClient;
-	cmds[svc_disconnectclient]	= &CL_DisconnectClient;
-	cmds[svc_activateline]		= &CL_ActivateLine;
-	cmds[svc_sector]			= &CL_UpdateSector;
-	cmds[svc_movingsector]		= &CL_UpdateMovingSector;
-	cmds[svc_switch]			= &CL_Switch;
-	cmds[svc_print]				= &CL_Print;
-    cmds[svc_midprint]          = &CL_MidPrint;
-	cmds[svc_say]				= &CL_Say;
-    cmds[svc_pingrequest]       = &CL_SendPingReply;
-	cmds[svc_svgametic]			= &CL_SaveSvGametic;
-	cmds[svc_mobjtranslation]	= &CL_MobjTranslation;
-	cmds[svc_inttimeleft]		= &CL_UpdateIntTimeLeft;
-
-	cmds[svc_startsound]		= &CL_Sound;
-	cmds[svc_soundorigin]		= &CL_SoundOrigin;
-	cmds[svc_mobjstate]			= &CL_SetMobjState;
-	cmds[svc_actor_movedir]		= &CL_Actor_Movedir;
-	cmds[svc_actor_target]		= &CL_Actor_Target;
-	cmds[svc_actor_tracer]		= &CL_Actor_Tracer;
-	cmds[svc_missedpacket]		= &CL_CheckMissedPacket;
-	cmds[svc_forceteam]			= &CL_ForceSetTeam;
-
-	cmds[svc_ctfevent]			= &CL_CTFEvent;
-	cmds[svc_secretevent]		= &CL_SecretEvent;
-	cmds[svc_serversettings]	= &CL_GetServerSettings;
-	cmds[svc_disconnect]		= &CL_EndGame;
-	cmds[svc_full]				= &CL_FullGame;
-	cmds[svc_reconnect]			= &CL_Reconnect;
-	cmds[svc_exitlevel]			= &CL_ExitLevel;
-
-	cmds[svc_challenge]			= &CL_Clear;
-	cmds[svc_launcher_challenge]= &CL_Clear;
-
-	cmds[svc_levelstate]		= &CL_LevelState;
-
-	cmds[svc_touchspecial]      = &CL_TouchSpecialThing;
-
-	cmds[svc_netdemocap]        = &CL_LocalDemoTic;
-	cmds[svc_netdemostop]       = &CL_NetDemoStop;
-	cmds[svc_netdemoloadsnap]	= &CL_NetDemoLoadSnap;
-	cmds[svc_fullupdatedone]	= &CL_FinishedFullUpdate;
-	cmds[svc_fullupdatestart]	= &CL_StartFullUpdate;
-
-	cmds[svc_vote_update] = &CL_VoteUpdate;
-	cmds[svc_maplist] = &CL_Maplist;
-	cmds[svc_maplist_update] = &CL_MaplistUpdate;
-	cmds[svc_maplist_index] = &CL_MaplistIndex;
-
-	cmds[svc_playerqueuepos] = &CL_UpdatePlayerQueuePos;
-	cmds[svc_executelinespecial] = &CL_ExecuteLineSpecial;
-	cmds[svc_executeacsspecial] = &CL_ACSExecuteSpecial;
-	cmds[svc_lineupdate] = &CL_LineUpdate;
-	cmds[svc_linesideupdate] = &CL_LineSideUpdate;
-	cmds[svc_sectorproperties] = &CL_SectorSectorPropertiesUpdate;
-	cmds[svc_thinkerupdate] = &CL_ThinkerUpdate;
+	CL_SetCommand(svc_abort, &CL_EndGame);
+	CL_SetCommand(svc_loadmap, &CL_LoadMap);
+	CL_SetCommand(svc_resetmap, &CL_ResetMap);
+	CL_SetCommand(svc_playerinfo, &CL_PlayerInfo);
+	CL_SetCommand(svc_consoleplayer, &CL_ConsolePlayer);
+	CL_SetCommand(svc_playermembers, &CL_PlayerMembers);
+	CL_SetCommand(svc_moveplayer, &CL_UpdatePlayer);
+	CL_SetCommand(svc_updatelocalplayer, &CL_UpdateLocalPlayer);
+	CL_SetCommand(svc_levellocals, &CL_LevelLocals);
+	CL_SetCommand(svc_userinfo, &CL_SetupUserInfo);
+	CL_SetCommand(svc_teammembers, &CL_TeamMembers);
+	CL_SetCommand(svc_playerstate, &CL_UpdatePlayerState);
+
+	CL_SetCommand(svc_updateping, &CL_UpdatePing);
+	CL_SetCommand(svc_spawnmobj, &CL_SpawnMobj);
+	CL_SetCommand(svc_mobjspeedangle, &CL_SetMobjSpeedAndAngle);
+	CL_SetCommand(svc_mobjinfo, &CL_UpdateMobjInfo);
+	CL_SetCommand(svc_explodemissile, &CL_ExplodeMissile);
+	CL_SetCommand(svc_removemobj, &CL_RemoveMobj);
+
+	CL_SetCommand(svc_killmobj, &CL_KillMobj);
+	CL_SetCommand(svc_movemobj, &CL_MoveMobj);
+	CL_SetCommand(svc_damagemobj, &CL_DamageMobj);
+	CL_SetCommand(svc_corpse, &CL_Corpse);
+	CL_SetCommand(svc_spawnplayer, &CL_SpawnPlayer);
+//	CL_SetCommand(svc_spawnhiddenplayer, &CL_SpawnHiddenPlayer);
+	CL_SetCommand(svc_damageplayer, &CL_DamagePlayer);
+	CL_SetCommand(svc_firepistol, &CL_FirePistol);
+	CL_SetCommand(svc_fireweapon, &CL_FireWeapon);
+
+	CL_SetCommand(svc_fireshotgun, &CL_FireShotgun);
+	CL_SetCommand(svc_firessg, &CL_FireSSG);
+	CL_SetCommand(svc_firechaingun, &CL_FireChainGun);
+	CL_SetCommand(svc_changeweapon, &CL_ChangeWeapon);
+	CL_SetCommand(svc_railtrail, &CL_RailTrail);
+	CL_SetCommand(svc_connectclient, &CL_ConnectClient);
+	CL_SetCommand(svc_disconnectclient, &CL_DisconnectClient);
+	CL_SetCommand(svc_activateline, &CL_ActivateLine);
+	CL_SetCommand(svc_sector, &CL_UpdateSector);
+	CL_SetCommand(svc_movingsector, &CL_UpdateMovingSector);
+	CL_SetCommand(svc_switch, &CL_Switch);
+	CL_SetCommand(svc_print, &CL_Print);
+    CL_SetCommand(svc_midprint, &CL_MidPrint);
+	CL_SetCommand(svc_say, &CL_Say);
+    CL_SetCommand(svc_pingrequest, &CL_SendPingReply);
+	CL_SetCommand(svc_svgametic, &CL_SaveSvGametic);
+	CL_SetCommand(svc_mobjtranslation, &CL_MobjTranslation);
+	CL_SetCommand(svc_inttimeleft, &CL_UpdateIntTimeLeft);
+
+	CL_SetCommand(svc_startsound, &CL_Sound);
+	CL_SetCommand(svc_soundorigin, &CL_SoundOrigin);
+	CL_SetCommand(svc_mobjstate, &CL_SetMobjState);
+	CL_SetCommand(svc_actor_movedir, &CL_Actor_Movedir);
+	CL_SetCommand(svc_actor_target, &CL_Actor_Target);
+	CL_SetCommand(svc_actor_tracer, &CL_Actor_Tracer);
+	CL_SetCommand(svc_missedpacket, &CL_CheckMissedPacket);
+	CL_SetCommand(svc_wadinfo, &CL_ServerWadInfo);
+	CL_SetCommand(svc_wadchunk, &CL_ServerWadChunk);
+	CL_SetCommand(svc_forceteam, &CL_ForceSetTeam);
+
+	CL_SetCommand(svc_ctfevent, &CL_CTFEvent);
+	CL_SetCommand(svc_secretevent, &CL_SecretEvent);
+	CL_SetCommand(svc_serversettings, &CL_GetServerSettings);
+	CL_SetCommand(svc_disconnect, &CL_EndGame);
+	CL_SetCommand(svc_full, &CL_FullGame);
+	CL_SetCommand(svc_reconnect, &CL_Reconnect);
+	CL_SetCommand(svc_exitlevel, &CL_ExitLevel);
+
+	CL_SetCommand(svc_challenge, &CL_Clear);
+	CL_SetCommand(svc_launcher_challenge, &CL_Clear);
+
+	CL_SetCommand(svc_levelstate, &CL_LevelState);
+
+	CL_SetCommand(svc_touchspecial, &CL_TouchSpecialThing);
+
+	CL_SetCommand(svc_netdemocap, &CL_LocalDemoTic);
+	CL_SetCommand(svc_netdemostop, &CL_NetDemoStop);
+	CL_SetCommand(svc_netdemoloadsnap, &CL_NetDemoLoadSnap);
+	CL_SetCommand(svc_fullupdatedone, &CL_FinishedFullUpdate);
+	CL_SetCommand(svc_fullupdatestart, &CL_StartFullUpdate);
+
+	CL_SetCommand(svc_vote_update, &CL_VoteUpdate);
+	CL_SetCommand(svc_maplist, &CL_Maplist);
+	CL_SetCommand(svc_maplist_update, &CL_MaplistUpdate);
+	CL_SetCommand(svc_maplist_index, &CL_MaplistIndex);
+
+	CL_SetCommand(svc_playerqueuepos, &CL_UpdatePlayerQueuePos);
+	CL_SetCommand(svc_executelinespecial, &CL_ExecuteLineSpecial);
+	CL_SetCommand(svc_executeacsspecial, &CL_ACSExecuteSpecial);
+	CL_SetCommand(svc_lineupdate, &CL_LineUpdate);
+	CL_SetCommand(svc_linesideupdate, &CL_LineSideUpdate);
+	CL_SetCommand(svc_sectorproperties, &CL_SectorSectorPropertiesUpdate);
+	CL_SetCommand(svc_thinkerupdate, &CL_ThinkerUpdate);
+	CL_SetCommand(svc_cmdack, &CL_CmdAck);
+}
+
+//
+// CL_PrintCommandHistory
+//
+static void CL_PrintCommandHistory()
+{
+	// Only the last CMD_HISTORY messages of the packet are kept
+	size_t first = cmd_history_count > CMD_HISTORY ? cmd_history_count - CMD_HISTORY : 0;
+
+	for (size_t j = first; j < cmd_history_count; j++)
+	{
+		svc_t cmd = cmd_history[j % CMD_HISTORY];
+		Printf(PRINT_HIGH, "CL_ParseCommands: message #%d [%d %s]\n", j, cmd, svc_info[cmd].getName());
+	}
+
+	if (!debug_netmessages)
+		Printf(PRINT_HIGH, "CL_ParseCommands: set debug_netmessages to see the messages before it\n");
 }
 
 //
@@ -3946,36 +4182,51 @@ void CL_InitCommands(void)
 //
 void CL_ParseCommands(void)
 {
-	std::vector<svc_t>	history;
 	svc_t				cmd = svc_abort;
+	size_t				count = 0;
 
 	static bool once = true;
 	if(once)CL_InitCommands();
 	once = false;
 
+	cmd_history_count = 0;
+
 	while(connected)
 	{
 		size_t byteStart = net_message.BytesRead();
 
 		cmd = (svc_t)MSG_ReadByte();
-		history.push_back(cmd);
 
 		if(cmd == (svc_t)-1)
 			break;
 
-		cmdmap::iterator i = cmds.find(cmd);
-		if(i == cmds.end())
+		count++;
+
+		if (debug_netmessages)
+			cmd_history[cmd_history_count++ % CMD_HISTORY] = cmd;
+
+		const client_command_t& command = cmds[cmd];
+		if(command.handler == NULL)
 		{
 			CL_QuitNetGame();
 			Printf(PRINT_HIGH, "CL_ParseCommands: Unknown server message %d following: \n", (int)cmd);
-
-			for(size_t j = 0; j < history.size(); j++)
-				Printf(PRINT_HIGH, "CL_ParseCommands: message #%d [%d %s]\n", j, history[j], svc_info[history[j]].getName());
+			CL_PrintCommandHistory();
 			Printf(PRINT_HIGH, "\n");
 			break;
 		}
 
-		i->second();
+		// A message with a known layout is checked before its handler sees
+		// it, so a truncated one never gets half applied
+		if (command.layout != NULL &&
+			NET_MeasureLayout(command.layout, net_message.ptr() + net_message.BytesRead(),
+			                  net_message.BytesLeftToRead()) < 0)
+		{
+			net_message.overflowed = true;
+		}
+		else
+		{
+			command.handler();
+		}
 
 		if (net_message.overflowed)
 		{
@@ -3985,9 +4236,8 @@ void CL_ParseCommands(void)
 					   (int)cmd,
 					   svc_info[cmd].getName());
 			Printf(PRINT_HIGH, "CL_ParseCommands: It was command number %d in the packet\n",
-                                           (int)history.back());
-			for(size_t j = 0; j < history.size(); j++)
-				Printf(PRINT_HIGH, "CL_ParseCommands: message #%d [%d %s]\n", j, history[j], svc_info[history[j]].getName());
+                                           (int)count);
+			CL_PrintCommandHistory();
 		}
 
 		// Measure length of each message, so we can keep track of bandwidth.
@@ -4009,6 +4259,32 @@ void CL_SaveCmd(void)
 
 extern int outrate;
 
+//
+// CL_CmdRedundancy
+//
+// How many of the most recent ticcmds each packet should carry so that a
+// ticcmd is only lost when every packet carrying it is, about one time in a
+// thousand at the packet loss the server reports.  Until the server has
+// reported anything, send as many as we can.
+//
+static int CL_CmdRedundancy()
+{
+	static const float ACCEPTED_LOSS = 0.001f;
+
+	if (cmd_acktic <= 0)
+		return MAX_NETCMDS_PER_PACKET;
+
+	int count = 2;
+	if (cmd_loss > 0.0f)
+	{
+		if (cmd_loss >= 1.0f)
+			return MAX_NETCMDS_PER_PACKET;
+		count = int(ceil(log(ACCEPTED_LOSS) / log(cmd_loss)));
+	}
+
+	return clamp(count, 2, MAX_NETCMDS_PER_PACKET);
+}
+
 //
 // CL_SendCmd
 //
@@ -4019,6 +4295,19 @@ void CL_SendCmd(void)
 	if (netdemo.isPlaying())	// we're not really connected to a server
 		return;
 
+	// Connected only to download a file, there is nothing else to send
+	if (CL_IsServerDownloading())
+	{
+		CL_WriteServerDownloadAck(&net_buffer);
+
+		if (net_buffer.size())
+		{
+			outrate += NET_SendPacket(net_buffer, serveraddr);
+			SZ_Clear(&net_buffer);
+		}
+		return;
+	}
+
 	if (!p->mo || gametic < 1 )
 		return;
 
@@ -4039,17 +4328,44 @@ void CL_SendCmd(void)
 	// need to be used for client's positional prediction.
     MSG_WriteLong(&net_buffer, gametic);
 
-	for (int i = 9; i >= 0; i--)
+	if (::gameversion < MAKEVER(0, 9, 4))
 	{
-		NetCommand blank_netcmd;
-		NetCommand* netcmd;
+		// Servers older than 0.9.4 expect the last ten ticcmds in full
+		for (int i = MAX_NETCMDS_PER_PACKET - 1; i >= 0; i--)
+		{
+			NetCommand blank_netcmd;
+			NetCommand* netcmd;
 
-		if (gametic >= i)
-			netcmd = &localcmds[(gametic - i) % MAXSAVETICS];
-		else
-			netcmd = &blank_netcmd;		// write a blank netcmd since not enough gametics have passed
+			if (gametic >= i)
+				netcmd = &localcmds[(gametic - i) % MAXSAVETICS];
+			else
+				netcmd = &blank_netcmd;		// write a blank netcmd since not enough gametics have passed
 
-		netcmd->write(&net_buffer);
+			netcmd->write(&net_buffer);
+		}
+	}
+	else
+	{
+		// Send the ticcmds the server has not acknowledged, but no more than
+		// the packet loss calls for.  Once a newer ticcmd arrives the server
+		// skips any older ones it missed, so resending those would be wasted.
+		int count = MIN(CL_CmdRedundancy(), gametic);
+		if (cmd_acktic > 0 && cmd_acktic < gametic)
+			count = MIN(count, gametic - cmd_acktic);
+
+		MSG_WriteByte(&net_buffer, count);
+
+		// Each ticcmd after the first only carries what changed from the one
+		// before it
+		for (int i = count - 1; i >= 0; i--)
+		{
+			NetCommand* netcmd = &localcmds[(gametic - i) % MAXSAVETICS];
+
+			if (i == count - 1)
+				netcmd->write(&net_buffer);
+			else
+				netcmd->write(&net_buffer, localcmds[(gametic - i - 1) % MAXSAVETICS]);
+		}
 	}
 
 	int bytesWritten = NET_SendPacket(net_buffer, serveraddr);
@@ -4201,19 +4517,26 @@ void CL_LocalDemoTic()
 
 void CL_RemoveCompletedMovingSectors()
 {
-	std::map<unsigned short, SectorSnapshotManager>::iterator itr;
-	itr = sector_snaps.begin();
-
-	while (itr != sector_snaps.end())
+	size_t i = 0;
+	while (i < sector_snaps_active.size())
 	{
-		SectorSnapshotManager *mgr = &(itr->second);
+		unsigned short sectornum = sector_snaps_active[i];
+		SectorSnapshotManager *mgr = sector_snaps[sectornum];
 		int time = mgr->getMostRecentTime();
 
 		// are all the snapshots in the container invalid or too old?
 		if (world_index - time > NUM_SNAPSHOTS || mgr->empty())
-			sector_snaps.erase(itr++);
+		{
+			sector_snaps_free.push_back(mgr);
+			sector_snaps[sectornum] = NULL;
+
+			sector_snaps_active[i] = sector_snaps_active.back();
+			sector_snaps_active.pop_back();
+		}
 		else
-			++itr;
+		{
+			++i;
+		}
 	}
 }
 
@@ -4237,10 +4560,9 @@ void CL_SimulateSectors()
 	CL_RemoveCompletedMovingSectors();
 
 	// Move sectors
-	std::map<unsigned short, SectorSnapshotManager>::iterator itr;
-	for (itr = sector_snaps.begin(); itr != sector_snaps.end(); ++itr)
+	for (size_t i = 0; i < sector_snaps_active.size(); i++)
 	{
-		unsigned short sectornum = itr->first;
+		unsigned short sectornum = sector_snaps_active[i];
 		if (sectornum >= numsectors)
 			continue;
 
@@ -4252,7 +4574,7 @@ void CL_SimulateSectors()
 
 		// Fetch the snapshot for this world_index and run the sector's
 		// thinkers to play any sector sounds
-		SectorSnapshot snap = itr->second.getSnapshot(world_index);
+		SectorSnapshot snap = sector_snaps[sectornum]->getSnapshot(world_index);
 		if (snap.isValid())
 		{
 			snap.toSector(sector);
@@ -4276,6 +4598,9 @@ void CL_SimulateSectors()
 //
 void CL_SimulatePlayers()
 {
+	// Players whose snapshot for world_index had not arrived in time
+	int extrapolated = 0;
+
 	for (Players::iterator it = players.begin();it != players.end();++it)
 	{
 		player_t *player = &*it;
@@ -4289,6 +4614,9 @@ void CL_SimulatePlayers()
 		PlayerSnapshot snap = player->snapshots.getSnapshot(world_index);
 		if (snap.isValid())
 		{
+			if (snap.isExtrapolated())
+				extrapolated++;
+
 			// Examine the old position.  If it doesn't match the snapshot for the
 			// previous world_index, then old position was probably extrapolated
 			// and should be smoothly moved towards the corrected position instead
@@ -4347,6 +4675,8 @@ void CL_SimulatePlayers()
 			}
 		}
 	}
+
+	netgraph.setExtrapolations(extrapolated);
 }
 
 
@@ -4396,7 +4726,7 @@ void CL_SimulateWorld()
 
 	// Not using interpolation?  Use the last update always
 	if (!cl_interp)
-		world_index = last_svgametic;
+		world_index = newest_svgametic;
 
 	#ifdef _WORLD_INDEX_DEBUG_
 	Printf(PRINT_HIGH, "Gametic %i, simulating world_index %i\n",
@@ -4404,7 +4734,10 @@ void CL_SimulateWorld()
 	#endif // _WORLD_INDEX_DEBUG_
 
 	// [SL] 2012-03-29 - Add sync information to the netgraph
-	netgraph.setWorldIndexSync(world_index - (last_svgametic - cl_interp));
+	const int delay = CL_InterpolationDelay();
+	netgraph.setWorldIndexSync(world_index - (newest_svgametic - delay));
+	netgraph.setInterpolation(delay);
+	netgraph.setJitterBuffer(newest_svgametic - world_index, jitter.getJitter());
 
 	CL_SimulateSectors();
 	CL_SimulatePlayers();
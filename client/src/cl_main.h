@@ -73,6 +73,9 @@ void CL_RunTics();
 
 bool CL_SectorIsPredicting(sector_t *sector);
 
+class SectorSnapshotManager;
+SectorSnapshotManager *CL_GetSectorSnapshotManager(sector_t *sector);
+
 std::string M_ExpandTokens(const std::string &str);
 
 #endif
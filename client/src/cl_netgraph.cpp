@@ -33,7 +33,8 @@
 #include "r_draw.h"
 
 NetGraph::NetGraph(int x, int y) :
-	mX(x), mY(y)
+	mX(x), mY(y), mInterpolation(0), mJitter(0.0f), mFrameTimeHead(0),
+	mInputLatencyHead(0)
 {
 	for (size_t i = 0; i < NetGraph::MAX_HISTORY_TICS; i++)
 	{
@@ -41,6 +42,15 @@ NetGraph::NetGraph(int x, int y) :
 		mWorldIndexSync[i] = 0;
 		mTrafficIn[i] = 0;
 		mTrafficOut[i] = 0;
+		mPacketsIn[i] = 0;
+		mBufferDepth[i] = 0;
+		mExtrapolations[i] = 0;
+	}
+
+	for (size_t i = 0; i < NetGraph::MAX_HISTORY_FRAMES; i++)
+	{
+		mFrameTime[i] = 0.0f;
+		mInputLatency[i] = 0.0f;
 	}
 }
 
@@ -92,11 +102,47 @@ void NetGraph::addPacketIn()
 	lastgametic = gametic;
 }
 
+void NetGraph::addFrameTime(float ms)
+{
+	mFrameTime[mFrameTimeHead] = ms;
+	mFrameTimeHead = (mFrameTimeHead + 1) % NetGraph::MAX_HISTORY_FRAMES;
+}
+
+void NetGraph::addInputLatency(float ms)
+{
+	mInputLatency[mInputLatencyHead] = ms;
+	mInputLatencyHead = (mInputLatencyHead + 1) % NetGraph::MAX_HISTORY_FRAMES;
+}
+
 void NetGraph::setInterpolation(int val)
 {
 	mInterpolation = val;
 }
 
+//
+// Tics of snapshots received past the one being shown, and how late packets
+// have been arriving in milliseconds
+//
+void NetGraph::setJitterBuffer(int depth, float jitter)
+{
+	if (depth > NetGraph::MAX_BUFFER_DEPTH)
+		depth = NetGraph::MAX_BUFFER_DEPTH;
+	else if (depth < 0)
+		depth = 0;
+
+	mBufferDepth[gametic % NetGraph::MAX_HISTORY_TICS] = depth;
+	mJitter = jitter;
+}
+
+//
+// Number of players whose position had to be extrapolated this tic because
+// their snapshot had not arrived yet
+//
+void NetGraph::setExtrapolations(int val)
+{
+	mExtrapolations[gametic % NetGraph::MAX_HISTORY_TICS] = val;
+}
+
 static void NetGraphDrawBar(int startx, int starty, int width, int height, int color)
 {
 	if (starty + height >= viewheight)
@@ -236,6 +282,72 @@ void NetGraph::drawPackets(int x, int y)
 	screen->DrawText(textcolor, x, y, buf.str().c_str());
 }
 
+void NetGraph::drawTimes(int x, int y, const char* label, const float* times, size_t head)
+{
+	static const int textcolor = CR_GREY;
+
+	float total = 0.0f, maxtime = 0.0f;
+
+	for (size_t i = 0; i < NetGraph::MAX_HISTORY_FRAMES; i++)
+	{
+		float time = times[(head + i) % NetGraph::MAX_HISTORY_FRAMES];
+		total += time;
+		if (time > maxtime)
+			maxtime = time;
+
+		int height = MIN<int>(int(time), NetGraph::MAX_TIME_MS);
+		if (height > 0)
+			NetGraphDrawBar(x + i * 2, y + 8 + NetGraph::MAX_TIME_MS - height, 2, height, 0xB0);
+	}
+
+	std::ostringstream buf;
+	buf.precision(1);
+	buf << label << std::fixed << total / NetGraph::MAX_HISTORY_FRAMES
+		<< " ms (max " << maxtime << ")";
+	screen->DrawText(textcolor, x, y, buf.str().c_str());
+}
+
+void NetGraph::drawJitterBuffer(int x, int y)
+{
+	static const int textcolor = CR_GREY;
+
+	const int graphheight = NetGraph::MAX_BUFFER_DEPTH * NetGraph::BAR_HEIGHT_BUFFER;
+	const int graphwidth = NetGraph::BAR_WIDTH_BUFFER * NetGraph::MAX_HISTORY_TICS;
+	const int bottomy = y + 8 + graphheight;
+
+	int extrapolated = 0;
+
+	for (size_t i = 0; i < NetGraph::MAX_HISTORY_TICS; i++)
+	{
+		int index = (gametic - (NetGraph::MAX_HISTORY_TICS - i)) % MAX_HISTORY_TICS;
+		int startx = x + i * NetGraph::BAR_WIDTH_BUFFER;
+		int height = mBufferDepth[index] * NetGraph::BAR_HEIGHT_BUFFER;
+
+		if (height > 0)
+			NetGraphDrawBar(startx, bottomy - height, NetGraph::BAR_WIDTH_BUFFER, height, 160);
+
+		// mark the tics where a player ran out of snapshots under the graph
+		if (mExtrapolations[index] > 0)
+		{
+			NetGraphDrawBar(startx, bottomy + 1, NetGraph::BAR_WIDTH_BUFFER, 2, 0xB0);
+			extrapolated++;
+		}
+	}
+
+	// draw the target delay line
+	if (mInterpolation > 0)
+	{
+		int liney = bottomy - NetGraph::BAR_HEIGHT_BUFFER * mInterpolation;
+		NetGraphDrawBar(x, liney, graphwidth, 1, 1);
+	}
+
+	std::ostringstream buf;
+	buf.precision(0);
+	buf << "Jitter Buffer: " << mInterpolation << " tics, " << std::fixed << mJitter
+		<< " ms (" << extrapolated << " late)";
+	screen->DrawText(textcolor, x, y, buf.str().c_str());
+}
+
 void NetGraph::draw()
 {
 	static const int textcolor = CR_GREY;
@@ -250,6 +362,11 @@ void NetGraph::draw()
 	drawTrafficIn(mX, mY + 128 + fontheight);
 	drawTrafficOut(mX, mY + 128 + fontheight * 3);
 	drawPackets(mX, mY + 128 + fontheight * 6);
+
+	const int timesx = mX + NetGraph::BAR_WIDTH_WORLD_INDEX * NetGraph::MAX_HISTORY_TICS + 16;
+	drawTimes(timesx, mY, "Frame Time: ", mFrameTime, mFrameTimeHead);
+	drawTimes(timesx, mY + 64 + fontheight, "Input Latency: ", mInputLatency, mInputLatencyHead);
+	drawJitterBuffer(timesx, mY + 128 + fontheight * 2);
 }
 
 VERSION_CONTROL (cl_netgraph_cpp, "$Id$")
@@ -33,9 +33,13 @@ public:
 	void setMisprediction(bool val);
 	void setWorldIndexSync(int val);
 	void setInterpolation(int val);
+	void setJitterBuffer(int depth, float jitter);
+	void setExtrapolations(int val);
 	void addTrafficIn(int val);
 	void addTrafficOut(int val);
 	void addPacketIn();
+	void addFrameTime(float ms);
+	void addInputLatency(float ms);
 	void draw();
 
 private:
@@ -44,6 +48,8 @@ private:
 	void drawTrafficIn(int x, int y);
 	void drawTrafficOut(int x, int y);
 	void drawPackets(int x, int y);
+	void drawTimes(int x, int y, const char* label, const float* times, size_t head);
+	void drawJitterBuffer(int x, int y);
 
 	static const int BAR_HEIGHT_WORLD_INDEX = 4;
 	static const int BAR_WIDTH_WORLD_INDEX = 2;
@@ -51,10 +57,17 @@ private:
 	static const int BAR_HEIGHT_MISPREDICTION = 2;
 	static const int BAR_WIDTH_MISPREDICTION = 2;
 
+	static const int BAR_HEIGHT_BUFFER = 4;
+	static const int BAR_WIDTH_BUFFER = 2;
+	static const int MAX_BUFFER_DEPTH = 8;
+
 	static const int MAX_WORLD_INDEX = 6;
 	static const int MIN_WORLD_INDEX = -6;
 	
 	static const size_t MAX_HISTORY_TICS = 64;
+	static const size_t MAX_HISTORY_FRAMES = 64;
+
+	static const int MAX_TIME_MS = 50;
 
 	int		mX;
 	int		mY;
@@ -65,6 +78,14 @@ private:
 	int		mTrafficIn[NetGraph::MAX_HISTORY_TICS];
 	int		mTrafficOut[NetGraph::MAX_HISTORY_TICS];
 	int		mPacketsIn[NetGraph::MAX_HISTORY_TICS];
+	int		mBufferDepth[NetGraph::MAX_HISTORY_TICS];
+	int		mExtrapolations[NetGraph::MAX_HISTORY_TICS];
+	float	mJitter;
+
+	float	mFrameTime[NetGraph::MAX_HISTORY_FRAMES];
+	size_t	mFrameTimeHead;
+	float	mInputLatency[NetGraph::MAX_HISTORY_FRAMES];
+	size_t	mInputLatencyHead;
 };
 
 #endif // __CL_NETGRAPH_H__
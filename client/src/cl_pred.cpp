@@ -29,6 +29,8 @@
 #include "cl_main.h"
 #include "cl_demo.h"
 #include "cl_netgraph.h"
+#include "c_dispatch.h"
+#include "i_system.h"
 
 #include "p_snapshot.h"
 
@@ -36,6 +38,7 @@ EXTERN_CVAR (cl_prednudge)
 EXTERN_CVAR (cl_predictsectors)
 
 extern NetGraph netgraph;
+extern fixed_t forwardmove[2];
 
 void P_DeathThink (player_t *player);
 void P_MovePlayer (player_t *player);
@@ -44,31 +47,15 @@ void P_CalcHeight (player_t *player);
 extern NetCommand localcmds[MAXSAVETICS];
 static PlayerSnapshot cl_savedsnaps[MAXSAVETICS];
 
-bool predicting;
-
-extern std::map<unsigned short, SectorSnapshotManager> sector_snaps;
+// Checkpoints of the local player's predicted state after each tic.  While
+// updates from the server agree with them, prediction only has to run the
+// newest tic instead of replaying every tic the server has not confirmed.
+static PlayerSnapshot cl_predictedsnaps[MAXSAVETICS];
+static int cl_checkedsnaptime = 0;
+static int cl_checkedsectortime = 0;
+static bool cl_replaynext = true;
 
-
-//
-// CL_GetSnapshotManager
-//
-// Returns the SectorSnapshotManager for the sector.
-// Returns NULL if a snapshots aren't currently stored for the sector.
-//
-static SectorSnapshotManager *CL_GetSectorSnapshotManager(sector_t *sector)
-{
-	unsigned short sectornum = sector - sectors;
-	if (!sector || sectornum >= numsectors)
-		return NULL;
-
-	std::map<unsigned short, SectorSnapshotManager>::iterator mgr_itr;
-	mgr_itr = sector_snaps.find(sectornum);
-	
-	if (mgr_itr != sector_snaps.end())
-		return &(mgr_itr->second);
-	
-	return NULL;
-}
+bool predicting;
 
 static bool CL_SectorHasSnapshots(sector_t *sector)
 {
@@ -99,10 +86,10 @@ bool CL_SectorIsPredicting(sector_t *sector)
 // CL_ResetSectors
 //
 // Moves predicting sectors to their most recent snapshot received from the
-// server.  Also performs cleanup on the list of predicting sectors when
-// sectors have finished their movement.
+// server if reset is true.  Also performs cleanup on the list of predicting
+// sectors when sectors have finished their movement.
 //
-static void CL_ResetSectors()
+static void CL_ResetSectors(bool reset)
 {
 	std::list<movingsector_t>::iterator itr;
 	itr = movingsectors.begin();
@@ -130,7 +117,7 @@ static void CL_ResetSectors()
 			
 			if (ceilingdone && floordone)
 				snapfinished = true;
-			else
+			else if (reset)
 			{
 				// snapshots have been received for this sector recently, so
 				// reset this sector to the most recent snapshot from the server
@@ -242,6 +229,81 @@ static void CL_PredictLocalPlayer(int predtic)
 	player->mo->RunThink();
 }
 
+//
+// CL_SamePosition
+//
+// Returns true if two snapshots of the local player agree on everything the
+// server sends back about them.
+//
+static bool CL_SamePosition(const PlayerSnapshot &a, const PlayerSnapshot &b)
+{
+	return a.getX() == b.getX() && a.getY() == b.getY() && a.getZ() == b.getZ() &&
+	       a.getMomX() == b.getMomX() && a.getMomY() == b.getMomY() &&
+	       a.getMomZ() == b.getMomZ();
+}
+
+//
+// CL_NewSectorSnapshots
+//
+// Returns true if the server has sent a snapshot for any predicting sector
+// since the last call.  Sectors do not keep checkpoints, so any such update
+// means the tics since have to be replayed.
+//
+static bool CL_NewSectorSnapshots()
+{
+	int newest = 0;
+
+	std::list<movingsector_t>::iterator itr;
+	for (itr = movingsectors.begin(); itr != movingsectors.end(); ++itr)
+	{
+		SectorSnapshotManager *mgr = CL_GetSectorSnapshotManager(itr->sector);
+		if (mgr && !mgr->empty() && mgr->getMostRecentTime() > newest)
+			newest = mgr->getMostRecentTime();
+	}
+
+	bool changed = (newest != cl_checkedsectortime);
+	cl_checkedsectortime = newest;
+	return changed;
+}
+
+//
+// CL_PredictionDiverged
+//
+// Decides whether the local player's prediction has to be replayed from the
+// last position the server confirmed, or whether the state predicted last
+// tic can be carried on from.
+//
+static bool CL_PredictionDiverged(player_t *p, const PlayerSnapshot &prevsnap,
+								  const PlayerSnapshot &snap, int snaptime)
+{
+	bool sectorschanged = cl_predictsectors && CL_NewSectorSnapshots();
+
+	if (cl_replaynext || sectorschanged)
+		return true;
+
+	// Was the player moved by something other than prediction since last tic?
+	const PlayerSnapshot &lastsnap = cl_predictedsnaps[(gametic - 1) % MAXSAVETICS];
+	if (lastsnap.getTime() != gametic - 1 || !CL_SamePosition(lastsnap, prevsnap))
+		return true;
+
+	// A new update from the server has to agree with what we predicted for
+	// the tic it confirms
+	if (snaptime != cl_checkedsnaptime)
+	{
+		if (!snap.isContinuous())
+			return true;
+
+		if (p->tic < gametic - MAXSAVETICS)
+			return true;
+
+		const PlayerSnapshot &checksnap = cl_predictedsnaps[p->tic % MAXSAVETICS];
+		if (checksnap.getTime() != p->tic || !CL_SamePosition(checksnap, snap))
+			return true;
+	}
+
+	return false;
+}
+
 //
 // CL_PredictWorld
 //
@@ -255,7 +317,10 @@ void CL_PredictWorld(void)
 	player_t *p = &consoleplayer();
 
 	if (!validplayer(*p) || !p->mo || noservermsgs || netdemo.isPaused())
+	{
+		cl_replaynext = true;
 		return;
+	}
 
 	// tenatively tell the netgraph that our prediction was successful
 	netgraph.setMisprediction(false);
@@ -268,11 +333,15 @@ void CL_PredictWorld(void)
 	if (consoleplayer().spectator)
 	{
 		CL_PredictSpectator();
+		cl_replaynext = true;
 		return;
 	}
 		
 	if (p->tic <= 0)	// No verified position from the server
+	{
+		cl_replaynext = true;
 		return;
+	}
 
 	// Disable sounds, etc, during prediction
 	predicting = true;
@@ -287,44 +356,63 @@ void CL_PredictWorld(void)
 	PlayerSnapshot prevsnap(p->tic, p);
 	cl_savedsnaps[gametic % MAXSAVETICS] = prevsnap;
 
-	// Move sectors to the last position received from the server
-	if (cl_predictsectors)
-		CL_ResetSectors();
-
-	// Move the client to the last position received from the sever
 	int snaptime = p->snapshots.getMostRecentTime();
 	PlayerSnapshot snap = p->snapshots.getSnapshot(snaptime);
-	snap.toPlayer(p);
 
-	while (++predtic < gametic)
+	if (CL_PredictionDiverged(p, prevsnap, snap, snaptime))
 	{
+		// Move sectors to the last position received from the server
 		if (cl_predictsectors)
-			CL_PredictSectors(predtic);
-		CL_PredictLocalPlayer(predtic);  
-	}
+			CL_ResetSectors(true);
 
-	// If the player didn't just spawn or teleport, nudge the player from
-	// his position last tic to this new corrected position.  This smooths the
-	// view when there's a misprediction.
-	if (snap.isContinuous())
-	{
-		PlayerSnapshot correctedprevsnap(p->tic, p);
+		// Move the client to the last position received from the sever
+		snap.toPlayer(p);
 
-		// Did we predict correctly?
-		bool correct = (correctedprevsnap.getX() == prevsnap.getX()) &&
-					   (correctedprevsnap.getY() == prevsnap.getY()) &&
-					   (correctedprevsnap.getZ() == prevsnap.getZ());
+		while (++predtic < gametic)
+		{
+			if (cl_predictsectors)
+				CL_PredictSectors(predtic);
+			CL_PredictLocalPlayer(predtic);
 
-		if (!correct)
+			cl_predictedsnaps[predtic % MAXSAVETICS] = PlayerSnapshot(predtic, p);
+		}
+
+		cl_replaynext = false;
+
+		// If the player didn't just spawn or teleport, nudge the player from
+		// his position last tic to this new corrected position.  This smooths the
+		// view when there's a misprediction.
+		if (snap.isContinuous())
 		{
-			// Update the netgraph concerning our prediction's error
-			netgraph.setMisprediction(true);
+			PlayerSnapshot correctedprevsnap(p->tic, p);
+
+			// Did we predict correctly?
+			bool correct = (correctedprevsnap.getX() == prevsnap.getX()) &&
+						   (correctedprevsnap.getY() == prevsnap.getY()) &&
+						   (correctedprevsnap.getZ() == prevsnap.getZ());
 
-			// Lerp from the our previous position to the correct position
-			PlayerSnapshot lerpedsnap = P_LerpPlayerPosition(prevsnap, correctedprevsnap, cl_prednudge);	
-			lerpedsnap.toPlayer(p);
+			if (!correct)
+			{
+				// Update the netgraph concerning our prediction's error
+				netgraph.setMisprediction(true);
+
+				// Lerp from the our previous position to the correct position
+				PlayerSnapshot lerpedsnap = P_LerpPlayerPosition(prevsnap, correctedprevsnap, cl_prednudge);	
+				lerpedsnap.toPlayer(p);
+
+				// The nudged position is not one we predicted, so keep
+				// replaying until it has caught up with the prediction
+				cl_replaynext = true;
+			}
 		}
 	}
+	else if (cl_predictsectors)
+	{
+		// Still clean up the sectors that have finished moving
+		CL_ResetSectors(false);
+	}
+
+	cl_checkedsnaptime = snaptime;
 
 	predicting = false;
 
@@ -332,7 +420,116 @@ void CL_PredictWorld(void)
 	if (cl_predictsectors)
 		CL_PredictSectors(gametic);		
 	CL_PredictLocalPlayer(gametic);
+
+	cl_predictedsnaps[gametic % MAXSAVETICS] = PlayerSnapshot(gametic, p);
+}
+
+//
+// CL_PredictionBench
+//
+// Runs CL_PredictWorld for the given number of tics while the server confirms
+// each tic lag tics after it was predicted, with the position that was
+// predicted for it.  If replay is true, every tic is replayed from the last
+// confirmed position.  Returns the time spent in CL_PredictWorld in ms.
+//
+static double CL_PredictionBench(int tics, int lag, bool replay)
+{
+	player_t *p = &consoleplayer();
+
+	int oldgametic = gametic;
+	int oldtic = p->tic;
+	PlayerSnapshot oldsnap(gametic, p);
+	angle_t oldangle = p->mo->angle;
+
+	NetCommand oldcmds[MAXSAVETICS];
+	for (int i = 0; i < MAXSAVETICS; i++)
+		oldcmds[i] = localcmds[i];
+
+	PlayerSnapshot startsnap(gametic, p);
+	startsnap.setAuthoritative(true);
+	startsnap.setContinuous(true);
+	p->snapshots.clearSnapshots();
+	p->snapshots.addSnapshot(startsnap);
+	p->tic = gametic;
+	cl_replaynext = true;
+
+	dtime_t elapsed = 0;
+
+	for (int i = 0; i < tics; i++)
+	{
+		gametic++;
+
+		// Run forward while turning, so the player keeps moving in a circle
+		NetCommand *netcmd = &localcmds[gametic % MAXSAVETICS];
+		netcmd->clear();
+		netcmd->setTic(gametic);
+		netcmd->setAngle(oldangle + i * (ANG45 / 16));
+		netcmd->setForwardMove(forwardmove[1] << 8);
+
+		// The server confirms what was predicted for the tic sent lag tics ago
+		int confirmed = gametic - lag;
+		if (confirmed > p->tic && cl_predictedsnaps[confirmed % MAXSAVETICS].getTime() == confirmed)
+		{
+			PlayerSnapshot snap = cl_predictedsnaps[confirmed % MAXSAVETICS];
+			snap.setAuthoritative(true);
+			snap.setContinuous(true);
+			p->snapshots.addSnapshot(snap);
+			p->tic = confirmed;
+		}
+
+		if (replay)
+			cl_replaynext = true;
+
+		dtime_t start = I_GetTime();
+		CL_PredictWorld();
+		elapsed += I_GetTime() - start;
+	}
+
+	gametic = oldgametic;
+	for (int i = 0; i < MAXSAVETICS; i++)
+		localcmds[i] = oldcmds[i];
+
+	oldsnap.toPlayer(p);
+	p->mo->angle = oldangle;
+	p->tic = oldtic;
+	p->snapshots.clearSnapshots();
+	cl_replaynext = true;
+
+	return double(elapsed) / I_ConvertTimeFromMs(1);
+}
+
+//
+// predbench
+//
+// Times client-side prediction at a given round trip time, once replaying
+// every unconfirmed tic each tic and once carrying on from the checkpoints.
+//
+BEGIN_COMMAND (predbench)
+{
+	player_t *p = &consoleplayer();
+
+	if (gamestate != GS_LEVEL || !connected || !validplayer(*p) || !p->mo ||
+		p->spectator || p->tic <= 0)
+	{
+		Printf(PRINT_HIGH, "predbench: must be playing in a level on a server\n");
+		return;
+	}
+
+	int tics = argc > 1 ? MAX(atoi(argv[1]), 1) : 1000;
+	int rtt = argc > 2 ? MAX(atoi(argv[2]), 0) : 250;
+	int lag = MIN((rtt * TICRATE + 999) / 1000, MAXSAVETICS - 1);
+
+	double replayms = CL_PredictionBench(tics, lag, true);
+	double checkpointms = CL_PredictionBench(tics, lag, false);
+
+	Printf(PRINT_HIGH, "predbench: %d tics at %d ms (%d tics unconfirmed)\n",
+			tics, rtt, lag);
+	Printf(PRINT_HIGH, "predbench: replaying every tic %.1f ms (%.2f us/tic), "
+			"from checkpoints %.1f ms (%.2f us/tic)\n",
+			replayms, replayms * 1000.0 / tics,
+			checkpointms, checkpointms * 1000.0 / tics);
 }
+END_COMMAND (predbench)
 
 
 VERSION_CONTROL (cl_pred_cpp, "$Id$")
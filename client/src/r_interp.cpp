@@ -30,37 +30,48 @@
 
 #include <vector>
 
-typedef std::pair<fixed_t, unsigned int> fixed_uint_pair;
+//
+// Sectors are added to the interpolation set by P_ChangeFloorHeight and
+// P_ChangeCeilingHeight the first time they move during a gametic, which
+// records the height they had before moving. The set is emptied at the start
+// of every gametic, so the per-frame cost only depends on how many sectors
+// are actually moving rather than on the size of the map.
+//
+struct InterpolatedSector
+{
+	int			secnum;
+	bool		ceiling;
+	bool		floor;
+	fixed_t		prev_ceilingheight;
+	fixed_t		prev_floorheight;
+	fixed_t		saved_ceilingheight;
+	fixed_t		saved_floorheight;
+};
 
-static std::vector<fixed_uint_pair> prev_ceilingheight;
-static std::vector<fixed_uint_pair> saved_ceilingheight;
-static std::vector<fixed_uint_pair> prev_floorheight;
-static std::vector<fixed_uint_pair> saved_floorheight;
+static std::vector<InterpolatedSector> interp_sectors;
+static size_t num_interp_sectors;
+
+// index of each sector in interp_sectors or -1 if it is not moving
+static std::vector<int> interp_sector_index;
+
+// set while the renderer is moving planes so they are not marked as moving
+static bool applying_interpolation;
 
 extern NetDemo netdemo;
 
 //
 // R_InterpolationTicker
 //
-// Records the current height of all moving planes and position of scrolling
-// textures, which will be used as the previous position during iterpolation.
-// This should be called once per gametic.
+// Empties the set of moving sectors. Sectors that move during the coming
+// gametic will add themselves back with their current height, which will be
+// used as the previous height during interpolation. This should be called
+// once per gametic.
 //
 void R_InterpolationTicker()
 {
-	prev_ceilingheight.clear();
-	prev_floorheight.clear();
-
-	if (gamestate == GS_LEVEL)
-	{
-		for (int i = 0; i < numsectors; i++)
-		{
-			if (sectors[i].ceilingdata)
-				prev_ceilingheight.push_back(std::make_pair(P_CeilingHeight(&sectors[i]), i));
-			if (sectors[i].floordata)
-				prev_floorheight.push_back(std::make_pair(P_FloorHeight(&sectors[i]), i));
-		}
-	}
+	for (size_t i = 0; i < num_interp_sectors; i++)
+		interp_sector_index[interp_sectors[i].secnum] = -1;
+	num_interp_sectors = 0;
 }
 
 
@@ -72,10 +83,10 @@ void R_InterpolationTicker()
 //
 void R_ResetInterpolation()
 {
-	prev_ceilingheight.clear();
-	prev_floorheight.clear();
-	saved_ceilingheight.clear();
-	saved_floorheight.clear();
+	interp_sectors.resize(numsectors);
+	interp_sector_index.assign(numsectors, -1);
+	num_interp_sectors = 0;
+
 	::localview.angle = 0;
 	::localview.setangle = false;
 	::localview.skipangle = false;
@@ -85,6 +96,52 @@ void R_ResetInterpolation()
 }
 
 
+//
+// R_InterpolateSectorMoved
+//
+// Called by P_ChangeCeilingHeight and P_ChangeFloorHeight before the height
+// of the sector's plane is changed.
+//
+void R_InterpolateSectorMoved(sector_t* sector, bool ceiling)
+{
+	if (applying_interpolation || gamestate != GS_LEVEL)
+		return;
+
+	if (sector < sectors || sector >= sectors + numsectors)
+		return;
+
+	// the map was loaded without resetting the interpolation data
+	if (interp_sector_index.size() != (size_t)numsectors)
+		R_ResetInterpolation();
+
+	int secnum = sector - sectors;
+	int index = interp_sector_index[secnum];
+
+	if (index < 0)
+	{
+		index = interp_sector_index[secnum] = num_interp_sectors++;
+
+		InterpolatedSector& interp = interp_sectors[index];
+		interp.secnum = secnum;
+		interp.ceiling = false;
+		interp.floor = false;
+	}
+
+	InterpolatedSector& interp = interp_sectors[index];
+
+	if (ceiling && !interp.ceiling)
+	{
+		interp.ceiling = true;
+		interp.prev_ceilingheight = P_CeilingHeight(sector);
+	}
+	else if (!ceiling && !interp.floor)
+	{
+		interp.floor = true;
+		interp.prev_floorheight = P_FloorHeight(sector);
+	}
+}
+
+
 //
 // R_BeginInterpolation
 //
@@ -95,41 +152,34 @@ void R_ResetInterpolation()
 //
 void R_BeginInterpolation(fixed_t amount)
 {
-	saved_ceilingheight.clear();
-	saved_floorheight.clear();
+	if (gamestate != GS_LEVEL)
+		return;
 
-	if (gamestate == GS_LEVEL)
+	applying_interpolation = true;
+
+	for (size_t i = 0; i < num_interp_sectors; i++)
 	{
-		for (std::vector<fixed_uint_pair>::const_iterator ceiling_it = prev_ceilingheight.begin();
-			 ceiling_it != prev_ceilingheight.end(); ++ceiling_it)
-		{
-			unsigned int secnum = ceiling_it->second;
-			sector_t* sector = &sectors[secnum];
+		InterpolatedSector& interp = interp_sectors[i];
+		sector_t* sector = &sectors[interp.secnum];
 
-			fixed_t old_value = ceiling_it->first;
-			fixed_t cur_value = P_CeilingHeight(sector);
+		if (interp.ceiling)
+		{
+			fixed_t old_value = interp.prev_ceilingheight;
+			fixed_t cur_value = interp.saved_ceilingheight = P_CeilingHeight(sector);
 
-			saved_ceilingheight.push_back(std::make_pair(cur_value, secnum));
-			
-			fixed_t new_value = old_value + FixedMul(cur_value - old_value, amount);
-			P_SetCeilingHeight(sector, new_value);
+			P_SetCeilingHeight(sector, old_value + FixedMul(cur_value - old_value, amount));
 		}
 
-		for (std::vector<fixed_uint_pair>::const_iterator floor_it = prev_floorheight.begin();
-			 floor_it != prev_floorheight.end(); ++floor_it)
+		if (interp.floor)
 		{
-			unsigned int secnum = floor_it->second;
-			sector_t* sector = &sectors[secnum];
-
-			fixed_t old_value = floor_it->first;
-			fixed_t cur_value = P_FloorHeight(sector);
+			fixed_t old_value = interp.prev_floorheight;
+			fixed_t cur_value = interp.saved_floorheight = P_FloorHeight(sector);
 
-			saved_floorheight.push_back(std::make_pair(cur_value, secnum));
-			
-			fixed_t new_value = old_value + FixedMul(cur_value - old_value, amount);
-			P_SetFloorHeight(sector, new_value);
+			P_SetFloorHeight(sector, old_value + FixedMul(cur_value - old_value, amount));
 		}
 	}
+
+	applying_interpolation = false;
 }
 
 //
@@ -140,22 +190,23 @@ void R_BeginInterpolation(fixed_t amount)
 //
 void R_EndInterpolation()
 {
-	if (gamestate == GS_LEVEL)
+	if (gamestate != GS_LEVEL)
+		return;
+
+	applying_interpolation = true;
+
+	for (size_t i = 0; i < num_interp_sectors; i++)
 	{
-		for (std::vector<fixed_uint_pair>::const_iterator ceiling_it = saved_ceilingheight.begin();
-			 ceiling_it != saved_ceilingheight.end(); ++ceiling_it)
-		{
-			sector_t* sector = &sectors[ceiling_it->second];
-			P_SetCeilingHeight(sector, ceiling_it->first);
-		}
+		const InterpolatedSector& interp = interp_sectors[i];
+		sector_t* sector = &sectors[interp.secnum];
 
-		for (std::vector<fixed_uint_pair>::const_iterator floor_it = saved_floorheight.begin();
-			 floor_it != saved_floorheight.end(); ++floor_it)
-		{
-			sector_t* sector = &sectors[floor_it->second];
-			P_SetFloorHeight(sector, floor_it->first);
-		}
+		if (interp.ceiling)
+			P_SetCeilingHeight(sector, interp.saved_ceilingheight);
+		if (interp.floor)
+			P_SetFloorHeight(sector, interp.saved_floorheight);
 	}
+
+	applying_interpolation = false;
 }
 
 //
@@ -46,7 +46,6 @@ void R_InterpolateCamera(fixed_t amount);
 #define DISTMAP			2
 
 int negonearray[MAXWIDTH];
-int viewheightarray[MAXWIDTH];
 
 void R_SpanInitData ();
 
@@ -1245,7 +1244,6 @@ static void R_InitViewWindow()
 	for (int i = 0; i < surface_width; i++)
 	{
 		negonearray[i] = -1;
-		viewheightarray[i] = (int)viewheight;
 	}
 
 	R_InitLightTables(surface_width, surface_height);
@@ -48,6 +48,8 @@
 #include "v_video.h"
 
 #include "m_vectors.h"
+#include "m_mempool.h"
+#include "c_dispatch.h"
 
 planefunction_t 		floorfunc;
 planefunction_t 		ceilingfunc;
@@ -62,6 +64,23 @@ static visplane_t		*visplanes[MAXVISPLANES];	// killough
 static visplane_t		*freetail;					// killough
 static visplane_t		**freehead = &freetail;		// killough
 
+// The top and bottom column arrays of every visplane are carved out of
+// this arena, which is reset at the start of each frame. Only the columns
+// that a visplane actually covers are ever initialized.
+static Pool<unsigned int> planecolumns(4 * 2 * (MAXWIDTH + 2));
+
+// Per-frame visplane statistics, reported by the r_planestats command.
+struct planestats_t
+{
+	int planes;			// visplanes created this frame
+	int merged;			// column ranges merged into an existing visplane
+	int splits;			// visplanes split due to overlapping columns
+	int columns;		// columns initialized by R_CheckPlane
+	int drawn;			// visplanes drawn by R_DrawPlanes
+};
+
+static planestats_t planestats, lastplanestats;
+
 visplane_t 				*floorplane;
 visplane_t 				*ceilingplane;
 visplane_t				*skyplane;
@@ -261,30 +280,102 @@ void R_ClearPlanes (void)
 	for (int i = 0; i < MAXVISPLANES; i++)	// new code -- killough
 		for (*freehead = visplanes[i], visplanes[i] = NULL; *freehead; )
 			freehead = &(*freehead)->next;
+
+	planecolumns.clear();
+
+	lastplanestats = planestats;
+	memset(&planestats, 0, sizeof(planestats));
 }
 
 //
 // New function, by Lee Killough
-// [RH] top and bottom buffers get allocated immediately
-//		after the visplane.
+// Top and bottom buffers are allocated from the per-frame arena and
+// have an extra column on each side for the sentinels used by R_MakeSpans.
 //
 static visplane_t *new_visplane(unsigned hash)
 {
 	visplane_t *check = freetail;
 
 	if (!check)
-	{
-		check = (visplane_t *)Calloc(1, sizeof(*check) + sizeof(*check->top)*2*I_GetSurfaceWidth());
-		check->bottom = &check->top[I_GetSurfaceWidth() + 2];
-	}
+		check = (visplane_t *)Calloc(1, sizeof(*check));
 	else
 		if (!(freetail = freetail->next))
 			freehead = &freetail;
+
+	unsigned int* columns = planecolumns.alloc(2 * (viewwidth + 2));
+	check->top = columns + 1;
+	check->bottom = columns + viewwidth + 3;
+
 	check->next = visplanes[hash];
 	visplanes[hash] = check;
+
+	planestats.planes++;
 	return check;
 }
 
+//
+// R_PlanesMatch
+//
+// Returns true if the two visplanes can be drawn with the same parameters.
+//
+static inline bool R_PlanesMatch(const visplane_t* a, const visplane_t* b)
+{
+	return P_IdenticalPlanes(&a->secplane, &b->secplane) &&
+		a->picnum == b->picnum &&
+		a->lightlevel == b->lightlevel &&
+		a->xoffs == b->xoffs &&
+		a->yoffs == b->yoffs &&
+		a->colormap == b->colormap &&
+		a->xscale == b->xscale &&
+		a->yscale == b->yscale &&
+		a->angle == b->angle;
+}
+
+//
+// R_PlaneColumnsFree
+//
+// Returns true if none of the columns in the range [start, stop] have been
+// marked in the visplane.
+//
+static inline bool R_PlaneColumnsFree(const visplane_t* pl, int start, int stop)
+{
+	const int intrl = MAX(start, pl->minx);
+	const int intrh = MIN(stop, pl->maxx);
+
+	for (int x = intrl; x <= intrh; x++)
+		if (pl->top[x] != (unsigned int)viewheight)
+			return false;
+	return true;
+}
+
+//
+// R_ExtendPlane
+//
+// Grows the visplane's column range to include [start, stop], initializing
+// only the columns that were not previously covered by the visplane.
+//
+static void R_ExtendPlane(visplane_t* pl, int start, int stop)
+{
+	if (pl->minx > pl->maxx)
+	{
+		for (int x = start; x <= stop; x++)
+			pl->top[x] = viewheight;
+		planestats.columns += stop - start + 1;
+		pl->minx = start;
+		pl->maxx = stop;
+		return;
+	}
+
+	for (int x = start; x < pl->minx; x++)
+		pl->top[x] = viewheight;
+	for (int x = pl->maxx + 1; x <= stop; x++)
+		pl->top[x] = viewheight;
+
+	planestats.columns += MAX(pl->minx - start, 0) + MAX(stop - pl->maxx, 0);
+	pl->minx = MIN(pl->minx, start);
+	pl->maxx = MAX(pl->maxx, stop);
+}
+
 
 //
 // R_FindPlane
@@ -331,73 +422,56 @@ visplane_t *R_FindPlane (plane_t secplane, int picnum, int lightlevel,
 	check->minx = viewwidth;			// Was SCREENWIDTH -- killough 11/98
 	check->maxx = -1;
 
-	memcpy(check->top, viewheightarray, viewwidth * sizeof(*check->top));
-
+	// Columns are initialized lazily by R_CheckPlane
 	return check;
 }
 
 //
 // R_CheckPlane
 //
+// If any of the columns in [start, stop] are already marked in pl,
+// try the most recently created visplane with identical parameters before
+// resorting to making a new visplane. Only that one candidate is checked so
+// the cost stays bounded when many planes share the same parameters.
+//
 visplane_t* R_CheckPlane(visplane_t* pl, int start, int stop)
 {
-    int		intrl;
-    int		intrh;
-    int		unionl;
-    int		unionh;
-    int		x;
-
-	if (start < pl->minx)
+	if (!R_PlaneColumnsFree(pl, start, stop))
 	{
-		intrl = pl->minx;
-		unionl = start;
-	}
-	else
-	{
-		unionl = pl->minx;
-		intrl = start;
-	}
-
-	if (stop > pl->maxx)
-	{
-		intrh = pl->maxx;
-		unionh = stop;
-	}
-	else
-	{
-		unionh = pl->maxx;
-		intrh = stop;
-	}
+		unsigned hash = visplane_hash (pl->picnum, pl->lightlevel, pl->secplane);
 
-	for (x = intrl ; x <= intrh && pl->top[x] == (unsigned int)viewheight; x++)
-		;
+		visplane_t* check;
+		for (check = visplanes[hash]; check; check = check->next)
+			if (check != pl && R_PlanesMatch(check, pl))
+				break;
 
-	if (x > intrh)
-	{
-		// use the same visplane
-		pl->minx = unionl;
-		pl->maxx = unionh;
-	}
-	else
-	{
-		// make a new visplane
-		unsigned hash = visplane_hash (pl->picnum, pl->lightlevel, pl->secplane);
-		visplane_t *new_pl = new_visplane (hash);
-
-		new_pl->secplane = pl->secplane;
-		new_pl->picnum = pl->picnum;
-		new_pl->lightlevel = pl->lightlevel;
-		new_pl->xoffs = pl->xoffs;			// killough 2/28/98
-		new_pl->yoffs = pl->yoffs;
-		new_pl->xscale = pl->xscale;
-		new_pl->yscale = pl->yscale;
-		new_pl->angle = pl->angle;
-		new_pl->colormap = pl->colormap;	// [RH] Copy colormap
-		pl = new_pl;
-		pl->minx = start;
-		pl->maxx = stop;
-		memcpy(pl->top, viewheightarray, viewwidth * sizeof(*pl->top));
+		if (check && R_PlaneColumnsFree(check, start, stop))
+		{
+			planestats.merged++;
+			pl = check;
+		}
+		else
+		{
+			// make a new visplane
+			visplane_t *new_pl = new_visplane (hash);
+			planestats.splits++;
+
+			new_pl->secplane = pl->secplane;
+			new_pl->picnum = pl->picnum;
+			new_pl->lightlevel = pl->lightlevel;
+			new_pl->xoffs = pl->xoffs;			// killough 2/28/98
+			new_pl->yoffs = pl->yoffs;
+			new_pl->xscale = pl->xscale;
+			new_pl->yscale = pl->yscale;
+			new_pl->angle = pl->angle;
+			new_pl->colormap = pl->colormap;	// [RH] Copy colormap
+			new_pl->minx = viewwidth;
+			new_pl->maxx = -1;
+			pl = new_pl;
+		}
 	}
+
+	R_ExtendPlane(pl, start, stop);
 	return pl;
 }
 
@@ -603,6 +677,8 @@ void R_DrawPlanes (void)
 			if (pl->minx > pl->maxx)
 				continue;
 
+			planestats.drawn++;
+
 			// sky flat
 			if (pl->picnum == skyflatnum || pl->picnum & PL_SKYFLAT)
 			{
@@ -673,6 +749,14 @@ void R_DrawPlanes (void)
 	}
 }
 
+BEGIN_COMMAND(r_planestats)
+{
+	Printf(PRINT_HIGH, "visplanes: %d (%d drawn), %d merged, %d split, %d columns\n",
+			lastplanestats.planes, lastplanestats.drawn, lastplanestats.merged,
+			lastplanestats.splits, lastplanestats.columns);
+}
+END_COMMAND(r_planestats)
+
 //
 // R_PlaneInitData
 //
@@ -758,13 +842,13 @@ BOOL R_AlignFlat (int linenum, int side, int fc)
 	{
 		sec->base_ceiling_angle = 0-angle;
 		sec->base_ceiling_yoffs = dist & ((1<<(FRACBITS+8))-1);
-		sec->SectorChanges |= SPC_AlignBase;
+		P_SectorChanged(sec, SPC_AlignBase);
 	}
 	else
 	{
 		sec->base_floor_angle = 0-angle;
 		sec->base_floor_yoffs = dist & ((1<<(FRACBITS+8))-1);
-		sec->SectorChanges |= SPC_AlignBase;
+		P_SectorChanged(sec, SPC_AlignBase);
 	}
 
 	return true;
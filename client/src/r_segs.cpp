@@ -635,7 +635,7 @@ void R_RenderMaskedSegRange(drawseg_t* ds, int x1, int x2)
 
 	// draw the columns
 	// TODO: change negonearray to the actual top/bottom
-	R_RenderColumnRange(x1, x2, negonearray, viewheightarray, ds->midposts,
+	R_RenderColumnRange(x1, x2, negonearray, floorclipinitial, ds->midposts,
 			MaskedColumnBlaster, true, 0);
 }
 
@@ -843,7 +843,7 @@ void R_StoreWallRange(int start, int stop)
 		rw_midtexturemid += sidedef->rowoffset;
 
 		ds_p->silhouette = SIL_BOTH;
-		ds_p->sprtopclip = viewheightarray;
+		ds_p->sprtopclip = floorclipinitial;
 		ds_p->sprbottomclip = negonearray;
 	}
 	else
@@ -857,7 +857,7 @@ void R_StoreWallRange(int start, int stop)
 		{
 			// clip all sprites behind this closed door (or otherwise solid line)
 			ds_p->silhouette = SIL_BOTH;
-			ds_p->sprtopclip = viewheightarray;
+			ds_p->sprtopclip = floorclipinitial;
 			ds_p->sprbottomclip = negonearray;
 		}
 		else
@@ -38,12 +38,15 @@
 
 #include "doomstat.h"
 
+#include "i_video.h"
 #include "v_video.h"
 
 #include "cmdlib.h"
 #include "s_sound.h"
 
 #include "m_vectors.h"
+#include "m_mempool.h"
+#include "c_dispatch.h"
 
 extern fixed_t FocalLengthX, FocalLengthY;
 
@@ -509,7 +512,7 @@ void R_DrawVisSprite (vissprite_t *vis, int x1, int x2)
 	}
 
 	// TODO: change from negonearray to actual top of sprite
-	R_RenderColumnRange(vis->x1, vis->x2, negonearray, viewheightarray,
+	R_RenderColumnRange(vis->x1, vis->x2, negonearray, floorclipinitial,
 			spriteposts, SpriteColumnBlaster, false, 0);
 
 	R_ResetDrawFuncs();
@@ -1043,7 +1046,7 @@ void R_DrawPlayerSprites (void)
 		spritelights = scalelight[lightnum];
 
 	// clip to screen bounds
-	mfloorclip = viewheightarray;
+	mfloorclip = floorclipinitial;
 	mceilingclip = negonearray;
 
 	{
@@ -1078,37 +1081,204 @@ void R_DrawPlayerSprites (void)
 //		more vissprites that need to be sorted, the better the performance
 //		gain compared to the old function.
 //
+// qsort() has since been replaced by an LSD radix sort on the fixed-point depth,
+//		using gzt (descending) as the tie breaker. The sort buffers come
+//		from a per-frame arena so large sprite counts do not reallocate.
+//
 
 static int				vsprcount;
 static vissprite_t**	spritesorter;
-static int				spritesorter_size = 0;
 
-static int STACK_ARGS sv_compare(const void *arg1, const void *arg2)
+static Pool<vissprite_t*> spritesort_pool(2 * 1024);
+
+// Per-frame sprite statistics, reported by the r_spritestats command.
+static int				lastvsprcount;
+static int				lastdrawsegbins;
+static int				lastspritesegchecks;
+static int				spritesegchecks;
+
+// Totals accumulated by R_DrawMasked while r_spritebench is running.
+static bool				spritebench;
+static dtime_t			spritebenchtime;
+static int				spritebenchsprites;
+static int				spritebenchdrawsegs;
+static int				spritebenchchecks;
+
+//
+// R_RadixSortSprites
+//
+// Stable sort of count vissprites in src by the unsigned 32-bit key
+// returned by keyfunc, one byte at a time. Passes in which every key
+// shares the same byte are skipped. Returns the buffer holding the
+// sorted result, which is either src or tmp.
+//
+template <typename KeyFunc>
+static vissprite_t** R_RadixSortSprites(vissprite_t** src, vissprite_t** tmp,
+										int count, KeyFunc keyfunc)
+{
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		int buckets[256] = { 0 };
+
+		for (int i = 0; i < count; i++)
+			buckets[(keyfunc(src[i]) >> shift) & 0xFF]++;
+
+		if (buckets[(keyfunc(src[0]) >> shift) & 0xFF] == count)
+			continue;
+
+		int offset = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			int n = buckets[b];
+			buckets[b] = offset;
+			offset += n;
+		}
+
+		for (int i = 0; i < count; i++)
+			tmp[buckets[(keyfunc(src[i]) >> shift) & 0xFF]++] = src[i];
+
+		std::swap(src, tmp);
+	}
+
+	return src;
+}
+
+// Convert signed fixed_t values into unsigned keys that sort in the same order.
+static inline uint32_t R_SpriteDepthKey(const vissprite_t* vis)
 {
-	int diff = (*(vissprite_t **)arg1)->depth - (*(vissprite_t **)arg2)->depth;
-	if (diff == 0)
-		return (*(vissprite_t **)arg2)->gzt - (*(vissprite_t **)arg1)->gzt;
-	return diff;
+	return (uint32_t)vis->depth ^ 0x80000000u;
+}
+
+static inline uint32_t R_SpriteHeightKey(const vissprite_t* vis)
+{
+	return ~((uint32_t)vis->gzt ^ 0x80000000u);
 }
 
 void R_SortVisSprites (void)
 {
 	vsprcount = vissprite_p - vissprites;
+	lastvsprcount = vsprcount;
 
 	if (!vsprcount)
 		return;
 
-	if (spritesorter_size < MaxVisSprites)
+	spritesort_pool.clear();
+	vissprite_t** buf = spritesort_pool.alloc(2 * vsprcount);
+
+	for (int i = 0; i < vsprcount; i++)
+		buf[i] = vissprites + i;
+
+	// sort by the tie-breaker first since each pass is stable
+	spritesorter = R_RadixSortSprites(buf, buf + vsprcount, vsprcount, R_SpriteHeightKey);
+	vissprite_t** tmp = (spritesorter == buf) ? buf + vsprcount : buf;
+	spritesorter = R_RadixSortSprites(spritesorter, tmp, vsprcount, R_SpriteDepthKey);
+}
+
+
+//
+// Drawseg column bins
+//
+// Each drawseg that can clip a sprite is added to every bin of
+// DRAWSEGBINWIDTH screen columns that it covers, in the order the drawsegs
+// were generated. R_DrawSprite then only needs to look at the drawsegs in
+// the bins its column range touches instead of every drawseg in the frame.
+//
+
+static const int DRAWSEGBINSHIFT = 5;
+static const int DRAWSEGBINWIDTH = 1 << DRAWSEGBINSHIFT;
+static const int MAXDRAWSEGBINS = (MAXWIDTH >> DRAWSEGBINSHIFT) + 1;
+
+// Sprites spanning more bins than this scan the full drawseg list instead.
+static const int MAXSPRITEBINSPAN = 8;
+
+static Pool<int> drawsegbin_pool(4096);
+static int*		drawsegbins[MAXDRAWSEGBINS];
+static int		drawsegbincount[MAXDRAWSEGBINS];
+
+static inline bool R_DrawSegClipsSprites(const drawseg_t* ds)
+{
+	return (ds->silhouette & SIL_BOTH) || ds->midposts;
+}
+
+static void R_BinDrawSegs()
+{
+	const int numbins = ((viewwidth - 1) >> DRAWSEGBINSHIFT) + 1;
+
+	drawsegbin_pool.clear();
+	memset(drawsegbincount, 0, numbins * sizeof(*drawsegbincount));
+
+	for (const drawseg_t* ds = drawsegs; ds < ds_p; ds++)
 	{
-		delete [] spritesorter;
-		spritesorter = new vissprite_t*[MaxVisSprites];
-		spritesorter_size = MaxVisSprites;
+		if (!R_DrawSegClipsSprites(ds) || ds->x1 > ds->x2)
+			continue;
+		for (int b = ds->x1 >> DRAWSEGBINSHIFT; b <= ds->x2 >> DRAWSEGBINSHIFT; b++)
+			drawsegbincount[b]++;
 	}
 
-	for (int i = 0; i < vsprcount; i++)
-		spritesorter[i] = vissprites + i;
+	for (int b = 0; b < numbins; b++)
+	{
+		drawsegbins[b] = drawsegbin_pool.alloc(drawsegbincount[b]);
+		drawsegbincount[b] = 0;
+	}
+
+	for (const drawseg_t* ds = drawsegs; ds < ds_p; ds++)
+	{
+		if (!R_DrawSegClipsSprites(ds) || ds->x1 > ds->x2)
+			continue;
+		int index = ds - drawsegs;
+		for (int b = ds->x1 >> DRAWSEGBINSHIFT; b <= ds->x2 >> DRAWSEGBINSHIFT; b++)
+			drawsegbins[b][drawsegbincount[b]++] = index;
+	}
+
+	lastdrawsegbins = numbins;
+}
+
+
+//
+// R_ClipSpriteToDrawSeg
+//
+// Clips the sprite against a single drawseg, rendering the drawseg's masked
+// mid texture first if the drawseg is behind the sprite.
+//
+static void R_ClipSpriteToDrawSeg(const vissprite_t* spr, drawseg_t* ds,
+								  int* cliptop, int* clipbot)
+{
+	spritesegchecks++;
+
+	// determine if the drawseg obscures the sprite
+	if (ds->x1 > spr->x2 || ds->x2 < spr->x1 || !R_DrawSegClipsSprites(ds))
+	{
+		// does not cover sprite
+		return;
+	}
+
+	int r1 = MAX<int>(ds->x1, spr->x1);
+	int r2 = MIN<int>(ds->x2, spr->x2);
 
-	qsort(spritesorter, vsprcount, sizeof(vissprite_t *), sv_compare);
+	fixed_t segscale1 = MAX<int>(ds->scale1, ds->scale2);
+	fixed_t segscale2 = MIN<int>(ds->scale1, ds->scale2);
+
+	// check if the seg is in front of the sprite
+	if (segscale1 < spr->yscale ||
+		(segscale2 < spr->yscale && !R_PointOnSegSide(spr->gx, spr->gy, ds->curline)))
+	{
+		// masked mid texture?
+		if (ds->midposts)
+			R_RenderMaskedSegRange(ds, r1, r2);
+		// seg is behind sprite
+		return;
+	}
+
+	// clip this piece of the sprite
+	// killough 3/27/98: optimized and made much shorter
+
+	for (int x = r1; x <= r2; x++)
+	{
+		if (ds->silhouette & SIL_BOTTOM && clipbot[x] > ds->sprbottomclip[x])
+			clipbot[x] = ds->sprbottomclip[x];
+		if (ds->silhouette & SIL_TOP && cliptop[x] < ds->sprtopclip[x])
+			cliptop[x] = ds->sprtopclip[x];
+	}
 }
 
 
@@ -1121,9 +1291,6 @@ void R_DrawSprite (vissprite_t *spr)
 	static int			clipbot[MAXWIDTH];
 
 	drawseg_t*			ds;
-	int 				x;
-	int 				r1, r2;
-	fixed_t 			segscale1, segscale2;
 
 	int					topclip = 0, botclip = viewheight;
 	int*				clip1;
@@ -1186,46 +1353,47 @@ void R_DrawSprite (vissprite_t *spr)
 	// Scan drawsegs from end to start for obscuring segs.
 	// The first drawseg that has a greater scale is the clip seg.
 
-	// Modified by Lee Killough:
-	// (pointer check was originally nonportable
-	// and buggy, by going past LEFT end of array):
+	const int bin1 = spr->x1 >> DRAWSEGBINSHIFT;
+	const int bin2 = spr->x2 >> DRAWSEGBINSHIFT;
 
-	for (ds = ds_p ; ds-- > drawsegs ; )  // new -- killough
+	if (bin2 - bin1 >= MAXSPRITEBINSPAN)
 	{
-		// determine if the drawseg obscures the sprite
-		if (ds->x1 > spr->x2 || ds->x2 < spr->x1 ||
-			(!(ds->silhouette & SIL_BOTH) && !ds->midposts) )
-		{
-			// does not cover sprite
-			continue;
-		}
+		// Modified by Lee Killough:
+		// (pointer check was originally nonportable
+		// and buggy, by going past LEFT end of array):
 
-		r1 = MAX<int>(ds->x1, spr->x1);
-		r2 = MIN<int>(ds->x2, spr->x2);
-
-		segscale1 = MAX<int>(ds->scale1, ds->scale2);
-		segscale2 = MIN<int>(ds->scale1, ds->scale2);
+		for (ds = ds_p ; ds-- > drawsegs ; )  // new -- killough
+			R_ClipSpriteToDrawSeg(spr, ds, cliptop, clipbot);
+	}
+	else
+	{
+		// Merge the bins covered by the sprite, visiting each drawseg
+		// once in the same back-to-front order as the full scan
+		int cursor[MAXSPRITEBINSPAN];
+		for (int b = bin1; b <= bin2; b++)
+			cursor[b - bin1] = drawsegbincount[b] - 1;
 
-		// check if the seg is in front of the sprite
-		if (segscale1 < spr->yscale ||
-			(segscale2 < spr->yscale && !R_PointOnSegSide(spr->gx, spr->gy, ds->curline)))
+		while (true)
 		{
-			// masked mid texture?
-			if (ds->midposts)
-				R_RenderMaskedSegRange(ds, r1, r2);
-			// seg is behind sprite
-			continue;
-		}
+			int index = -1;
+			for (int b = bin1; b <= bin2; b++)
+			{
+				int c = cursor[b - bin1];
+				if (c >= 0 && drawsegbins[b][c] > index)
+					index = drawsegbins[b][c];
+			}
 
-		// clip this piece of the sprite
-		// killough 3/27/98: optimized and made much shorter
+			if (index < 0)
+				break;
 
-		for (x = r1; x <= r2; x++)
-		{
-			if (ds->silhouette & SIL_BOTTOM && clipbot[x] > ds->sprbottomclip[x])
-				clipbot[x] = ds->sprbottomclip[x];
-			if (ds->silhouette & SIL_TOP && cliptop[x] < ds->sprtopclip[x])
-				cliptop[x] = ds->sprtopclip[x];
+			for (int b = bin1; b <= bin2; b++)
+			{
+				int c = cursor[b - bin1];
+				if (c >= 0 && drawsegbins[b][c] == index)
+					cursor[b - bin1]--;
+			}
+
+			R_ClipSpriteToDrawSeg(spr, drawsegs + index, cliptop, clipbot);
 		}
 	}
 
@@ -1251,11 +1419,27 @@ void R_DrawMasked (void)
 {
 	drawseg_t		 *ds;
 
+	dtime_t start = spritebench ? I_GetTime() : 0;
+
 	R_SortVisSprites ();
 
+	if (vsprcount > 0)
+		R_BinDrawSegs();
+
+	lastspritesegchecks = spritesegchecks;
+	spritesegchecks = 0;
+
 	while (vsprcount > 0)
 		R_DrawSprite(spritesorter[--vsprcount]);
 
+	if (spritebench)
+	{
+		spritebenchtime += I_GetTime() - start;
+		spritebenchsprites += lastvsprcount;
+		spritebenchdrawsegs += ds_p - drawsegs;
+		spritebenchchecks += spritesegchecks;
+	}
+
 	// render any remaining masked mid textures
 
 	// Modified by Lee Killough:
@@ -1272,6 +1456,66 @@ void R_DrawMasked (void)
 	R_DrawPlayerSprites();
 }
 
+BEGIN_COMMAND(r_spritestats)
+{
+	Printf(PRINT_HIGH, "vissprites: %d, drawseg bins: %d, drawseg checks: %d\n",
+			lastvsprcount, lastdrawsegbins, lastspritesegchecks);
+}
+END_COMMAND(r_spritestats)
+
+//
+// r_spritebench
+//
+// Renders the player's view for a number of frames while turning the
+// camera through a full circle. Reports the total frame time, the time
+// spent sorting, clipping and drawing vissprites, and the average sprite,
+// drawseg and drawseg-check counts per frame.
+//
+BEGIN_COMMAND(r_spritebench)
+{
+	if (gamestate != GS_LEVEL || !displayplayer().camera)
+	{
+		Printf(PRINT_HIGH, "r_spritebench: not in a level\n");
+		return;
+	}
+
+	int frames = argc > 1 ? MAX(atoi(argv[1]), 1) : 360;
+
+	AActor* mo = displayplayer().camera;
+	angle_t old_angle = mo->angle;
+	bool wasviewactive = viewactive;
+	viewactive = true;
+
+	spritebench = true;
+	spritebenchtime = 0;
+	spritebenchsprites = spritebenchdrawsegs = spritebenchchecks = 0;
+
+	dtime_t start = I_GetTime();
+
+	for (int i = 0; i < frames; i++)
+	{
+		mo->angle = old_angle + (angle_t)((double)i / frames * 4294967296.0);
+
+		I_BeginUpdate();
+		R_RenderPlayerView(&displayplayer());
+		I_FinishUpdate();
+	}
+
+	double ms = double(I_GetTime() - start) / I_ConvertTimeFromMs(1);
+	double spritems = double(spritebenchtime) / I_ConvertTimeFromMs(1);
+
+	spritebench = false;
+	mo->angle = old_angle;
+	viewactive = wasviewactive;
+
+	Printf(PRINT_HIGH, "r_spritebench: timed %d frames in %.1f ms, %.1f ms in sprites\n",
+			frames, ms, spritems);
+	Printf(PRINT_HIGH, "r_spritebench: %d vissprites, %d drawsegs, %d drawseg checks per frame\n",
+			spritebenchsprites / frames, spritebenchdrawsegs / frames,
+			spritebenchchecks / frames);
+}
+END_COMMAND(r_spritebench)
+
 void R_InitParticles (void)
 {
 	const char *i;
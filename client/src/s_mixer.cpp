@@ -0,0 +1,209 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Software mixer for sound effects.
+//
+//-----------------------------------------------------------------------------
+
+#include <string.h>
+
+#include "s_mixer.h"
+
+const int SoundMixer::MAX_CHANNELS;
+const int SoundMixer::UNITY_GAIN;
+const size_t SoundMixer::BLOCK_FRAMES;
+
+SoundMixer::SoundMixer() : mOutputRate(44100), mSSE2(false)
+{
+	memset(mChannels, 0, sizeof(mChannels));
+}
+
+void SoundMixer::setOutputRate(uint32_t rate)
+{
+	mOutputRate = rate ? rate : 1;
+}
+
+void SoundMixer::setSSE2(bool enable)
+{
+#ifdef __SSE2__
+	mSSE2 = enable;
+#else
+	mSSE2 = false;
+#endif
+}
+
+void SoundMixer::start(int channel, const mixsound_t* sound, bool loop)
+{
+	channel_t& chan = mChannels[channel];
+
+	if (sound == NULL || sound->length == 0 || sound->rate == 0)
+	{
+		chan.sound = NULL;
+		return;
+	}
+
+	chan.sound = sound;
+	chan.pos = 0;
+	chan.step = ((uint64_t)sound->rate << 32) / mOutputRate;
+	chan.loop = loop;
+}
+
+void SoundMixer::stop(int channel)
+{
+	mChannels[channel].sound = NULL;
+}
+
+void SoundMixer::stopAll()
+{
+	for (int i = 0; i < MAX_CHANNELS; i++)
+		mChannels[i].sound = NULL;
+}
+
+bool SoundMixer::isPlaying(int channel) const
+{
+	return mChannels[channel].sound != NULL;
+}
+
+void SoundMixer::setGains(int channel, int left, int right)
+{
+	mChannels[channel].left = clamp(left, 0, UNITY_GAIN);
+	mChannels[channel].right = clamp(right, 0, UNITY_GAIN);
+}
+
+void SoundMixer::mix(int16_t* out, size_t frames)
+{
+	while (frames > 0)
+	{
+		size_t block = MIN(frames, BLOCK_FRAMES);
+		mixBlock(out, block);
+		out += block * 2;
+		frames -= block;
+	}
+}
+
+void SoundMixer::mixBlock(int16_t* out, size_t frames)
+{
+	bool any = false;
+
+	for (int i = 0; i < MAX_CHANNELS; i++)
+	{
+		channel_t& chan = mChannels[i];
+		if (chan.sound == NULL)
+			continue;
+
+		if (!any)
+		{
+			memset(mAccum, 0, frames * 2 * sizeof(*mAccum));
+			any = true;
+		}
+
+		size_t mixed;
+#ifdef __SSE2__
+		if (mSSE2)
+			mixed = S_MixChannel_SSE2(chan, mAccum, frames);
+		else
+#endif
+			mixed = S_MixChannel_c(chan, mAccum, frames);
+
+		if (mixed < frames)
+			chan.sound = NULL;
+	}
+
+	if (!any)
+		return;
+
+#ifdef __SSE2__
+	if (mSSE2)
+	{
+		S_ClipAccum_SSE2(mAccum, out, frames);
+		return;
+	}
+#endif
+
+	for (size_t i = 0; i < frames * 2; i++)
+	{
+		int sample = clamp(mAccum[i] >> 8, -32768, 32767);
+		out[i] = clamp(out[i] + sample, -32768, 32767);
+	}
+}
+
+template<typename T>
+static inline int S_SampleAt(const T* data, uint32_t index);
+
+template<>
+inline int S_SampleAt<byte>(const byte* data, uint32_t index)
+{
+	return (data[index] - 128) << 8;
+}
+
+template<>
+inline int S_SampleAt<int16_t>(const int16_t* data, uint32_t index)
+{
+	return data[index];
+}
+
+//
+// S_MixSamples
+//
+// Interpolates between neighbouring samples with a 14-bit weight, the same
+// arithmetic the SSE2 loop does with _mm_madd_epi16.
+//
+template<typename T>
+static size_t S_MixSamples(SoundMixer::channel_t& chan, int32_t* accum, size_t frames)
+{
+	const T* data = static_cast<const T*>(chan.sound->data);
+	const uint32_t length = chan.sound->length;
+	const uint64_t end = (uint64_t)length << 32;
+
+	size_t i;
+	for (i = 0; i < frames; i++)
+	{
+		if (chan.pos >= end)
+		{
+			if (!chan.loop)
+				break;
+			chan.pos %= end;
+		}
+
+		uint32_t index = (uint32_t)(chan.pos >> 32);
+		uint32_t next = index + 1;
+		if (next >= length)
+			next = chan.loop ? 0 : index;
+
+		int weight = (int)((chan.pos >> 18) & 0x3FFF);
+		int sample = (S_SampleAt(data, index) * (0x4000 - weight) +
+		              S_SampleAt(data, next) * weight) >> 14;
+
+		accum[i * 2] += sample * chan.left;
+		accum[i * 2 + 1] += sample * chan.right;
+
+		chan.pos += chan.step;
+	}
+
+	return i;
+}
+
+size_t S_MixChannel_c(SoundMixer::channel_t& chan, int32_t* accum, size_t frames)
+{
+	if (chan.sound->bits == 16)
+		return S_MixSamples<int16_t>(chan, accum, frames);
+	else
+		return S_MixSamples<byte>(chan, accum, frames);
+}
+
+VERSION_CONTROL (s_mixer_cpp, "$Id$")
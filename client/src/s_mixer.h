@@ -0,0 +1,103 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Software mixer for sound effects.
+//
+//	Sounds stay in the format they were loaded in, mono 8 or 16 bit at
+//	their own sample rate, and are resampled with linear interpolation as
+//	they are mixed into the 16-bit stereo output.  Nothing here talks to the
+//	audio device, the backend in i_sound.cpp feeds the output to one and
+//	does the locking between the game and the thread that mixes.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __S_MIXER_H__
+#define __S_MIXER_H__
+
+#include "doomtype.h"
+
+// A sound as it is kept in memory
+struct mixsound_t
+{
+	const void*	data;		// unsigned 8-bit or signed 16-bit samples
+	uint32_t	length;		// in samples
+	uint32_t	rate;		// samples per second
+	byte		bits;		// 8 or 16
+};
+
+class SoundMixer
+{
+public:
+	static const int MAX_CHANNELS = 32;
+
+	// Gains are 0 to UNITY_GAIN
+	static const int UNITY_GAIN = 256;
+
+	// Frames mixed per pass, longer requests are split
+	static const size_t BLOCK_FRAMES = 512;
+
+	SoundMixer();
+
+	void setOutputRate(uint32_t rate);
+	uint32_t getOutputRate() const { return mOutputRate; }
+
+	// Use the SSE2 mixing loop, only available when built with SSE2
+	void setSSE2(bool enable);
+	bool usingSSE2() const { return mSSE2; }
+
+	void start(int channel, const mixsound_t* sound, bool loop);
+	void stop(int channel);
+	void stopAll();
+	bool isPlaying(int channel) const;
+	void setGains(int channel, int left, int right);
+
+	// Adds frames of interleaved stereo to out, saturating at the 16-bit
+	// limits.  Channels that reach the end of a sound stop.
+	void mix(int16_t* out, size_t frames);
+
+	// Every channel's position and step for the SSE2 loop
+	struct channel_t
+	{
+		const mixsound_t*	sound;
+		uint64_t			pos;	// 32.32 fixed point sample index
+		uint64_t			step;
+		int					left;
+		int					right;
+		bool				loop;
+	};
+
+private:
+	void mixBlock(int16_t* out, size_t frames);
+
+	channel_t	mChannels[MAX_CHANNELS];
+	uint32_t	mOutputRate;
+	bool		mSSE2;
+
+	int32_t		mAccum[BLOCK_FRAMES * 2];
+};
+
+// Mixes one channel into accum, returns the frames it produced before the
+// sound ran out
+size_t S_MixChannel_c(SoundMixer::channel_t& chan, int32_t* accum, size_t frames);
+
+#ifdef __SSE2__
+size_t S_MixChannel_SSE2(SoundMixer::channel_t& chan, int32_t* accum, size_t frames);
+void S_ClipAccum_SSE2(const int32_t* accum, int16_t* out, size_t frames);
+#endif
+
+#endif // __S_MIXER_H__
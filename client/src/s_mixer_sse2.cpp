@@ -0,0 +1,137 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	SSE2 mixing loops for the sound effect mixer.
+//
+//-----------------------------------------------------------------------------
+
+#include "s_mixer.h"
+
+#ifdef __SSE2__
+
+#include <string.h>
+#include <emmintrin.h>
+
+//
+// S_SamplePair
+//
+// Packs a sample and the one after it into the low and high halves of a
+// 32-bit word, ready for _mm_madd_epi16.  Only called where both are inside
+// the sound.
+//
+static inline uint32_t S_SamplePair(const byte* data, uint32_t index)
+{
+	uint32_t s0 = (uint16_t)((data[index] - 128) << 8);
+	uint32_t s1 = (uint16_t)((data[index + 1] - 128) << 8);
+	return s0 | (s1 << 16);
+}
+
+static inline uint32_t S_SamplePair(const int16_t* data, uint32_t index)
+{
+	uint32_t pair;
+	memcpy(&pair, data + index, sizeof(pair));
+	return pair;
+}
+
+template<typename T>
+static size_t S_MixSamples_SSE2(SoundMixer::channel_t& chan, int32_t* accum, size_t frames)
+{
+	const T* data = static_cast<const T*>(chan.sound->data);
+	const uint64_t last = (uint64_t)(chan.sound->length - 1) << 32;
+
+	// Frames whose sample and the next one are both inside the sound, the
+	// rest is left to the C loop to wrap or stop
+	size_t safe = 0;
+	if (chan.pos < last)
+		safe = (size_t)MIN<uint64_t>((last - chan.pos + chan.step - 1) / chan.step, frames);
+
+	const __m128i gains = _mm_set_epi16(chan.right, chan.left, chan.right, chan.left,
+	                                    chan.right, chan.left, chan.right, chan.left);
+
+	const __m128i one = _mm_set1_epi32(0x4000);
+
+	size_t i = 0;
+	for (; i + 4 <= safe; i += 4)
+	{
+		const uint64_t p0 = chan.pos;
+		const uint64_t p1 = p0 + chan.step;
+		const uint64_t p2 = p1 + chan.step;
+		const uint64_t p3 = p2 + chan.step;
+		chan.pos = p3 + chan.step;
+
+		// Built in registers, going through memory stalls on store forwarding
+		__m128i pairs = _mm_set_epi32(S_SamplePair(data, (uint32_t)(p3 >> 32)),
+		                              S_SamplePair(data, (uint32_t)(p2 >> 32)),
+		                              S_SamplePair(data, (uint32_t)(p1 >> 32)),
+		                              S_SamplePair(data, (uint32_t)(p0 >> 32)));
+
+		// The weight of the next sample in the high half of each word, what
+		// is left of 0x4000 for this one in the low half
+		__m128i weight = _mm_set_epi32((int)((p3 >> 18) & 0x3FFF), (int)((p2 >> 18) & 0x3FFF),
+		                               (int)((p1 >> 18) & 0x3FFF), (int)((p0 >> 18) & 0x3FFF));
+		__m128i weights = _mm_or_si128(_mm_sub_epi32(one, weight), _mm_slli_epi32(weight, 16));
+
+		// Interpolate, then duplicate each sample for both sides
+		__m128i samples = _mm_madd_epi16(pairs, weights);
+		samples = _mm_srai_epi32(samples, 14);
+		samples = _mm_packs_epi32(samples, samples);
+		samples = _mm_unpacklo_epi16(samples, samples);
+
+		// Full 32-bit products of sample and gain
+		__m128i lo = _mm_mullo_epi16(samples, gains);
+		__m128i hi = _mm_mulhi_epi16(samples, gains);
+
+		__m128i* dest = (__m128i*)(accum + i * 2);
+		_mm_storeu_si128(dest, _mm_add_epi32(_mm_loadu_si128(dest), _mm_unpacklo_epi16(lo, hi)));
+		_mm_storeu_si128(dest + 1, _mm_add_epi32(_mm_loadu_si128(dest + 1), _mm_unpackhi_epi16(lo, hi)));
+	}
+
+	return i + S_MixChannel_c(chan, accum + i * 2, frames - i);
+}
+
+size_t S_MixChannel_SSE2(SoundMixer::channel_t& chan, int32_t* accum, size_t frames)
+{
+	if (chan.sound->bits == 16)
+		return S_MixSamples_SSE2<int16_t>(chan, accum, frames);
+	else
+		return S_MixSamples_SSE2<byte>(chan, accum, frames);
+}
+
+void S_ClipAccum_SSE2(const int32_t* accum, int16_t* out, size_t frames)
+{
+	size_t count = frames * 2;
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(accum + i)), 8);
+		__m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(accum + i + 4)), 8);
+		__m128i* dest = (__m128i*)(out + i);
+		_mm_storeu_si128(dest, _mm_adds_epi16(_mm_loadu_si128(dest), _mm_packs_epi32(a, b)));
+	}
+
+	for (; i < count; i++)
+	{
+		int sample = clamp(accum[i] >> 8, -32768, 32767);
+		out[i] = clamp(out[i] + sample, -32768, 32767);
+	}
+}
+
+VERSION_CONTROL (s_mixer_sse2_cpp, "$Id$")
+
+#endif
@@ -267,6 +267,8 @@ void S_Init (float sfxVolume, float musicVolume)
 
 	// no sounds are playing, and they are not mus_paused
 	mus_paused = 0;
+
+	I_PrecacheSounds();
 }
 
 /**
@@ -26,11 +26,14 @@
 #include <cmath>
 #include <exception>
 #include <stdio.h>
+#include <algorithm>
+#include <vector>
 
 #include "cmdlib.h"
 #include "c_console.h"
 #include "c_dispatch.h"
 #include "m_alloc.h"
+#include "hashtable.h"
 
 #include "doomstat.h"
 #include "c_cvars.h"
@@ -42,10 +45,20 @@
 bool cvar_t::m_DoNoSet = false;
 bool cvar_t::m_UseCallback = false;
 
+typedef OHashTable<icase_key_t, cvar_t *> cvar_table_t;
+
+// Cvars whose callbacks are held back until the batch ends
+static int batchdepth = 0;
+static std::vector<cvar_t *> batchchanged;
+
 // denis - all this class does is delete the cvars during its static destruction
 class ad_t {
 public:
 	cvar_t *&GetCVars() { static cvar_t *CVars; return CVars; }
+
+	// Index of the list by name, the list keeps the order for output.  Never
+	// freed, as cvars are destroyed in no particular order at exit.
+	cvar_table_t &GetTable() { static cvar_table_t *Table = new cvar_table_t(1024); return *Table; }
 	ad_t() {}
 	~ad_t()
 	{
@@ -82,8 +95,7 @@ cvar_t::cvar_t(const char* var_name, const char* def, const char* help, cvartype
 void cvar_t::InitSelf(const char* var_name, const char* def, const char* help, cvartype_t type,
 		DWORD var_flags, void (*callback)(cvar_t &), float minval, float maxval)
 {
-	cvar_t* dummy;
-	cvar_t* var = FindCVar(var_name, &dummy);
+	cvar_t* var = FindCVar(var_name);
 
 	m_Callback = callback;
 	m_String = "";
@@ -130,25 +142,40 @@ void cvar_t::InitSelf(const char* var_name, const char* def, const char* help, c
 	else if (def)
 		ForceSet(def);
 
+	// the cvar this one replaces has taken itself out of the index
+	if (m_Name.length())
+		ad.GetTable().insert(std::make_pair(icase_key_t(m_Name.c_str()), this));
+
 	m_Flags = var_flags | CVAR_ISDEFAULT;
 }
 
 cvar_t::~cvar_t ()
+{
+	Unlink();
+}
+
+//
+// cvar_t::Unlink
+//
+// Takes the cvar out of the list and, if it is the cvar its name finds,
+// out of the index.
+//
+void cvar_t::Unlink()
 {
 	if (m_Name.length())
 	{
-		cvar_t *var, *dummy = NULL;
+		cvar_table_t::iterator it = ad.GetTable().find(m_Name.c_str());
 
-		var = FindCVar (m_Name.c_str(), &dummy);
-
-		if (var == this)
-		{
-			if (dummy)
-				dummy->m_Next = m_Next;
-			else
-				ad.GetCVars() = m_Next;
-		}
+		if (it != ad.GetTable().end() && it->second == this)
+			ad.GetTable().erase(it);
 	}
+
+	cvar_t **link = &ad.GetCVars();
+	while (*link && *link != this)
+		link = &(*link)->m_Next;
+
+	if (*link)
+		*link = m_Next;
 }
 
 void cvar_t::ForceSet(const char* valstr)
@@ -167,6 +194,11 @@ void cvar_t::ForceSet(const char* valstr)
 	}
 	else
 	{
+		// a batch only calls back for values that changed
+		std::string oldstring;
+		if (batchdepth > 0)
+			oldstring = m_String;
+
 		m_Flags |= CVAR_MODIFIED;
 
 		bool numerical_value = IsRealNum(valstr);
@@ -200,7 +232,13 @@ void cvar_t::ForceSet(const char* valstr)
 		m_Value = valf;
 
 		if (m_UseCallback)
-			Callback();
+		{
+			if (batchdepth == 0)
+				Callback();
+			else if (m_String != oldstring &&
+			         std::find(batchchanged.begin(), batchchanged.end(), this) == batchchanged.end())
+				batchchanged.push_back(this);
+		}
 
 		if (m_Flags & CVAR_USERINFO)
 			D_UserInfoChanged(this);
@@ -258,10 +296,10 @@ void cvar_t::RestoreDefault ()
 //
 void cvar_t::Transfer(const char *fromname, const char *toname)
 {
-	cvar_t *from, *to, *dummy;
+	cvar_t *from, *to;
 
-	from = FindCVar(fromname, &dummy);
-	to = FindCVar(toname, &dummy);
+	from = FindCVar(fromname);
+	to = FindCVar(toname);
 
 	if (from && to)
 	{
@@ -269,19 +307,15 @@ void cvar_t::Transfer(const char *fromname, const char *toname)
 		to->ForceSet(from->m_String.c_str());
 
 		// remove the old cvar
-		cvar_t *cur = ad.GetCVars();
-		while (cur->m_Next != from)
-			cur = cur->m_Next;
-
-		cur->m_Next = from->m_Next;
+		from->Unlink();
 	}
 }
 
 cvar_t *cvar_t::cvar_set (const char *var_name, const char *val)
 {
-	cvar_t *var, *dummy;
+	cvar_t *var;
 
-	if ( (var = FindCVar (var_name, &dummy)) )
+	if ( (var = FindCVar (var_name)) )
 		var->Set (val);
 
 	return var;
@@ -289,14 +323,32 @@ cvar_t *cvar_t::cvar_set (const char *var_name, const char *val)
 
 cvar_t *cvar_t::cvar_forceset (const char *var_name, const char *val)
 {
-	cvar_t *var, *dummy;
+	cvar_t *var;
 
-	if ( (var = FindCVar (var_name, &dummy)) )
+	if ( (var = FindCVar (var_name)) )
 		var->ForceSet (val);
 
 	return var;
 }
 
+void cvar_t::BeginCallbackBatch ()
+{
+	batchdepth++;
+}
+
+void cvar_t::EndCallbackBatch ()
+{
+	if (batchdepth == 0 || --batchdepth > 0)
+		return;
+
+	// a callback may set other cvars, those call back straight away
+	std::vector<cvar_t *> changed;
+	changed.swap(batchchanged);
+
+	for (size_t i = 0; i < changed.size(); i++)
+		changed[i]->Callback();
+}
+
 void cvar_t::EnableNoSet ()
 {
 	m_DoNoSet = true;
@@ -483,23 +535,17 @@ void cvar_t::C_RestoreCVars (void)
 	UnlatchCVars();
 }
 
-cvar_t *cvar_t::FindCVar (const char *var_name, cvar_t **prev)
+cvar_t *cvar_t::FindCVar (const char *var_name)
 {
-	cvar_t *var;
-
 	if (var_name == NULL)
 		return NULL;
 
-	var = ad.GetCVars();
-	*prev = NULL;
-	while (var)
-	{
-		if (iequals(var->m_Name, var_name))
-			break;
-		*prev = var;
-		var = var->m_Next;
-	}
-	return var;
+	cvar_table_t::iterator it = ad.GetTable().find(var_name);
+
+	if (it == ad.GetTable().end())
+		return NULL;
+
+	return it->second;
 }
 
 void cvar_t::UnlatchCVars (void)
@@ -630,9 +676,9 @@ BEGIN_COMMAND (set)
 	}
 	else
 	{
-		cvar_t *var, *prev;
+		cvar_t *var;
 
-		var = cvar_t::FindCVar (argv[1], &prev);
+		var = cvar_t::FindCVar (argv[1]);
 		if (!var)
 			var = new cvar_t(argv[1], NULL, "", CVARTYPE_NONE,  CVAR_AUTO | CVAR_UNSETTABLE | cvar_defflags);
 
@@ -678,7 +724,6 @@ END_COMMAND (set)
 
 BEGIN_COMMAND (get)
 {
-    cvar_t *prev;
 	cvar_t *var;
 
     if (argc < 2)
@@ -687,7 +732,7 @@ BEGIN_COMMAND (get)
         return;
 	}
 
-    var = cvar_t::FindCVar (argv[1], &prev);
+    var = cvar_t::FindCVar (argv[1]);
 
 	if (var)
 	{
@@ -714,7 +759,6 @@ END_COMMAND (get)
 
 BEGIN_COMMAND (toggle)
 {
-    cvar_t *prev;
 	cvar_t *var;
 
     if (argc < 2)
@@ -723,7 +767,7 @@ BEGIN_COMMAND (toggle)
         return;
 	}
 
-    var = cvar_t::FindCVar (argv[1], &prev);
+    var = cvar_t::FindCVar (argv[1]);
 
 	if (!var)
 	{
@@ -758,9 +802,66 @@ BEGIN_COMMAND (cvarlist)
 }
 END_COMMAND (cvarlist)
 
+//
+// cvarbench
+//
+// Times executing a large config, [lines] lines setting [cvars] temporary
+// cvars, alternating "set" with the bare "name value" form in another case.
+// The cvars are removed again afterwards.
+//
+BEGIN_COMMAND (cvarbench)
+{
+	int lines = argc > 1 ? MAX(atoi(argv[1]), 1) : 20000;
+	int count = argc > 2 ? clamp(atoi(argv[2]), 1, 4096) : 1000;
+
+	std::vector<std::string> config;
+	config.reserve(lines);
+
+	char line[64];
+	for (int i = 0; i < lines; i++)
+	{
+		// the first pass creates the cvars with set
+		if (i < count || i % 2)
+			sprintf(line, "set cvarbench_%d %d", i % count, i);
+		else
+			sprintf(line, "CVARBENCH_%d %d", i % count, i);
+
+		config.push_back(line);
+	}
+
+	int oldflags = cvar_defflags;
+	cvar_defflags = 0;
+
+	dtime_t start = I_GetTime();
+
+	for (size_t i = 0; i < config.size(); i++)
+		AddCommandString(config[i]);
+
+	dtime_t elapsed = I_GetTime() - start;
+
+	cvar_defflags = oldflags;
+
+	char name[32];
+	for (int i = 0; i < count; i++)
+	{
+		sprintf(name, "cvarbench_%d", i);
+		cvar_t *var = cvar_t::FindCVar(name);
+
+		if (var && (var->flags() & CVAR_AUTO))
+		{
+			C_RemoveTabCommand(name);
+			delete var;
+		}
+	}
+
+	Printf(PRINT_HIGH, "cvarbench: %d lines over %d cvars in %.1f ms, %.0f ns per line\n",
+	       lines, count, (double)elapsed / I_ConvertTimeFromMs(1),
+	       (double)elapsed / lines);
+}
+END_COMMAND (cvarbench)
+
 BEGIN_COMMAND (help)
 {
-    cvar_t *prev;
     cvar_t *var;
 
     if (argc < 2)
@@ -769,7 +870,7 @@ BEGIN_COMMAND (help)
         return;
     }
 
-    var = cvar_t::FindCVar (argv[1], &prev);
+    var = cvar_t::FindCVar (argv[1]);
 
     if (!var)
     {
@@ -163,6 +163,11 @@ public:
 	static void EnableNoSet ();		// enable the honoring of CVAR_NOSET
 	static void EnableCallbacks ();
 
+	// Holds back callbacks while many cvars are set, then calls back once
+	// for each cvar whose value changed.  Batches can nest.
+	static void BeginCallbackBatch ();
+	static void EndCallbackBatch ();
+
 	unsigned int m_Flags;
 
 	// Writes all cvars that could effect demo sync to *demo_p. These are
@@ -184,8 +189,8 @@ public:
 	// that might possibly have been changed during the course of demo playback.
 	static void C_RestoreCVars (void);
 
-	// Finds a named cvar
-	static cvar_t *FindCVar (const char *var_name, cvar_t **prev);
+	// Finds a named cvar, ignoring case
+	static cvar_t *FindCVar (const char *var_name);
 
 	// Called from G_InitNew()
 	static void UnlatchCVars (void);
@@ -219,6 +224,8 @@ private:
 
 	cvar_t(const cvar_t &var) { }
 
+	void Unlink();
+
 	void InitSelf(const char* name, const char* def, const char* help, cvartype_t,
 				DWORD flags, void (*callback)(cvar_t &), float minval = -FLT_MAX, float maxval = FLT_MAX);
 
@@ -46,10 +46,11 @@ IMPLEMENT_CLASS (DConsoleAlias, DConsoleCommand)
 
 EXTERN_CVAR (lookspring)
 
-typedef std::map<std::string, DConsoleCommand *> command_map_t;
+// Keyed by each command's own m_Name
+typedef OHashTable<icase_key_t, DConsoleCommand *> command_map_t;
 command_map_t &Commands()
 {
-	static command_map_t _Commands;
+	static command_map_t _Commands(512);
 	return _Commands;
 }
 
@@ -269,7 +270,7 @@ void C_DoCommand(const char *cmd, uint32_t key)
 		// Checking for matching commands follows this search order:
 		//	1. Check the Commands map
 		//	2. Check the CVars list
-		command_map_t::iterator c = Commands().find(StdStringToLower(argv[0]));
+		command_map_t::iterator c = Commands().find(argv[0]);
 
 		if (c != Commands().end())
 		{
@@ -291,9 +292,9 @@ void C_DoCommand(const char *cmd, uint32_t key)
 		else
 		{
 			// Check for any CVars that match the command
-			cvar_t *var, *dummy;
+			cvar_t *var;
 
-			if ( (var = cvar_t::FindCVar (argv[0], &dummy)) )
+			if ( (var = cvar_t::FindCVar (argv[0])) )
 			{
 				if (argc >= 2)
 				{
@@ -521,8 +522,8 @@ BEGIN_COMMAND (if)
 	if (argc < 4)
 		return;
 
-	cvar_t *var, *dummy;
-	var = cvar_t::FindCVar (argv[1], &dummy);
+	cvar_t *var;
+	var = cvar_t::FindCVar (argv[1]);
 
 	if (!var)
 	{
@@ -661,13 +662,13 @@ const char *ParseString2(const char *data)
 // contents of <cvar>.
 const char *ParseString (const char *data)
 {
-	cvar_t *var, *dummy;
+	cvar_t *var;
 
 	if ( (data = ParseString2 (data)) )
 	{
 		if (com_token[0] == '$')
 		{
-			if ( (var = cvar_t::FindCVar (&com_token[1], &dummy)) )
+			if ( (var = cvar_t::FindCVar (&com_token[1])) )
 			{
 				strcpy (com_token, var->cstring());
 			}
@@ -700,12 +701,19 @@ DConsoleCommand::DConsoleCommand (const char *name)
 
 	m_Name = name;
 
-	Commands()[name] = this;
+	// the key points at m_Name, so replace any entry rather than reuse it
+	Commands().erase(m_Name.c_str());
+	Commands().insert(std::make_pair(icase_key_t(m_Name.c_str()), this));
 	C_AddTabCommand(name);
 }
 
 DConsoleCommand::~DConsoleCommand ()
 {
+	command_map_t::iterator i = Commands().find(m_Name.c_str());
+
+	if (i != Commands().end() && i->second == this)
+		Commands().erase(i);
+
 	C_RemoveTabCommand (m_Name.c_str());
 }
 
@@ -810,13 +818,32 @@ std::string C_QuoteString(const std::string &argstr)
 	return buffer.str();
 }
 
+static bool SortCommands (const DConsoleCommand *a, const DConsoleCommand *b)
+{
+	return a->m_Name < b->m_Name;
+}
+
+// The commands in name order, the table has none
+static std::vector<DConsoleCommand *> SortedCommands ()
+{
+	std::vector<DConsoleCommand *> cmds;
+	cmds.reserve(Commands().size());
+
+	for (command_map_t::iterator i = Commands().begin(), e = Commands().end(); i != e; ++i)
+		cmds.push_back(i->second);
+
+	std::sort(cmds.begin(), cmds.end(), SortCommands);
+	return cmds;
+}
+
 static int DumpHash (BOOL aliases)
 {
 	int count = 0;
+	std::vector<DConsoleCommand *> cmds = SortedCommands();
 
-	for (command_map_t::iterator i = Commands().begin(), e = Commands().end(); i != e; ++i)
+	for (size_t i = 0; i < cmds.size(); i++)
 	{
-		DConsoleCommand *cmd = i->second;
+		DConsoleCommand *cmd = cmds[i];
 
 		count++;
 		if (cmd->IsAlias())
@@ -838,9 +865,11 @@ void DConsoleAlias::Archive(FILE *f)
 
 void DConsoleAlias::C_ArchiveAliases (FILE *f)
 {
-	for (command_map_t::iterator i = Commands().begin(), e = Commands().end(); i != e; ++i)
+	std::vector<DConsoleCommand *> cmds = SortedCommands();
+
+	for (size_t i = 0; i < cmds.size(); i++)
 	{
-		DConsoleCommand *alias = i->second;
+		DConsoleCommand *alias = cmds[i];
 
 		if (alias->IsAlias())
 			static_cast<DConsoleAlias *>(alias)->Archive (f);
@@ -849,13 +878,17 @@ void DConsoleAlias::C_ArchiveAliases (FILE *f)
 
 void DConsoleAlias::DestroyAll()
 {
+	// deleting an alias takes it out of the table, so collect them first
+	std::vector<DConsoleCommand *> aliases;
+
 	for (command_map_t::iterator i = Commands().begin(), e = Commands().end(); i != e; ++i)
 	{
-		DConsoleCommand *alias = i->second;
-
-		if (alias->IsAlias())
-			delete alias;
+		if (i->second->IsAlias())
+			aliases.push_back(i->second);
 	}
+
+	for (size_t i = 0; i < aliases.size(); i++)
+		delete aliases[i];
 }
 
 BEGIN_COMMAND (alias)
@@ -867,15 +900,14 @@ BEGIN_COMMAND (alias)
 	}
 	else
 	{
-		command_map_t::iterator i = Commands().find(StdStringToLower(argv[1]));
+		command_map_t::iterator i = Commands().find(argv[1]);
 
 		if(i != Commands().end())
 		{
 			if(i->second->IsAlias())
 			{
-				// Remove the old alias
+				// Remove the old alias, it takes itself out of the table
 				delete i->second;
-				Commands().erase(i);
 			}
 			else
 			{
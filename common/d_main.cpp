@@ -863,7 +863,7 @@ class TaskScheduler
 {
 public:
 	virtual ~TaskScheduler() { }
-	virtual void run() = 0;
+	virtual int run() = 0;
 	virtual dtime_t getNextTime() const = 0;
 	virtual float getRemainder() const = 0;
 };
@@ -877,9 +877,10 @@ public:
 
 	virtual ~UncappedTaskScheduler() { }
 
-	virtual void run()
+	virtual int run()
 	{
 		mTask();
+		return 1;
 	}
 
 	virtual dtime_t getNextTime() const
@@ -909,19 +910,22 @@ public:
 
 	virtual ~CappedTaskScheduler() { }
 
-	virtual void run()
+	virtual int run()
 	{
 		mFrameStartTime = I_GetTime();
 		mAccumulator += mFrameStartTime - mPreviousFrameStartTime;
 		mPreviousFrameStartTime = mFrameStartTime;
 
-		int count = mMaxCount;
+		int count = 0;
 
-		while (mAccumulator >= mFrameDuration && count--)
+		while (mAccumulator >= mFrameDuration && count < mMaxCount)
 		{
 			mTask();
 			mAccumulator -= mFrameDuration;
+			count++;
 		}
+
+		return count;
 	}
 
 	virtual dtime_t getNextTime() const
@@ -949,6 +953,9 @@ private:
 static TaskScheduler* simulation_scheduler;
 static TaskScheduler* display_scheduler;
 
+// Moving average of how long the display task takes to run.
+static dtime_t display_duration;
+
 //
 // D_InitTaskSchedulers
 //
@@ -1010,12 +1017,26 @@ void STACK_ARGS D_ClearTaskSchedulers()
 // be called as often as possible. After each iteration through the loop,
 // the program yields briefly to the operating system.
 //
+// A frame is not started if it is expected to still be running when
+// the next simulation tic is due. Instead the loop waits for the tic so that
+// input is sampled and sent on time, then draws the frame right after it.
+//
 void D_RunTics(void (*sim_func)(), void(*display_func)())
 {
 	D_InitTaskSchedulers(sim_func, display_func);
 
 	simulation_scheduler->run();
 
+	const dtime_t tic_duration = I_ConvertTimeFromMs(1000) / TICRATE;
+	bool defer_display = false;
+
+	if (!timingdemo && display_duration < tic_duration)
+	{
+		dtime_t next_tic_time = simulation_scheduler->getNextTime();
+		dtime_t now = I_GetTime();
+		defer_display = next_tic_time > now && next_tic_time - now < display_duration;
+	}
+
 #ifdef CLIENT_APP
 	// Use linear interpolation for rendering entities if the display
 	// framerate is not synced with the simulation frequency.
@@ -1029,7 +1050,12 @@ void D_RunTics(void (*sim_func)(), void(*display_func)())
 		render_lerp_amount = simulation_scheduler->getRemainder() * FRACUNIT;
 #endif
 
-	display_scheduler->run();
+	if (!defer_display)
+	{
+		dtime_t display_start_time = I_GetTime();
+		if (display_scheduler->run() > 0)
+			display_duration = (7 * display_duration + I_GetTime() - display_start_time) / 8;
+	}
 
 	if (timingdemo)
 		return;
@@ -1037,7 +1063,8 @@ void D_RunTics(void (*sim_func)(), void(*display_func)())
 	// Sleep until the next scheduled task.
 	dtime_t simulation_wake_time = simulation_scheduler->getNextTime();
 	dtime_t display_wake_time = display_scheduler->getNextTime();
-	dtime_t wake_time = std::min<dtime_t>(simulation_wake_time, display_wake_time);
+	dtime_t wake_time = defer_display ? simulation_wake_time :
+				std::min<dtime_t>(simulation_wake_time, display_wake_time);
 
 	const dtime_t max_sleep_amount = 1000LL * 1000LL;	// 1ms
 
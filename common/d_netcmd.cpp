@@ -89,28 +89,12 @@ void NetCommand::write(buf_t *buf)
 	int serialized_fields = getSerializedFields();
 	buf->WriteByte(serialized_fields);
 	buf->WriteLong(mWorldIndex);
-		
-	if (serialized_fields & CMD_BUTTONS)
-		buf->WriteByte(mButtons);
-	if (serialized_fields & CMD_ANGLE)
-		buf->WriteShort((mAngle >> FRACBITS) + mDeltaYaw);
-	if (serialized_fields & CMD_PITCH)
+
+	for (int field = CMD_BUTTONS; field <= CMD_IMPULSE; field <<= 1)
 	{
-		// ZDoom uses a hack to center the view when toggling cl_mouselook
-		bool centerview = (mDeltaPitch == CENTERVIEW);
-		if (centerview)
-			buf->WriteShort(0);
-		else
-			buf->WriteShort((mPitch >> FRACBITS) + mDeltaPitch);
+		if (serialized_fields & field)
+			writeSerializedValue(buf, field);
 	}
-	if (serialized_fields & CMD_FORWARD)
-		buf->WriteShort(mForwardMove);
-	if (serialized_fields & CMD_SIDE)
-		buf->WriteShort(mSideMove);
-	if (serialized_fields & CMD_UP)
-		buf->WriteShort(mUpMove);
-	if (serialized_fields & CMD_IMPULSE)
-		buf->WriteByte(mImpulse);
 }
 
 void NetCommand::read(buf_t *buf)
@@ -135,8 +119,49 @@ void NetCommand::read(buf_t *buf)
 		mImpulse = buf->ReadByte();
 }
 
+void NetCommand::write(buf_t *buf, const NetCommand &from)
+{
+	// The fields are compared as they would be sent so the recipient ends up
+	// with the same values whichever way the command was written
+	int changed_fields = 0;
+	for (int field = CMD_BUTTONS; field <= CMD_IMPULSE; field <<= 1)
+	{
+		if (getSerializedValue(field) != from.getSerializedValue(field))
+			changed_fields |= field;
+	}
+
+	buf->WriteByte(changed_fields);
+	buf->WriteVarint(mWorldIndex - from.mWorldIndex);
+
+	for (int field = CMD_BUTTONS; field <= CMD_IMPULSE; field <<= 1)
+	{
+		if (changed_fields & field)
+			writeSerializedValue(buf, field);
+	}
+}
+
+void NetCommand::read(buf_t *buf, const NetCommand &from)
+{
+	clear();
+	int changed_fields = buf->ReadByte();
+	mWorldIndex = from.mWorldIndex + buf->ReadVarint();
+
+	for (int field = CMD_BUTTONS; field <= CMD_IMPULSE; field <<= 1)
+	{
+		int value;
+		if (!(changed_fields & field))
+			value = from.getSerializedValue(field);
+		else if (field == CMD_BUTTONS || field == CMD_IMPULSE)
+			value = buf->ReadByte();
+		else
+			value = buf->ReadShort();
+
+		setSerializedValue(field, value);
+	}
+}
+
 
-int NetCommand::getSerializedFields()
+int NetCommand::getSerializedFields() const
 {
 	int serialized_fields = 0;
 
@@ -158,5 +183,76 @@ int NetCommand::getSerializedFields()
 	return serialized_fields;
 }
 
+//
+// NetCommand::getSerializedValue
+//
+// Returns a field as it goes over the network, angles are whole degrees with
+// the delta already applied.  Fields that are not sent read as zero.
+//
+int NetCommand::getSerializedValue(int field) const
+{
+	if (!(getSerializedFields() & field))
+		return 0;
+
+	switch (field)
+	{
+	case CMD_BUTTONS:
+		return mButtons;
+	case CMD_ANGLE:
+		return short((mAngle >> FRACBITS) + mDeltaYaw);
+	case CMD_PITCH:
+		// ZDoom uses a hack to center the view when toggling cl_mouselook
+		if (mDeltaPitch == CENTERVIEW)
+			return 0;
+		return short((mPitch >> FRACBITS) + mDeltaPitch);
+	case CMD_FORWARD:
+		return mForwardMove;
+	case CMD_SIDE:
+		return mSideMove;
+	case CMD_UP:
+		return mUpMove;
+	case CMD_IMPULSE:
+		return mImpulse;
+	default:
+		return 0;
+	}
+}
+
+void NetCommand::setSerializedValue(int field, int value)
+{
+	switch (field)
+	{
+	case CMD_BUTTONS:
+		setButtons(value);
+		break;
+	case CMD_ANGLE:
+		setAngle(value << FRACBITS);
+		break;
+	case CMD_PITCH:
+		setPitch(value << FRACBITS);
+		break;
+	case CMD_FORWARD:
+		setForwardMove(value);
+		break;
+	case CMD_SIDE:
+		setSideMove(value);
+		break;
+	case CMD_UP:
+		setUpMove(value);
+		break;
+	case CMD_IMPULSE:
+		setImpulse(value);
+		break;
+	}
+}
+
+void NetCommand::writeSerializedValue(buf_t *buf, int field) const
+{
+	if (field == CMD_BUTTONS || field == CMD_IMPULSE)
+		buf->WriteByte(getSerializedValue(field));
+	else
+		buf->WriteShort(getSerializedValue(field));
+}
+
 VERSION_CONTROL (d_netcmd_cpp, "$Id$")
 
@@ -33,6 +33,11 @@ class player_s;
 typedef player_s player_t;
 
 static const short CENTERVIEW = -32768;
+
+// Most ticcmds a client sends in one clc_move, enough to ride out a third
+// of a second of lost packets
+static const int MAX_NETCMDS_PER_PACKET = 10;
+
 //
 // NetCommand
 //
@@ -136,6 +141,11 @@ public:
 	void clear();
 	void write(buf_t *buf);
 	void read(buf_t *buf);
+
+	// Delta encoding against the command for the previous tic, only the
+	// fields that differ from it are sent
+	void write(buf_t *buf, const NetCommand &from);
+	void read(buf_t *buf, const NetCommand &from);
 	
 	void toPlayer(player_t *player) const;
 	void fromPlayer(player_t *player);
@@ -164,7 +174,10 @@ private:
 	short		mDeltaYaw;
 	short		mDeltaPitch;
 
-	int getSerializedFields();
+	int getSerializedFields() const;
+	int getSerializedValue(int field) const;
+	void setSerializedValue(int field, int value);
+	void writeSerializedValue(buf_t *buf, int field) const;
 
 	void updateFields(int flag, int value)
 	{
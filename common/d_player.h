@@ -301,6 +301,11 @@ public:
 
 		int			lastcmdtic, lastclientcmdtic;
 
+		// newest client-tic of the last clc_move and the share of client
+		// packets that went missing, averaged over about a second
+		int			lastcmdpackettic;
+		float		cmdloss;
+
 		std::string	digest;			// randomly generated string that the client must use for any hashes it sends back
 		bool        allow_rcon;     // allow remote admin
 		bool		displaydisconnect; // display disconnect message when disconnecting
@@ -339,6 +344,8 @@ public:
 			last_received = 0;
 			lastcmdtic = 0;
 			lastclientcmdtic = 0;
+			lastcmdpackettic = 0;
+			cmdloss = 0.0f;
 
 
 			// GhostlyDeath -- done with the {}
@@ -367,6 +374,8 @@ public:
 			last_received(other.last_received),
 			lastcmdtic(other.lastcmdtic),
 			lastclientcmdtic(other.lastclientcmdtic),
+			lastcmdpackettic(other.lastcmdpackettic),
+			cmdloss(other.cmdloss),
 			digest(other.digest),
 			allow_rcon(false),
 			displaydisconnect(true),
@@ -23,6 +23,7 @@
 
 
 #include "p_local.h"
+#include "p_acs.h"
 #include "dsectoreffect.h"
 
 
@@ -50,6 +51,9 @@ void DSectorEffect::Destroy ()
 			m_Sector->ceilingdata = NULL;
 		if (m_Sector->lightingdata == this)
 			m_Sector->lightingdata = NULL;
+
+		// Scripts waiting on this tag can look again
+		P_ACSWakeTagWait(m_Sector->tag);
 	}
 
 	Super::Destroy();
@@ -1340,7 +1340,9 @@ void G_ParseMusInfo(void)
 // G_LoadWad
 //
 // Determines if the vectors of wad & patch filenames differs from the currently
-// loaded ones and calls D_DoomWadReboot if so.
+// loaded ones and calls D_DoomWadReboot if so.  When they don't, the lump
+// directory, textures, flats and file hashes are all kept and only the level
+// is changed.
 //
 bool G_LoadWad(const OWantFiles& newwadfiles, const OWantFiles& newpatchfiles,
                const std::string& mapname)
@@ -1348,8 +1350,11 @@ bool G_LoadWad(const OWantFiles& newwadfiles, const OWantFiles& newpatchfiles,
 	bool AddedIWAD = false;
 	bool Reboot = false;
 
-	// Did we pass an IWAD?
-	if (!newwadfiles.empty() && W_IsKnownIWAD(newwadfiles[0]))
+	// Did we pass an IWAD?  A name without an extension isn't recognized
+	// as one, so also check it against the IWAD that is loaded.
+	if (!newwadfiles.empty() &&
+	    (W_IsKnownIWAD(newwadfiles[0]) ||
+	     (::wadfiles.size() >= 2 && M_WantedMatchesResFile(newwadfiles[0], ::wadfiles[1]))))
 	{
 		AddedIWAD = true;
 	}
@@ -1359,7 +1364,7 @@ bool G_LoadWad(const OWantFiles& newwadfiles, const OWantFiles& newpatchfiles,
 	// Did we switch IWAD files?
 	if (AddedIWAD && !::wadfiles.empty())
 	{
-		if (newwadfiles.at(0).getBasename() != wadfiles.at(1).getBasename())
+		if (::wadfiles.size() < 2 || !M_WantedMatchesResFile(newwadfiles.at(0), ::wadfiles.at(1)))
 		{
 			Reboot = true;
 		}
@@ -1368,7 +1373,8 @@ bool G_LoadWad(const OWantFiles& newwadfiles, const OWantFiles& newpatchfiles,
 	// Do the sizes of the WAD lists not match up?
 	if (!Reboot)
 	{
-		if (::wadfiles.size() - 2 != newwadfiles.size() - (AddedIWAD ? 1 : 0))
+		if (::wadfiles.size() < 2 ||
+		    ::wadfiles.size() - 2 != newwadfiles.size() - (AddedIWAD ? 1 : 0))
 		{
 			Reboot = true;
 		}
@@ -1380,7 +1386,7 @@ bool G_LoadWad(const OWantFiles& newwadfiles, const OWantFiles& newpatchfiles,
 		for (size_t i = 2, j = (AddedIWAD ? 1 : 0);
 		     i < ::wadfiles.size() && j < newwadfiles.size(); i++, j++)
 		{
-			if (!(newwadfiles.at(j).getBasename() == ::wadfiles.at(i).getBasename()))
+			if (!M_WantedMatchesResFile(newwadfiles.at(j), ::wadfiles.at(i)))
 			{
 				Reboot = true;
 				break;
@@ -1403,7 +1409,7 @@ bool G_LoadWad(const OWantFiles& newwadfiles, const OWantFiles& newpatchfiles,
 		for (size_t i = 0, j = 0; i < ::patchfiles.size() && j < newpatchfiles.size();
 		     i++, j++)
 		{
-			if (!(newpatchfiles.at(j).getBasename() == ::patchfiles.at(i).getBasename()))
+			if (!M_WantedMatchesResFile(newpatchfiles.at(j), ::patchfiles.at(i)))
 			{
 				Reboot = true;
 				break;
@@ -2069,6 +2075,7 @@ void G_InitLevelLocals()
 	}
 
 	movingsectors.clear();
+	dirtysectors.clear();
 }
 
 static void MapinfoHelp()
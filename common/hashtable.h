@@ -26,6 +26,7 @@
 
 #include <cstddef>
 #include <cassert>
+#include <cctype>
 #include <utility>
 #include <string>
 
@@ -180,6 +181,47 @@ template <> struct hashfunc<const char*>
 template <> struct hashfunc<std::string>
 {	unsigned int operator()(const std::string& str) const { return __hash_cstring(str.c_str()); } };
 
+static inline unsigned int __hash_cstring_nocase(const char* str)
+{
+	unsigned int val = 0;
+	while (*str != 0)
+		val = val * 101 + tolower((unsigned char)*str++);
+	return val;
+}
+
+// ----------------------------------------------------------------------------
+// icase_key_t
+//
+// A C string key that is hashed and compared without regard to case, for
+// names typed at the console.  Only the pointer is kept, so the string has
+// to outlive its entry in the table.
+// ----------------------------------------------------------------------------
+
+struct icase_key_t
+{
+	const char* str;
+
+	icase_key_t(const char* s = "") : str(s) { }
+
+	bool operator== (const icase_key_t& other) const
+	{
+		const unsigned char* a = (const unsigned char*)str;
+		const unsigned char* b = (const unsigned char*)other.str;
+
+		while (*a != 0 && tolower(*a) == tolower(*b))
+			a++, b++;
+		return tolower(*a) == tolower(*b);
+	}
+
+	bool operator!= (const icase_key_t& other) const
+	{
+		return !(operator==(other));
+	}
+};
+
+template <> struct hashfunc<icase_key_t>
+{	unsigned int operator()(const icase_key_t& key) const { return __hash_cstring_nocase(key.str); } };
+
 
 // ----------------------------------------------------------------------------
 // OHashTable interface & inline implementation
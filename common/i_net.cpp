@@ -74,12 +74,22 @@ typedef int SOCKET;
 #define SETSOCKOPTCAST(x) ((const void *)(x))
 #endif
 
+#if !defined(_XBOX) && !defined(GEKKO)
+#define ODA_HAVE_IPV6
+#endif
+
+#ifdef _WIN32
+typedef int socklen_t;
+#endif
+
 #include "doomtype.h"
 
 #include "i_system.h"
 
 #include "doomstat.h"
 #include "i_net.h"
+#include "i_netmsg.h"
+#include "m_argv.h"
 
 #ifdef _XBOX
 #include "i_xbox.h"
@@ -100,6 +110,7 @@ typedef int SOCKET;
 
 unsigned int	inet_socket;
 int         	localport;
+static bool 	inet_ipv6;  // socket takes both IPv6 and IPv4-mapped traffic
 netadr_t    	net_from;   // address of who sent the packet
 
 buf_t       net_message(MAX_UDP_PACKET);
@@ -291,6 +302,28 @@ SOCKET UDPsocket (void)
 {
 	SOCKET s;
 
+#ifdef ODA_HAVE_IPV6
+	// Prefer one dual-stack socket, IPv4 peers show up on it with
+	// IPv4-mapped addresses.  Without IPv6 in the system fall back to IPv4.
+	if (!Args.CheckParm("-noipv6"))
+	{
+		s = socket (PF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+		if (s != INVALID_SOCKET)
+		{
+			int v6only = 0;
+			if (setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, SETSOCKOPTCAST(&v6only), sizeof(v6only)) == 0)
+			{
+				inet_ipv6 = true;
+				return s;
+			}
+
+			closesocket (s);
+		}
+	}
+#endif
+
+	inet_ipv6 = false;
+
 	// allocate a socket
 	s = socket (PF_INET, SOCK_DGRAM, IPPROTO_UDP);
 	if (s == INVALID_SOCKET)
@@ -299,25 +332,81 @@ SOCKET UDPsocket (void)
 	return s;
 }
 
+// The first 12 bytes of an IPv4-mapped address
+static const byte v4mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+
+// Room for a socket address of either family
+typedef union
+{
+	struct sockaddr sa;
+	struct sockaddr_in sin;
+#ifdef ODA_HAVE_IPV6
+	struct sockaddr_in6 sin6;
+#endif
+} sockadr_t;
+
+// this is from Quake source code :)
+
+static void SockadrToNetadr (const sockadr_t *s, netadr_t *a)
+{
+#ifdef ODA_HAVE_IPV6
+	if (s->sa.sa_family == AF_INET6)
+	{
+		memcpy(a->ip, &s->sin6.sin6_addr, NETADR_IPBYTES);
+		a->port = s->sin6.sin6_port;
+		return;
+	}
+#endif
+
+	memcpy(a->ip, v4mapped_prefix, sizeof(v4mapped_prefix));
+	memcpy(a->ip + sizeof(v4mapped_prefix), &s->sin.sin_addr, sizeof(struct in_addr));
+	a->port = s->sin.sin_port;
+}
+
+// Fill in a socket address for our socket's family, returns its length.
+static socklen_t NetadrToSockadr (const netadr_t *a, sockadr_t *s)
+{
+	memset (s, 0, sizeof(*s));
+
+#ifdef ODA_HAVE_IPV6
+	if (inet_ipv6)
+	{
+		s->sin6.sin6_family = AF_INET6;
+		memcpy(&s->sin6.sin6_addr, a->ip, NETADR_IPBYTES);
+		s->sin6.sin6_port = a->port;
+		return sizeof(s->sin6);
+	}
+#endif
+
+	s->sin.sin_family = AF_INET;
+	memcpy(&s->sin.sin_addr, a->ip + sizeof(v4mapped_prefix), sizeof(struct in_addr));
+	s->sin.sin_port = a->port;
+	return sizeof(s->sin);
+}
+
 //
 // BindToLocalPort
 //
 void BindToLocalPort (SOCKET s, u_short wanted)
 {
 	int v;
-	struct sockaddr_in address;
+	netadr_t any;
+	sockadr_t address;
+
+	// The unspecified address, :: or 0.0.0.0 on an IPv4 socket
+	memset (&any, 0, sizeof(any));
+	if (!inet_ipv6)
+		memcpy(any.ip, v4mapped_prefix, sizeof(v4mapped_prefix));
 
-	memset (&address, 0, sizeof(address));
-	address.sin_family = AF_INET;
-	address.sin_addr.s_addr = INADDR_ANY;
 	u_short next = wanted;
 
 	// denis - try several ports
 	do
 	{
-		address.sin_port = htons(next++);
+		I_SetPort(any, next++);
+		socklen_t addrlen = NetadrToSockadr(&any, &address);
 
-		v = bind (s, (sockaddr *)&address, sizeof(address));
+		v = bind (s, &address.sa, addrlen);
 
 		if(next > wanted + 32)
 		{
@@ -350,7 +439,7 @@ void BindToLocalPort (SOCKET s, u_short wanted)
     }
 #endif
 
-	Printf(PRINT_HIGH, "Bound to local port %d\n", next - 1);
+	Printf(PRINT_HIGH, "Bound to local port %d%s\n", next - 1, inet_ipv6 ? " (IPv4 and IPv6)" : "");
 }
 
 
@@ -367,87 +456,201 @@ void CloseNetwork (void)
 }
 
 
-// this is from Quake source code :)
-
-void SockadrToNetadr (struct sockaddr_in *s, netadr_t *a)
+bool NET_IsIPv4Adr (const netadr_t &a)
 {
-	 memcpy(&(a->ip), &(s->sin_addr), sizeof(struct in_addr));
-     a->port = s->sin_port;
+	return memcmp(a.ip, v4mapped_prefix, sizeof(v4mapped_prefix)) == 0;
 }
 
-void NetadrToSockadr (netadr_t *a, struct sockaddr_in *s)
+// True for an address that was never set or failed to resolve, either the
+// unspecified IPv6 address or 0.0.0.0.
+bool NET_IsNullAdr (const netadr_t &a)
 {
-     memset (s, 0, sizeof(*s));
-     s->sin_family = AF_INET;
+	static const byte zero[NETADR_IPBYTES] = {0};
+
+	if (NET_IsIPv4Adr(a))
+		return memcmp(a.ip + sizeof(v4mapped_prefix), zero, 4) == 0;
+
+	return memcmp(a.ip, zero, NETADR_IPBYTES) == 0;
+}
 
-	 memcpy(&(s->sin_addr), &(a->ip), sizeof(struct in_addr));
-     s->sin_port = a->port;
+// True when the socket can reach IPv6 addresses.
+bool NET_HaveIPv6 (void)
+{
+	return inet_ipv6;
 }
 
-char *NET_AdrToString (netadr_t a)
+char *NET_AdrToString (const netadr_t &a, bool displayport)
 {
-     static  char    s[64];
+	static char s[64];
+	char host[48];
 
-     sprintf (s, "%i.%i.%i.%i:%i", a.ip[0], a.ip[1], a.ip[2], a.ip[3], ntohs(a.port));
+	if (NET_IsIPv4Adr(a))
+	{
+		const byte *ip = a.ip + sizeof(v4mapped_prefix);
+		sprintf (host, "%i.%i.%i.%i", ip[0], ip[1], ip[2], ip[3]);
+	}
+	else
+	{
+		strcpy(host, "?");
+#ifdef ODA_HAVE_IPV6
+		sockadr_t sadr;
+		memset (&sadr, 0, sizeof(sadr));
+		sadr.sin6.sin6_family = AF_INET6;
+		memcpy(&sadr.sin6.sin6_addr, a.ip, NETADR_IPBYTES);
+		getnameinfo(&sadr.sa, sizeof(sadr.sin6), host, sizeof(host), NULL, 0, NI_NUMERICHOST);
+#endif
+	}
+
+	if (!displayport)
+		sprintf (s, "%s", host);
+	else if (NET_IsIPv4Adr(a))
+		sprintf (s, "%s:%i", host, ntohs(a.port));
+	else
+		sprintf (s, "[%s]:%i", host, ntohs(a.port));
 
-     return s;
+	return s;
 }
 
-bool NET_StringToAdr (const char *s, netadr_t *a)
+//
+// NET_StringToAdr
+//
+// Takes a host name or address with an optional port: "host:port",
+// "1.2.3.4:port", "[::1]:port" or a bare IPv6 address.  type limits which
+// family a host name may resolve to.
+//
+bool NET_StringToAdr (const char *s, netadr_t *a, netadrtype_t type)
 {
-	 struct hostent  *h;
-	 struct sockaddr_in sadr;
-	 char	*colon;
-	 char	copy[256];
-
+	char copy[256];
+	char *host = copy;
+	const char *portstr = NULL;
 
-	 memset (&sadr, 0, sizeof(sadr));
-	 sadr.sin_family = AF_INET;
+	strncpy (copy, s, sizeof(copy) - 1);
+	copy[sizeof(copy) - 1] = 0;
 
-	 sadr.sin_port = 0;
+	// strip off a trailing :port if present, IPv6 addresses with a port are
+	// written in brackets
+	if (copy[0] == '[')
+	{
+		char *end = strchr(copy, ']');
+		if (!end)
+			return false;
 
-	 strncpy (copy, s, sizeof(copy) - 1);
-	 copy[sizeof(copy) - 1] = 0;
+		*end = 0;
+		host = copy + 1;
 
-	 // strip off a trailing :port if present
-	 for (colon = copy ; *colon ; colon++)
-		if (*colon == ':')
+		if (end[1] == ':')
+			portstr = end + 2;
+	}
+	else
+	{
+		char *colon = strchr(copy, ':');
+		if (colon && !strchr(colon + 1, ':'))
 		{
 			*colon = 0;
-			sadr.sin_port = htons(atoi(colon+1));
+			portstr = colon + 1;
 		}
+	}
 
-	if (! (h = gethostbyname(copy)) )
-		return 0;
+	sockadr_t sadr;
+	memset (&sadr, 0, sizeof(sadr));
+
+#ifdef ODA_HAVE_IPV6
+	struct addrinfo hints;
+	struct addrinfo *result = NULL;
+
+	memset (&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_DGRAM;
 
-	*(int *)&sadr.sin_addr = *(int *)h->h_addr_list[0];
+	if (type == NA_IPV4)
+		hints.ai_family = AF_INET;
+	else if (type == NA_IPV6)
+		hints.ai_family = AF_INET6;
+	else
+		hints.ai_family = inet_ipv6 ? AF_UNSPEC : AF_INET;
+
+	if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL)
+		return false;
+
+	memcpy(&sadr, result->ai_addr, MIN(sizeof(sadr), (size_t)result->ai_addrlen));
+	freeaddrinfo(result);
+#else
+	struct hostent *h;
+
+	if (type == NA_IPV6)
+		return false;
+
+	if (! (h = gethostbyname(host)) )
+		return false;
+
+	sadr.sin.sin_family = AF_INET;
+	*(int *)&sadr.sin.sin_addr = *(int *)h->h_addr_list[0];
+#endif
 
 	SockadrToNetadr (&sadr, a);
+	a->port = portstr ? htons(atoi(portstr)) : 0;
 
 	return true;
 }
 
-bool NET_CompareAdr (netadr_t a, netadr_t b)
+//
+// NET_StringToIP
+//
+// Parses a numeric IPv4 or IPv6 address, without a port, into the
+// NETADR_IPBYTES form netadr_t uses.  Never does a name lookup.
+//
+bool NET_StringToIP (const char *s, byte *ip)
 {
-	if (a.ip[0] == b.ip[0] && a.ip[1] == b.ip[1] && a.ip[2] == b.ip[2] && a.ip[3] == b.ip[3] && a.port == b.port)
-		return true;
+#ifdef ODA_HAVE_IPV6
+	struct addrinfo hints;
+	struct addrinfo *result = NULL;
 
-	return false;
-}
+	memset (&hints, 0, sizeof(hints));
+	hints.ai_flags = AI_NUMERICHOST;
+	hints.ai_socktype = SOCK_DGRAM;
 
-#ifdef _WIN32
-typedef int socklen_t;
+	if (getaddrinfo(s, NULL, &hints, &result) != 0 || result == NULL)
+		return false;
+
+	sockadr_t sadr;
+	netadr_t adr;
+	memset (&sadr, 0, sizeof(sadr));
+	memcpy(&sadr, result->ai_addr, MIN(sizeof(sadr), (size_t)result->ai_addrlen));
+	freeaddrinfo(result);
+
+	SockadrToNetadr(&sadr, &adr);
+	memcpy(ip, adr.ip, NETADR_IPBYTES);
+	return true;
+#else
+	unsigned int b[4];
+	char end;
+	if (sscanf(s, "%u.%u.%u.%u%c", &b[0], &b[1], &b[2], &b[3], &end) != 4)
+		return false;
+
+	memcpy(ip, v4mapped_prefix, sizeof(v4mapped_prefix));
+	for (int i = 0; i < 4; i++)
+	{
+		if (b[i] > 255)
+			return false;
+		ip[sizeof(v4mapped_prefix) + i] = (byte)b[i];
+	}
+	return true;
 #endif
+}
+
+bool NET_CompareAdr (const netadr_t &a, const netadr_t &b)
+{
+	return a.port == b.port && memcmp(a.ip, b.ip, NETADR_IPBYTES) == 0;
+}
 
 int NET_GetPacket (void)
 {
 	int				  ret;
-	struct sockaddr_in   from;
+	sockadr_t			from;
 	socklen_t			fromlen;
 
 	fromlen = sizeof(from);
 	net_message.clear();
-	ret = recvfrom (inet_socket, (char *)net_message.ptr(), net_message.maxsize(), 0, (struct sockaddr *)&from, &fromlen);
+	ret = recvfrom (inet_socket, (char *)net_message.ptr(), net_message.maxsize(), 0, &from.sa, &fromlen);
 
 	if (ret == -1)
 	{
@@ -488,7 +691,8 @@ int NET_GetPacket (void)
 int NET_SendPacket (buf_t &buf, netadr_t &to)
 {
 	int				   ret;
-	struct sockaddr_in	addr;
+	sockadr_t			addr;
+	socklen_t			addrlen;
 
 	// [SL] 2011-07-06 - Don't try to send a packet if we're not really connected
 	// (eg, a netdemo is being played back)
@@ -498,12 +702,19 @@ int NET_SendPacket (buf_t &buf, netadr_t &to)
 		return 0;
 	}
 
-	NetadrToSockadr (&to, &addr);
+	// An IPv4 socket has no way to reach an IPv6 peer
+	if (!inet_ipv6 && !NET_IsIPv4Adr(to))
+	{
+		buf.clear();
+		return 0;
+	}
+
+	addrlen = NetadrToSockadr (&to, &addr);
 
 #ifdef GEKKO
-	ret = sendto(inet_socket, (const char *)buf.ptr(), buf.size(), 0, (struct sockaddr *)&addr, 8);	// 8 is important for online
+	ret = sendto(inet_socket, (const char *)buf.ptr(), buf.size(), 0, &addr.sa, 8);	// 8 is important for online
 #else
-	ret = sendto(inet_socket, (const char *)buf.ptr(), buf.size(), 0, (struct sockaddr *)&addr, sizeof(addr));
+	ret = sendto(inet_socket, (const char *)buf.ptr(), buf.size(), 0, &addr.sa, addrlen);
 #endif
 
 	buf.clear();
@@ -1016,11 +1227,11 @@ static void InitNetMessageFormats()
 	SVC_INFO(svc_exitlevel);
 	SVC_INFO(svc_touchspecial);
 	SVC_INFO(svc_changeweapon);
-	SVC_INFO(svc_reserved42);
+	SVC_INFO(svc_wadinfo);
 	SVC_INFO(svc_corpse);
 	SVC_INFO(svc_missedpacket);
 	SVC_INFO(svc_soundorigin);
-	SVC_INFO(svc_reserved46);
+	SVC_INFO(svc_wadchunk);
 	SVC_INFO(svc_reserved47);
 	SVC_INFO(svc_forceteam);
 	SVC_INFO(svc_switch);
@@ -1053,6 +1264,7 @@ static void InitNetMessageFormats()
 	SVC_INFO(svc_executelinespecial);
 	SVC_INFO(svc_executeacsspecial);
 	SVC_INFO(svc_thinkerupdate);
+	SVC_INFO(svc_cmdack);
 	SVC_INFO(svc_netdemocap);
 	SVC_INFO(svc_netdemostop);
 	SVC_INFO(svc_netdemoloadsnap);
@@ -1065,6 +1277,12 @@ static void InitNetMessageFormats()
 	SVC_INFO(svc_challenge);
 	SVC_INFO(svc_max);
 
+	for (size_t i = 0; i < svc_layouts_count; i++)
+	{
+		if (svc_layouts[i].layout != NULL)
+			::svc_info[svc_layouts[i].id].msgFormat = svc_layouts[i].layout;
+	}
+
 	// Client Messages.
 	CLC_INFO(clc_abort);
 	CLC_INFO(clc_reserved1);
@@ -1091,6 +1309,7 @@ static void InitNetMessageFormats()
 	CLC_INFO(clc_netcmd);
 	CLC_INFO(clc_spy);
 	CLC_INFO(clc_privmsg);
+	CLC_INFO(clc_wadack);
 	CLC_INFO(clc_launcher_challenge);
 	CLC_INFO(clc_challenge);
 	CLC_INFO(clc_max);
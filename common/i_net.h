@@ -107,7 +107,7 @@ struct msg_info_t
 {
 	int id;
 	const char *msgName;
-	const char *msgFormat; // 'b'=byte, 'n'=short, 'N'=long, 's'=string
+	const char *msgFormat; // layout from i_netmsg.h, "x" if it has none
 
 	const char *getName() { return msgName ? msgName : ""; }
 };
@@ -154,11 +154,11 @@ enum svc_t
 	svc_exitlevel,
 	svc_touchspecial,
 	svc_changeweapon,
-	svc_reserved42,
+	svc_wadinfo,			// [string:name] [long:length] [short:chunk size]
 	svc_corpse,
 	svc_missedpacket,
 	svc_soundorigin,
-	svc_reserved46,
+	svc_wadchunk,			// [long:offset] [short:length] [data], in a packet of its own
 	svc_reserved47,
 	svc_forceteam,			// [Toke] Allows server to change a clients team setting.
 	svc_switch,
@@ -192,6 +192,7 @@ enum svc_t
 	svc_executelinespecial,
 	svc_executeacsspecial,
 	svc_thinkerupdate,
+	svc_cmdack,				// Newest ticcmd received from the client and upstream packet loss
 		
 	// netdemos - NullPoint
 	svc_netdemocap = 100,
@@ -241,7 +242,7 @@ enum clc_t
 	clc_changeteam,		// [NightFang] - Change your team [Toke - Teams] Made this actualy work
 	clc_ctfcommand,
 	clc_spectate,			// denis - [byte:state]
-	clc_wantwad,			// denis - string:name, string:hash
+	clc_wantwad,			// denis - string:name, string:hash, long:offset
 	clc_kill,				// denis - suicide
 	clc_cheat,				// denis - god, pumpkins, etc
     clc_cheatpulse,         // Russell - one off cheats (idkfa, idfa etc)
@@ -252,6 +253,7 @@ enum clc_t
 	clc_netcmd,				// [AM] Send a string command to the server.
 	clc_spy,				// [SL] Tell server to send info about this player
 	clc_privmsg,			// [AM] Targeted chat to a specific player.
+	clc_wadack,				// [long:next chunk] [byte:count] [count bytes of later chunks held]
 
 	// for when launcher packets go astray
 	clc_launcher_challenge = 212,
@@ -259,6 +261,15 @@ enum clc_t
 	clc_max = 255
 };
 
+// Type of connection a client asks for when it joins
+enum connectiontype_t
+{
+	CONNECT_PLAY,
+	CONNECT_SPECTATE,
+	CONNECT_RCON,
+	CONNECT_DOWNLOAD	// only to fetch a file with clc_wantwad
+};
+
 extern msg_info_t clc_info[clc_max + 1];
 extern msg_info_t svc_info[svc_max + 1];
 
@@ -270,13 +281,26 @@ enum svc_compressed_masks
 	minilzo_mask = 8
 };
 
+// Addresses are held as IPv6 addresses, with IPv4 addresses in their
+// IPv4-mapped form (::ffff:a.b.c.d), so both families compare, hash and
+// print the same way.  port is in network byte order.
+#define NETADR_IPBYTES 16
+
 typedef struct
 {
-   byte    ip[4];
+   byte    ip[NETADR_IPBYTES];
    unsigned short  port;
    unsigned short  pad;
 } netadr_t;
 
+// Address families NET_StringToAdr can be limited to
+enum netadrtype_t
+{
+	NA_ANY,
+	NA_IPV4,
+	NA_IPV6
+};
+
 extern  netadr_t  net_from;  // address of who sent the packet
 
 
@@ -693,9 +717,13 @@ void InitNetCommon(void);
 void I_SetPort(netadr_t &addr, int port);
 bool NetWaitOrTimeout(size_t ms);
 
-char *NET_AdrToString (netadr_t a);
-bool NET_StringToAdr (const char *s, netadr_t *a);
-bool NET_CompareAdr (netadr_t a, netadr_t b);
+char *NET_AdrToString (const netadr_t &a, bool displayport = true);
+bool NET_StringToAdr (const char *s, netadr_t *a, netadrtype_t type = NA_ANY);
+bool NET_StringToIP (const char *s, byte *ip);
+bool NET_CompareAdr (const netadr_t &a, const netadr_t &b);
+bool NET_IsIPv4Adr (const netadr_t &a);
+bool NET_IsNullAdr (const netadr_t &a);
+bool NET_HaveIPv6 (void);
 int  NET_GetPacket (void);
 int NET_SendPacket (buf_t &buf, netadr_t &to);
 std::string NET_GetLocalAddress (void);
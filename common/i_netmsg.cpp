@@ -0,0 +1,176 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Wire layout of server messages.
+//
+//-----------------------------------------------------------------------------
+
+#include "i_netmsg.h"
+#include "i_net.h"
+
+#define SVC_LAYOUT(n, l) { n, #n, l }
+
+// Keep these in step with the CL_ handlers that read them
+const svc_layout_t svc_layouts[] =
+{
+	SVC_LAYOUT(svc_abort,			""),
+	SVC_LAYOUT(svc_full,			""),
+	SVC_LAYOUT(svc_disconnect,		""),
+	SVC_LAYOUT(svc_reserved3,		NULL),
+	SVC_LAYOUT(svc_playerinfo,		NULL),
+	SVC_LAYOUT(svc_moveplayer,		"bNNNNnnbNNNb"),
+	SVC_LAYOUT(svc_updatelocalplayer,	"NNNNNNNb"),
+	SVC_LAYOUT(svc_levellocals,		NULL),
+	SVC_LAYOUT(svc_pingrequest,		"N"),
+	SVC_LAYOUT(svc_updateping,		"bN"),
+	SVC_LAYOUT(svc_spawnmobj,		NULL),
+	SVC_LAYOUT(svc_disconnectclient,	NULL),
+	SVC_LAYOUT(svc_loadmap,			NULL),
+	SVC_LAYOUT(svc_consoleplayer,	"bs"),
+	SVC_LAYOUT(svc_mobjspeedangle,	"uNNNN"),
+	SVC_LAYOUT(svc_explodemissile,	"u"),
+	SVC_LAYOUT(svc_removemobj,		"u"),
+	SVC_LAYOUT(svc_userinfo,		NULL),
+	SVC_LAYOUT(svc_movemobj,		"ubNNN"),
+	SVC_LAYOUT(svc_spawnplayer,		NULL),
+	SVC_LAYOUT(svc_damageplayer,	NULL),
+	SVC_LAYOUT(svc_killmobj,		"uuuvvbv"),
+	SVC_LAYOUT(svc_firepistol,		"b"),
+	SVC_LAYOUT(svc_fireshotgun,		"b"),
+	SVC_LAYOUT(svc_firessg,			"b"),
+	SVC_LAYOUT(svc_firechaingun,	"b"),
+	SVC_LAYOUT(svc_fireweapon,		"bN"),
+	SVC_LAYOUT(svc_sector,			NULL),
+	SVC_LAYOUT(svc_print,			"bs"),
+	SVC_LAYOUT(svc_mobjinfo,		"uN"),
+	SVC_LAYOUT(svc_playermembers,	NULL),
+	SVC_LAYOUT(svc_teammembers,		NULL),
+	SVC_LAYOUT(svc_activateline,	NULL),
+	SVC_LAYOUT(svc_movingsector,	NULL),
+	SVC_LAYOUT(svc_startsound,		"uNNbbbb"),
+	SVC_LAYOUT(svc_reconnect,		NULL),
+	SVC_LAYOUT(svc_exitlevel,		""),
+	SVC_LAYOUT(svc_touchspecial,	"u"),
+	SVC_LAYOUT(svc_changeweapon,	"b"),
+	SVC_LAYOUT(svc_wadinfo,		"sNn"),
+	SVC_LAYOUT(svc_corpse,			"ubb"),
+	SVC_LAYOUT(svc_missedpacket,	NULL),
+	SVC_LAYOUT(svc_soundorigin,		"NNbbbb"),
+	SVC_LAYOUT(svc_wadchunk,		NULL),
+	SVC_LAYOUT(svc_reserved47,		NULL),
+	SVC_LAYOUT(svc_forceteam,		NULL),
+	SVC_LAYOUT(svc_switch,			NULL),
+	SVC_LAYOUT(svc_say,				"bbs"),
+	SVC_LAYOUT(svc_reserved51,		NULL),
+	SVC_LAYOUT(svc_spawnhiddenplayer,	NULL),
+	SVC_LAYOUT(svc_updatedeaths,	NULL),
+	SVC_LAYOUT(svc_ctfevent,		NULL),
+	SVC_LAYOUT(svc_secretevent,		NULL),
+	SVC_LAYOUT(svc_serversettings,	NULL),
+	SVC_LAYOUT(svc_connectclient,	NULL),
+	SVC_LAYOUT(svc_midprint,		"sn"),
+	SVC_LAYOUT(svc_svgametic,		"b"),
+	SVC_LAYOUT(svc_inttimeleft,		"n"),
+	SVC_LAYOUT(svc_mobjtranslation,	"ub"),
+	SVC_LAYOUT(svc_fullupdatedone,	""),
+	SVC_LAYOUT(svc_railtrail,		"nnnnnn"),
+	SVC_LAYOUT(svc_playerstate,		NULL),
+	SVC_LAYOUT(svc_levelstate,		NULL),
+	SVC_LAYOUT(svc_resetmap,		NULL),
+	SVC_LAYOUT(svc_playerqueuepos,	NULL),
+	SVC_LAYOUT(svc_fullupdatestart,	""),
+	SVC_LAYOUT(svc_lineupdate,		NULL),
+	SVC_LAYOUT(svc_sectorproperties,	NULL),
+	SVC_LAYOUT(svc_linesideupdate,	NULL),
+	SVC_LAYOUT(svc_mobjstate,		"un"),
+	SVC_LAYOUT(svc_actor_movedir,	"ubN"),
+	SVC_LAYOUT(svc_actor_target,	"uu"),
+	SVC_LAYOUT(svc_actor_tracer,	"uu"),
+	SVC_LAYOUT(svc_damagemobj,		"unb"),
+	SVC_LAYOUT(svc_executelinespecial,	NULL),
+	SVC_LAYOUT(svc_executeacsspecial,	NULL),
+	SVC_LAYOUT(svc_thinkerupdate,	NULL),
+	SVC_LAYOUT(svc_cmdack,			"ub"),
+	SVC_LAYOUT(svc_netdemocap,		"bbnnnnnbNNNNNNNNNNNNNbb"),
+	SVC_LAYOUT(svc_netdemostop,		""),
+	SVC_LAYOUT(svc_netdemoloadsnap,	NULL),
+	SVC_LAYOUT(svc_vote_update,		NULL),
+	SVC_LAYOUT(svc_maplist,			NULL),
+	SVC_LAYOUT(svc_maplist_update,	NULL),
+	SVC_LAYOUT(svc_maplist_index,	NULL),
+	SVC_LAYOUT(svc_challenge,		NULL),
+	SVC_LAYOUT(svc_compressed,		NULL),
+	SVC_LAYOUT(svc_launcher_challenge,	NULL),
+};
+
+const size_t svc_layouts_count = sizeof(svc_layouts) / sizeof(svc_layouts[0]);
+
+const char *NET_SvcLayout(int id)
+{
+	for (size_t i = 0; i < svc_layouts_count; i++)
+	{
+		if (svc_layouts[i].id == id)
+			return svc_layouts[i].layout;
+	}
+
+	return NULL;
+}
+
+int NET_MeasureLayout(const char *layout, const unsigned char *data, size_t len)
+{
+	size_t pos = 0;
+
+	for (const char *field = layout; *field; field++)
+	{
+		switch (*field)
+		{
+		case 'b':
+			pos += 1;
+			break;
+		case 'n':
+			pos += 2;
+			break;
+		case 'N':
+			pos += 4;
+			break;
+		case 'u':
+		case 'v':
+			// up to five bytes, the last one without the flag bit
+			for (int i = 0; ; i++)
+			{
+				if (pos >= len || i == 5)
+					return -1;
+				if (!(data[pos++] & 0x80))
+					break;
+			}
+			break;
+		case 's':
+			while (pos < len && data[pos])
+				pos++;
+			pos++;
+			break;
+		default:
+			return -1;
+		}
+
+		if (pos > len)
+			return -1;
+	}
+
+	return (int)pos;
+}
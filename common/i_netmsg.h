@@ -0,0 +1,59 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Wire layout of server messages.
+//
+//     This file has no engine dependencies beyond the message ids in i_net.h
+//     so tools/netdecode can build it on its own.
+//
+//     A layout is a string with one character per field, in the order the
+//     client reads them:
+//
+//       b  byte               n  short            N  long
+//       u  unsigned varint    v  signed varint    s  NUL terminated string
+//
+//     An empty layout is a message with no body.  Messages whose body
+//     depends on flags inside the message, on game state or on the protocol
+//     version have no layout, only their handler knows where they end.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __I_NETMSG_H__
+#define __I_NETMSG_H__
+
+#include <stddef.h>
+
+struct svc_layout_t
+{
+	int id;
+	const char *name;
+	const char *layout;
+};
+
+// Every server message in id order, with a NULL layout if it has none
+extern const svc_layout_t svc_layouts[];
+extern const size_t svc_layouts_count;
+
+// Layout of a server message, or NULL if it has none
+const char *NET_SvcLayout(int id);
+
+// Bytes a message with this layout takes at the start of data, or -1 if
+// the message runs past len
+int NET_MeasureLayout(const char *layout, const unsigned char *data, size_t len);
+
+#endif // __I_NETMSG_H__
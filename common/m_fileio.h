@@ -83,6 +83,29 @@ std::string M_GetUserDir();
  */
 std::string M_GetWriteDir();
 
+/**
+ * @brief Create a directory if it does not already exist.
+ *
+ * @param path Directory to create, its parent must exist.
+ * @return True if the directory exists afterwards.
+ */
+bool M_CreateDir(const std::string& path);
+
+/**
+ * @brief Map a whole file into memory, read-only.
+ *
+ * @param path File to map.
+ * @param length Set to the length of the file.
+ * @return Start of the file in memory, or NULL if it could not be mapped.
+ *         Pass it to M_UnmapFile when done.
+ */
+const byte* M_MapFile(const std::string& path, size_t& length);
+
+/**
+ * @brief Unmap a file mapped by M_MapFile.
+ */
+void M_UnmapFile(const byte* data, size_t length);
+
 /**
  * @brief Resolve a file name into a user directory.
  * 
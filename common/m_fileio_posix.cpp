@@ -34,7 +34,9 @@
 
 #include <errno.h>
 #include <pwd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #if defined(__linux__)
 #include <linux/limits.h>
@@ -175,6 +177,53 @@ std::string M_GetWriteDir()
 	return path;
 }
 
+bool M_CreateDir(const std::string& path)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) == 0)
+		return S_ISDIR(info.st_mode);
+
+	return mkdir(path.c_str(), S_IRUSR | S_IWUSR | S_IXUSR) == 0;
+}
+
+const byte* M_MapFile(const std::string& path, size_t& length)
+{
+	length = 0;
+
+#if defined(GEKKO) || defined(__SWITCH__)
+	return NULL;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size <= 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	// The mapping outlives the descriptor
+	void* data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return NULL;
+
+	length = info.st_size;
+	return (const byte*)data;
+#endif
+}
+
+void M_UnmapFile(const byte* data, size_t length)
+{
+#if !defined(GEKKO) && !defined(__SWITCH__)
+	if (data != NULL)
+		munmap((void*)data, length);
+#endif
+}
+
 std::string M_GetUserFileName(const std::string& file)
 {
 
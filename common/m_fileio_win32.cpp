@@ -123,6 +123,60 @@ std::string M_GetWriteDir()
 #endif
 }
 
+bool M_CreateDir(const std::string& path)
+{
+	if (CreateDirectory(path.c_str(), NULL))
+		return true;
+
+	DWORD attributes = GetFileAttributes(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES &&
+	       (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+const byte* M_MapFile(const std::string& path, size_t& length)
+{
+	length = 0;
+
+#if defined(_XBOX)
+	return NULL;
+#else
+	HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+	                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL)
+		return NULL;
+
+	// The view outlives both handles
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	if (data == NULL)
+		return NULL;
+
+	length = (size_t)size.QuadPart;
+	return (const byte*)data;
+#endif
+}
+
+void M_UnmapFile(const byte* data, size_t length)
+{
+#if !defined(_XBOX)
+	if (data != NULL)
+		UnmapViewOfFile(data);
+#endif
+}
+
 std::string M_GetUserFileName(const std::string& file)
 {
 #if defined(_XBOX)
@@ -324,6 +324,49 @@ bool M_ResolveWantedFile(OResFile& out, const OWantFile& wanted)
 	return false;
 }
 
+/**
+ * @brief Check if a wanted file would resolve to a file that is already
+ *        loaded, without searching for it or hashing it.
+ *
+ * @detail A wanted file without an extension matches any of the extensions
+ *         of its type, the same way M_ResolveWantedFile would find it.  If
+ *         the wanted file has a hash, it has to be the loaded file's hash.
+ *
+ * @param wanted Wanted file to check.
+ * @param res Loaded file to check against.
+ * @return True if the loaded file is the wanted file.
+ */
+bool M_WantedMatchesResFile(const OWantFile& wanted, const OResFile& res)
+{
+	if (!wanted.getWantedHash().empty() && wanted.getWantedHash() != res.getHash())
+	{
+		return false;
+	}
+
+	if (wanted.getBasename() == res.getBasename())
+	{
+		return true;
+	}
+
+	std::string strext;
+	if (M_ExtractFileExtension(wanted.getBasename(), strext))
+	{
+		return false;
+	}
+
+	const std::vector<std::string>& exts = M_FileTypeExts(wanted.getWantedType());
+	for (std::vector<std::string>::const_iterator it = exts.begin(); it != exts.end();
+	     ++it)
+	{
+		if (wanted.getBasename() + *it == res.getBasename())
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 BEGIN_COMMAND(whereis)
 {
 	if (argc < 2)
@@ -157,5 +157,6 @@ std::string M_ResFilesToString(const OResFiles& files);
 const std::vector<std::string>& M_FileTypeExts(ofile_t type);
 std::vector<std::string> M_FileSearchDirs();
 bool M_ResolveWantedFile(OResFile& out, const OWantFile& wanted);
+bool M_WantedMatchesResFile(const OWantFile& wanted, const OResFile& res);
 
 #endif // __ORESFILE_H__
@@ -0,0 +1,300 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     WDL binary stats log format and its converter to the text format.
+//
+//-----------------------------------------------------------------------------
+
+#include "m_wdlconv.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Reads the varints and strings a binary log is made of.  Running out of
+// file part way through anything sets the end flag, the caller throws away
+// the record it was reading.
+class WDLReader
+{
+public:
+	WDLReader(FILE* fh) : m_File(fh), m_End(false) { }
+
+	bool End() const
+	{
+		return m_End;
+	}
+
+	int ReadByte()
+	{
+		int c = getc(m_File);
+		if (c == EOF)
+			m_End = true;
+		return c;
+	}
+
+	unsigned int ReadUnVarint()
+	{
+		unsigned int v = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			int b = ReadByte();
+			if (b == EOF)
+				return 0;
+
+			v |= (unsigned int)(b & 0x7F) << shift;
+			if (!(b & 0x80))
+				return v;
+		}
+
+		// Too long to be a varint, the log is damaged.
+		m_End = true;
+		return 0;
+	}
+
+	int ReadVarint()
+	{
+		unsigned int uv = ReadUnVarint();
+		return (int)(uv >> 1) ^ -(int)(uv & 1);
+	}
+
+	std::string ReadString()
+	{
+		std::string str;
+		int c;
+		while ((c = ReadByte()) != EOF && c != 0)
+			str += (char)c;
+		return str;
+	}
+
+private:
+	FILE* m_File;
+	bool m_End;
+};
+
+struct WDLLogHeader
+{
+	unsigned int version;
+	std::string starttime;
+	int levelnum;
+	std::string levelname;
+	int begintic;
+};
+
+struct WDLLogPlayer
+{
+	int team;
+	std::string netname;
+};
+
+struct WDLLogEvent
+{
+	unsigned int ev;
+	unsigned int activator;
+	unsigned int target;
+	int gametic;
+	int apos[3];
+	int tpos[3];
+	int arg0;
+	int arg1;
+	int arg2;
+};
+
+static bool ReadHeader(FILE* fh, WDLReader& reader, WDLLogHeader& header)
+{
+	char magic[4];
+	if (fread(magic, 1, sizeof(magic), fh) != sizeof(magic) ||
+	    memcmp(magic, WDLLOG_MAGIC, sizeof(magic)) != 0)
+		return false;
+
+	header.version = reader.ReadUnVarint();
+	header.starttime = reader.ReadString();
+	header.levelnum = reader.ReadVarint();
+	header.levelname = reader.ReadString();
+	header.begintic = reader.ReadVarint();
+
+	return !reader.End();
+}
+
+// The gametic is stored as a delta, lasttic carries it between events.
+static void ReadEvent(WDLReader& reader, WDLLogEvent& evt, int& lasttic)
+{
+	evt.ev = reader.ReadUnVarint();
+	evt.activator = reader.ReadUnVarint();
+	evt.target = reader.ReadUnVarint();
+	evt.gametic = lasttic + reader.ReadVarint();
+	for (int i = 0; i < 3; i++)
+		evt.apos[i] = reader.ReadVarint();
+	for (int i = 0; i < 3; i++)
+		evt.tpos[i] = reader.ReadVarint();
+	evt.arg0 = reader.ReadVarint();
+	evt.arg1 = reader.ReadVarint();
+	evt.arg2 = reader.ReadVarint();
+
+	lasttic = evt.gametic;
+}
+
+static const char* PlayerName(const std::vector<WDLLogPlayer>& players, unsigned int id)
+{
+	// Ids are stored off by one so zero can mean nobody.
+	if (id == 0 || id > players.size())
+		return "";
+	return players[id - 1].netname.c_str();
+}
+
+bool M_ConvertWDLLog(
+	const std::string& binpath, const std::string& textpath,
+	bool& partial, std::string& error
+)
+{
+	partial = true;
+
+	FILE* in = fopen(binpath.c_str(), "rb");
+	if (in == NULL)
+	{
+		error = "could not open \"" + binpath + "\"";
+		return false;
+	}
+
+	WDLReader reader(in);
+	WDLLogHeader header;
+	if (!ReadHeader(in, reader, header))
+	{
+		fclose(in);
+		error = "\"" + binpath + "\" is not a WDL binary log";
+		return false;
+	}
+
+	long eventsofs = ftell(in);
+
+	// First pass finds the players, which the text format lists before the
+	// events, and how far the log can be trusted.
+	std::vector<WDLLogPlayer> players;
+	WDLLogEvent evt;
+	int lasttic = header.begintic;
+	int endgametic = header.begintic;
+	std::string endtime;
+	long validend = eventsofs;
+
+	for (;;)
+	{
+		int tag = reader.ReadByte();
+		if (tag == EOF)
+			break;
+
+		if (tag == WDL_RECORD_PLAYER)
+		{
+			unsigned int id = reader.ReadUnVarint();
+			WDLLogPlayer player;
+			player.team = reader.ReadVarint();
+			player.netname = reader.ReadString();
+			if (reader.End() || id != players.size())
+				break;
+			players.push_back(player);
+		}
+		else if (tag == WDL_RECORD_EVENT)
+		{
+			ReadEvent(reader, evt, lasttic);
+			if (reader.End())
+				break;
+			endgametic = evt.gametic;
+		}
+		else if (tag == WDL_RECORD_END)
+		{
+			int tic = reader.ReadVarint();
+			std::string time = reader.ReadString();
+			if (reader.End())
+				break;
+			endgametic = tic;
+			endtime = time;
+			partial = false;
+			validend = ftell(in);
+			break;
+		}
+		else
+		{
+			// Unknown record, nothing after it can be read.
+			break;
+		}
+
+		validend = ftell(in);
+	}
+
+	FILE* out = fopen(textpath.c_str(), "w+");
+	if (out == NULL)
+	{
+		fclose(in);
+		error = "could not open \"" + textpath + "\" for writing";
+		return false;
+	}
+
+	// Header
+	fprintf(out, "version=%u\n", header.version);
+	fprintf(out, "time=%s\n", partial ? header.starttime.c_str() : endtime.c_str());
+	fprintf(out, "levelnum=%d\n", header.levelnum);
+	fprintf(out, "levelname=%s\n", header.levelname.c_str());
+	fprintf(out, "duration=%d\n", endgametic - header.begintic);
+	fprintf(out, "endgametic=%d\n", endgametic);
+
+	// Players
+	fprintf(out, "players\n");
+	std::vector<WDLLogPlayer>::const_iterator pit = players.begin();
+	for (; pit != players.end(); ++pit)
+		fprintf(out, "%d,%s\n", pit->team, pit->netname.c_str());
+
+	// Events
+	fprintf(out, "events\n");
+	fseek(in, eventsofs, SEEK_SET);
+	lasttic = header.begintic;
+	while (ftell(in) < validend)
+	{
+		int tag = reader.ReadByte();
+
+		if (tag == WDL_RECORD_PLAYER)
+		{
+			reader.ReadUnVarint();
+			reader.ReadVarint();
+			reader.ReadString();
+		}
+		else if (tag == WDL_RECORD_EVENT)
+		{
+			ReadEvent(reader, evt, lasttic);
+
+			//           "ev,ac,tg,gt,ax,ay,az,tx,ty,tz,a0,a1,a2"
+			fprintf(out, "%u,%s,%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
+				evt.ev, PlayerName(players, evt.activator),
+				PlayerName(players, evt.target), evt.gametic,
+				evt.apos[0], evt.apos[1], evt.apos[2],
+				evt.tpos[0], evt.tpos[1], evt.tpos[2],
+				evt.arg0, evt.arg1, evt.arg2);
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	fclose(in);
+
+	if (fclose(out) != 0)
+	{
+		error = "could not finish writing \"" + textpath + "\"";
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,67 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     WDL binary stats log format and its converter to the text format.
+//
+//     This file has no engine dependencies so tools/wdlconv can build it on
+//     its own.
+//
+//     A binary log is the magic "WDLB" followed by a header, then a stream of
+//     records each starting with a tag byte.  Integers are varints, the same
+//     encoding buf_t::WriteUnVarint and WriteVarint use, and strings are NUL
+//     terminated.
+//
+//       header   uvarint version, string start time, varint levelnum,
+//                string levelname, varint begintic
+//       'P'      uvarint id, varint team, string netname
+//       'E'      uvarint event, uvarint activator id + 1, uvarint target
+//                id + 1 (0 for nobody), varint gametic delta from the last
+//                event, varint ax, ay, az, tx, ty, tz, arg0, arg1, arg2
+//       'Z'      varint endgametic, string end time
+//
+//     Every record stands on its own, so a log cut short by a crash converts
+//     up to its last complete record.  A log without a 'Z' record is partial.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __WDLCONV_H__
+#define __WDLCONV_H__
+
+#include <string>
+
+#define WDLLOG_MAGIC "WDLB"
+
+enum WDLRecordTags
+{
+	WDL_RECORD_PLAYER = 'P',
+	WDL_RECORD_EVENT = 'E',
+	WDL_RECORD_END = 'Z',
+};
+
+/**
+ * Convert a binary WDL log to the text format M_CommitWDLLog used to write.
+ *
+ * Returns false with a message in error if the log could not be read or the
+ * text log could not be written.  partial is set if the log was cut short.
+ */
+bool M_ConvertWDLLog(
+	const std::string& binpath, const std::string& textpath,
+	bool& partial, std::string& error
+);
+
+#endif
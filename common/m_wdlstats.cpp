@@ -23,15 +23,48 @@
 
 #include "m_wdlstats.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
 #include "c_dispatch.h"
 #include "g_levelstate.h"
+#include "i_net.h"
+#include "i_system.h"
+#include "m_wdlconv.h"
 #include "p_local.h"
 
+// Only the server writes its log from a thread of its own, the client
+// writes from the game thread so it does not need threads on every target.
+#ifdef SERVER_APP
+#define WDL_WRITER_THREAD
+#endif
+
+#ifdef _WIN32
+#include "win32inc.h"
+#include <io.h>
+#else
+#include <unistd.h>
+#ifdef WDL_WRITER_THREAD
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+#endif
+
 #define WDLSTATS_VERSION 5
 
+// Bytes in the buffer between the game thread and the log writer.
+#define WDL_RING_SIZE (256 * 1024)
+
+// Largest batch of records handed to the writer at once.
+#define WDL_BATCH_SIZE (16 * 1024)
+
+// Seconds between forcing the log out to disk.
+#define WDL_SYNC_SECONDS 5
+
+// Events kept around for wdlinfo.
+#define WDL_HISTORY 64
+
 extern Players players;
 
 EXTERN_CVAR(sv_gametype)
@@ -65,6 +98,15 @@ static struct WDLState {
 
 	// The starting gametic of the most recent log.
 	int begintic;
+
+	// Binary log being written, the text log is made from it at the end.
+	std::string binfilename;
+
+	// Events logged since the log started.
+	size_t eventcount;
+
+	// Gametic of the last event handed to the writer.
+	int lasttic;
 } wdlstate;
 
 // A single tracked player
@@ -74,16 +116,19 @@ struct WDLPlayer
 	team_t team;
 };
 
-// WDL Players that we're keeping track of.
+// WDL Players that we're keeping track of, events refer to them by index.
 typedef std::vector<WDLPlayer> WDLPlayers;
 static WDLPlayers wdlplayers;
 
+typedef std::map<std::string, int> WDLPlayerIds;
+static WDLPlayerIds wdlplayerids;
+
 // A single event.
 struct WDLEvent
 {
 	WDLEvents ev;
-	std::string activator;
-	std::string target;
+	int activator;	// index into wdlplayers, -1 for nobody
+	int target;
 	int gametic;
 	fixed_t apos[3];
 	fixed_t tpos[3];
@@ -92,9 +137,417 @@ struct WDLEvent
 	int arg2;
 };
 
-// Events that we're keeping track of.
+// Events from the current gametic.  Damage and accuracy events can still be
+// merged into these, they go to the writer once the gametic is over.
 typedef std::vector<WDLEvent> WDLEventLog;
-static WDLEventLog wdlevents;
+static WDLEventLog wdltic;
+
+// The last few events, for wdlinfo.
+static WDLEvent wdlhistory[WDL_HISTORY];
+
+// Records waiting to be handed to the writer.
+static buf_t wdlbatch(WDL_BATCH_SIZE + 1024);
+
+//
+// The log writer
+//
+// The game thread hands the writer frames through a single producer, single
+// consumer ring: a little-endian length, a frame type and the payload.  The
+// game thread only moves the head and the writer only moves the tail, so
+// neither ever waits on the other unless the ring fills up.
+//
+
+enum WDLFrameTypes
+{
+	WDL_FRAME_OPEN,		// payload is the binary log's filename
+	WDL_FRAME_DATA,		// payload is appended to the binary log
+	WDL_FRAME_CLOSE,	// payload is the text log's filename, if any
+};
+
+#define WDL_FRAME_HEADER 5
+
+#if defined(_MSC_VER)
+#define WDLBarrier() MemoryBarrier()
+#else
+#define WDLBarrier() __sync_synchronize()
+#endif
+
+static byte wdlring[WDL_RING_SIZE];
+static volatile size_t wdlring_head = 0;
+static volatile size_t wdlring_tail = 0;
+
+// Writer state, only touched by the writer.
+static FILE* wdlfile = NULL;
+static std::string wdlopenname;
+static time_t wdllastsync = 0;
+static bool wdlunsynced = false;
+
+// Messages from the writer for the console, guarded by the lock.
+static std::vector<std::string> wdlmessages;
+
+static bool wdl_thread_started = false;
+
+#if !defined(WDL_WRITER_THREAD)
+static void WDLLock() { }
+static void WDLUnlock() { }
+#elif defined(_WIN32)
+static CRITICAL_SECTION wdl_lock;
+static HANDLE wdl_event;
+static bool wdl_lock_init = false;
+
+static void WDLLock()
+{
+	if (!wdl_lock_init)
+	{
+		InitializeCriticalSection(&wdl_lock);
+		wdl_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+		wdl_lock_init = true;
+	}
+	EnterCriticalSection(&wdl_lock);
+}
+
+static void WDLUnlock()
+{
+	LeaveCriticalSection(&wdl_lock);
+}
+
+static void WDLWait(int ms)
+{
+	WaitForSingleObject(wdl_event, ms);
+}
+
+static void WDLSignal()
+{
+	SetEvent(wdl_event);
+}
+#else
+static pthread_mutex_t wdl_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wdl_cond = PTHREAD_COND_INITIALIZER;
+static bool wdl_signalled = false;
+
+static void WDLLock()
+{
+	pthread_mutex_lock(&wdl_lock);
+}
+
+static void WDLUnlock()
+{
+	pthread_mutex_unlock(&wdl_lock);
+}
+
+// Waits for a signal or until ms have passed, whichever comes first.
+static void WDLWait(int ms)
+{
+	struct timeval now;
+	struct timespec until;
+
+	gettimeofday(&now, NULL);
+	until.tv_sec = now.tv_sec + ms / 1000;
+	until.tv_nsec = (now.tv_usec + (ms % 1000) * 1000) * 1000;
+	if (until.tv_nsec >= 1000000000)
+	{
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&wdl_lock);
+	if (!wdl_signalled)
+		pthread_cond_timedwait(&wdl_cond, &wdl_lock, &until);
+	wdl_signalled = false;
+	pthread_mutex_unlock(&wdl_lock);
+}
+
+static void WDLSignal()
+{
+	pthread_mutex_lock(&wdl_lock);
+	wdl_signalled = true;
+	pthread_cond_signal(&wdl_cond);
+	pthread_mutex_unlock(&wdl_lock);
+}
+#endif
+
+static void WDLMessage(const std::string& message)
+{
+	WDLLock();
+	wdlmessages.push_back(message);
+	WDLUnlock();
+}
+
+// Game thread only, prints what the writer had to say.
+static void WDLPrintMessages()
+{
+	std::vector<std::string> messages;
+
+	WDLLock();
+	messages.swap(wdlmessages);
+	WDLUnlock();
+
+	for (size_t i = 0; i < messages.size(); i++)
+		Printf(PRINT_HIGH, "wdlstats: %s\n", messages[i].c_str());
+}
+
+static void WDLSyncFile(FILE* fh)
+{
+	fflush(fh);
+#ifdef _WIN32
+	_commit(_fileno(fh));
+#else
+	fsync(fileno(fh));
+#endif
+	wdllastsync = time(NULL);
+	wdlunsynced = false;
+}
+
+// Copies len bytes out of the ring starting at pos, minding the wrap.
+static void WDLRingRead(size_t pos, byte* dest, size_t len)
+{
+	size_t ofs = pos % WDL_RING_SIZE;
+	size_t first = MIN<size_t>(len, WDL_RING_SIZE - ofs);
+
+	memcpy(dest, wdlring + ofs, first);
+	memcpy(dest + first, wdlring, len - first);
+}
+
+static std::string WDLRingString(size_t pos, size_t len)
+{
+	std::vector<byte> str(len + 1, 0);
+	WDLRingRead(pos, &str[0], len);
+	return std::string((const char*)&str[0], len);
+}
+
+static void WDLCloseFile(const std::string& textfilename)
+{
+	if (wdlfile == NULL)
+		return;
+
+	WDLSyncFile(wdlfile);
+	fclose(wdlfile);
+	wdlfile = NULL;
+
+	if (textfilename.empty())
+		return;
+
+	bool partial;
+	std::string error;
+	if (!M_ConvertWDLLog(wdlopenname, textfilename, partial, error))
+		WDLMessage("Could not convert log, " + error + ".");
+	else
+		WDLMessage("Log saved as \"" + textfilename + "\".");
+}
+
+//
+// WDLWriterDrain
+//
+// Writes out everything in the ring.  Runs on the writer thread, or on the
+// game thread when there is none.
+//
+static void WDLWriterDrain()
+{
+	size_t head = wdlring_head;
+	WDLBarrier();
+	size_t tail = wdlring_tail;
+
+	while (tail != head)
+	{
+		byte header[WDL_FRAME_HEADER];
+		WDLRingRead(tail, header, WDL_FRAME_HEADER);
+
+		size_t len = header[0] | (header[1] << 8) | (header[2] << 16) | (header[3] << 24);
+		size_t pos = tail + WDL_FRAME_HEADER;
+
+		switch (header[4])
+		{
+		case WDL_FRAME_OPEN:
+		{
+			std::string filename = WDLRingString(pos, len);
+
+			WDLCloseFile("");
+			wdlfile = fopen(filename.c_str(), "wb");
+			wdlopenname = filename;
+			if (wdlfile == NULL)
+				WDLMessage("Could not open \"" + filename + "\" for writing.");
+			wdllastsync = time(NULL);
+			break;
+		}
+		case WDL_FRAME_DATA:
+			if (wdlfile != NULL)
+			{
+				size_t ofs = pos % WDL_RING_SIZE;
+				size_t first = MIN<size_t>(len, WDL_RING_SIZE - ofs);
+
+				fwrite(wdlring + ofs, 1, first, wdlfile);
+				if (len > first)
+					fwrite(wdlring, 1, len - first, wdlfile);
+				wdlunsynced = true;
+			}
+			break;
+		case WDL_FRAME_CLOSE:
+			WDLCloseFile(WDLRingString(pos, len));
+			break;
+		}
+
+		tail = pos + len;
+		WDLBarrier();
+		wdlring_tail = tail;
+	}
+
+	// Whatever is written survives the process going down, syncing now and
+	// then keeps most of it if the machine goes down too.
+	if (wdlfile != NULL && wdlunsynced)
+	{
+		fflush(wdlfile);
+		if (time(NULL) - wdllastsync >= WDL_SYNC_SECONDS)
+			WDLSyncFile(wdlfile);
+	}
+}
+
+#ifdef WDL_WRITER_THREAD
+#ifdef _WIN32
+static DWORD WINAPI WDLWriterThread(LPVOID)
+#else
+static void *WDLWriterThread(void *)
+#endif
+{
+	for (;;)
+	{
+		WDLWait(1000);
+		WDLWriterDrain();
+	}
+
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
+#endif
+
+static void WDLStartWriter()
+{
+#ifdef WDL_WRITER_THREAD
+	if (wdl_thread_started)
+		return;
+
+	// Set up the lock before there are two threads to race for it.
+	WDLLock();
+	WDLUnlock();
+
+#ifdef _WIN32
+	HANDLE thread = CreateThread(NULL, 0, WDLWriterThread, NULL, 0, NULL);
+	wdl_thread_started = (thread != NULL);
+	if (thread != NULL)
+		CloseHandle(thread);
+#else
+	pthread_t thread;
+	wdl_thread_started = (pthread_create(&thread, NULL, WDLWriterThread, NULL) == 0);
+	if (wdl_thread_started)
+		pthread_detach(thread);
+#endif
+
+	if (!wdl_thread_started)
+		Printf(PRINT_HIGH, "wdlstats: Could not start the log writer thread, writing from the game thread.\n");
+#endif
+}
+
+// Has the writer look at the ring now instead of when it next wakes up.
+static void WDLWake()
+{
+#ifdef WDL_WRITER_THREAD
+	if (wdl_thread_started)
+	{
+		WDLSignal();
+		return;
+	}
+#endif
+	WDLWriterDrain();
+}
+
+static void WDLPushFrame(byte type, const byte* data, size_t len)
+{
+	size_t total = WDL_FRAME_HEADER + len;
+
+	// Wait for the writer to make room, this only happens if the disk
+	// cannot keep up.
+	while (WDL_RING_SIZE - (wdlring_head - wdlring_tail) < total)
+	{
+		WDLWake();
+		if (wdl_thread_started)
+			I_Sleep(I_ConvertTimeFromMs(1));
+	}
+
+	byte header[WDL_FRAME_HEADER] = {
+		(byte)(len & 0xff), (byte)((len >> 8) & 0xff),
+		(byte)((len >> 16) & 0xff), (byte)((len >> 24) & 0xff),
+		type
+	};
+
+	size_t head = wdlring_head;
+	for (size_t i = 0; i < total; i++)
+	{
+		byte b = i < WDL_FRAME_HEADER ? header[i] : data[i - WDL_FRAME_HEADER];
+		wdlring[(head + i) % WDL_RING_SIZE] = b;
+	}
+
+	WDLBarrier();
+	wdlring_head = head + total;
+
+	// Let the writer sleep until it has something worth waking up for.
+	if (type != WDL_FRAME_DATA || wdlring_head - wdlring_tail > WDL_RING_SIZE / 4)
+		WDLWake();
+}
+
+static void WDLPushBatch()
+{
+	if (::wdlbatch.size() == 0)
+		return;
+
+	WDLPushFrame(WDL_FRAME_DATA, ::wdlbatch.ptr(), ::wdlbatch.size());
+	SZ_Clear(&::wdlbatch);
+}
+
+static void WDLPushString(byte type, const std::string& str)
+{
+	WDLPushBatch();
+	WDLPushFrame(type, (const byte*)str.c_str(), str.length());
+}
+
+// Hands the events from the last gametic to the writer.
+static void WDLFlushTic()
+{
+	WDLEventLog::const_iterator it = ::wdltic.begin();
+	for (; it != ::wdltic.end(); ++it)
+	{
+		::wdlbatch.WriteByte(WDL_RECORD_EVENT);
+		::wdlbatch.WriteUnVarint(it->ev);
+		::wdlbatch.WriteUnVarint(it->activator + 1);
+		::wdlbatch.WriteUnVarint(it->target + 1);
+		::wdlbatch.WriteVarint(it->gametic - ::wdlstate.lasttic);
+		for (int i = 0; i < 3; i++)
+			::wdlbatch.WriteVarint(it->apos[i]);
+		for (int i = 0; i < 3; i++)
+			::wdlbatch.WriteVarint(it->tpos[i]);
+		::wdlbatch.WriteVarint(it->arg0);
+		::wdlbatch.WriteVarint(it->arg1);
+		::wdlbatch.WriteVarint(it->arg2);
+
+		::wdlstate.lasttic = it->gametic;
+		::wdlhistory[::wdlstate.eventcount % WDL_HISTORY] = *it;
+		::wdlstate.eventcount++;
+
+		if (::wdlbatch.size() >= WDL_BATCH_SIZE)
+			WDLPushBatch();
+	}
+
+	::wdltic.clear();
+	WDLPushBatch();
+}
+
+// Events for a new gametic push out the ones from the last.
+static void WDLStartTic()
+{
+	if (!::wdltic.empty() && ::wdltic.back().gametic != ::gametic)
+		WDLFlushTic();
+}
 
 // Turn an event enum into a string.
 static const char* WDLEventString(WDLEvents i)
@@ -104,21 +557,35 @@ static const char* WDLEventString(WDLEvents i)
 	return ::wdlevstrings[i];
 }
 
-static void AddWDLPlayer(const player_t* player)
+static const char* WDLPlayerName(int id)
 {
-	// Don't add player if their name is already in the vector.
-	WDLPlayers::const_iterator it = ::wdlplayers.begin();
-	for (; it != ::wdlplayers.end(); ++it)
-	{
-		if ((*it).netname == player->userinfo.netname)
-			return;
-	}
+	if (id < 0 || (size_t)id >= ::wdlplayers.size())
+		return "";
+	return ::wdlplayers[id].netname.c_str();
+}
+
+// Returns the player's index, adding them if their name is new.
+static int AddWDLPlayer(const player_t* player)
+{
+	WDLPlayerIds::const_iterator it = ::wdlplayerids.find(player->userinfo.netname);
+	if (it != ::wdlplayerids.end())
+		return it->second;
+
+	int id = ::wdlplayers.size();
 
 	WDLPlayer wdlplayer = {
 		player->userinfo.netname,
 		player->userinfo.team,
 	};
 	::wdlplayers.push_back(wdlplayer);
+	::wdlplayerids[wdlplayer.netname] = id;
+
+	::wdlbatch.WriteByte(WDL_RECORD_PLAYER);
+	::wdlbatch.WriteUnVarint(id);
+	::wdlbatch.WriteVarint(wdlplayer.team);
+	::wdlbatch.WriteString(wdlplayer.netname.c_str());
+
+	return id;
 }
 
 // Generate a log filename based on the current time.
@@ -168,6 +635,16 @@ END_COMMAND(wdlstats)
 
 void M_StartWDLLog()
 {
+	WDLPrintMessages();
+
+	// A log that never got committed is left as it is, partial.
+	if (::wdlstate.recording)
+	{
+		WDLFlushTic();
+		WDLPushString(WDL_FRAME_CLOSE, "");
+		::wdlstate.recording = false;
+	}
+
 	if (::wdlstate.logdir.empty())
 	{
 		::wdlstate.recording = false;
@@ -193,17 +670,39 @@ void M_StartWDLLog()
 		return;
 	}
 
+	WDLStartWriter();
+
 	// Clear our ingame players.
 	::wdlplayers.clear();
+	::wdlplayerids.clear();
 
 	// Start with a fresh slate of events.
-	::wdlevents.clear();
+	::wdltic.clear();
+	::wdlstate.eventcount = 0;
 
 	// Turn on recording.
 	::wdlstate.recording = true;
 
 	// Set our starting tic.
 	::wdlstate.begintic = ::gametic;
+	::wdlstate.lasttic = ::gametic;
+
+	// The binary log is written as we go, so a crash still leaves
+	// everything up to the last second or so.
+	std::string timestamp = GenerateTimestamp();
+	::wdlstate.binfilename = ::wdlstate.logdir + "wdl_" + timestamp + ".wdl";
+	WDLPushString(WDL_FRAME_OPEN, ::wdlstate.binfilename);
+
+	::wdlbatch.WriteByte(WDLLOG_MAGIC[0]);
+	::wdlbatch.WriteByte(WDLLOG_MAGIC[1]);
+	::wdlbatch.WriteByte(WDLLOG_MAGIC[2]);
+	::wdlbatch.WriteByte(WDLLOG_MAGIC[3]);
+	::wdlbatch.WriteUnVarint(WDLSTATS_VERSION);
+	::wdlbatch.WriteString(timestamp.c_str());
+	::wdlbatch.WriteVarint(::level.levelnum);
+	::wdlbatch.WriteString(::level.level_name);
+	::wdlbatch.WriteVarint(::wdlstate.begintic);
+	WDLPushBatch();
 
 	Printf(
 		PRINT_HIGH, "wdlstats: Started, will log to directory \"%s\".\n",
@@ -221,30 +720,23 @@ void M_StartWDLLog()
  * otherwise false if we need to generate a new event.
  */
 static bool LogDamageEvent(
-	WDLEvents event, player_t* activator, player_t* target,
+	WDLEvents event, int activator, int target,
 	int arg0, int arg1, int arg2
 )
 {
-	WDLEventLog::reverse_iterator it = ::wdlevents.rbegin();
-	for (;it != ::wdlevents.rend(); ++it)
+	WDLEventLog::reverse_iterator it = ::wdltic.rbegin();
+	for (;it != ::wdltic.rend(); ++it)
 	{
-		if ((*it).gametic != ::gametic)
-		{
-			// We're too late for events from last tic, so we must have a
-			// new event.
-			return false;
-		}
-
 		// Event type is the same?
 		if ((*it).ev != event)
 			continue;
 
 		// Activator is the same?
-		if ((*it).activator != activator->userinfo.netname)
+		if ((*it).activator != activator)
 			continue;
 
 		// Target is the same?
-		if ((*it).target != target->userinfo.netname)
+		if ((*it).target != target)
 			continue;
 
 		// Update our existing event.
@@ -264,30 +756,23 @@ static bool LogDamageEvent(
  * otherwise false if we need to generate a new event.
  */
 static bool LogAccuracyEvent(
-	WDLEvents event, player_t* activator, player_t* target,
+	WDLEvents event, int activator, int target,
 	int arg0, int arg1, int arg2
 )
 {
-	WDLEventLog::reverse_iterator it = ::wdlevents.rbegin();
-	for (;it != ::wdlevents.rend(); ++it)
+	WDLEventLog::reverse_iterator it = ::wdltic.rbegin();
+	for (;it != ::wdltic.rend(); ++it)
 	{
-		if ((*it).gametic != ::gametic)
-		{
-			// We're too late for events from last tic, so we must have a
-			// new event.
-			return false;
-		}
-
 		// Event type is the same?
 		if ((*it).ev != event)
 			continue;
 
 		// Activator is the same?
-		if ((*it).activator != activator->userinfo.netname)
+		if ((*it).activator != activator)
 			continue;
 
 		// Target is the same?
-		if ((*it).target != target->userinfo.netname)
+		if ((*it).target != target)
 			continue;
 
 		// Update our existing event - by doing nothing.
@@ -311,16 +796,17 @@ void M_LogWDLEvent(
 	if (!::wdlstate.recording)
 		return;
 
+	WDLStartTic();
+
 	// Activator
-	std::string aname = "";
+	int aid = -1;
 	int ax = 0;
 	int ay = 0;
 	int az = 0;
 	if (activator != NULL)
 	{
 		// Add the activator.
-		AddWDLPlayer(activator);
-		aname = activator->userinfo.netname;
+		aid = AddWDLPlayer(activator);
 
 		// Add the activator's body information.
 		if (activator->mo)
@@ -332,15 +818,14 @@ void M_LogWDLEvent(
 	}
 
 	// Target
-	std::string tname = "";
+	int tid = -1;
 	int tx = 0;
 	int ty = 0;
 	int tz = 0;
 	if (target != NULL)
 	{
 		// Add the target.
-		AddWDLPlayer(target);
-		tname = target->userinfo.netname;
+		tid = AddWDLPlayer(target);
 
 		// Add the target's body information.
 		if (target->mo)
@@ -356,23 +841,23 @@ void M_LogWDLEvent(
 		activator && target &&
 		(event == WDL_EVENT_DAMAGE || event == WDL_EVENT_CARRIERDAMAGE)
 	) {
-		if (LogDamageEvent(event, activator, target, arg0, arg1, arg2))
+		if (LogDamageEvent(event, aid, tid, arg0, arg1, arg2))
 			return;
 	}
 
 	if (event == WDL_EVENT_ACCURACY)
 	{
-		if (LogAccuracyEvent(event, activator, target, arg0, arg1, arg2))
+		if (LogAccuracyEvent(event, aid, tid, arg0, arg1, arg2))
 			return;
 	}
 
 	// Add the event to the log.
 	WDLEvent evt = {
-		event, aname, tname, ::gametic,
+		event, aid, tid, ::gametic,
 		{ ax, ay, az }, { tx, ty, tz },
 		arg0, arg1, arg2
 	};
-	::wdlevents.push_back(evt);
+	::wdltic.push_back(evt);
 }
 
 /**
@@ -408,15 +893,16 @@ void M_MaybeLogWDLAccuracyMiss(player_t* activator, int arg0, int arg1)
 	if (!::wdlstate.recording)
 		return;
 
-	std::string aname = "";
+	WDLStartTic();
+
+	int aid = -1;
 	int ax = 0;
 	int ay = 0;
 	int az = 0;
 	if (activator != NULL)
 	{
 		// Add the activator.
-		AddWDLPlayer(activator);
-		aname = activator->userinfo.netname;
+		aid = AddWDLPlayer(activator);
 
 		// Add the activator's body information.
 		if (activator->mo)
@@ -428,22 +914,15 @@ void M_MaybeLogWDLAccuracyMiss(player_t* activator, int arg0, int arg1)
 	}
 
 	// See if we have an existing accuracy event for this tic.
-	WDLEventLog::reverse_iterator it = ::wdlevents.rbegin();
-	for (;it != ::wdlevents.rend(); ++it)
+	WDLEventLog::reverse_iterator it = ::wdltic.rbegin();
+	for (;it != ::wdltic.rend(); ++it)
 	{
-		if ((*it).gametic != ::gametic)
-		{
-			// Whoops, we went a whole gametic without seeing an accuracy
-			// to our name.
-			break;
-		}
-
 		// Event type is the same?
 		if ((*it).ev != WDL_EVENT_ACCURACY)
 			continue;
 
 		// Activator is the same?
-		if ((*it).activator != activator->userinfo.netname)
+		if ((*it).activator != aid)
 			continue;
 
 		// We found an existing accuracy event for this tic - bail out.
@@ -452,11 +931,11 @@ void M_MaybeLogWDLAccuracyMiss(player_t* activator, int arg0, int arg1)
 
 	// Add the event to the log.
 	WDLEvent evt = {
-		WDL_EVENT_ACCURACY, aname, "", ::gametic,
+		WDL_EVENT_ACCURACY, aid, -1, ::gametic,
 		{ ax, ay, az }, { 0, 0, 0 },
 		arg0, arg1, 0
 	};
-	::wdlevents.push_back(evt);
+	::wdltic.push_back(evt);
 }
 
 weapontype_t M_MODToWeapon(int mod)
@@ -493,51 +972,24 @@ void M_CommitWDLLog()
 	if (!::wdlstate.recording)
 		return;
 
-	// See if we can write a file.
+	// The writer turns the binary log into the text log once it has
+	// written the rest of it out.
 	std::string timestamp = GenerateTimestamp();
 	std::string filename = ::wdlstate.logdir + "wdl_" + timestamp + ".log";
-	FILE* fh = fopen(filename.c_str(), "w+");
-	if (fh == NULL)
-	{
-		::wdlstate.recording = false;
-		Printf(PRINT_HIGH, "wdlstats: Could not save\"%s\" for writing.\n", filename.c_str());
-		return;
-	}
 
-	// Header
-	fprintf(fh, "version=%d\n", 5);
-	fprintf(fh, "time=%s\n", timestamp.c_str());
-	fprintf(fh, "levelnum=%d\n", ::level.levelnum);
-	fprintf(fh, "levelname=%s\n", ::level.level_name);
-	fprintf(fh, "duration=%d\n", ::gametic - ::wdlstate.begintic);
-	fprintf(fh, "endgametic=%d\n", ::gametic);
-
-	// Players
-	fprintf(fh, "players\n");
-	WDLPlayers::const_iterator pit = ::wdlplayers.begin();
-	for (; pit != ::wdlplayers.end(); ++pit)
-		fprintf(fh, "%d,%s\n", pit->team, pit->netname.c_str());
-
-	// Events
-	fprintf(fh, "events\n");
-	WDLEventLog::const_iterator eit = ::wdlevents.begin();
-	for (; eit != ::wdlevents.end(); ++eit)
-	{
-		//          "ev,ac,tg,gt,ax,ay,az,tx,ty,tz,a0,a1,a2"
-		fprintf(fh, "%d,%s,%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
-			eit->ev, eit->activator.c_str(), eit->target.c_str(), eit->gametic,
-			eit->apos[0], eit->apos[1], eit->apos[2],
-			eit->tpos[0], eit->tpos[1], eit->tpos[2],
-			eit->arg0, eit->arg1, eit->arg2);
-	}
+	WDLFlushTic();
 
-	fclose(fh);
+	::wdlbatch.WriteByte(WDL_RECORD_END);
+	::wdlbatch.WriteVarint(::gametic);
+	::wdlbatch.WriteString(timestamp.c_str());
+	WDLPushString(WDL_FRAME_CLOSE, filename);
 
 	// Turn off stat recording global - it must be turned on again by the
 	// log starter next go-around.
 	::wdlstate.recording = false;
 
-	Printf(PRINT_HIGH, "wdlstats: Log saved as \"%s\".\n", filename.c_str());
+	Printf(PRINT_HIGH, "wdlstats: Saving log as \"%s\".\n", filename.c_str());
+	WDLPrintMessages();
 }
 
 static void PrintWDLEvent(const WDLEvent& evt)
@@ -545,7 +997,7 @@ static void PrintWDLEvent(const WDLEvent& evt)
 	// FIXME: Once we have access to StrFormat, dedupe this format string.
 	//                 "ev,ac,tg,gt,ax,ay,az,tx,ty,tz,a0,a1,a2"
 	Printf(PRINT_HIGH, "%d,%s,%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
-		evt.ev, evt.activator.c_str(), evt.target.c_str(), evt.gametic,
+		evt.ev, WDLPlayerName(evt.activator), WDLPlayerName(evt.target), evt.gametic,
 		evt.apos[0], evt.apos[1], evt.apos[2],
 		evt.tpos[0], evt.tpos[1], evt.tpos[2],
 		evt.arg0, evt.arg1, evt.arg2);
@@ -557,13 +1009,13 @@ static void WDLInfoHelp()
 		"wdlinfo - Looks up internal information about logged WDL events\n\n"
 		"Usage:\n"
 		"  ] wdlinfo event <ID>\n"
-		"  Print the event by ID.\n\n"
+		"  Print the event by ID, if it is one of the last %d.\n\n"
 		"  ] wdlinfo size\n"
-		"  Return the size of the internal event array.\n\n"
+		"  Return the number of events logged so far.\n\n"
 		"  ] wdlinfo state\n"
 		"  Return relevant WDL stats state.\n\n"
 		"  ] wdlinfo tail\n"
-		"  Print the last 10 events.\n");
+		"  Print the last 10 events.\n", WDL_HISTORY);
 }
 
 BEGIN_COMMAND(wdlinfo)
@@ -574,10 +1026,12 @@ BEGIN_COMMAND(wdlinfo)
 		return;
 	}
 
+	WDLPrintMessages();
+
 	if (stricmp(argv[1], "size") == 0)
 	{
 		// Count total events.
-		Printf(PRINT_HIGH, "%" PRIuSIZE " events found\n", ::wdlevents.size());
+		Printf(PRINT_HIGH, "%" PRIuSIZE " events found\n", ::wdlstate.eventcount + ::wdltic.size());
 		return;
 	}
 	else if (stricmp(argv[1], "state") == 0)
@@ -586,18 +1040,22 @@ BEGIN_COMMAND(wdlinfo)
 		Printf(PRINT_HIGH, "Currently recording?: %s\n", ::wdlstate.recording ? "Yes" : "No");
 		Printf(PRINT_HIGH, "Directory to write logs to: \"%s\"\n", ::wdlstate.logdir.c_str());
 		Printf(PRINT_HIGH, "Log starting gametic: %d\n", ::wdlstate.begintic);
+		Printf(PRINT_HIGH, "Binary log: \"%s\"\n", ::wdlstate.binfilename.c_str());
+		Printf(PRINT_HIGH, "Writer: %s, %" PRIuSIZE " bytes waiting\n",
+			wdl_thread_started ? "thread" : "game thread",
+			wdlring_head - wdlring_tail);
 		return;
 	}
 	else if (stricmp(argv[1], "tail") == 0)
 	{
-		// Show last 10 events.
-		WDLEventLog::const_iterator it = ::wdlevents.end() - 10;
-		if (it < ::wdlevents.begin())
-			it = wdlevents.begin();
-
-		Printf(PRINT_HIGH, "Showing last %" PRIdSIZE " events:\n", ::wdlevents.end() - it);
-		for (; it != ::wdlevents.end(); ++it)
-			PrintWDLEvent(*it);
+		// Show last 10 events, the current tic's are not in the history yet.
+		WDLFlushTic();
+
+		size_t count = MIN<size_t>(::wdlstate.eventcount, 10);
+
+		Printf(PRINT_HIGH, "Showing last %" PRIuSIZE " events:\n", count);
+		for (size_t i = ::wdlstate.eventcount - count; i < ::wdlstate.eventcount; i++)
+			PrintWDLEvent(::wdlhistory[i % WDL_HISTORY]);
 		return;
 	}
 
@@ -609,14 +1067,15 @@ BEGIN_COMMAND(wdlinfo)
 
 	if (stricmp(argv[1], "event") == 0)
 	{
-		int id = atoi(argv[2]);
-		if (id >= ::wdlevents.size())
+		WDLFlushTic();
+
+		size_t id = atoi(argv[2]);
+		if (id >= ::wdlstate.eventcount || id + WDL_HISTORY < ::wdlstate.eventcount)
 		{
-			Printf(PRINT_HIGH, "Event number %d not found\n", id);
+			Printf(PRINT_HIGH, "Event number %" PRIuSIZE " not found\n", id);
 			return;
 		}
-		WDLEvent evt = ::wdlevents.at(id);
-		PrintWDLEvent(evt);
+		PrintWDLEvent(::wdlhistory[id % WDL_HISTORY]);
 		return;
 	}
 
@@ -578,6 +578,10 @@ FBehavior::FBehavior (BYTE *object, int len)
 	Arrays = NULL;
 	Chunks = NULL;
 
+	// Anything that cannot be decoded ends up here
+	Code.assign (1, DLevelScript::PCD_TERMINATE);
+	CodeLumpOfs.assign (1, 0);
+
 	if (object[0] != 'A' || object[1] != 'C' || object[2] != 'S')
 	{
 		Format = ACS_Unknown;
@@ -731,6 +735,8 @@ FBehavior::FBehavior (BYTE *object, int len)
 		}
 	}
 
+	DecodeScripts ();
+
 	DPrintf ("Loaded %d scripts, %d Functions\n", NumScripts, NumFunctions);
 }
 
@@ -769,7 +775,366 @@ int *FBehavior::FindScript (int script) const
 	const ScriptPtr *ptr = BinarySearch<ScriptPtr, WORD>
 		((ScriptPtr *)Scripts, NumScripts, &ScriptPtr::Number, (WORD)script);
 
-	return ptr ? (int *)(ptr->Address + Data) : NULL;
+	return ptr ? GetCode() + ScriptCode[ptr - (ScriptPtr *)Scripts] : NULL;
+}
+
+//
+// FBehavior::DecodeScripts
+//
+// Decodes every script and function in the lump.  Only code reachable from
+// an entry point is decoded, so string tables and chunks between them are
+// never mistaken for p-codes.
+//
+void FBehavior::DecodeScripts ()
+{
+	int i;
+
+	LumpCodeOfs.assign (DataSize, -1);
+
+	ScriptCode.resize (NumScripts);
+	for (i = 0; i < NumScripts; ++i)
+		ScriptCode[i] = DecodeFrom (((ScriptPtr *)Scripts)[i].Address);
+
+	FunctionCode.resize (NumFunctions);
+	for (i = 0; i < NumFunctions; ++i)
+	{
+		DWORD address = ((ScriptFunction *)Functions)[i].Address;
+		FunctionCode[i] = address ? DecodeFrom (address) : 0;
+	}
+
+	DPrintf ("Decoded %d bytes of p-code to %d words\n",
+		DataSize, (int)Code.size());
+}
+
+void FBehavior::Emit (int value, DWORD ofs)
+{
+	Code.push_back (value);
+	CodeLumpOfs.push_back (ofs);
+}
+
+//
+// FBehavior::ReadOperand
+//
+// Reads one operand from the lump.  Byte operands are only bytes in the
+// little-endian enhanced format, the same as NEXTBYTE used to read them.
+//
+bool FBehavior::ReadOperand (DWORD &ofs, bool isbyte, int &value) const
+{
+	if (isbyte && Format == ACS_LittleEnhanced)
+	{
+		if (ofs >= (DWORD)DataSize)
+			return false;
+		value = Data[ofs++];
+		return true;
+	}
+
+	if (ofs + 4 > (DWORD)DataSize)
+		return false;
+
+	DWORD word;
+	memcpy (&word, Data + ofs, 4);
+	value = LELONG ((int)word);
+	ofs += 4;
+	return true;
+}
+
+//
+// FBehavior::DecodeFrom
+//
+// Decodes the code at lump offset ofs and everything it can jump to, and
+// returns its index in the decoded stream.  Straight-line code is laid out
+// in order; a run that falls into code decoded earlier ends in a goto.
+//
+int FBehavior::DecodeFrom (DWORD start)
+{
+	std::vector<DWORD> pending;
+	std::vector<std::pair<size_t, DWORD> > fixups;
+
+	if (start >= (DWORD)DataSize)
+		return 0;
+
+	pending.push_back (start);
+
+	while (!pending.empty ())
+	{
+		DWORD ofs = pending.back ();
+		bool first = true;
+
+		pending.pop_back ();
+
+		for (;; first = false)
+		{
+			if (ofs >= (DWORD)DataSize)
+			{
+				// Ran off the end of the lump
+				Emit (DLevelScript::PCD_TERMINATE, ofs);
+				break;
+			}
+
+			if (LumpCodeOfs[ofs] >= 0)
+			{
+				if (!first)
+				{
+					Emit (DLevelScript::PCD_GOTO, ofs);
+					Emit (LumpCodeOfs[ofs], ofs);
+				}
+				break;
+			}
+
+			DWORD insn = ofs;
+			int pcd, value;
+
+			LumpCodeOfs[insn] = Code.size ();
+
+			if (!ReadOperand (ofs, true, pcd))
+			{
+				Emit (DLevelScript::PCD_TERMINATE, insn);
+				break;
+			}
+
+			int op = pcd;
+			int bytes = 0;		// operands read with NEXTBYTE
+			int words = 0;		// operands read with NEXTWORD
+			int raw = 0;		// operands that are always single bytes
+			bool counted = false;
+			bool jump = false;
+			bool stop = false;
+			bool ok = true;
+
+			switch (pcd)
+			{
+			case DLevelScript::PCD_TERMINATE:
+			case DLevelScript::PCD_RESTART:
+			case DLevelScript::PCD_RETURNVOID:
+			case DLevelScript::PCD_RETURNVAL:
+				stop = true;
+				break;
+
+			case DLevelScript::PCD_GOTO:
+				jump = stop = true;
+				break;
+
+			case DLevelScript::PCD_IFGOTO:
+			case DLevelScript::PCD_IFNOTGOTO:
+				jump = true;
+				break;
+
+			case DLevelScript::PCD_CASEGOTO:
+				words = 1;
+				jump = true;
+				break;
+
+			case DLevelScript::PCD_LSPEC1:
+			case DLevelScript::PCD_LSPEC2:
+			case DLevelScript::PCD_LSPEC3:
+			case DLevelScript::PCD_LSPEC4:
+			case DLevelScript::PCD_LSPEC5:
+			case DLevelScript::PCD_CALL:
+			case DLevelScript::PCD_CALLDISCARD:
+			case DLevelScript::PCD_ASSIGNSCRIPTVAR:
+			case DLevelScript::PCD_ASSIGNMAPVAR:
+			case DLevelScript::PCD_ASSIGNWORLDVAR:
+			case DLevelScript::PCD_ASSIGNGLOBALVAR:
+			case DLevelScript::PCD_ASSIGNMAPARRAY:
+			case DLevelScript::PCD_PUSHSCRIPTVAR:
+			case DLevelScript::PCD_PUSHMAPVAR:
+			case DLevelScript::PCD_PUSHWORLDVAR:
+			case DLevelScript::PCD_PUSHGLOBALVAR:
+			case DLevelScript::PCD_PUSHMAPARRAY:
+			case DLevelScript::PCD_ADDSCRIPTVAR:
+			case DLevelScript::PCD_ADDMAPVAR:
+			case DLevelScript::PCD_ADDWORLDVAR:
+			case DLevelScript::PCD_ADDGLOBALVAR:
+			case DLevelScript::PCD_ADDMAPARRAY:
+			case DLevelScript::PCD_SUBSCRIPTVAR:
+			case DLevelScript::PCD_SUBMAPVAR:
+			case DLevelScript::PCD_SUBWORLDVAR:
+			case DLevelScript::PCD_SUBGLOBALVAR:
+			case DLevelScript::PCD_SUBMAPARRAY:
+			case DLevelScript::PCD_MULSCRIPTVAR:
+			case DLevelScript::PCD_MULMAPVAR:
+			case DLevelScript::PCD_MULWORLDVAR:
+			case DLevelScript::PCD_MULGLOBALVAR:
+			case DLevelScript::PCD_MULMAPARRAY:
+			case DLevelScript::PCD_DIVSCRIPTVAR:
+			case DLevelScript::PCD_DIVMAPVAR:
+			case DLevelScript::PCD_DIVWORLDVAR:
+			case DLevelScript::PCD_DIVGLOBALVAR:
+			case DLevelScript::PCD_DIVMAPARRAY:
+			case DLevelScript::PCD_MODSCRIPTVAR:
+			case DLevelScript::PCD_MODMAPVAR:
+			case DLevelScript::PCD_MODWORLDVAR:
+			case DLevelScript::PCD_MODGLOBALVAR:
+			case DLevelScript::PCD_MODMAPARRAY:
+			case DLevelScript::PCD_INCSCRIPTVAR:
+			case DLevelScript::PCD_INCMAPVAR:
+			case DLevelScript::PCD_INCWORLDVAR:
+			case DLevelScript::PCD_INCGLOBALVAR:
+			case DLevelScript::PCD_INCMAPARRAY:
+			case DLevelScript::PCD_DECSCRIPTVAR:
+			case DLevelScript::PCD_DECMAPVAR:
+			case DLevelScript::PCD_DECWORLDVAR:
+			case DLevelScript::PCD_DECGLOBALVAR:
+			case DLevelScript::PCD_DECMAPARRAY:
+				bytes = 1;
+				break;
+
+			case DLevelScript::PCD_LSPEC1DIRECT:
+			case DLevelScript::PCD_LSPEC2DIRECT:
+			case DLevelScript::PCD_LSPEC3DIRECT:
+			case DLevelScript::PCD_LSPEC4DIRECT:
+			case DLevelScript::PCD_LSPEC5DIRECT:
+				bytes = 1;
+				words = pcd - DLevelScript::PCD_LSPEC1DIRECT + 1;
+				break;
+
+			case DLevelScript::PCD_PUSHNUMBER:
+			case DLevelScript::PCD_DELAYDIRECT:
+			case DLevelScript::PCD_TAGWAITDIRECT:
+			case DLevelScript::PCD_POLYWAITDIRECT:
+			case DLevelScript::PCD_SCRIPTWAITDIRECT:
+			case DLevelScript::PCD_SETGRAVITYDIRECT:
+			case DLevelScript::PCD_SETAIRCONTROLDIRECT:
+			case DLevelScript::PCD_CHECKINVENTORYDIRECT:
+				words = 1;
+				break;
+
+			case DLevelScript::PCD_RANDOMDIRECT:
+			case DLevelScript::PCD_THINGCOUNTDIRECT:
+			case DLevelScript::PCD_CHANGEFLOORDIRECT:
+			case DLevelScript::PCD_CHANGECEILINGDIRECT:
+			case DLevelScript::PCD_GIVEINVENTORYDIRECT:
+			case DLevelScript::PCD_TAKEINVENTORYDIRECT:
+				words = 2;
+				break;
+
+			case DLevelScript::PCD_SETMUSICDIRECT:
+			case DLevelScript::PCD_LOCALSETMUSICDIRECT:
+				words = 3;
+				break;
+
+			case DLevelScript::PCD_SPAWNSPOTDIRECT:
+				words = 4;
+				break;
+
+			case DLevelScript::PCD_SPAWNDIRECT:
+				words = 6;
+				break;
+
+			// The byte-packed forms become their word forms
+			case DLevelScript::PCD_PUSHBYTE:
+				op = DLevelScript::PCD_PUSHNUMBER;
+				raw = 1;
+				break;
+
+			case DLevelScript::PCD_PUSH2BYTES:
+			case DLevelScript::PCD_PUSH3BYTES:
+			case DLevelScript::PCD_PUSH4BYTES:
+			case DLevelScript::PCD_PUSH5BYTES:
+				op = DLevelScript::PCD_PUSHBYTES;
+				raw = pcd - DLevelScript::PCD_PUSH2BYTES + 2;
+				counted = true;
+				break;
+
+			case DLevelScript::PCD_PUSHBYTES:
+				if ((ok = ofs < (DWORD)DataSize))
+					raw = Data[ofs++];
+				counted = true;
+				break;
+
+			case DLevelScript::PCD_LSPEC1DIRECTB:
+			case DLevelScript::PCD_LSPEC2DIRECTB:
+			case DLevelScript::PCD_LSPEC3DIRECTB:
+			case DLevelScript::PCD_LSPEC4DIRECTB:
+			case DLevelScript::PCD_LSPEC5DIRECTB:
+				op = DLevelScript::PCD_LSPEC1DIRECT + pcd - DLevelScript::PCD_LSPEC1DIRECTB;
+				raw = pcd - DLevelScript::PCD_LSPEC1DIRECTB + 2;
+				break;
+
+			case DLevelScript::PCD_DELAYDIRECTB:
+				op = DLevelScript::PCD_DELAYDIRECT;
+				raw = 1;
+				break;
+
+			case DLevelScript::PCD_RANDOMDIRECTB:
+				op = DLevelScript::PCD_RANDOMDIRECT;
+				raw = 2;
+				break;
+
+			default:
+				// Anything else takes its arguments from the stack.  P-codes
+				// past the end of the table could never run, keep the
+				// message the interpreter used to print for them.
+				if ((unsigned)pcd >= DLevelScript::PCODE_COMMAND_COUNT)
+				{
+					DPrintf ("Unknown P-Code %d at offset %u\n", pcd, insn);
+					op = DLevelScript::PCD_NOP;
+				}
+				break;
+			}
+
+			Emit (op, insn);
+			if (counted)
+				Emit (raw, insn);
+
+			int i;
+
+			for (i = 0; ok && i < bytes; ++i)
+				if ((ok = ReadOperand (ofs, true, value)))
+					Emit (value, insn);
+			for (i = 0; ok && i < words; ++i)
+				if ((ok = ReadOperand (ofs, false, value)))
+					Emit (value, insn);
+			for (i = 0; ok && i < raw; ++i)
+				if ((ok = ofs < (DWORD)DataSize))
+					Emit (Data[ofs++], insn);
+			if (ok && jump && (ok = ReadOperand (ofs, false, value)))
+			{
+				fixups.push_back (std::make_pair (Code.size (), (DWORD)value));
+				Emit (0, insn);
+				pending.push_back ((DWORD)value);
+			}
+
+			if (!ok)
+			{
+				// Operands ran off the end of the lump
+				Code.resize (LumpCodeOfs[insn]);
+				CodeLumpOfs.resize (LumpCodeOfs[insn]);
+				Emit (DLevelScript::PCD_TERMINATE, insn);
+				break;
+			}
+
+			if (stop)
+				break;
+		}
+	}
+
+	for (size_t i = 0; i < fixups.size (); ++i)
+	{
+		DWORD target = fixups[i].second;
+
+		if (target < (DWORD)DataSize && LumpCodeOfs[target] >= 0)
+			Code[fixups[i].first] = LumpCodeOfs[target];
+		else
+			Code[fixups[i].first] = 0;
+	}
+
+	return LumpCodeOfs[start];
+}
+
+DWORD FBehavior::PC2Ofs (int *pc) const
+{
+	size_t index = pc - GetCode ();
+
+	return index < CodeLumpOfs.size () ? CodeLumpOfs[index] : 0;
+}
+
+int *FBehavior::Ofs2PC (DWORD ofs) const
+{
+	if (ofs < (DWORD)DataSize && LumpCodeOfs[ofs] >= 0)
+		return GetCode () + LumpCodeOfs[ofs];
+
+	return GetCode ();
 }
 
 ScriptFunction *FBehavior::GetFunction (int funcnum) const
@@ -1008,7 +1373,7 @@ void FBehavior::StartTypedScripts (WORD type, AActor *activator, int arg0, int a
 		if (ptr->Type == type)
 		{
 			P_GetScriptGoing (activator, NULL, ptr->Number,
-				(int *)(ptr->Address + Data), 0, arg0, arg1, arg2, always, true);
+				GetCode () + ScriptCode[i], 0, arg0, arg1, arg2, always, true);
 		}
 	}
 }
@@ -1017,11 +1382,93 @@ void FBehavior::StartTypedScripts (WORD type, AActor *activator, int arg0, int a
 
 
 
-#define NEXTWORD	(LELONG(*pc++))
-#define NEXTBYTE	(fmt==ACS_LittleEnhanced?getbyte(pc):NEXTWORD)
+// Operands were widened to ints when the script was decoded
+#define NEXTWORD	(*pc++)
+#define NEXTBYTE	(*pc++)
 #define STACK(a)	(Stack[sp - (a)])
 #define PushToStack(a)	(Stack[sp++] = (a))
 
+// With GCC and Clang the most common p-codes jump straight to the next
+// handler through a table of label addresses instead of going back around
+// the loop and through the switch.  P-codes not in THREADED_PCODES, and
+// anything that can change the script's state, still go through the loop.
+#if defined(__GNUC__) && !defined(ACS_NO_THREADED_DISPATCH)
+#define ACS_THREADED_DISPATCH
+#endif
+
+#ifdef ACS_THREADED_DISPATCH
+#define PCODE(x)	case x: pcode_##x
+#define NEXTPCODE	{ if (++runaway > 500000) break; pcd = NEXTBYTE; goto *pcodes[pcd]; }
+#else
+#define PCODE(x)	case x
+#define NEXTPCODE	break
+#endif
+
+#define THREADED_PCODES \
+	THREADED_PCODE(PCD_NOP) \
+	THREADED_PCODE(PCD_PUSHNUMBER) \
+	THREADED_PCODE(PCD_PUSHBYTES) \
+	THREADED_PCODE(PCD_DUP) \
+	THREADED_PCODE(PCD_SWAP) \
+	THREADED_PCODE(PCD_DROP) \
+	THREADED_PCODE(PCD_CALL) \
+	THREADED_PCODE(PCD_CALLDISCARD) \
+	THREADED_PCODE(PCD_RETURNVOID) \
+	THREADED_PCODE(PCD_RETURNVAL) \
+	THREADED_PCODE(PCD_ADD) \
+	THREADED_PCODE(PCD_SUBTRACT) \
+	THREADED_PCODE(PCD_MULTIPLY) \
+	THREADED_PCODE(PCD_EQ) \
+	THREADED_PCODE(PCD_NE) \
+	THREADED_PCODE(PCD_LT) \
+	THREADED_PCODE(PCD_GT) \
+	THREADED_PCODE(PCD_LE) \
+	THREADED_PCODE(PCD_GE) \
+	THREADED_PCODE(PCD_ASSIGNSCRIPTVAR) \
+	THREADED_PCODE(PCD_ASSIGNMAPVAR) \
+	THREADED_PCODE(PCD_ASSIGNWORLDVAR) \
+	THREADED_PCODE(PCD_ASSIGNGLOBALVAR) \
+	THREADED_PCODE(PCD_ASSIGNMAPARRAY) \
+	THREADED_PCODE(PCD_PUSHSCRIPTVAR) \
+	THREADED_PCODE(PCD_PUSHMAPVAR) \
+	THREADED_PCODE(PCD_PUSHWORLDVAR) \
+	THREADED_PCODE(PCD_PUSHGLOBALVAR) \
+	THREADED_PCODE(PCD_PUSHMAPARRAY) \
+	THREADED_PCODE(PCD_ADDSCRIPTVAR) \
+	THREADED_PCODE(PCD_ADDMAPVAR) \
+	THREADED_PCODE(PCD_ADDWORLDVAR) \
+	THREADED_PCODE(PCD_ADDGLOBALVAR) \
+	THREADED_PCODE(PCD_SUBSCRIPTVAR) \
+	THREADED_PCODE(PCD_SUBMAPVAR) \
+	THREADED_PCODE(PCD_SUBWORLDVAR) \
+	THREADED_PCODE(PCD_SUBGLOBALVAR) \
+	THREADED_PCODE(PCD_MULSCRIPTVAR) \
+	THREADED_PCODE(PCD_MULMAPVAR) \
+	THREADED_PCODE(PCD_MULWORLDVAR) \
+	THREADED_PCODE(PCD_MULGLOBALVAR) \
+	THREADED_PCODE(PCD_INCSCRIPTVAR) \
+	THREADED_PCODE(PCD_INCMAPVAR) \
+	THREADED_PCODE(PCD_INCWORLDVAR) \
+	THREADED_PCODE(PCD_INCGLOBALVAR) \
+	THREADED_PCODE(PCD_DECSCRIPTVAR) \
+	THREADED_PCODE(PCD_DECMAPVAR) \
+	THREADED_PCODE(PCD_DECWORLDVAR) \
+	THREADED_PCODE(PCD_DECGLOBALVAR) \
+	THREADED_PCODE(PCD_GOTO) \
+	THREADED_PCODE(PCD_IFGOTO) \
+	THREADED_PCODE(PCD_IFNOTGOTO) \
+	THREADED_PCODE(PCD_CASEGOTO) \
+	THREADED_PCODE(PCD_ANDLOGICAL) \
+	THREADED_PCODE(PCD_ORLOGICAL) \
+	THREADED_PCODE(PCD_ANDBITWISE) \
+	THREADED_PCODE(PCD_ORBITWISE) \
+	THREADED_PCODE(PCD_EORBITWISE) \
+	THREADED_PCODE(PCD_NEGATELOGICAL) \
+	THREADED_PCODE(PCD_LSHIFT) \
+	THREADED_PCODE(PCD_RSHIFT) \
+	THREADED_PCODE(PCD_UNARYMINUS) \
+	THREADED_PCODE(PCD_LINESIDE)
+
 void strbin (char *str);
 
 IMPLEMENT_SERIAL (DACSThinker, DThinker)
@@ -1097,6 +1544,27 @@ void DACSThinker::RunThink ()
 	}
 }
 
+void DACSThinker::WakeWaiting (DLevelScript::EScriptState state, int data)
+{
+	for (DLevelScript *script = Scripts; script; script = script->next)
+	{
+		if (script->state == state && script->statedata == data)
+			script->recheck = true;
+	}
+}
+
+void P_ACSWakeTagWait (int tag)
+{
+	if (DACSThinker::ActiveThinker)
+		DACSThinker::ActiveThinker->WakeWaiting (DLevelScript::SCRIPT_TagWait, tag);
+}
+
+void P_ACSWakePolyWait (int polyobj)
+{
+	if (DACSThinker::ActiveThinker)
+		DACSThinker::ActiveThinker->WakeWaiting (DLevelScript::SCRIPT_PolyWait, polyobj);
+}
+
 // FlashFader class - not sure where to put this so it goes here for now...
 class DFlashFader : public DThinker
 {
@@ -1387,6 +1855,7 @@ void DLevelScript::Serialize (FArchive &arc)
 DLevelScript::DLevelScript ()
 {
 	next = prev = NULL;
+	recheck = true;
 	if (DACSThinker::ActiveThinker == NULL)
 		new DACSThinker;
 }
@@ -1542,7 +2011,7 @@ void DLevelScript::ChangeFlat (int tag, int name, bool floorOrCeiling)
 		{
 			sectors[secnum].ceilingpic = flat;
 		}
-		sectors[secnum].SectorChanges |= SPC_FlatPic;
+		P_SectorChanged(&sectors[secnum], SPC_FlatPic);
 	}
 
 	if (serverside)
@@ -2055,13 +2524,6 @@ void DLevelScript::DoFadeRange(AActor* who, int r1, int g1, int b1, int a1,
 }
 
 
-inline int getbyte (int *&pc)
-{
-	int res = *(BYTE *)pc;
-	pc = (int *)((BYTE *)pc+1);
-	return res;
-}
-
 void DLevelScript::RunScript ()
 {
 	DACSThinker *controller = DACSThinker::ActiveThinker;
@@ -2083,8 +2545,13 @@ void DLevelScript::RunScript ()
 
 	case SCRIPT_TagWait:
 		// Wait for tagged sector(s) to go inactive, then enter
-		// state running
+		// state running.  Only look when a mover on the tag has
+		// stopped since the last time.
 	{
+		if (!recheck)
+			return;
+		recheck = false;
+
 		int secnum = -1;
 
 		while ((secnum = P_FindSectorFromTag (statedata, secnum)) >= 0)
@@ -2098,6 +2565,10 @@ void DLevelScript::RunScript ()
 
 	case SCRIPT_PolyWait:
 		// Wait for polyobj(s) to stop moving, then enter state running
+		if (!recheck)
+			return;
+		recheck = false;
+
 		if (!PO_Busy (statedata))
 		{
 			state = SCRIPT_Running;
@@ -2106,12 +2577,23 @@ void DLevelScript::RunScript ()
 
 	case SCRIPT_ScriptWaitPre:
 		// Wait for a script to start running, then enter state scriptwait
+		if (!recheck)
+			return;
+		recheck = false;
+
 		if (controller->RunningScripts[statedata])
+		{
 			state = SCRIPT_ScriptWait;
+			recheck = true;
+		}
 		break;
 
 	case SCRIPT_ScriptWait:
 		// Wait for a script to stop running, then enter state running
+		if (!recheck)
+			return;
+		recheck = false;
+
 		if (controller->RunningScripts[statedata])
 			return;
 
@@ -2125,7 +2607,7 @@ void DLevelScript::RunScript ()
 
 	int *pc = this->pc;
 	int sp = this->sp;
-	const ACSFormat fmt = level.behavior->GetFormat();
+	int *const code = level.behavior->GetCode();
 	int runaway = 0;	// used to prevent infinite loops
 	int pcd;
 	char work[4096], *workwhere = work;
@@ -2133,6 +2615,19 @@ void DLevelScript::RunScript ()
 //	int optstart = -1;
 	int temp;
 
+#ifdef ACS_THREADED_DISPATCH
+	static void *pcodes[PCODE_COMMAND_COUNT];
+
+	if (pcodes[0] == NULL)
+	{
+		for (int i = 0; i < PCODE_COMMAND_COUNT; ++i)
+			pcodes[i] = &&pcode_switch;
+#define THREADED_PCODE(x)	pcodes[x] = &&pcode_##x;
+		THREADED_PCODES
+#undef THREADED_PCODE
+	}
+#endif
+
 	while (state == SCRIPT_Running)
 	{
 		if (++runaway > 500000)
@@ -2143,6 +2638,10 @@ void DLevelScript::RunScript ()
 		}
 
 		pcd = NEXTBYTE;
+#ifdef ACS_THREADED_DISPATCH
+		goto *pcodes[pcd];
+pcode_switch:
+#endif
 		switch (pcd)
 		{
 		default:
@@ -2153,73 +2652,31 @@ void DLevelScript::RunScript ()
 			state = SCRIPT_PleaseRemove;
 			break;
 
-		case PCD_NOP:
-			break;
+		PCODE(PCD_NOP):
+			NEXTPCODE;
 
 		case PCD_SUSPEND:
 			state = SCRIPT_Suspended;
 			break;
 
-		case PCD_PUSHNUMBER:
+		PCODE(PCD_PUSHNUMBER):
 			PushToStack(NEXTWORD);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHBYTE:
-			PushToStack(*(BYTE*)pc);
-			pc = (int*)((BYTE*)pc + 1);
-			break;
-
-		case PCD_PUSH2BYTES:
-			Stack[sp] = ((BYTE*)pc)[0];
-			Stack[sp + 1] = ((BYTE*)pc)[1];
-			sp += 2;
-			pc = (int*)((BYTE*)pc + 2);
-			break;
-
-		case PCD_PUSH3BYTES:
-			Stack[sp] = ((BYTE*)pc)[0];
-			Stack[sp + 1] = ((BYTE*)pc)[1];
-			Stack[sp + 2] = ((BYTE*)pc)[2];
-			sp += 3;
-			pc = (int*)((BYTE*)pc + 3);
-			break;
-
-		case PCD_PUSH4BYTES:
-			Stack[sp] = ((BYTE*)pc)[0];
-			Stack[sp + 1] = ((BYTE*)pc)[1];
-			Stack[sp + 2] = ((BYTE*)pc)[2];
-			Stack[sp + 3] = ((BYTE*)pc)[3];
-			sp += 4;
-			pc = (int*)((BYTE*)pc + 4);
-			break;
-
-		case PCD_PUSH5BYTES:
-			Stack[sp] = ((BYTE*)pc)[0];
-			Stack[sp + 1] = ((BYTE*)pc)[1];
-			Stack[sp + 2] = ((BYTE*)pc)[2];
-			Stack[sp + 3] = ((BYTE*)pc)[3];
-			Stack[sp + 4] = ((BYTE*)pc)[4];
-			sp += 5;
-			pc = (int*)((BYTE*)pc + 5);
-			break;
-
-		case PCD_PUSHBYTES:
-			temp = *(BYTE*)pc;
-			pc = (int*)((BYTE*)pc + temp + 1);
-			for (temp = -temp; temp; temp++)
-			{
-				PushToStack(*((BYTE*)pc + temp));
-			}
-			break;
+		PCODE(PCD_PUSHBYTES):
+			temp = NEXTBYTE;
+			while (temp--)
+				PushToStack(NEXTBYTE);
+			NEXTPCODE;
 
-		case PCD_DUP:
+		PCODE(PCD_DUP):
 			Stack[sp] = Stack[sp - 1];
 			sp++;
-			break;
+			NEXTPCODE;
 
-		case PCD_SWAP:
+		PCODE(PCD_SWAP):
 			std::swap(Stack[sp - 2], Stack[sp - 1]);
-			break;
+			NEXTPCODE;
 
 		case PCD_LSPEC1:
 			ActivateLineSpecial(NEXTBYTE, activationline, activator,
@@ -2288,40 +2745,8 @@ void DLevelScript::RunScript ()
 			pc += 5;
 			break;
 
-		case PCD_LSPEC1DIRECTB:
-			ActivateLineSpecial(((BYTE *)pc)[0], activationline, activator,
-				((BYTE *)pc)[1], 0, 0, 0, 0);
-			pc = (int *)((BYTE *)pc + 2);
-			break;
-
-		case PCD_LSPEC2DIRECTB:
-			ActivateLineSpecial(((BYTE *)pc)[0], activationline, activator,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], 0, 0, 0);
-			pc = (int *)((BYTE *)pc + 3);
-			break;
-
-		case PCD_LSPEC3DIRECTB:
-			ActivateLineSpecial(((BYTE *)pc)[0], activationline, activator,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3], 0, 0);
-			pc = (int *)((BYTE *)pc + 4);
-			break;
-
-		case PCD_LSPEC4DIRECTB:
-			ActivateLineSpecial(((BYTE *)pc)[0], activationline, activator,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3],
-				((BYTE *)pc)[4], 0);
-			pc = (int *)((BYTE *)pc + 5);
-			break;
-
-		case PCD_LSPEC5DIRECTB:
-			ActivateLineSpecial(((BYTE *)pc)[0], activationline, activator,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3],
-				((BYTE *)pc)[4], ((BYTE *)pc)[5]);
-			pc = (int *)((BYTE *)pc + 6);
-			break;
-
-		case PCD_CALL:
-		case PCD_CALLDISCARD: {
+		PCODE(PCD_CALL):
+		PCODE(PCD_CALLDISCARD): {
 			int funcnum;
 			int i;
 			ScriptFunction* func;
@@ -2349,17 +2774,17 @@ void DLevelScript::RunScript ()
 				Stack[sp + i] = 0;
 			}
 			sp += i;
-			((CallReturn*)&Stack[sp])->ReturnAddress = level.behavior->PC2Ofs(pc);
+			((CallReturn*)&Stack[sp])->ReturnAddress = pc - code;
 			((CallReturn*)&Stack[sp])->ReturnFunction = activeFunction;
 			((CallReturn*)&Stack[sp])->bDiscardResult = (pcd == PCD_CALLDISCARD);
 			sp += sizeof(CallReturn) / sizeof(int);
-			pc = level.behavior->Ofs2PC(func->Address);
+			pc = level.behavior->GetFunctionCode(funcnum);
 			activeFunction = func;
 		}
-		break;
+		NEXTPCODE;
 
-		case PCD_RETURNVOID:
-		case PCD_RETURNVAL: {
+		PCODE(PCD_RETURNVOID):
+		PCODE(PCD_RETURNVAL): {
 			int value;
 			CallReturn* retState;
 
@@ -2373,7 +2798,7 @@ void DLevelScript::RunScript ()
 			}
 			sp -= sizeof(CallReturn) / sizeof(int);
 			retState = (CallReturn*)&Stack[sp];
-			pc = level.behavior->Ofs2PC(retState->ReturnAddress);
+			pc = code + retState->ReturnAddress;
 			sp -= activeFunction->ArgCount + activeFunction->LocalCount;
 			activeFunction = retState->ReturnFunction;
 			if (activeFunction == NULL)
@@ -2390,22 +2815,22 @@ void DLevelScript::RunScript ()
 				Stack[sp++] = value;
 			}
 		}
-		break;
+		NEXTPCODE;
 
-		case PCD_ADD:
+		PCODE(PCD_ADD):
 			STACK(2) = STACK(2) + STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBTRACT:
+		PCODE(PCD_SUBTRACT):
 			STACK(2) = STACK(2) - STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULTIPLY:
+		PCODE(PCD_MULTIPLY):
 			STACK(2) = STACK(2) * STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
 		case PCD_DIVIDE:
 			if (STACK(1) == 0)
@@ -2431,100 +2856,100 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_EQ:
+		PCODE(PCD_EQ):
 			STACK(2) = (STACK(2) == STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_NE:
+		PCODE(PCD_NE):
 			STACK(2) = (STACK(2) != STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_LT:
+		PCODE(PCD_LT):
 			STACK(2) = (STACK(2) < STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_GT:
+		PCODE(PCD_GT):
 			STACK(2) = (STACK(2) > STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_LE:
+		PCODE(PCD_LE):
 			STACK(2) = (STACK(2) <= STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_GE:
+		PCODE(PCD_GE):
 			STACK(2) = (STACK(2) >= STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNSCRIPTVAR:
+		PCODE(PCD_ASSIGNSCRIPTVAR):
 			locals[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNMAPVAR:
+		PCODE(PCD_ASSIGNMAPVAR):
 			level.vars[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNWORLDVAR:
+		PCODE(PCD_ASSIGNWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNGLOBALVAR:
+		PCODE(PCD_ASSIGNGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ASSIGNMAPARRAY:
+		PCODE(PCD_ASSIGNMAPARRAY):
 			level.behavior->SetArrayVal(ACS_WorldVars[NEXTBYTE], STACK(2), STACK(1));
 			sp -= 2;
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHSCRIPTVAR:
+		PCODE(PCD_PUSHSCRIPTVAR):
 			PushToStack(locals[NEXTBYTE]);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHMAPVAR:
+		PCODE(PCD_PUSHMAPVAR):
 			PushToStack(level.vars[NEXTBYTE]);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHWORLDVAR:
+		PCODE(PCD_PUSHWORLDVAR):
 			PushToStack(ACS_WorldVars[NEXTBYTE]);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHGLOBALVAR:
+		PCODE(PCD_PUSHGLOBALVAR):
 			PushToStack(ACS_GlobalVars[NEXTBYTE]);
-			break;
+			NEXTPCODE;
 
-		case PCD_PUSHMAPARRAY:
+		PCODE(PCD_PUSHMAPARRAY):
 			STACK(1) = level.behavior->GetArrayVal(level.vars[NEXTBYTE], STACK(1));
-			break;
+			NEXTPCODE;
 
-		case PCD_ADDSCRIPTVAR:
+		PCODE(PCD_ADDSCRIPTVAR):
 			locals[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ADDMAPVAR:
+		PCODE(PCD_ADDMAPVAR):
 			level.vars[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ADDWORLDVAR:
+		PCODE(PCD_ADDWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ADDGLOBALVAR:
+		PCODE(PCD_ADDGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
 		case PCD_ADDMAPARRAY: {
 			int a = ACS_WorldVars[NEXTBYTE];
@@ -2535,25 +2960,25 @@ void DLevelScript::RunScript ()
 		}
 		break;
 
-		case PCD_SUBSCRIPTVAR:
+		PCODE(PCD_SUBSCRIPTVAR):
 			locals[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBMAPVAR:
+		PCODE(PCD_SUBMAPVAR):
 			level.vars[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBWORLDVAR:
+		PCODE(PCD_SUBWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_SUBGLOBALVAR:
+		PCODE(PCD_SUBGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
 		case PCD_SUBMAPARRAY: {
 			int a = ACS_WorldVars[NEXTBYTE];
@@ -2564,25 +2989,25 @@ void DLevelScript::RunScript ()
 		}
 		break;
 
-		case PCD_MULSCRIPTVAR:
+		PCODE(PCD_MULSCRIPTVAR):
 			locals[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULMAPVAR:
+		PCODE(PCD_MULMAPVAR):
 			level.vars[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULWORLDVAR:
+		PCODE(PCD_MULWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_MULGLOBALVAR:
+		PCODE(PCD_MULGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTPCODE;
 
 		case PCD_MULMAPARRAY: {
 			int a = ACS_WorldVars[NEXTBYTE];
@@ -2721,21 +3146,21 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_INCSCRIPTVAR:
+		PCODE(PCD_INCSCRIPTVAR):
 			++locals[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_INCMAPVAR:
+		PCODE(PCD_INCMAPVAR):
 			++level.vars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_INCWORLDVAR:
+		PCODE(PCD_INCWORLDVAR):
 			++ACS_WorldVars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_INCGLOBALVAR:
+		PCODE(PCD_INCGLOBALVAR):
 			++ACS_GlobalVars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
 		case PCD_INCMAPARRAY:
 			{
@@ -2747,21 +3172,21 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DECSCRIPTVAR:
+		PCODE(PCD_DECSCRIPTVAR):
 			--locals[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_DECMAPVAR:
+		PCODE(PCD_DECMAPVAR):
 			--level.vars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_DECWORLDVAR:
+		PCODE(PCD_DECWORLDVAR):
 			--ACS_WorldVars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
-		case PCD_DECGLOBALVAR:
+		PCODE(PCD_DECGLOBALVAR):
 			--ACS_GlobalVars[NEXTBYTE];
-			break;
+			NEXTPCODE;
 
 		case PCD_DECMAPARRAY:
 			{
@@ -2773,21 +3198,21 @@ void DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_GOTO:
-			pc = level.behavior->Ofs2PC (*pc);
-			break;
+		PCODE(PCD_GOTO):
+			pc = code + *pc;
+			NEXTPCODE;
 
-		case PCD_IFGOTO:
+		PCODE(PCD_IFGOTO):
 			if (STACK(1))
-				pc = level.behavior->Ofs2PC (*pc);
+				pc = code + *pc;
 			else
 				pc++;
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_DROP:
+		PCODE(PCD_DROP):
 			sp--;
-			break;
+			NEXTPCODE;
 
 		case PCD_DELAY:
 			state = SCRIPT_Delayed;
@@ -2800,12 +3225,6 @@ void DLevelScript::RunScript ()
 			statedata = NEXTWORD;
 			break;
 
-		case PCD_DELAYDIRECTB:
-			state = SCRIPT_Delayed;
-			statedata = *(BYTE *)pc;
-			pc = (int *)((BYTE *)pc + 1);
-			break;
-
 		case PCD_RANDOM:
 			STACK(2) = Random (STACK(2), STACK(1));
 			sp--;
@@ -2816,11 +3235,6 @@ void DLevelScript::RunScript ()
 			pc += 2;
 			break;
 
-		case PCD_RANDOMDIRECTB:
-			PushToStack (Random (((BYTE *)pc)[0], ((BYTE *)pc)[1]));
-			pc = (int *)((BYTE *)pc + 2);
-			break;
-
 		case PCD_THINGCOUNT:
 			STACK(2) = ThingCount (STACK(2), STACK(1));
 			sp--;
@@ -2833,23 +3247,27 @@ void DLevelScript::RunScript ()
 
 		case PCD_TAGWAIT:
 			state = SCRIPT_TagWait;
+			recheck = true;
 			statedata = STACK(1);
 			sp--;
 			break;
 
 		case PCD_TAGWAITDIRECT:
 			state = SCRIPT_TagWait;
+			recheck = true;
 			statedata = NEXTWORD;
 			break;
 
 		case PCD_POLYWAIT:
 			state = SCRIPT_PolyWait;
+			recheck = true;
 			statedata = STACK(1);
 			sp--;
 			break;
 
 		case PCD_POLYWAITDIRECT:
 			state = SCRIPT_PolyWait;
+			recheck = true;
 			statedata = NEXTWORD;
 			break;
 
@@ -2877,60 +3295,60 @@ void DLevelScript::RunScript ()
 			pc = level.behavior->FindScript (script);
 			break;
 
-		case PCD_ANDLOGICAL:
+		PCODE(PCD_ANDLOGICAL):
 			STACK(2) = (STACK(2) && STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ORLOGICAL:
+		PCODE(PCD_ORLOGICAL):
 			STACK(2) = (STACK(2) || STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ANDBITWISE:
+		PCODE(PCD_ANDBITWISE):
 			STACK(2) = (STACK(2) & STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_ORBITWISE:
+		PCODE(PCD_ORBITWISE):
 			STACK(2) = (STACK(2) | STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_EORBITWISE:
+		PCODE(PCD_EORBITWISE):
 			STACK(2) = (STACK(2) ^ STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_NEGATELOGICAL:
+		PCODE(PCD_NEGATELOGICAL):
 			STACK(1) = !STACK(1);
-			break;
+			NEXTPCODE;
 
-		case PCD_LSHIFT:
+		PCODE(PCD_LSHIFT):
 			STACK(2) = (STACK(2) << STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_RSHIFT:
+		PCODE(PCD_RSHIFT):
 			STACK(2) = (STACK(2) >> STACK(1));
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_UNARYMINUS:
+		PCODE(PCD_UNARYMINUS):
 			STACK(1) = -STACK(1);
-			break;
+			NEXTPCODE;
 
-		case PCD_IFNOTGOTO:
+		PCODE(PCD_IFNOTGOTO):
 			if (!STACK(1))
-				pc = level.behavior->Ofs2PC (*pc);
+				pc = code + *pc;
 			else
 				pc++;
 			sp--;
-			break;
+			NEXTPCODE;
 
-		case PCD_LINESIDE:
+		PCODE(PCD_LINESIDE):
 			PushToStack (lineSide);
-			break;
+			NEXTPCODE;
 
 		case PCD_SCRIPTWAIT:
 			statedata = STACK(1);
@@ -2938,12 +3356,14 @@ void DLevelScript::RunScript ()
 				state = SCRIPT_ScriptWait;
 			else
 				state = SCRIPT_ScriptWaitPre;
+			recheck = true;
 			sp--;
 			PutLast ();
 			break;
 
 		case PCD_SCRIPTWAITDIRECT:
 			state = SCRIPT_ScriptWait;
+			recheck = true;
 			statedata = NEXTWORD;
 			PutLast ();
 			break;
@@ -2953,17 +3373,17 @@ void DLevelScript::RunScript ()
 				activationline->special = 0;
 			break;
 
-		case PCD_CASEGOTO:
+		PCODE(PCD_CASEGOTO):
 			if (STACK(1) == NEXTWORD)
 			{
-				pc = level.behavior->Ofs2PC (*pc);
+				pc = code + *pc;
 				sp--;
 			}
 			else
 			{
 				pc++;
 			}
-			break;
+			NEXTPCODE;
 
 		case PCD_BEGINPRINT:
 			workwhere = work;
@@ -3547,8 +3967,8 @@ void DLevelScript::RunScript ()
 			break;
 
 		case PCD_GETCVAR: {
-			cvar_t *var, *prev;
-			var = cvar_t::FindCVar(level.behavior->LookupString(STACK(1)), &prev);
+			cvar_t *var;
+			var = cvar_t::FindCVar(level.behavior->LookupString(STACK(1)));
 			if (var == NULL)
 			{
 				STACK(1) = 0;
@@ -3667,7 +4087,10 @@ void DLevelScript::RunScript ()
 			return;
 
 		if (controller->RunningScripts[script] == this)
+		{
 			controller->RunningScripts[script] = NULL;
+			controller->WakeWaiting (SCRIPT_ScriptWait, script);
+		}
 		this->Destroy ();
 	}
 }
@@ -3718,8 +4141,13 @@ DLevelScript::DLevelScript (AActor *who, line_t *where, int num, int *code, int
 		state = SCRIPT_Running;
 	}
 
+	recheck = true;
+
 	if (!always)
+	{
 		DACSThinker::ActiveThinker->RunningScripts[num] = this;
+		DACSThinker::ActiveThinker->WakeWaiting (SCRIPT_ScriptWaitPre, num);
+	}
 
 	Link ();
 
@@ -3979,6 +4407,262 @@ BEGIN_COMMAND (scriptstat)
 }
 END_COMMAND (scriptstat)
 
+//
+// acsbench
+//
+// Times the interpreter on a small object built in memory: a straight
+// arithmetic loop, a casegoto dispatch, function calls and a crowd of
+// scripts sitting in a script wait.  Results are in nanoseconds.
+//
+
+static void BenchWord (std::vector<BYTE> &lump, DWORD value)
+{
+	for (int i = 0; i < 4; i++)
+		lump.push_back ((BYTE)(value >> (i * 8)));
+}
+
+static void BenchPatch (std::vector<BYTE> &lump, size_t at, DWORD value)
+{
+	for (int i = 0; i < 4; i++)
+		lump[at + i] = (BYTE)(value >> (i * 8));
+}
+
+// Scripts and functions in the benchmark object
+enum
+{
+	BENCH_ARITH = 1,
+	BENCH_CASE,
+	BENCH_CALL,
+	BENCH_WAIT,
+
+	BENCH_LOOPS = 20000,	// stays under the runaway limit
+	BENCH_WAITERS = 1000,
+	BENCH_WAITTICS = 100
+};
+
+static std::vector<BYTE> BenchBuildObject ()
+{
+	typedef DLevelScript S;
+	std::vector<BYTE> lump;
+	DWORD start[4], func, loop;
+	size_t fix[4];
+	int i;
+
+	lump.push_back ('A'); lump.push_back ('C');
+	lump.push_back ('S'); lump.push_back ('E');
+	BenchWord (lump, 0);	// chunk offset, patched below
+
+	// i = 0; do { x = i * 3 + 7; } while (++i < BENCH_LOOPS);
+	start[0] = lump.size ();
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_ASSIGNSCRIPTVAR); BenchWord (lump, 0);
+	loop = lump.size ();
+	BenchWord (lump, S::PCD_PUSHSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, 3);
+	BenchWord (lump, S::PCD_MULTIPLY);
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, 7);
+	BenchWord (lump, S::PCD_ADD);
+	BenchWord (lump, S::PCD_ASSIGNMAPVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_INCSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, BENCH_LOOPS);
+	BenchWord (lump, S::PCD_LT);
+	BenchWord (lump, S::PCD_IFGOTO); BenchWord (lump, loop);
+	BenchWord (lump, S::PCD_TERMINATE);
+
+	// i = 0; do { switch (i & 3) { case 0..2: x += case } } while (++i < ...);
+	start[1] = lump.size ();
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_ASSIGNMAPVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_ASSIGNSCRIPTVAR); BenchWord (lump, 0);
+	loop = lump.size ();
+	BenchWord (lump, S::PCD_PUSHSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, 3);
+	BenchWord (lump, S::PCD_ANDBITWISE);
+	for (i = 0; i < 3; i++)
+	{
+		BenchWord (lump, S::PCD_CASEGOTO); BenchWord (lump, i);
+		fix[i] = lump.size (); BenchWord (lump, 0);
+	}
+	BenchWord (lump, S::PCD_DROP);
+	BenchWord (lump, S::PCD_GOTO);
+	fix[3] = lump.size (); BenchWord (lump, 0);
+	for (i = 0; i < 3; i++)
+	{
+		BenchPatch (lump, fix[i], lump.size ());
+		BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, i);
+		BenchWord (lump, S::PCD_ADDMAPVAR); BenchWord (lump, 0);
+		if (i < 2)
+		{
+			// jump to the loop test, patched below
+			BenchWord (lump, S::PCD_GOTO);
+			fix[i] = lump.size (); BenchWord (lump, 0);
+		}
+	}
+	for (i = 0; i < 2; i++)
+		BenchPatch (lump, fix[i], lump.size ());
+	BenchPatch (lump, fix[3], lump.size ());
+	BenchWord (lump, S::PCD_INCSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, BENCH_LOOPS);
+	BenchWord (lump, S::PCD_LT);
+	BenchWord (lump, S::PCD_IFGOTO); BenchWord (lump, loop);
+	BenchWord (lump, S::PCD_TERMINATE);
+
+	// function 0 (a) { return a + 1; }
+	func = lump.size ();
+	BenchWord (lump, S::PCD_PUSHSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, 1);
+	BenchWord (lump, S::PCD_ADD);
+	BenchWord (lump, S::PCD_RETURNVAL);
+
+	// i = 0; do { i = f(i); } while (i < BENCH_LOOPS);
+	start[2] = lump.size ();
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_ASSIGNSCRIPTVAR); BenchWord (lump, 0);
+	loop = lump.size ();
+	BenchWord (lump, S::PCD_PUSHSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_CALL); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_DUP);
+	BenchWord (lump, S::PCD_ASSIGNSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_PUSHNUMBER); BenchWord (lump, BENCH_LOOPS);
+	BenchWord (lump, S::PCD_LT);
+	BenchWord (lump, S::PCD_IFGOTO); BenchWord (lump, loop);
+	BenchWord (lump, S::PCD_PUSHSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_ASSIGNMAPVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_TERMINATE);
+
+	// scriptwait on the script number passed as the first argument
+	start[3] = lump.size ();
+	BenchWord (lump, S::PCD_PUSHSCRIPTVAR); BenchWord (lump, 0);
+	BenchWord (lump, S::PCD_SCRIPTWAIT);
+	BenchWord (lump, S::PCD_TERMINATE);
+
+	BenchPatch (lump, 4, lump.size ());
+
+	BenchWord (lump, MAKE_ID('S','P','T','R'));
+	BenchWord (lump, 4 * 12);
+	for (i = 0; i < 4; i++)
+	{
+		BenchWord (lump, BENCH_ARITH + i);	// number and type
+		BenchWord (lump, start[i]);
+		BenchWord (lump, i == 3 ? 1 : 0);
+	}
+
+	BenchWord (lump, MAKE_ID('F','U','N','C'));
+	BenchWord (lump, 8);
+	lump.push_back (1);		// ArgCount
+	lump.push_back (1);		// LocalCount
+	lump.push_back (1);		// HasReturnValue
+	lump.push_back (0);
+	BenchWord (lump, func);
+
+	return lump;
+}
+
+// Runs a script through to the end and returns how long that took
+static dtime_t BenchRun (int num, int *code)
+{
+	DLevelScript *script = new DLevelScript (NULL, NULL, num, code, 0, 0, 0, 0, 1, false);
+
+	dtime_t start = I_GetTime ();
+	script->RunScript ();
+	return I_GetTime () - start;
+}
+
+BEGIN_COMMAND (acsbench)
+{
+	if (gamestate != GS_LEVEL)
+	{
+		Printf (PRINT_HIGH, "acsbench: not in a level\n");
+		return;
+	}
+
+	static const char *names[] = { "arith", "casegoto", "call" };
+	static const int expect[] =
+	{
+		(BENCH_LOOPS - 1) * 3 + 7,
+		(BENCH_LOOPS / 4) * (0 + 1 + 2),
+		BENCH_LOOPS
+	};
+
+	std::vector<BYTE> lump = BenchBuildObject ();
+	FBehavior *saved = level.behavior;
+	SDWORD savedvar = level.vars[0];
+	bool madethinker = (DACSThinker::ActiveThinker == NULL);
+	int i, j;
+
+	FBehavior bench (&lump[0], lump.size ());
+	level.behavior = &bench;
+
+	for (i = 0; i < 3; i++)
+	{
+		dtime_t best = 0;
+
+		for (j = 0; j < 5; j++)
+		{
+			dtime_t t = BenchRun (BENCH_ARITH + i, bench.FindScript (BENCH_ARITH + i));
+			if (j == 0 || t < best)
+				best = t;
+		}
+
+		Printf (PRINT_HIGH, "%-9s %6.2f ns/loop%s\n", names[i],
+			(double)best / BENCH_LOOPS,
+			level.vars[0] == expect[i] ? "" : "  (wrong result)");
+	}
+
+	// Park the waiters on a script that never finishes, in a free slot
+	DACSThinker *controller = DACSThinker::ActiveThinker;
+	int slot = 999;
+	while (slot > 0 && controller->RunningScripts[slot])
+		slot--;
+
+	if (controller->RunningScripts[slot])
+	{
+		Printf (PRINT_HIGH, "wait      skipped, no free script number\n");
+	}
+	else
+	{
+		DLevelScript *holder = new DLevelScript (NULL, NULL, slot,
+			bench.FindScript (BENCH_ARITH), 0, 0, 0, 0, 0, false);
+		holder->SetState (DLevelScript::SCRIPT_Suspended);
+
+		std::vector<DLevelScript *> waiters;
+		for (i = 0; i < BENCH_WAITERS; i++)
+		{
+			waiters.push_back (new DLevelScript (NULL, NULL, BENCH_WAIT,
+				bench.FindScript (BENCH_WAIT), 0, slot, 0, 0, 1, false));
+		}
+
+		dtime_t start = I_GetTime ();
+		for (i = 0; i < BENCH_WAITTICS; i++)
+		{
+			for (j = 0; j < BENCH_WAITERS; j++)
+				waiters[j]->RunScript ();
+		}
+		dtime_t waiting = I_GetTime () - start;
+
+		for (j = 0; j < BENCH_WAITERS; j++)
+		{
+			waiters[j]->SetState (DLevelScript::SCRIPT_PleaseRemove);
+			waiters[j]->RunScript ();
+		}
+		holder->SetState (DLevelScript::SCRIPT_PleaseRemove);
+		holder->RunScript ();
+
+		Printf (PRINT_HIGH, "%-9s %6.2f ns/tic for %d waiting scripts\n", "wait",
+			(double)waiting / BENCH_WAITTICS, BENCH_WAITERS);
+	}
+
+	level.behavior = saved;
+	level.vars[0] = savedvar;
+
+	if (madethinker && DACSThinker::ActiveThinker)
+		DACSThinker::ActiveThinker->Destroy ();
+}
+END_COMMAND (acsbench)
+
 void DACSThinker::DumpScriptStatus ()
 {
 	static const char *stateNames[] =
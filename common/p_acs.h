@@ -3,6 +3,8 @@
 #ifndef __P_ACS_H__
 #define __P_ACS_H__
 
+#include <vector>
+
 #include "dobject.h"
 #include "doomtype.h"
 #include "r_defs.h"
@@ -73,10 +75,12 @@ public:
 	const char *LookupString (DWORD index, DWORD ofs=0) const;
 	const char *LocalizeString (DWORD index) const;
 	void StartTypedScripts (WORD type, AActor *activator, int arg0=0, int arg1=0, int arg2=0, bool always = true) const;
-	DWORD PC2Ofs (int *pc) const { return (BYTE *)pc - Data; }
-	int *Ofs2PC (DWORD ofs) const { return (int *)(Data + ofs); }
+	DWORD PC2Ofs (int *pc) const;
+	int *Ofs2PC (DWORD ofs) const;
+	int *GetCode () const { return const_cast<int *>(&Code[0]); }
 	ACSFormat GetFormat() const { return Format; }
 	ScriptFunction *GetFunction (int funcnum) const;
+	int *GetFunctionCode (int funcnum) const { return GetCode() + FunctionCode[funcnum]; }
 	int GetArrayVal (int arraynum, int index) const;
 	void SetArrayVal (int arraynum, int index, int value);
 
@@ -97,7 +101,21 @@ private:
 	DWORD LanguageNeutral;
 	DWORD Localized;
 
+	// Scripts and functions are decoded once at load into an instruction
+	// stream of whole ints: byte operands are widened, the byte-packed
+	// p-codes are folded into their word forms and jump targets are
+	// indices into the stream.  RunScript never sees the lump format.
+	std::vector<int> Code;
+	std::vector<int> CodeLumpOfs;		// lump offset of each decoded int
+	std::vector<int> LumpCodeOfs;		// decoded index of each lump offset, or -1
+	std::vector<int> ScriptCode;		// decoded entry of each script, same order as Scripts
+	std::vector<int> FunctionCode;		// decoded entry of each function
+
 	static int STACK_ARGS SortScripts (const void *a, const void *b);
+	void DecodeScripts ();
+	int DecodeFrom (DWORD ofs);
+	void Emit (int value, DWORD ofs);
+	bool ReadOperand (DWORD &ofs, bool isbyte, int &value) const;
 	void AddLanguage (DWORD lang);
 	DWORD FindLanguage (DWORD lang, bool ignoreregion) const;
 	DWORD *CheckIfInList (DWORD lang);
@@ -476,6 +494,7 @@ protected:
 	line_t			*activationline;
 	int				lineSide;
 	int				stringstart;
+	bool			recheck;	// a wait may be over, look again next run
 
 	inline void PushToStack (int val);
 
@@ -538,6 +557,9 @@ public:
 
     void DumpScriptStatus();
 
+	// Something a waiting script may be waiting for has changed
+	void WakeWaiting (DLevelScript::EScriptState state, int data);
+
 private:
 	DLevelScript *LastScript;
 	DLevelScript *Scripts;				// List of all running scripts
@@ -567,5 +589,10 @@ typedef struct acsdefered_s acsdefered_t;
 FArchive &operator<< (FArchive &arc, acsdefered_s *defer);
 FArchive &operator>> (FArchive &arc, acsdefered_s* &defer);
 
+// Called when a sector mover or polyobject action ends so scripts waiting
+// on it check again instead of polling every tic
+void P_ACSWakeTagWait (int tag);
+void P_ACSWakePolyWait (int polyobj);
+
 #endif //__P_ACS_H__
 
@@ -374,7 +374,7 @@ void EV_TurnTagLightsOff (int tag)
 				min = tsec->lightlevel;
 		}
 		sector->lightlevel = min;
-		sector->SectorChanges |= SPC_LightLevel;
+		P_SectorChanged(sector, SPC_LightLevel);
 	}
 }
 
@@ -412,7 +412,7 @@ void EV_LightTurnOn (int tag, int bright)
 			}
 		}
 		sector->lightlevel = CLIPLIGHT(bright);
-		sector->SectorChanges |= SPC_LightLevel;
+		P_SectorChanged(sector, SPC_LightLevel);
 	}
 }
 
@@ -467,7 +467,7 @@ int EV_LightTurnOnPartway(int tag, int level)
         // Set level in-between extremes
         sector->lightlevel =
             (level * bright + (FRACUNIT-level) * min) >> FRACBITS;
-		sector->SectorChanges |= SPC_LightLevel;
+		P_SectorChanged(sector, SPC_LightLevel);
     }
     return 1;
 }
@@ -485,7 +485,7 @@ void EV_LightChange (int tag, int value)
 	while ((secnum = P_FindSectorFromTag (tag, secnum)) >= 0) {
 		int newlight = sectors[secnum].lightlevel + value;
 		sectors[secnum].lightlevel = CLIPLIGHT(newlight);
-		sectors[secnum].SectorChanges |= SPC_LightLevel;
+		P_SectorChanged(&sectors[secnum], SPC_LightLevel);
 	}
 }
 
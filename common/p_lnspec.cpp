@@ -1504,7 +1504,7 @@ FUNC(LS_Sector_SetGravity)
 	while ((secnum = P_FindSectorFromTag(arg0, secnum)) >= 0)
 	{
 		sectors[secnum].gravity = gravity;
-		sectors[secnum].SectorChanges |= SPC_Gravity;
+		P_SectorChanged(&sectors[secnum], SPC_Gravity);
 	}
 
 	return true;
@@ -1520,7 +1520,7 @@ FUNC(LS_Sector_SetColor)
 				sectors[secnum].colormap->fade.getr(),
 				sectors[secnum].colormap->fade.getg(),
 				sectors[secnum].colormap->fade.getb());
-		sectors[secnum].SectorChanges |= SPC_Color;
+		P_SectorChanged(&sectors[secnum], SPC_Color);
 	}
 	return true;
 }
@@ -1539,7 +1539,7 @@ FUNC(LS_Sector_SetFade)
 		byte r = sectors[secnum].colormap->fade.getr();
 		byte g = sectors[secnum].colormap->fade.getg();
 		byte b = sectors[secnum].colormap->fade.getb();
-		sectors[secnum].SectorChanges |= SPC_Fade;
+		P_SectorChanged(&sectors[secnum], SPC_Fade);
 	}
 	return true;
 }
@@ -1555,7 +1555,7 @@ FUNC(LS_Sector_SetCeilingPanning)
 	{
 		sectors[secnum].ceiling_xoffs = xofs;
 		sectors[secnum].ceiling_yoffs = yofs;
-		sectors[secnum].SectorChanges |= SPC_Panning;
+		P_SectorChanged(&sectors[secnum], SPC_Panning);
 	}
 	return true;
 }
@@ -1571,7 +1571,7 @@ FUNC(LS_Sector_SetFloorPanning)
 	{
 		sectors[secnum].floor_xoffs = xofs;
 		sectors[secnum].floor_yoffs = yofs;
-		sectors[secnum].SectorChanges |= SPC_Panning;
+		P_SectorChanged(&sectors[secnum], SPC_Panning);
 	}
 	return true;
 }
@@ -1594,7 +1594,7 @@ FUNC(LS_Sector_SetCeilingScale)
 			sectors[secnum].ceiling_xscale = xscale;
 		if (yscale)
 			sectors[secnum].ceiling_yscale = yscale;
-		sectors[secnum].SectorChanges |= SPC_Scale;
+		P_SectorChanged(&sectors[secnum], SPC_Scale);
 	}
 	return true;
 }
@@ -1617,7 +1617,7 @@ FUNC(LS_Sector_SetFloorScale)
 			sectors[secnum].floor_xscale = xscale;
 		if (yscale)
 			sectors[secnum].floor_yscale = yscale;
-		sectors[secnum].SectorChanges |= SPC_Scale;
+		P_SectorChanged(&sectors[secnum], SPC_Scale);
 	}
 	return true;
 }
@@ -1633,7 +1633,7 @@ FUNC(LS_Sector_SetRotation)
 	{
 		sectors[secnum].floor_angle = floor;
 		sectors[secnum].ceiling_angle = ceiling;
-		sectors[secnum].SectorChanges |= SPC_Rotation;
+		P_SectorChanged(&sectors[secnum], SPC_Rotation);
 	}
 	return true;
 }
@@ -378,6 +378,7 @@ class DPolyAction : public DThinker
 	DECLARE_SERIAL (DPolyAction, DThinker)
 public:
 	DPolyAction (int polyNum);
+	virtual void Destroy ();
 protected:
 	DPolyAction ();
 	int m_PolyObj;
@@ -3550,11 +3550,19 @@ bool P_IdenticalPlanes(const plane_t *pl1, const plane_t *pl2)
 		(pl1->a == pl2->a && pl1->b == pl2->b && pl1->c == pl2->c && pl1->d == pl2->d);
 }
 
+#ifdef CLIENT_APP
+void R_InterpolateSectorMoved(sector_t* sector, bool ceiling);
+#endif
+
 void P_ChangeCeilingHeight(sector_t *sector, fixed_t amount)
 {
 	if (!sector)
 		return;
 
+#ifdef CLIENT_APP
+	R_InterpolateSectorMoved(sector, true);
+#endif
+
 	plane_t *plane = &sector->ceilingplane;
 	plane->d -= FixedMul(amount, plane->c);
 
@@ -3568,6 +3576,10 @@ void P_ChangeFloorHeight(sector_t *sector, fixed_t amount)
 	if (!sector)
 		return;
 
+#ifdef CLIENT_APP
+	R_InterpolateSectorMoved(sector, false);
+#endif
+
 	plane_t *plane = &sector->floorplane;
 	plane->d -= FixedMul(amount, plane->c);
 
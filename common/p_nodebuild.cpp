@@ -0,0 +1,1146 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Node, blockmap and reject builder, and the on-disk cache of what it
+//	builds.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+
+#include "m_bbox.h"
+#include "m_fixed.h"
+#include "md5.h"
+#include "p_nodebuild.h"
+
+// Bump when the output of any builder changes, so old cache files are
+// no longer found
+static const unsigned int MAPDATA_VERSION = 1;
+
+static const char MAPDATA_MAGIC[4] = { 'O', 'D', 'M', 'C' };
+
+static const int NO_SIDE = -1;
+
+static const int ML_TWOSIDED_FLAG = 0x0004;
+
+//
+// Raw lump access
+//
+// Lumps are little endian and records are not aligned, so fields are read
+// a byte at a time.
+//
+
+static inline int ReadShort(const byte* p)
+{
+	return (short)(p[0] | (p[1] << 8));
+}
+
+static inline unsigned int ReadUShort(const byte* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline void WriteByte(std::vector<byte>& out, unsigned int value)
+{
+	out.push_back((byte)value);
+}
+
+static inline void WriteUShort(std::vector<byte>& out, unsigned int value)
+{
+	out.push_back((byte)value);
+	out.push_back((byte)(value >> 8));
+}
+
+static inline void WriteULong(std::vector<byte>& out, unsigned int value)
+{
+	out.push_back((byte)value);
+	out.push_back((byte)(value >> 8));
+	out.push_back((byte)(value >> 16));
+	out.push_back((byte)(value >> 24));
+}
+
+struct rawline_t
+{
+	int v1, v2;
+	int flags;
+	int sidenum[2];		// NO_SIDE if missing
+};
+
+static int NumVertexes(const maplumps_t& lumps)
+{
+	return (int)(lumps.vertexes_len / 4);
+}
+
+static int NumSectors(const maplumps_t& lumps)
+{
+	return (int)(lumps.sectors_len / 26);
+}
+
+//
+// ReadLines
+//
+// Reads the linedefs with the vertex and side numbers checked.  Returns
+// false if a line uses a vertex that does not exist.
+//
+static bool ReadLines(const maplumps_t& lumps, std::vector<rawline_t>& lines)
+{
+	const size_t size = lumps.hexen ? 16 : 14;
+	const size_t sideofs = lumps.hexen ? 12 : 10;
+	const int numvertexes = NumVertexes(lumps);
+	const int numsides = (int)(lumps.sidedefs_len / 30);
+
+	const size_t count = lumps.linedefs_len / size;
+	lines.resize(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const byte* p = lumps.linedefs + i * size;
+		rawline_t& line = lines[i];
+
+		line.v1 = ReadUShort(p);
+		line.v2 = ReadUShort(p + 2);
+		line.flags = ReadUShort(p + 4);
+
+		if (line.v1 >= numvertexes || line.v2 >= numvertexes)
+			return false;
+
+		for (int side = 0; side < 2; side++)
+		{
+			int sidenum = ReadUShort(p + sideofs + side * 2);
+			line.sidenum[side] = sidenum < numsides ? sidenum : NO_SIDE;
+		}
+	}
+
+	return true;
+}
+
+static int SideSector(const maplumps_t& lumps, int sidenum)
+{
+	if (sidenum == NO_SIDE)
+		return -1;
+
+	int sector = ReadUShort(lumps.sidedefs + sidenum * 30 + 28);
+	return sector < NumSectors(lumps) ? sector : -1;
+}
+
+
+//
+// NodeBuilder
+//
+// Recursively splits the segs of the map by the line of one of them until
+// every set left is convex, choosing the line that splits the fewest segs
+// and keeps the two sides closest in size.  Partition lines are always
+// linedefs, so they are exact in the map units the NODES format stores,
+// and sides are decided with the cross product R_PointOnSide uses.
+//
+class NodeBuilder
+{
+public:
+	NodeBuilder(const maplumps_t& lumps) : mLumps(lumps) {}
+
+	bool build(std::vector<byte>& out);
+
+private:
+	struct nbvertex_t
+	{
+		int x, y;				// fixed point
+	};
+
+	struct nbseg_t
+	{
+		int v1, v2;
+		int linedef;
+		int side;
+	};
+
+	struct nbnode_t
+	{
+		int x, y, dx, dy;		// map units
+		int bbox[2][4];			// map units, BOXTOP, BOXBOTTOM, BOXLEFT, BOXRIGHT
+		unsigned int children[2];
+	};
+
+	// Partition line of a seg, its linedef in the seg's direction
+	struct partition_t
+	{
+		int x, y, dx, dy;
+		double length;
+	};
+
+	enum { SIDE_FRONT, SIDE_BACK, SIDE_SPLIT };
+
+	// Candidates looked at per set before trying the rest
+	static const size_t MAX_CANDIDATES = 128;
+
+	// Deeper than any sane tree, only reached if splitting stops making
+	// progress
+	static const int MAX_DEPTH = 1024;
+
+	// Points this close to a partition, in fixed units, are on it
+	static const double SIDE_EPSILON;
+
+	partition_t getPartition(const nbseg_t& seg) const;
+	double pointDist(const partition_t& part, int vertex) const;
+	static int pointSide(double dist);
+	int classify(const nbseg_t& seg, const partition_t& part, double& d1, double& d2) const;
+
+	int evaluate(const std::vector<int>& set, const partition_t& part, int bestcost) const;
+	int choosePartition(const std::vector<int>& set) const;
+	int splitVertex(const nbseg_t& seg, double d1, double d2);
+	void divide(const std::vector<int>& set, const partition_t& part,
+	            std::vector<int>& front, std::vector<int>& back);
+
+	unsigned int buildSubtree(std::vector<int>& set, int bbox[4], int depth);
+
+	const maplumps_t&					mLumps;
+	std::vector<rawline_t>				mLines;
+	std::vector<nbvertex_t>				mVertexes;
+	std::map<std::pair<int, int>, int>	mVertexMap;
+	std::vector<nbseg_t>				mSegs;
+
+	std::vector<int>					mOutSegs;
+	std::vector<unsigned int>			mOutSubsectors;		// seg counts
+	std::vector<nbnode_t>				mOutNodes;
+};
+
+const double NodeBuilder::SIDE_EPSILON = 8.0;
+
+NodeBuilder::partition_t NodeBuilder::getPartition(const nbseg_t& seg) const
+{
+	const rawline_t& line = mLines[seg.linedef];
+	const nbvertex_t& v1 = mVertexes[seg.side ? line.v2 : line.v1];
+	const nbvertex_t& v2 = mVertexes[seg.side ? line.v1 : line.v2];
+
+	partition_t part;
+	part.x = v1.x >> FRACBITS;
+	part.y = v1.y >> FRACBITS;
+	part.dx = (v2.x >> FRACBITS) - part.x;
+	part.dy = (v2.y >> FRACBITS) - part.y;
+	part.length = sqrt((double)part.dx * part.dx + (double)part.dy * part.dy);
+	return part;
+}
+
+//
+// NodeBuilder::pointDist
+//
+// Distance of a vertex from the partition in fixed units, positive on the
+// front side.
+//
+double NodeBuilder::pointDist(const partition_t& part, int vertex) const
+{
+	const nbvertex_t& v = mVertexes[vertex];
+	int64_t cross = ((int64_t)v.x - ((int64_t)part.x << FRACBITS)) * part.dy -
+	                ((int64_t)v.y - ((int64_t)part.y << FRACBITS)) * part.dx;
+	return (double)cross / part.length;
+}
+
+int NodeBuilder::pointSide(double dist)
+{
+	if (dist > SIDE_EPSILON)
+		return 1;
+	if (dist < -SIDE_EPSILON)
+		return -1;
+	return 0;
+}
+
+int NodeBuilder::classify(const nbseg_t& seg, const partition_t& part,
+                          double& d1, double& d2) const
+{
+	d1 = pointDist(part, seg.v1);
+	d2 = pointDist(part, seg.v2);
+
+	int s1 = pointSide(d1);
+	int s2 = pointSide(d2);
+
+	if (s1 == 0 && s2 == 0)
+	{
+		// On the partition, segs facing the same way go in front
+		const nbvertex_t& v1 = mVertexes[seg.v1];
+		const nbvertex_t& v2 = mVertexes[seg.v2];
+		double dot = (double)(v2.x - v1.x) * part.dx + (double)(v2.y - v1.y) * part.dy;
+		return dot > 0 ? SIDE_FRONT : SIDE_BACK;
+	}
+
+	if (s1 >= 0 && s2 >= 0)
+		return SIDE_FRONT;
+	if (s1 <= 0 && s2 <= 0)
+		return SIDE_BACK;
+	return SIDE_SPLIT;
+}
+
+//
+// NodeBuilder::evaluate
+//
+// Cost of splitting the set by part, or -1 if it would leave a side
+// empty.  Gives up once the cost passes bestcost.
+//
+int NodeBuilder::evaluate(const std::vector<int>& set, const partition_t& part,
+                          int bestcost) const
+{
+	int front = 0, back = 0, splits = 0;
+
+	for (size_t i = 0; i < set.size(); i++)
+	{
+		double d1, d2;
+		switch (classify(mSegs[set[i]], part, d1, d2))
+		{
+		case SIDE_FRONT:
+			front++;
+			break;
+		case SIDE_BACK:
+			back++;
+			break;
+		default:
+			splits++;
+			if (bestcost >= 0 && splits * 8 > bestcost)
+				return -1;
+			break;
+		}
+	}
+
+	if ((front == 0 && splits == 0) || (back == 0 && splits == 0))
+		return -1;
+
+	return splits * 8 + (front > back ? front - back : back - front);
+}
+
+//
+// NodeBuilder::choosePartition
+//
+// Returns the seg whose line splits the set best, or -1 if the set is
+// convex.  Each linedef is tried once.  Large sets only try an even sample
+// of their lines first, and all of them if none of the sample divides the
+// set.
+//
+int NodeBuilder::choosePartition(const std::vector<int>& set) const
+{
+	std::vector<int> candidates;
+	std::vector<bool> seen(mLines.size(), false);
+
+	for (size_t i = 0; i < set.size(); i++)
+	{
+		const nbseg_t& seg = mSegs[set[i]];
+		if (seen[seg.linedef])
+			continue;
+		seen[seg.linedef] = true;
+
+		// The NODES format stores partitions as shorts
+		partition_t part = getPartition(seg);
+		if (part.dx < -32768 || part.dx > 32767 || part.dy < -32768 || part.dy > 32767)
+			continue;
+
+		candidates.push_back(set[i]);
+	}
+
+	int best = -1, bestcost = -1;
+	std::vector<bool> tried(candidates.size(), false);
+
+	size_t sample = MIN(candidates.size(), MAX_CANDIDATES);
+	for (size_t i = 0; i < sample; i++)
+	{
+		size_t index = i * candidates.size() / sample;
+		tried[index] = true;
+
+		int cost = evaluate(set, getPartition(mSegs[candidates[index]]), bestcost);
+		if (cost >= 0 && (bestcost < 0 || cost < bestcost))
+		{
+			best = candidates[index];
+			bestcost = cost;
+		}
+	}
+
+	if (best >= 0)
+		return best;
+
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		if (tried[i])
+			continue;
+
+		int cost = evaluate(set, getPartition(mSegs[candidates[i]]), bestcost);
+		if (cost >= 0 && (bestcost < 0 || cost < bestcost))
+		{
+			best = candidates[i];
+			bestcost = cost;
+		}
+	}
+
+	return best;
+}
+
+//
+// NodeBuilder::splitVertex
+//
+// Vertex where the partition crosses seg, rounded to fixed point and shared
+// with any other seg split at the same place.
+//
+int NodeBuilder::splitVertex(const nbseg_t& seg, double d1, double d2)
+{
+	const nbvertex_t& v1 = mVertexes[seg.v1];
+	const nbvertex_t& v2 = mVertexes[seg.v2];
+
+	double t = d1 / (d1 - d2);
+	int x = (int)floor(v1.x + t * (v2.x - v1.x) + 0.5);
+	int y = (int)floor(v1.y + t * (v2.y - v1.y) + 0.5);
+
+	std::pair<int, int> key(x, y);
+	std::map<std::pair<int, int>, int>::iterator it = mVertexMap.find(key);
+	if (it != mVertexMap.end())
+		return it->second;
+
+	nbvertex_t v;
+	v.x = x;
+	v.y = y;
+	mVertexes.push_back(v);
+
+	int index = (int)mVertexes.size() - 1;
+	mVertexMap[key] = index;
+	return index;
+}
+
+void NodeBuilder::divide(const std::vector<int>& set, const partition_t& part,
+                         std::vector<int>& front, std::vector<int>& back)
+{
+	for (size_t i = 0; i < set.size(); i++)
+	{
+		double d1, d2;
+		int side = classify(mSegs[set[i]], part, d1, d2);
+
+		if (side == SIDE_FRONT)
+		{
+			front.push_back(set[i]);
+			continue;
+		}
+		if (side == SIDE_BACK)
+		{
+			back.push_back(set[i]);
+			continue;
+		}
+
+		int v = splitVertex(mSegs[set[i]], d1, d2);
+
+		// Rounding put the split on an end, the seg is all on one side
+		if (v == mSegs[set[i]].v1 || v == mSegs[set[i]].v2)
+		{
+			double d = (v == mSegs[set[i]].v1) ? d2 : d1;
+			(d > 0 ? front : back).push_back(set[i]);
+			continue;
+		}
+
+		// The first part keeps the seg, the rest is a new one
+		nbseg_t rest = mSegs[set[i]];
+		rest.v1 = v;
+		mSegs[set[i]].v2 = v;
+		mSegs.push_back(rest);
+
+		int restindex = (int)mSegs.size() - 1;
+		if (d1 > 0)
+		{
+			front.push_back(set[i]);
+			back.push_back(restindex);
+		}
+		else
+		{
+			back.push_back(set[i]);
+			front.push_back(restindex);
+		}
+	}
+}
+
+//
+// NodeBuilder::buildSubtree
+//
+// Returns the child reference for the set, a node number or a subsector
+// number with NF_SUBSECTOR set, and the set's bounding box in fixed point.
+// Children are numbered before their parent, so the root is the last node.
+//
+unsigned int NodeBuilder::buildSubtree(std::vector<int>& set, int bbox[4], int depth)
+{
+	bbox[BOXTOP] = bbox[BOXRIGHT] = MININT;
+	bbox[BOXBOTTOM] = bbox[BOXLEFT] = MAXINT;
+
+	for (size_t i = 0; i < set.size(); i++)
+	{
+		const int vs[2] = { mSegs[set[i]].v1, mSegs[set[i]].v2 };
+		for (int j = 0; j < 2; j++)
+		{
+			const nbvertex_t& v = mVertexes[vs[j]];
+			bbox[BOXTOP] = MAX(bbox[BOXTOP], v.y);
+			bbox[BOXBOTTOM] = MIN(bbox[BOXBOTTOM], v.y);
+			bbox[BOXLEFT] = MIN(bbox[BOXLEFT], v.x);
+			bbox[BOXRIGHT] = MAX(bbox[BOXRIGHT], v.x);
+		}
+	}
+
+	int partseg = depth < MAX_DEPTH ? choosePartition(set) : -1;
+
+	if (partseg < 0)
+	{
+		mOutSegs.insert(mOutSegs.end(), set.begin(), set.end());
+		mOutSubsectors.push_back((unsigned int)set.size());
+		return (unsigned int)(mOutSubsectors.size() - 1) | 0x80000000u;
+	}
+
+	const partition_t part = getPartition(mSegs[partseg]);
+
+	std::vector<int> front, back;
+	divide(set, part, front, back);
+
+	// Nothing above needs the set again
+	std::vector<int>().swap(set);
+
+	nbnode_t node;
+	node.x = part.x;
+	node.y = part.y;
+	node.dx = part.dx;
+	node.dy = part.dy;
+
+	std::vector<int>* children[2] = { &front, &back };
+	for (int i = 0; i < 2; i++)
+	{
+		int childbox[4];
+		node.children[i] = buildSubtree(*children[i], childbox, depth + 1);
+
+		// Rounded outwards to whole map units
+		node.bbox[i][BOXTOP] = (childbox[BOXTOP] + FRACUNIT - 1) >> FRACBITS;
+		node.bbox[i][BOXBOTTOM] = childbox[BOXBOTTOM] >> FRACBITS;
+		node.bbox[i][BOXLEFT] = childbox[BOXLEFT] >> FRACBITS;
+		node.bbox[i][BOXRIGHT] = (childbox[BOXRIGHT] + FRACUNIT - 1) >> FRACBITS;
+	}
+
+	mOutNodes.push_back(node);
+	return (unsigned int)(mOutNodes.size() - 1);
+}
+
+bool NodeBuilder::build(std::vector<byte>& out)
+{
+	if (!ReadLines(mLumps, mLines))
+		return false;
+
+	const int numorgvert = NumVertexes(mLumps);
+	for (int i = 0; i < numorgvert; i++)
+	{
+		nbvertex_t v;
+		v.x = ReadShort(mLumps.vertexes + i * 4) << FRACBITS;
+		v.y = ReadShort(mLumps.vertexes + i * 4 + 2) << FRACBITS;
+		mVertexes.push_back(v);
+		mVertexMap.insert(std::make_pair(std::make_pair(v.x, v.y), i));
+	}
+
+	// A seg for each side of each line, zero length lines are left out
+	std::vector<int> set;
+	for (size_t i = 0; i < mLines.size(); i++)
+	{
+		const rawline_t& line = mLines[i];
+		const nbvertex_t& v1 = mVertexes[line.v1];
+		const nbvertex_t& v2 = mVertexes[line.v2];
+
+		if (v1.x == v2.x && v1.y == v2.y)
+			continue;
+
+		for (int side = 0; side < 2; side++)
+		{
+			if (line.sidenum[side] == NO_SIDE)
+				continue;
+
+			nbseg_t seg;
+			seg.v1 = side ? line.v2 : line.v1;
+			seg.v2 = side ? line.v1 : line.v2;
+			seg.linedef = (int)i;
+			seg.side = side;
+
+			mSegs.push_back(seg);
+			set.push_back((int)mSegs.size() - 1);
+		}
+	}
+
+	if (set.empty() || mLines.size() > 0xFFFF)
+		return false;
+
+	int bbox[4];
+	buildSubtree(set, bbox, 0);
+
+	// Written in the ZDBSP extended format P_LoadXNOD reads
+	out.clear();
+	out.insert(out.end(), "XNOD", "XNOD" + 4);
+
+	WriteULong(out, numorgvert);
+	WriteULong(out, (unsigned int)(mVertexes.size() - numorgvert));
+	for (size_t i = numorgvert; i < mVertexes.size(); i++)
+	{
+		WriteULong(out, (unsigned int)mVertexes[i].x);
+		WriteULong(out, (unsigned int)mVertexes[i].y);
+	}
+
+	WriteULong(out, (unsigned int)mOutSubsectors.size());
+	for (size_t i = 0; i < mOutSubsectors.size(); i++)
+		WriteULong(out, mOutSubsectors[i]);
+
+	WriteULong(out, (unsigned int)mOutSegs.size());
+	for (size_t i = 0; i < mOutSegs.size(); i++)
+	{
+		const nbseg_t& seg = mSegs[mOutSegs[i]];
+		WriteULong(out, seg.v1);
+		WriteULong(out, seg.v2);
+		WriteUShort(out, seg.linedef);
+		WriteByte(out, seg.side);
+	}
+
+	WriteULong(out, (unsigned int)mOutNodes.size());
+	for (size_t i = 0; i < mOutNodes.size(); i++)
+	{
+		const nbnode_t& node = mOutNodes[i];
+		WriteUShort(out, node.x & 0xFFFF);
+		WriteUShort(out, node.y & 0xFFFF);
+		WriteUShort(out, node.dx & 0xFFFF);
+		WriteUShort(out, node.dy & 0xFFFF);
+		for (int j = 0; j < 2; j++)
+			for (int k = 0; k < 4; k++)
+				WriteUShort(out, node.bbox[j][k] & 0xFFFF);
+		WriteULong(out, node.children[0]);
+		WriteULong(out, node.children[1]);
+	}
+
+	return true;
+}
+
+//
+// P_BuildNodes
+//
+// Builds a BSP tree for the map in the ZDBSP extended format.  Returns
+// false if the map has no lines to build from or they are broken.
+//
+bool P_BuildNodes(const maplumps_t& lumps, std::vector<byte>& out)
+{
+	NodeBuilder builder(lumps);
+	return builder.build(out);
+}
+
+
+//
+// P_BuildBlockMap
+//
+// jff 10/6/98
+// New code added to speed up calculation of internal blockmap
+// Algorithm is order of nlines*(ncols+nrows) not nlines*ncols*nrows
+//
+// This finds the intersection of each linedef with the column and
+// row lines at the left and bottom of each blockmap cell. It then
+// adds the line to all block lists touching the intersection.
+//
+// The lists come out as the original linked lists built them, a leading 0,
+// the lines from last to first, then -1.
+//
+
+#define blkshift 7               /* places to shift rel position for cell num */
+#define blkmask ((1<<blkshift)-1)/* mask for rel position within cell */
+#define blkmargin 0              /* size guardband around map used */
+                                 // jff 10/8/98 use guardband>0
+                                 // jff 10/12/98 0 ok with + 1 in rows,cols
+
+//
+// Subroutine to add a line number to a block list
+// It simply returns if the line is already in the block
+//
+static inline void AddBlockLine(std::vector<std::vector<int> >& lists,
+                                std::vector<int>& done, int blockno, int lineno)
+{
+	// done holds the last line added to each block, so it never needs
+	// clearing between lines
+	if (done[blockno] == lineno)
+		return;
+
+	lists[blockno].push_back(lineno);
+	done[blockno] = lineno;
+}
+
+bool P_BuildBlockMap(const maplumps_t& lumps, std::vector<int>& out)
+{
+	std::vector<rawline_t> lines;
+	if (!ReadLines(lumps, lines))
+		return false;
+
+	const int numvertexes = NumVertexes(lumps);
+	const int numlines = (int)lines.size();
+
+	int map_minx = MAXINT;			// init for map limits search
+	int map_miny = MAXINT;
+	int map_maxx = MININT;
+	int map_maxy = MININT;
+
+	// scan for map limits, which the blockmap must enclose
+
+	std::vector<int> vx(numvertexes), vy(numvertexes);
+	for (int i = 0; i < numvertexes; i++)
+	{
+		vx[i] = ReadShort(lumps.vertexes + i * 4);
+		vy[i] = ReadShort(lumps.vertexes + i * 4 + 2);
+
+		map_minx = MIN(map_minx, vx[i]);
+		map_maxx = MAX(map_maxx, vx[i]);
+		map_miny = MIN(map_miny, vy[i]);
+		map_maxy = MAX(map_maxy, vy[i]);
+	}
+
+	if (numvertexes == 0)
+		map_minx = map_maxx = map_miny = map_maxy = 0;
+
+	// set up blockmap area to enclose level plus margin
+
+	const int xorg = map_minx-blkmargin;
+	const int yorg = map_miny-blkmargin;
+	const int ncols = (map_maxx+blkmargin-xorg+1+blkmask)>>blkshift;	//jff 10/12/98
+	const int nrows = (map_maxy+blkmargin-yorg+1+blkmask)>>blkshift;	//+1 needed for
+	const int NBlocks = ncols*nrows;									//map exactly 1 cell
+
+	std::vector<std::vector<int> > blocklists(NBlocks);
+	std::vector<int> blockdone(NBlocks, -1);
+
+	// For each linedef in the wad, determine all blockmap blocks it touches,
+	// and add the linedef number to the blocklists for those blocks
+
+	for (int i = 0; i < numlines; i++)
+	{
+		int x1 = vx[lines[i].v1];				// lines[i] map coords
+		int y1 = vy[lines[i].v1];
+		int x2 = vx[lines[i].v2];
+		int y2 = vy[lines[i].v2];
+		int dx = x2-x1;
+		int dy = y2-y1;
+		int vert = !dx;							// lines[i] slopetype
+		int horiz = !dy;
+		int spos = (dx^dy) > 0;
+		int sneg = (dx^dy) < 0;
+		int bx,by;								// block cell coords
+		int minx = x1>x2? x2 : x1;				// extremal lines[i] coords
+		int maxx = x1>x2? x1 : x2;
+		int miny = y1>y2? y2 : y1;
+		int maxy = y1>y2? y1 : y2;
+
+		// The line always belongs to the blocks containing its endpoints
+
+		bx = (x1-xorg) >> blkshift;
+		by = (y1-yorg) >> blkshift;
+		AddBlockLine (blocklists, blockdone, by*ncols+bx, i);
+		bx = (x2-xorg) >> blkshift;
+		by = (y2-yorg) >> blkshift;
+		AddBlockLine (blocklists, blockdone, by*ncols+bx, i);
+
+		// For each column, see where the line along its left edge, which
+		// it contains, intersects the Linedef i. Add i to each corresponding
+		// blocklist.
+
+		if (!vert)    // don't interesect vertical lines with columns
+		{
+			for (int j=0;j<ncols;j++)
+			{
+				// intersection of Linedef with x=xorg+(j<<blkshift)
+				// (y-y1)*dx = dy*(x-x1)
+				// y = dy*(x-x1)+y1*dx;
+
+				int x = xorg+(j<<blkshift);		// (x,y) is intersection
+				int y = (dy*(x-x1))/dx+y1;
+				int yb = (y-yorg)>>blkshift;	// block row number
+				int yp = (y-yorg)&blkmask;		// y position within block
+
+				if (yb<0 || yb>nrows-1)			// outside blockmap, continue
+					continue;
+
+				if (x<minx || x>maxx)			// line doesn't touch column
+					continue;
+
+				// The cell that contains the intersection point is always added
+
+				AddBlockLine(blocklists,blockdone,ncols*yb+j,i);
+
+				// if the intersection is at a corner it depends on the slope
+				// (and whether the line extends past the intersection) which
+				// blocks are hit
+
+				if (yp==0)			// intersection at a corner
+				{
+					if (sneg)		//   \ - blocks x,y-, x-,y
+					{
+						if (yb>0 && miny<y)
+							AddBlockLine(blocklists, blockdone, ncols*(yb-1)+j, i);
+						if (j>0 && minx<x)
+							AddBlockLine(blocklists, blockdone, ncols*yb+j-1, i);
+					}
+					else if (spos)	//   / - block x-,y-
+					{
+						if (yb>0 && j>0 && minx<x)
+							AddBlockLine(blocklists,blockdone,ncols*(yb-1)+j-1,i);
+					}
+					else if (horiz)	//   - - block x-,y
+					{
+						if (j>0 && minx<x)
+							AddBlockLine(blocklists,blockdone,ncols*yb+j-1,i);
+					}
+				}
+				else if (j>0 && minx<x)	// else not at corner: x-,y
+					AddBlockLine(blocklists,blockdone,ncols*yb+j-1,i);
+			}
+		}
+
+		// For each row, see where the line along its bottom edge, which
+		// it contains, intersects the Linedef i. Add i to all the corresponding
+		// blocklists.
+
+		if (!horiz)
+		{
+			for (int j=0;j<nrows;j++)
+			{
+				// intersection of Linedef with y=yorg+(j<<blkshift)
+				// (x,y) on Linedef i satisfies: (y-y1)*dx = dy*(x-x1)
+				// x = dx*(y-y1)/dy+x1;
+
+				int y = yorg+(j<<blkshift);		// (x,y) is intersection
+				int x = (dx*(y-y1))/dy+x1;
+				int xb = (x-xorg)>>blkshift;	// block column number
+				int xp = (x-xorg)&blkmask;		// x position within block
+
+				if (xb<0 || xb>ncols-1)			// outside blockmap, continue
+					continue;
+
+				if (y<miny || y>maxy)			 // line doesn't touch row
+					continue;
+
+				// The cell that contains the intersection point is always added
+
+				AddBlockLine (blocklists, blockdone, ncols*j+xb, i);
+
+				// if the intersection is at a corner it depends on the slope
+				// (and whether the line extends past the intersection) which
+				// blocks are hit
+
+				if (xp==0)			// intersection at a corner
+				{
+					if (sneg)       //   \ - blocks x,y-, x-,y
+					{
+						if (j>0 && miny<y)
+							AddBlockLine (blocklists, blockdone, ncols*(j-1)+xb, i);
+						if (xb>0 && minx<x)
+							AddBlockLine (blocklists, blockdone, ncols*j+xb-1, i);
+					}
+					else if (vert)  //   | - block x,y-
+					{
+						if (j>0 && miny<y)
+							AddBlockLine (blocklists, blockdone, ncols*(j-1)+xb, i);
+					}
+					else if (spos)  //   / - block x-,y-
+					{
+						if (xb>0 && j>0 && miny<y)
+							AddBlockLine (blocklists, blockdone, ncols*(j-1)+xb-1, i);
+					}
+				}
+				else if (j>0 && miny<y) // else not on a corner: x,y-
+					AddBlockLine (blocklists, blockdone, ncols*(j-1)+xb, i);
+			}
+		}
+	}
+
+	// count the total number of lines, with the leading 0 and trailing -1
+	size_t linetotal = 0;
+	for (int i = 0; i < NBlocks; i++)
+		linetotal += blocklists[i].size() + 2;
+
+	out.clear();
+	out.reserve(4 + NBlocks + linetotal);
+
+	// blockmap header
+	out.push_back(xorg);
+	out.push_back(yorg);
+	out.push_back(ncols);
+	out.push_back(nrows);
+
+	// offsets to lists and block lists
+	size_t offs = 4 + NBlocks;
+	for (int i = 0; i < NBlocks; i++)
+	{
+		out.push_back((int)offs);
+		offs += blocklists[i].size() + 2;
+	}
+
+	for (int i = 0; i < NBlocks; i++)
+	{
+		out.push_back(0);
+		out.insert(out.end(), blocklists[i].rbegin(), blocklists[i].rend());
+		out.push_back(-1);
+	}
+
+	return true;
+}
+
+// jff 10/6/98
+// End new code added to speed up calculation of internal blockmap
+
+
+//
+// P_BuildReject
+//
+// Marks every pair of sectors that no two-sided line path connects as
+// unable to see each other.  Sight never passes a one-sided line, so this
+// never rejects a pair that could see, but unlike a full reject builder
+// it keeps every pair of connected sectors for P_CheckSight.
+//
+static int FindSectorGroup(std::vector<int>& groups, int sector)
+{
+	while (groups[sector] != sector)
+	{
+		groups[sector] = groups[groups[sector]];
+		sector = groups[sector];
+	}
+	return sector;
+}
+
+bool P_BuildReject(const maplumps_t& lumps, std::vector<byte>& out)
+{
+	std::vector<rawline_t> lines;
+	if (!ReadLines(lumps, lines))
+		return false;
+
+	const int numsectors = NumSectors(lumps);
+
+	std::vector<int> groups(numsectors);
+	for (int i = 0; i < numsectors; i++)
+		groups[i] = i;
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		if (!(lines[i].flags & ML_TWOSIDED_FLAG))
+			continue;
+
+		int front = SideSector(lumps, lines[i].sidenum[0]);
+		int back = SideSector(lumps, lines[i].sidenum[1]);
+		if (front < 0 || back < 0)
+			continue;
+
+		front = FindSectorGroup(groups, front);
+		back = FindSectorGroup(groups, back);
+		if (front != back)
+			groups[MAX(front, back)] = MIN(front, back);
+	}
+
+	for (int i = 0; i < numsectors; i++)
+		groups[i] = FindSectorGroup(groups, i);
+
+	out.assign(((size_t)numsectors * numsectors + 7) / 8, 0);
+
+	for (int s1 = 0; s1 < numsectors; s1++)
+	{
+		for (int s2 = 0; s2 < numsectors; s2++)
+		{
+			if (groups[s1] == groups[s2])
+				continue;
+
+			size_t pnum = (size_t)s1 * numsectors + s2;
+			out[pnum >> 3] |= 1 << (pnum & 7);
+		}
+	}
+
+	return true;
+}
+
+
+void P_BuildMapData(const maplumps_t& lumps, unsigned int parts, mapdata_t& data)
+{
+	if ((parts & MAPDATA_NODES) && P_BuildNodes(lumps, data.nodes))
+		data.parts |= MAPDATA_NODES;
+
+	if ((parts & MAPDATA_BLOCKMAP) && P_BuildBlockMap(lumps, data.blockmap))
+		data.parts |= MAPDATA_BLOCKMAP;
+
+	if ((parts & MAPDATA_REJECT) && P_BuildReject(lumps, data.reject))
+		data.parts |= MAPDATA_REJECT;
+}
+
+
+//
+// P_MapDataKey
+//
+// MD5 of the builder version and every lump the data is built from.
+//
+std::string P_MapDataKey(const maplumps_t& lumps)
+{
+	md5_state_t state;
+	md5_init(&state);
+
+	std::vector<byte> header;
+	header.insert(header.end(), MAPDATA_MAGIC, MAPDATA_MAGIC + 4);
+	WriteULong(header, MAPDATA_VERSION);
+	WriteByte(header, lumps.hexen);
+	md5_append(&state, &header[0], (int)header.size());
+
+	const byte* data[4] = { lumps.vertexes, lumps.linedefs, lumps.sidedefs, lumps.sectors };
+	const size_t lengths[4] = { lumps.vertexes_len, lumps.linedefs_len,
+	                            lumps.sidedefs_len, lumps.sectors_len };
+
+	for (int i = 0; i < 4; i++)
+	{
+		// Lengths go in too so data can't move from one lump to the next
+		std::vector<byte> length;
+		WriteULong(length, (unsigned int)lengths[i]);
+		md5_append(&state, &length[0], (int)length.size());
+
+		if (lengths[i])
+			md5_append(&state, data[i], (int)lengths[i]);
+	}
+
+	md5_byte_t digest[16];
+	md5_finish(&state, digest);
+
+	char hex[33];
+	for (int i = 0; i < 16; i++)
+		sprintf(hex + i * 2, "%02x", digest[i]);
+
+	return std::string(hex, 32);
+}
+
+
+//
+// Cache files
+//
+// "ODMC", the builder version and the parts present, then each part in
+// MAPDATA_* order as a 32-bit count followed by its bytes, or its ints for
+// the blockmap.
+//
+
+static bool ReadULong(FILE* fp, unsigned int& value)
+{
+	byte buf[4];
+	if (fread(buf, 1, 4, fp) != 4)
+		return false;
+
+	value = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+	return true;
+}
+
+static bool ReadBytes(FILE* fp, std::vector<byte>& out, size_t remaining)
+{
+	unsigned int count;
+	if (!ReadULong(fp, count) || count > remaining)
+		return false;
+
+	out.resize(count);
+	return count == 0 || fread(&out[0], 1, count, fp) == count;
+}
+
+bool P_ReadMapDataCache(const std::string& filename, mapdata_t& data)
+{
+	FILE* fp = fopen(filename.c_str(), "rb");
+	if (fp == NULL)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	char magic[4];
+	unsigned int version, parts;
+
+	bool ok = size >= 12 && fread(magic, 1, 4, fp) == 4 &&
+	          memcmp(magic, MAPDATA_MAGIC, 4) == 0 &&
+	          ReadULong(fp, version) && version == MAPDATA_VERSION &&
+	          ReadULong(fp, parts) && (parts & ~MAPDATA_ALL) == 0;
+
+	mapdata_t cached;
+	cached.parts = parts;
+
+	if (ok && (parts & MAPDATA_NODES))
+		ok = ReadBytes(fp, cached.nodes, size);
+
+	if (ok && (parts & MAPDATA_BLOCKMAP))
+	{
+		std::vector<byte> bytes;
+		ok = ReadBytes(fp, bytes, size) && bytes.size() % 4 == 0;
+
+		cached.blockmap.resize(bytes.size() / 4);
+		for (size_t i = 0; ok && i < cached.blockmap.size(); i++)
+		{
+			const byte* p = &bytes[i * 4];
+			cached.blockmap[i] = (int)(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24));
+		}
+	}
+
+	if (ok && (parts & MAPDATA_REJECT))
+		ok = ReadBytes(fp, cached.reject, size);
+
+	fclose(fp);
+
+	if (!ok)
+		return false;
+
+	data = cached;
+	return true;
+}
+
+bool P_WriteMapDataCache(const std::string& filename, const mapdata_t& data)
+{
+	std::vector<byte> out;
+	out.insert(out.end(), MAPDATA_MAGIC, MAPDATA_MAGIC + 4);
+	WriteULong(out, MAPDATA_VERSION);
+	WriteULong(out, data.parts);
+
+	if (data.parts & MAPDATA_NODES)
+	{
+		WriteULong(out, (unsigned int)data.nodes.size());
+		out.insert(out.end(), data.nodes.begin(), data.nodes.end());
+	}
+
+	if (data.parts & MAPDATA_BLOCKMAP)
+	{
+		WriteULong(out, (unsigned int)data.blockmap.size() * 4);
+		for (size_t i = 0; i < data.blockmap.size(); i++)
+			WriteULong(out, (unsigned int)data.blockmap[i]);
+	}
+
+	if (data.parts & MAPDATA_REJECT)
+	{
+		WriteULong(out, (unsigned int)data.reject.size());
+		out.insert(out.end(), data.reject.begin(), data.reject.end());
+	}
+
+	// Written beside the real file and renamed over it, so a reader never
+	// sees half of one
+	std::string temp = filename + ".tmp";
+
+	FILE* fp = fopen(temp.c_str(), "wb");
+	if (fp == NULL)
+		return false;
+
+	bool ok = fwrite(&out[0], 1, out.size(), fp) == out.size();
+	ok = (fclose(fp) == 0) && ok;
+
+	if (ok)
+	{
+		// Windows won't rename over an existing file
+		remove(filename.c_str());
+		ok = rename(temp.c_str(), filename.c_str()) == 0;
+	}
+
+	if (!ok)
+		remove(temp.c_str());
+
+	return ok;
+}
+
+VERSION_CONTROL (p_nodebuild_cpp, "$Id$")
@@ -0,0 +1,89 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Node, blockmap and reject builder, and the on-disk cache of what it
+//	builds.
+//
+//	Everything here works on the raw map lumps and keeps no state, so the
+//	same code builds data for the level being loaded and for the nodecache
+//	tool.  Output is deterministic: the same lumps always give the same
+//	bytes, which is what lets it be cached under the hash of the lumps.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __P_NODEBUILD_H__
+#define __P_NODEBUILD_H__
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "doomtype.h"
+
+// The lumps the derived data is built from
+struct maplumps_t
+{
+	const byte*	vertexes;
+	size_t		vertexes_len;
+	const byte*	linedefs;
+	size_t		linedefs_len;
+	const byte*	sidedefs;
+	size_t		sidedefs_len;
+	const byte*	sectors;
+	size_t		sectors_len;
+	bool		hexen;			// Hexen format linedefs
+};
+
+enum
+{
+	MAPDATA_NODES		= 1,
+	MAPDATA_BLOCKMAP	= 2,
+	MAPDATA_REJECT		= 4,
+
+	MAPDATA_ALL			= MAPDATA_NODES | MAPDATA_BLOCKMAP | MAPDATA_REJECT
+};
+
+struct mapdata_t
+{
+	unsigned int		parts;		// MAPDATA_* flags of what is present
+	std::vector<byte>	nodes;		// ZDBSP extended nodes, "XNOD"
+	std::vector<int>	blockmap;	// expanded, as blockmaplump
+	std::vector<byte>	reject;
+
+	mapdata_t() : parts(0) {}
+};
+
+// Builds the requested parts into data, adding the ones that were built to
+// data.parts.  Nodes are not built for maps with broken geometry.
+void P_BuildMapData(const maplumps_t& lumps, unsigned int parts, mapdata_t& data);
+
+bool P_BuildNodes(const maplumps_t& lumps, std::vector<byte>& out);
+bool P_BuildBlockMap(const maplumps_t& lumps, std::vector<int>& out);
+bool P_BuildReject(const maplumps_t& lumps, std::vector<byte>& out);
+
+// Cache key for the data built from lumps, changes with the builder.  The
+// cache file for a map is the key with MAPDATA_EXT on the end.
+std::string P_MapDataKey(const maplumps_t& lumps);
+
+#define MAPDATA_EXT ".odc"
+
+bool P_ReadMapDataCache(const std::string& filename, mapdata_t& data);
+bool P_WriteMapDataCache(const std::string& filename, const mapdata_t& data);
+
+#endif // __P_NODEBUILD_H__
@@ -31,6 +31,7 @@
 #include "m_alloc.h"
 #include "m_vectors.h"
 #include "m_argv.h"
+#include "m_fileio.h"
 #include "z_zone.h"
 #include "m_swap.h"
 #include "m_bbox.h"
@@ -49,6 +50,7 @@
 
 #include "p_mobj.h"
 #include "p_setup.h"
+#include "p_nodebuild.h"
 
 void SV_PreservePlayer(player_t &player);
 void P_SpawnMapThing (mapthing2_t *mthing, int position);
@@ -441,21 +443,183 @@ void P_LoadNodes (int lump)
 }
 
 //
-// P_LoadXNOD - load ZDBSP extended nodes
-// returns false if nodes are not extended to fall back to original nodes
+// P_CheckNodes
+//
+// Checks the vanilla SEGS, SSECTORS and NODES of a map before they are
+// loaded.  Segs that are off the line they belong to mean the nodes were
+// built for an older version of the map.
 //
-bool P_LoadXNOD(int lump)
+static bool P_CheckNodes(int lumpnum)
 {
-	size_t len = W_LumpLength(lump);
-	byte *data = (byte *) W_CacheLumpNum(lump, PU_STATIC);
+	int count_segs = W_LumpLength(lumpnum + ML_SEGS) / sizeof(mapseg_t);
+	int count_subsectors = W_LumpLength(lumpnum + ML_SSECTORS) / sizeof(mapsubsector_t);
+	int count_nodes = W_LumpLength(lumpnum + ML_NODES) / sizeof(mapnode_t);
+
+	if (!count_segs || !count_subsectors || !count_nodes)
+		return false;
+
+	bool ok = true;
+
+	mapseg_t *ml = (mapseg_t *)W_CacheLumpNum(lumpnum + ML_SEGS, PU_STATIC);
+	for (int i = 0; ok && i < count_segs; i++)
+	{
+		unsigned short v1 = LESHORT(ml[i].v1);
+		unsigned short v2 = LESHORT(ml[i].v2);
+		unsigned short linedef = LESHORT(ml[i].linedef);
+		short side = LESHORT(ml[i].side);
+
+		if (side != 0 && side != 1)
+			side = 1;
+
+		if (v1 >= numvertexes || v2 >= numvertexes || linedef >= numlines ||
+		    lines[linedef].sidenum[side] == R_NOSIDE)
+		{
+			ok = false;
+			break;
+		}
+
+		const line_t *ld = &lines[linedef];
+		double dx = FIXED2DOUBLE(ld->dx);
+		double dy = FIXED2DOUBLE(ld->dy);
+		double length = sqrt(dx * dx + dy * dy);
+		const vertex_t *vs[2] = { &vertexes[v1], &vertexes[v2] };
+
+		for (int j = 0; ok && j < 2 && length > 0; j++)
+		{
+			double cross = FIXED2DOUBLE(vs[j]->x - ld->v1->x) * dy -
+			               FIXED2DOUBLE(vs[j]->y - ld->v1->y) * dx;
+			if (fabs(cross) / length > 2.0)
+				ok = false;
+		}
+	}
+	Z_Free(ml);
+
+	mapsubsector_t *ms = (mapsubsector_t *)W_CacheLumpNum(lumpnum + ML_SSECTORS, PU_STATIC);
+	for (int i = 0; ok && i < count_subsectors; i++)
+	{
+		int first = (unsigned short)LESHORT(ms[i].firstseg);
+		int num = (unsigned short)LESHORT(ms[i].numsegs);
+		if (num == 0 || first + num > count_segs)
+			ok = false;
+	}
+	Z_Free(ms);
+
+	mapnode_t *mn = (mapnode_t *)W_CacheLumpNum(lumpnum + ML_NODES, PU_STATIC);
+	for (int i = 0; ok && i < count_nodes; i++)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			unsigned int child = LESHORT(mn[i].children[j]);
+
+			if (child & 0x8000)
+				ok = ok && (int)(child & ~0x8000) < count_subsectors;
+			else
+				ok = ok && (int)child < count_nodes;
+		}
+	}
+	Z_Free(mn);
+
+	return ok;
+}
 
+//
+// P_CheckXNOD
+//
+// Checks that ZDBSP extended nodes fit in their lump and only refer to
+// vertices, lines and sides that exist, before P_LoadXNOD trusts them.
+//
+static bool P_CheckXNOD(const byte *data, size_t len)
+{
 	if (len < 4 || memcmp(data, "XNOD", 4) != 0)
+		return false;
+
+	const byte *p = data + 4;
+	const byte *end = data + len;
+
+	if ((size_t)(end - p) < 8)
+		return false;
+	unsigned int numorgvert = LELONG(*(unsigned int *)p); p += 4;
+	unsigned int numnewvert = LELONG(*(unsigned int *)p); p += 4;
+
+	if (numorgvert != (unsigned int)numvertexes || numnewvert > (size_t)(end - p) / 8)
+		return false;
+	p += numnewvert * 8;
+
+	unsigned int totalvert = numorgvert + numnewvert;
+
+	if ((size_t)(end - p) < 4)
+		return false;
+	unsigned int count_subsectors = LELONG(*(unsigned int *)p); p += 4;
+
+	if (count_subsectors == 0 || count_subsectors > (size_t)(end - p) / 4)
+		return false;
+
+	QWORD totalsegs = 0;
+	for (unsigned int i = 0; i < count_subsectors; i++)
 	{
-		Z_Free(data);
+		unsigned int num = LELONG(*(unsigned int *)p); p += 4;
+		if (num == 0)
+			return false;
+		totalsegs += num;
+	}
+
+	if ((size_t)(end - p) < 4)
+		return false;
+	unsigned int count_segs = LELONG(*(unsigned int *)p); p += 4;
+
+	if (count_segs != totalsegs || count_segs > (size_t)(end - p) / 11)
 		return false;
+
+	for (unsigned int i = 0; i < count_segs; i++)
+	{
+		unsigned int v1 = LELONG(*(unsigned int *)p); p += 4;
+		unsigned int v2 = LELONG(*(unsigned int *)p); p += 4;
+		unsigned short ld = LESHORT(*(unsigned short *)p); p += 2;
+		unsigned char side = *(unsigned char *)p; p += 1;
+
+		if (side != 0 && side != 1)
+			side = 1;
+
+		if (v1 >= totalvert || v2 >= totalvert || ld >= numlines ||
+		    lines[ld].sidenum[side] == R_NOSIDE)
+			return false;
 	}
 
-	byte *p = data + 4; // skip the magic number
+	if ((size_t)(end - p) < 4)
+		return false;
+	unsigned int count_nodes = LELONG(*(unsigned int *)p); p += 4;
+
+	if (count_nodes > (size_t)(end - p) / 32)
+		return false;
+
+	for (unsigned int i = 0; i < count_nodes; i++)
+	{
+		p += 24;
+
+		for (int j = 0; j < 2; j++)
+		{
+			unsigned int child = LELONG(*(unsigned int *)p); p += 4;
+
+			if (child & NF_SUBSECTOR)
+			{
+				if ((child & ~NF_SUBSECTOR) >= count_subsectors)
+					return false;
+			}
+			else if (child >= count_nodes)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// P_LoadXNOD - load ZDBSP extended nodes
+// data has to have passed P_CheckXNOD
+//
+static void P_LoadXNOD(const byte *data)
+{
+	const byte *p = data + 4; // skip the magic number
 
 	// Load vertices
 	unsigned int numorgvert = LELONG(*(unsigned int *)p); p += 4;
@@ -570,9 +734,36 @@ bool P_LoadXNOD(int lump)
 			node->children[j] = LELONG(*(unsigned int *)p); p += 4;
 		}
 	}
+}
+
+//
+// P_LoadNodeLumps
+//
+// Loads the nodes the map was shipped with, extended or vanilla.  Returns
+// false without touching the level if there are none or they are broken.
+//
+static bool P_LoadNodeLumps(int lumpnum)
+{
+	size_t len = W_LumpLength(lumpnum + ML_NODES);
+	byte *data = (byte *)W_CacheLumpNum(lumpnum + ML_NODES, PU_STATIC);
+
+	bool extended = len >= 4 && memcmp(data, "XNOD", 4) == 0;
+	bool ok = extended && P_CheckXNOD(data, len);
+
+	if (ok)
+		P_LoadXNOD(data);
 
 	Z_Free(data);
 
+	if (extended)
+		return ok;
+
+	if (!P_CheckNodes(lumpnum))
+		return false;
+
+	P_LoadSubsectors (lumpnum+ML_SSECTORS);
+	P_LoadNodes (lumpnum+ML_NODES);
+	P_LoadSegs (lumpnum+ML_SEGS);
 	return true;
 }
 
@@ -1091,373 +1282,267 @@ void P_LoadSideDefs2 (int lump)
 
 
 //
-// jff 10/6/98
-// New code added to speed up calculation of internal blockmap
-// Algorithm is order of nlines*(ncols+nrows) not nlines*ncols*nrows
+// P_CheckBlockMap
 //
+// Checks that the offsets of a blockmap point at lists inside it, and that
+// every list ends there and only holds lines that exist.
+//
+static bool P_CheckBlockMap(const int *bmap, size_t count)
+{
+	if (count < 4)
+		return false;
 
-#define blkshift 7               /* places to shift rel position for cell num */
-#define blkmask ((1<<blkshift)-1)/* mask for rel position within cell */
-#define blkmargin 0              /* size guardband around map used */
-                                 // jff 10/8/98 use guardband>0
-                                 // jff 10/12/98 0 ok with + 1 in rows,cols
+	int ncols = bmap[2];
+	int nrows = bmap[3];
 
-typedef struct linelist_t        // type used to list lines in each block
-{
-	int		num;
-	struct	linelist_t *next;
-} linelist_t;
+	if (ncols <= 0 || nrows <= 0 || ncols > 0x10000 || nrows > 0x10000 ||
+	    (QWORD)ncols * nrows > count - 4)
+		return false;
 
-//
-// Subroutine to add a line number to a block list
-// It simply returns if the line is already in the block
-//
+	size_t lists = 4 + (size_t)ncols * nrows;
 
-static void AddBlockLine
-(
-	linelist_t **lists,
-	int *count,
-	int *done,
-	int blockno,
-	DWORD lineno
-)
-{
-	linelist_t *l;
+	// A list can run on to the last terminator at most
+	size_t last = count;
+	for (size_t i = lists; i < count; i++)
+	{
+		if (bmap[i] == -1)
+			last = i;
+		else if (bmap[i] < 0 || bmap[i] >= numlines)
+			return false;
+	}
 
-	if (done[blockno])
-		return;
+	if (last == count)
+		return false;
 
-	l = new linelist_t;
-	l->num = lineno;
-	l->next = lists[blockno];
-	lists[blockno] = l;
-	count[blockno]++;
-	done[blockno] = 1;
+	for (size_t i = 4; i < lists; i++)
+	{
+		if ((DWORD)bmap[i] < lists || (DWORD)bmap[i] > last)
+			return false;
+	}
+
+	return true;
 }
 
 //
-// Actually construct the blockmap lump from the level data
+// P_SetupBlockMap
 //
-// This finds the intersection of each linedef with the column and
-// row lines at the left and bottom of each blockmap cell. It then
-// adds the line to all block lists touching the intersection.
+// Sets up the level's blockmap from blockmaplump.
 //
-
-void P_CreateBlockMap()
+static void P_SetupBlockMap()
 {
-	int xorg,yorg;					// blockmap origin (lower left)
-	int nrows,ncols;				// blockmap dimensions
-	linelist_t **blocklists=NULL;	// array of pointers to lists of lines
-	int *blockcount=NULL;			// array of counters of line lists
-	int *blockdone=NULL;			// array keeping track of blocks/line
-	int NBlocks;					// number of cells = nrows*ncols
-	DWORD linetotal=0;				// total length of all blocklists
-	int i,j;
-	int map_minx=MAXINT;			// init for map limits search
-	int map_miny=MAXINT;
-	int map_maxx=MININT;
-	int map_maxy=MININT;
-
-	// scan for map limits, which the blockmap must enclose
+	bmaporgx = blockmaplump[0]<<FRACBITS;
+	bmaporgy = blockmaplump[1]<<FRACBITS;
+	bmapwidth = blockmaplump[2];
+	bmapheight = blockmaplump[3];
 
-	for (i = 0; i < numvertexes; i++)
-	{
-		fixed_t t;
-
-		if ((t=vertexes[i].x) < map_minx)
-			map_minx = t;
-		else if (t > map_maxx)
-			map_maxx = t;
-		if ((t=vertexes[i].y) < map_miny)
-			map_miny = t;
-		else if (t > map_maxy)
-			map_maxy = t;
-	}
-	map_minx >>= FRACBITS;    // work in map coords, not fixed_t
-	map_maxx >>= FRACBITS;
-	map_miny >>= FRACBITS;
-	map_maxy >>= FRACBITS;
+	// clear out mobj chains
+	int count = sizeof(*blocklinks) * bmapwidth*bmapheight;
+	blocklinks = (AActor **)Z_Malloc (count, PU_LEVEL, 0);
+	memset (blocklinks, 0, count);
+	blockmap = blockmaplump+4;
+}
 
-	// set up blockmap area to enclose level plus margin
+//
+// P_LoadBlockMap
+//
+// [RH] Changed this some
+// Returns false without setting up a blockmap if the map's is missing or
+// broken, or too big for the lump's 16-bit offsets.
+//
+static bool P_LoadBlockMap (int lump)
+{
+	int count = W_LumpLength(lump)/2;
 
-	xorg = map_minx-blkmargin;
-	yorg = map_miny-blkmargin;
-	ncols = (map_maxx+blkmargin-xorg+1+blkmask)>>blkshift;	//jff 10/12/98
-	nrows = (map_maxy+blkmargin-yorg+1+blkmask)>>blkshift;	//+1 needed for
-	NBlocks = ncols*nrows;									//map exactly 1 cell
+	if (count >= 0x10000 || count < 4)
+		return false;
 
-	// create the array of pointers on NBlocks to blocklists
-	// also create an array of linelist counts on NBlocks
-	// finally make an array in which we can mark blocks done per line
+	short *wadblockmaplump = (short *)W_CacheLumpNum (lump, PU_LEVEL);
+	int i;
+	blockmaplump = (int *)Z_Malloc(sizeof(*blockmaplump) * count, PU_LEVEL, 0);
 
-	blocklists = new linelist_t *[NBlocks];
-	memset (blocklists, 0, NBlocks*sizeof(linelist_t *));
-	blockcount = new int[NBlocks];
-	memset (blockcount, 0, NBlocks*sizeof(int));
-	blockdone = new int[NBlocks];
+	// killough 3/1/98: Expand wad blockmap into larger internal one,
+	// by treating all offsets except -1 as unsigned and zero-extending
+	// them. This potentially doubles the size of blockmaps allowed,
+	// because Doom originally considered the offsets as always signed.
 
-	// initialize each blocklist, and enter the trailing -1 in all blocklists
-	// note the linked list of lines grows backwards
+	blockmaplump[0] = LESHORT(wadblockmaplump[0]);
+	blockmaplump[1] = LESHORT(wadblockmaplump[1]);
+	blockmaplump[2] = (DWORD)(LESHORT(wadblockmaplump[2])) & 0xffff;
+	blockmaplump[3] = (DWORD)(LESHORT(wadblockmaplump[3])) & 0xffff;
 
-	for (i = 0; i < NBlocks; i++)
+	for (i=4 ; i<count ; i++)
 	{
-		blocklists[i] = new linelist_t;
-		blocklists[i]->num = -1;
-		blocklists[i]->next = NULL;
-		blockcount[i]++;
+		short t = LESHORT(wadblockmaplump[i]);          // killough 3/1/98
+		blockmaplump[i] = t == -1 ? (DWORD)0xffffffff : (DWORD) t & 0xffff;
 	}
 
-	// For each linedef in the wad, determine all blockmap blocks it touches,
-	// and add the linedef number to the blocklists for those blocks
+	Z_Free (wadblockmaplump);
 
-	for (i = 0; i < numlines; i++)
+	if (!P_CheckBlockMap(blockmaplump, count))
 	{
-		int x1 = lines[i].v1->x>>FRACBITS;		// lines[i] map coords
-		int y1 = lines[i].v1->y>>FRACBITS;
-		int x2 = lines[i].v2->x>>FRACBITS;
-		int y2 = lines[i].v2->y>>FRACBITS;
-		int dx = x2-x1;
-		int dy = y2-y1;
-		int vert = !dx;							// lines[i] slopetype
-		int horiz = !dy;
-		int spos = (dx^dy) > 0;
-		int sneg = (dx^dy) < 0;
-		int bx,by;								// block cell coords
-		int minx = x1>x2? x2 : x1;				// extremal lines[i] coords
-		int maxx = x1>x2? x1 : x2;
-		int miny = y1>y2? y2 : y1;
-		int maxy = y1>y2? y1 : y2;
-
-		// no blocks done for this linedef yet
-
-		memset (blockdone, 0, NBlocks*sizeof(int));
-
-		// The line always belongs to the blocks containing its endpoints
-
-		bx = (x1-xorg) >> blkshift;
-		by = (y1-yorg) >> blkshift;
-		AddBlockLine (blocklists, blockcount, blockdone, by*ncols+bx, i);
-		bx = (x2-xorg) >> blkshift;
-		by = (y2-yorg) >> blkshift;
-		AddBlockLine (blocklists, blockcount, blockdone, by*ncols+bx, i);
-
-		// For each column, see where the line along its left edge, which
-		// it contains, intersects the Linedef i. Add i to each corresponding
-		// blocklist.
-
-		if (!vert)    // don't interesect vertical lines with columns
-		{
-			for (j=0;j<ncols;j++)
-			{
-				// intersection of Linedef with x=xorg+(j<<blkshift)
-				// (y-y1)*dx = dy*(x-x1)
-				// y = dy*(x-x1)+y1*dx;
-
-				int x = xorg+(j<<blkshift);		// (x,y) is intersection
-				int y = (dy*(x-x1))/dx+y1;
-				int yb = (y-yorg)>>blkshift;	// block row number
-				int yp = (y-yorg)&blkmask;		// y position within block
-
-				if (yb<0 || yb>nrows-1)			// outside blockmap, continue
-					continue;
-
-				if (x<minx || x>maxx)			// line doesn't touch column
-					continue;
-
-				// The cell that contains the intersection point is always added
-
-				AddBlockLine(blocklists,blockcount,blockdone,ncols*yb+j,i);
-
-				// if the intersection is at a corner it depends on the slope
-				// (and whether the line extends past the intersection) which
-				// blocks are hit
-
-				if (yp==0)			// intersection at a corner
-				{
-					if (sneg)		//   \ - blocks x,y-, x-,y
-					{
-						if (yb>0 && miny<y)
-							AddBlockLine(blocklists, blockcount, blockdone, ncols*(yb-1)+j, i);
-						if (j>0 && minx<x)
-							AddBlockLine(blocklists, blockcount, blockdone, ncols*yb+j-1, i);
-					}
-					else if (spos)	//   / - block x-,y-
-					{
-						if (yb>0 && j>0 && minx<x)
-							AddBlockLine(blocklists,blockcount,blockdone,ncols*(yb-1)+j-1,i);
-					}
-					else if (horiz)	//   - - block x-,y
-					{
-						if (j>0 && minx<x)
-							AddBlockLine(blocklists,blockcount,blockdone,ncols*yb+j-1,i);
-					}
-				}
-				else if (j>0 && minx<x)	// else not at corner: x-,y
-					AddBlockLine(blocklists,blockcount,blockdone,ncols*yb+j-1,i);
-			}
-		}
-
-		// For each row, see where the line along its bottom edge, which
-		// it contains, intersects the Linedef i. Add i to all the corresponding
-		// blocklists.
+		Z_Free (blockmaplump);
+		blockmaplump = NULL;
+		return false;
+	}
 
-		if (!horiz)
-		{
-			for (j=0;j<nrows;j++)
-			{
-				// intersection of Linedef with y=yorg+(j<<blkshift)
-				// (x,y) on Linedef i satisfies: (y-y1)*dx = dy*(x-x1)
-				// x = dx*(y-y1)/dy+x1;
+	P_SetupBlockMap();
+	return true;
+}
 
-				int y = yorg+(j<<blkshift);		// (x,y) is intersection
-				int x = (dx*(y-y1))/dy+x1;
-				int xb = (x-xorg)>>blkshift;	// block column number
-				int xp = (x-xorg)&blkmask;		// x position within block
+//
+// P_MapDataCacheDir
+//
+// Where built nodes, blockmaps and rejects are kept, the -nodecache
+// directory or nodecache in the write directory.  Empty if it can't be
+// created.
+//
+static std::string P_MapDataCacheDir()
+{
+	const char *dir = Args.CheckValue("-nodecache");
+	std::string path = dir ? std::string(dir) : M_GetWriteDir() + PATHSEP "nodecache";
 
-				if (xb<0 || xb>ncols-1)			// outside blockmap, continue
-					continue;
+	if (!M_CreateDir(path))
+	{
+		DPrintf("Could not create node cache directory %s.\n", path.c_str());
+		return "";
+	}
 
-				if (y<miny || y>maxy)			 // line doesn't touch row
-					continue;
+	return path;
+}
 
-				// The cell that contains the intersection point is always added
+//
+// P_GetMapData
+//
+// Gets the parts of the map's derived data that it has to build, from the
+// cache if they were built before.  Anything missing from the cache is
+// built and the cache file rewritten with it.
+//
+static void P_GetMapData(const char *mapname, int lumpnum, unsigned int parts, mapdata_t &data)
+{
+	const int lumps[4] = { ML_VERTEXES, ML_LINEDEFS, ML_SIDEDEFS, ML_SECTORS };
+	byte *cached[4];
+
+	for (int i = 0; i < 4; i++)
+		cached[i] = (byte *)W_CacheLumpNum(lumpnum + lumps[i], PU_STATIC);
+
+	maplumps_t map;
+	map.vertexes = cached[0];
+	map.vertexes_len = W_LumpLength(lumpnum + ML_VERTEXES);
+	map.linedefs = cached[1];
+	map.linedefs_len = W_LumpLength(lumpnum + ML_LINEDEFS);
+	map.sidedefs = cached[2];
+	map.sidedefs_len = W_LumpLength(lumpnum + ML_SIDEDEFS);
+	map.sectors = cached[3];
+	map.sectors_len = W_LumpLength(lumpnum + ML_SECTORS);
+	map.hexen = HasBehavior;
+
+	std::string dir = P_MapDataCacheDir();
+	std::string filename;
+
+	if (!dir.empty())
+	{
+		filename = dir + PATHSEP + P_MapDataKey(map) + MAPDATA_EXT;
+		P_ReadMapDataCache(filename, data);
+	}
 
-				AddBlockLine (blocklists, blockcount, blockdone, ncols*j+xb, i);
+	// Cached data that doesn't fit the map is built again
+	if ((data.parts & MAPDATA_NODES) &&
+	    (data.nodes.empty() || !P_CheckXNOD(&data.nodes[0], data.nodes.size())))
+		data.parts &= ~MAPDATA_NODES;
 
-				// if the intersection is at a corner it depends on the slope
-				// (and whether the line extends past the intersection) which
-				// blocks are hit
+	if ((data.parts & MAPDATA_BLOCKMAP) &&
+	    (data.blockmap.empty() || !P_CheckBlockMap(&data.blockmap[0], data.blockmap.size())))
+		data.parts &= ~MAPDATA_BLOCKMAP;
 
-				if (xp==0)			// intersection at a corner
-				{
-					if (sneg)       //   \ - blocks x,y-, x-,y
-					{
-						if (j>0 && miny<y)
-							AddBlockLine (blocklists, blockcount, blockdone, ncols*(j-1)+xb, i);
-						if (xb>0 && minx<x)
-							AddBlockLine (blocklists, blockcount, blockdone, ncols*j+xb-1, i);
-					}
-					else if (vert)  //   | - block x,y-
-					{
-						if (j>0 && miny<y)
-							AddBlockLine (blocklists, blockcount, blockdone, ncols*(j-1)+xb, i);
-					}
-					else if (spos)  //   / - block x-,y-
-					{
-						if (xb>0 && j>0 && miny<y)
-							AddBlockLine (blocklists, blockcount, blockdone, ncols*(j-1)+xb-1, i);
-					}
-				}
-				else if (j>0 && miny<y) // else not on a corner: x,y-
-					AddBlockLine (blocklists, blockcount, blockdone, ncols*(j-1)+xb, i);
-			}
-		}
-	}
+	if ((data.parts & MAPDATA_REJECT) &&
+	    data.reject.size() < ((size_t)numsectors * numsectors + 7) / 8)
+		data.parts &= ~MAPDATA_REJECT;
 
-	// Add initial 0 to all blocklists
-	// count the total number of lines (and 0's and -1's)
-	memset (blockdone, 0, NBlocks*sizeof(int));
-	for (i = 0, linetotal = 0; i < NBlocks; i++)
-	{
-		AddBlockLine (blocklists, blockcount, blockdone, i, 0);
-		linetotal += blockcount[i];
-	}
+	unsigned int missing = parts & ~data.parts;
 
-	// Create the blockmap lump
-	blockmaplump = (int *)Z_Malloc(sizeof(*blockmaplump) * (4+NBlocks+linetotal), PU_LEVEL, 0);
-
-	// blockmap header
-	//
-	// Rjy: P_CreateBlockMap should not initialise bmaporg{x,y} as P_LoadBlockMap
-	// does so again, resulting in their being left-shifted by FRACBITS twice.
-	//
-	// Thus any map having its blockmap built by the engine would have its
-	// origin at (0,0) regardless of where the walls and monsters actually are,
-	// breaking all collision detection.
-	//
-	// Instead have P_CreateBlockMap create blockmaplump only, so that both
-	// clauses of the conditional in P_LoadBlockMap have the same effect, and
-	// bmap* are only initialised from blockmaplump[0..3] once in the latter.
-	//
-	blockmaplump[0] = xorg;
-	blockmaplump[1] = yorg;
-	blockmaplump[2] = ncols;
-	blockmaplump[3] = nrows;
-
-	// offsets to lists and block lists
-	for (i = 0; i < NBlocks; i++)
+	if (missing)
 	{
-		linelist_t *bl = blocklists[i];
-		DWORD offs = blockmaplump[4+i] =   // set offset to block's list
-			(i? blockmaplump[4+i-1] : 4+NBlocks) + (i? blockcount[i-1] : 0);
-
-		// add the lines in each block's list to the blockmaplump
-		// delete each list node as we go
-
-		while (bl)
-		{
-			linelist_t *tmp = bl->next;
-			blockmaplump[offs++] = bl->num;
-			delete bl;
-			bl = tmp;
-		}
+		dtime_t start = I_GetTime();
+		P_BuildMapData(map, missing, data);
+		dtime_t elapsed = I_GetTime() - start;
+
+		Printf(PRINT_HIGH, "Built%s%s%s for %s in %d ms\n",
+		       (missing & MAPDATA_NODES) ? " nodes" : "",
+		       (missing & MAPDATA_BLOCKMAP) ? " blockmap" : "",
+		       (missing & MAPDATA_REJECT) ? " reject" : "",
+		       mapname, (int)I_ConvertTimeToMs(elapsed));
+
+		if (!filename.empty() && (data.parts & missing))
+			P_WriteMapDataCache(filename, data);
 	}
 
-	// free all temporary storage
-	delete[] blocklists;
-	delete[] blockcount;
-	delete[] blockdone;
+	for (int i = 0; i < 4; i++)
+		Z_Free(cached[i]);
 }
 
-// jff 10/6/98
-// End new code added to speed up calculation of internal blockmap
-
 //
-// P_LoadBlockMap
+// P_LoadMapData
 //
-// [RH] Changed this some
+// Loads the nodes, blockmap and reject the map was shipped with, and
+// builds the ones that are missing, broken, out of date or asked for with
+// -buildnodes or -blockmap.
 //
-void P_LoadBlockMap (int lump)
+static void P_LoadMapData(const char *mapname, int lumpnum)
 {
-	int count;
+	unsigned int parts = 0;
+
+	if (Args.CheckParm("-blockmap") || !P_LoadBlockMap(lumpnum + ML_BLOCKMAP))
+		parts |= MAPDATA_BLOCKMAP;
+
+	if (Args.CheckParm("-buildnodes") || !P_LoadNodeLumps(lumpnum))
+		parts |= MAPDATA_NODES;
 
-	if (Args.CheckParm("-blockmap") || (count = W_LumpLength(lump)/2) >= 0x10000 || count < 4)
-		P_CreateBlockMap();
+	// [SL] 2011-07-01 - Check to see if the reject table is of the proper size
+	if (W_LumpLength(lumpnum + ML_REJECT) < ((unsigned int)ceil((float)(numsectors * numsectors / 8))))
+		parts |= MAPDATA_REJECT;
 	else
-	{
-		short *wadblockmaplump = (short *)W_CacheLumpNum (lump, PU_LEVEL);
-		int i;
-		blockmaplump = (int *)Z_Malloc(sizeof(*blockmaplump) * count, PU_LEVEL, 0);
+		rejectmatrix = (byte *)W_CacheLumpNum (lumpnum+ML_REJECT, PU_LEVEL);
 
-		// killough 3/1/98: Expand wad blockmap into larger internal one,
-		// by treating all offsets except -1 as unsigned and zero-extending
-		// them. This potentially doubles the size of blockmaps allowed,
-		// because Doom originally considered the offsets as always signed.
+	if (!parts)
+		return;
 
-		blockmaplump[0] = LESHORT(wadblockmaplump[0]);
-		blockmaplump[1] = LESHORT(wadblockmaplump[1]);
-		blockmaplump[2] = (DWORD)(LESHORT(wadblockmaplump[2])) & 0xffff;
-		blockmaplump[3] = (DWORD)(LESHORT(wadblockmaplump[3])) & 0xffff;
+	mapdata_t data;
+	P_GetMapData(mapname, lumpnum, parts, data);
 
-		for (i=4 ; i<count ; i++)
-		{
-			short t = LESHORT(wadblockmaplump[i]);          // killough 3/1/98
-			blockmaplump[i] = t == -1 ? (DWORD)0xffffffff : (DWORD) t & 0xffff;
-		}
+	if (parts & MAPDATA_BLOCKMAP)
+	{
+		if (!(data.parts & MAPDATA_BLOCKMAP))
+			I_Error("P_LoadMapData: could not build a blockmap for %s", mapname);
 
-		Z_Free (wadblockmaplump);
+		blockmaplump = (int *)Z_Malloc(sizeof(*blockmaplump) * data.blockmap.size(), PU_LEVEL, 0);
+		memcpy(blockmaplump, &data.blockmap[0], sizeof(*blockmaplump) * data.blockmap.size());
+		P_SetupBlockMap();
 	}
 
-	bmaporgx = blockmaplump[0]<<FRACBITS;
-	bmaporgy = blockmaplump[1]<<FRACBITS;
-	bmapwidth = blockmaplump[2];
-	bmapheight = blockmaplump[3];
+	if (parts & MAPDATA_NODES)
+	{
+		if (!(data.parts & MAPDATA_NODES))
+			I_Error("P_LoadMapData: could not build nodes for %s", mapname);
 
-	// clear out mobj chains
-	count = sizeof(*blocklinks) * bmapwidth*bmapheight;
-	blocklinks = (AActor **)Z_Malloc (count, PU_LEVEL, 0);
-	memset (blocklinks, 0, count);
-	blockmap = blockmaplump+4;
+		P_LoadXNOD(&data.nodes[0]);
+	}
+
+	if (parts & MAPDATA_REJECT)
+	{
+		if (data.parts & MAPDATA_REJECT)
+		{
+			rejectmatrix = (byte *)Z_Malloc(data.reject.size(), PU_LEVEL, 0);
+			memcpy(rejectmatrix, &data.reject[0], data.reject.size());
+		}
+		else
+		{
+			// If it's too short, the reject table should be ignored when
+			// calling P_CheckSight
+			DPrintf("Reject matrix is not valid and will be ignored.\n");
+			rejectmatrix = (byte *)W_CacheLumpNum (lumpnum+ML_REJECT, PU_LEVEL);
+			rejectempty = true;
+		}
+	}
 }
 
 
@@ -1716,6 +1801,9 @@ void P_SetupLevel (char *lumpname, int position)
 
 	PolyBlockMap = NULL;
 
+	// A reject is only ignored on the level that has a broken one
+	rejectempty = false;
+
 	// [AM] So shootthing isn't a wild pointer on map swtich.
 	shootthing = NULL;
 
@@ -1761,26 +1849,8 @@ void P_SetupLevel (char *lumpname, int position)
 		P_LoadLineDefs2 (lumpnum+ML_LINEDEFS);	// [RH] Load Hexen-style linedefs
 	P_LoadSideDefs2 (lumpnum+ML_SIDEDEFS);
 	P_FinishLoadingLineDefs ();
-	P_LoadBlockMap (lumpnum+ML_BLOCKMAP);
-
-	if (!P_LoadXNOD(lumpnum+ML_NODES))
-	{
-		P_LoadSubsectors (lumpnum+ML_SSECTORS);
-		P_LoadNodes (lumpnum+ML_NODES);
-		P_LoadSegs (lumpnum+ML_SEGS);
-	}
+	P_LoadMapData (lumpname, lumpnum);
 
-	rejectmatrix = (byte *)W_CacheLumpNum (lumpnum+ML_REJECT, PU_LEVEL);
-	{
-		// [SL] 2011-07-01 - Check to see if the reject table is of the proper size
-		// If it's too short, the reject table should be ignored when
-		// calling P_CheckSight
-		if (W_LumpLength(lumpnum + ML_REJECT) < ((unsigned int)ceil((float)(numsectors * numsectors / 8))))
-		{
-			DPrintf("Reject matrix is not valid and will be ignored.\n");
-			rejectempty = true;
-		}
-	}
 	P_GroupLines ();
 
 	// [SL] don't move seg vertices if compatibility is cruical
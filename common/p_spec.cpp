@@ -66,6 +66,7 @@ EXTERN_CVAR(sv_allowexit)
 EXTERN_CVAR(sv_fragexitswitch)
 
 std::list<movingsector_t> movingsectors;
+std::vector<dirtysector_t> dirtysectors;
 bool s_SpecialFromServer;
 
 //
@@ -82,6 +83,40 @@ std::list<movingsector_t>::iterator P_FindMovingSector(sector_t *sector)
 	return movingsectors.end();
 }
 
+//
+// P_MarkSectorDirty
+//
+// Adds the passed sector to dirtysectors the first time it is about to
+// change, remembering its heights, flats and special as the map has them
+//
+void P_MarkSectorDirty(sector_t *sector)
+{
+	if (!sector || sector->dirty)
+		return;
+
+	dirtysector_t dirty;
+	dirty.sector = sector;
+	dirty.floorheight = P_FloorHeight(sector);
+	dirty.ceilingheight = P_CeilingHeight(sector);
+	dirty.floorpic = sector->floorpic;
+	dirty.ceilingpic = sector->ceilingpic;
+	dirty.special = sector->special;
+
+	sector->dirty = true;
+	dirtysectors.push_back(dirty);
+}
+
+//
+// P_SectorChanged
+//
+// Records sector properties (SPC_*) changed from how the map has them
+//
+void P_SectorChanged(sector_t *sector, int changes)
+{
+	P_MarkSectorDirty(sector);
+	sector->SectorChanges |= changes;
+}
+
 //
 // P_AddMovingCeiling
 //
@@ -111,6 +146,7 @@ void P_AddMovingCeiling(sector_t *sector)
 	movesec->sector = sector;
 	movesec->moving_ceiling = true;
 
+	P_MarkSectorDirty(sector);
 	sector->moveable = true;
 	// [SL] 2012-05-04 - Register this sector as a moveable sector with the
 	// reconciliation system for unlagging
@@ -146,6 +182,7 @@ void P_AddMovingFloor(sector_t *sector)
 	movesec->sector = sector;
 	movesec->moving_floor = true;
 
+	P_MarkSectorDirty(sector);
 	sector->moveable = true;
 	// [SL] 2012-05-04 - Register this sector as a moveable sector with the
 	// reconciliation system for unlagging
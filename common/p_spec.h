@@ -29,6 +29,7 @@
 #define __P_SPEC__
 
 #include <list>
+#include <vector>
 #include "dsectoreffect.h"
 
 typedef struct movingsector_s
@@ -45,11 +46,30 @@ typedef struct movingsector_s
 extern std::list<movingsector_t> movingsectors;
 extern bool s_SpecialFromServer;
 
+//
+// Sectors that have moved or had properties changed since the level was
+// loaded, and how the map left what svc_sector carries, so a full update
+// only has to look at these
+//
+typedef struct dirtysector_s
+{
+	sector_t	*sector;
+	fixed_t		floorheight;
+	fixed_t		ceilingheight;
+	short		floorpic;
+	short		ceilingpic;
+	short		special;
+} dirtysector_t;
+
+extern std::vector<dirtysector_t> dirtysectors;
+
 #define IgnoreSpecial !serverside && !s_SpecialFromServer
 
 std::list<movingsector_t>::iterator P_FindMovingSector(sector_t *sector);
 void P_AddMovingCeiling(sector_t *sector);
 void P_AddMovingFloor(sector_t *sector);
+void P_MarkSectorDirty(sector_t *sector);
+void P_SectorChanged(sector_t *sector, int changes);
 void P_RemoveMovingCeiling(sector_t *sector);
 void P_RemoveMovingFloor(sector_t *sector);
 bool P_MovingCeilingCompleted(sector_t *sector);
@@ -32,6 +32,7 @@
 #include "m_bbox.h"
 #include "tables.h"
 #include "s_sndseq.h"
+#include "p_acs.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -105,6 +106,14 @@ DPolyAction::DPolyAction (int polyNum)
 	m_Dist = 0;
 }
 
+void DPolyAction::Destroy ()
+{
+	// Scripts waiting on this polyobject can look again
+	P_ACSWakePolyWait (m_PolyObj);
+
+	Super::Destroy ();
+}
+
 DRotatePoly::DRotatePoly ()
 {
 }
@@ -42,6 +42,8 @@
 
 #include "v_palette.h"
 #include "v_video.h"
+#include "c_dispatch.h"
+#include "c_cvars.h"
 
 #include <ctype.h>
 #include <cstddef>
@@ -75,6 +77,9 @@ static int*		texturecompositesize;
 static short** 	texturecolumnlump;
 static unsigned **texturecolumnofs;
 static byte**	texturecomposite;
+static int*		texturecompositeused;	// gametic the composite was last used
+static int*		texturecompositeprev;	// composite LRU list links, -1 for none
+static int*		texturecompositenext;
 fixed_t*		texturescalex;
 fixed_t*		texturescaley;
 
@@ -234,6 +239,153 @@ void R_DrawColumnInCache(const tallpost_t *post, byte *cache,
 	}
 }
 
+//
+// Composite texture cache
+//
+// Composites are built on demand and count against a byte budget set by
+// r_texturecachesize (in megabytes, 0 for unlimited). Every composite is
+// kept on a list ordered from most to least recently used. When the budget
+// is exceeded composites are freed from the tail of the list. Composites used
+// during the current gametic are never freed since the renderer may still
+// hold pointers to their columns.
+//
+// Without a budget (and always on the server) composites are left PU_CACHE
+// so the zone remains free to purge them, as it was before the cache.
+//
+
+#ifdef CLIENT_APP
+EXTERN_CVAR(r_texturecachesize)
+#endif
+
+static size_t	compositecachebytes;
+static unsigned	compositecachehits;
+static unsigned	compositecachemisses;
+static unsigned	compositecacheevictions;
+static int		compositelruhead = -1;
+static int		compositelrutail = -1;
+
+static size_t R_CompositeCacheBudget()
+{
+#ifdef CLIENT_APP
+	return (size_t)r_texturecachesize.asInt() * 1024 * 1024;
+#else
+	return 0;
+#endif
+}
+
+static zoneTag_e R_CompositeTag()
+{
+	return R_CompositeCacheBudget() ? PU_STATIC : PU_CACHE;
+}
+
+static inline bool R_CompositeLinked(int texnum)
+{
+	return texturecompositeprev[texnum] != -1 || compositelruhead == texnum;
+}
+
+//
+// R_UnlinkComposite
+//
+static void R_UnlinkComposite(int texnum)
+{
+	const int prev = texturecompositeprev[texnum];
+	const int next = texturecompositenext[texnum];
+
+	if (prev != -1)
+		texturecompositenext[prev] = next;
+	else
+		compositelruhead = next;
+
+	if (next != -1)
+		texturecompositeprev[next] = prev;
+	else
+		compositelrutail = prev;
+
+	texturecompositeprev[texnum] = texturecompositenext[texnum] = -1;
+}
+
+//
+// R_TouchComposite
+//
+// Moves the composite to the front of the LRU list.
+//
+static inline void R_TouchComposite(int texnum)
+{
+	texturecompositeused[texnum] = gametic;
+
+	if (compositelruhead == texnum)
+		return;
+
+	if (R_CompositeLinked(texnum))
+		R_UnlinkComposite(texnum);
+
+	texturecompositeprev[texnum] = -1;
+	texturecompositenext[texnum] = compositelruhead;
+	if (compositelruhead != -1)
+		texturecompositeprev[compositelruhead] = texnum;
+	else
+		compositelrutail = texnum;
+	compositelruhead = texnum;
+}
+
+//
+// R_FreeComposite
+//
+// Also drops the accounting for a PU_CACHE composite the zone has already
+// purged.
+//
+static void R_FreeComposite(int texnum)
+{
+	if (!R_CompositeLinked(texnum))
+		return;
+
+	R_UnlinkComposite(texnum);
+	compositecachebytes -= texturecompositesize[texnum];
+
+	if (texturecomposite[texnum])
+		Z_Free(texturecomposite[texnum]);
+	texturecomposite[texnum] = NULL;
+}
+
+//
+// R_TrimCompositeCache
+//
+// Frees least recently used composites until there is room for a new
+// composite of the given size.
+//
+static void R_TrimCompositeCache(size_t needed)
+{
+	const size_t budget = R_CompositeCacheBudget();
+	if (budget == 0)
+		return;
+
+	while (compositecachebytes + needed > budget && compositelrutail != -1)
+	{
+		const int oldest = compositelrutail;
+		if (texturecompositeused[oldest] == gametic)
+			break;
+
+		R_FreeComposite(oldest);
+		compositecacheevictions++;
+	}
+}
+
+#ifdef CLIENT_APP
+CVAR_FUNC_IMPL(r_texturecachesize)
+{
+	if (!texturecomposite)
+		return;
+
+	// switch the existing composites between purgable and budgeted
+	const zoneTag_e tag = R_CompositeTag();
+	for (int i = compositelruhead; i != -1; i = texturecompositenext[i])
+		if (texturecomposite[i])
+			Z_ChangeTag(texturecomposite[i], tag);
+
+	R_TrimCompositeCache(0);
+}
+#endif
+
 //
 // R_GenerateComposite
 // Using the texture definition,
@@ -244,9 +396,14 @@ void R_DrawColumnInCache(const tallpost_t *post, byte *cache,
 
 void R_GenerateComposite (int texnum)
 {
+	R_FreeComposite(texnum);
+	R_TrimCompositeCache(texturecompositesize[texnum]);
+
 	byte *block = (byte *)Z_Malloc (texturecompositesize[texnum], PU_STATIC,
 						   (void **) &texturecomposite[texnum]);
 	texturecomposite[texnum] = block;
+	R_TouchComposite(texnum);
+	compositecachebytes += texturecompositesize[texnum];
 	texture_t *texture = textures[texnum];
 
 	// Composite the columns together.
@@ -323,10 +480,9 @@ void R_GenerateComposite (int texnum)
 	delete [] marks;
 	delete [] tmpdata;
 
-	// Now that the texture has been built in column cache,
-	// it is purgable from zone memory.
-
-	Z_ChangeTag(block, PU_CACHE);
+	// With a budget the composite stays PU_STATIC and is freed by the
+	// composite cache when it falls out of the budget.
+	Z_ChangeTag(block, R_CompositeTag());
 }
 
 //
@@ -389,7 +545,7 @@ void R_GenerateLookup(int texnum, int *const errors)
 	// Now count the number of columns that are covered by more than one patch.
 	// Fill in the lump / offset, so columns with only a single patch are all done.
 
-	texturecomposite[texnum] = 0;
+	R_FreeComposite(texnum);
 	int csize = 0;
 
 	// [RH] Always create a composite texture for multipatch textures
@@ -463,9 +619,17 @@ tallpost_t* R_GetTextureColumn(int texnum, int colnum)
 	if (lump > 0)
 		return (tallpost_t*)((byte *)W_CachePatch(lump, PU_CACHE) + ofs);
 
-	if (!texturecomposite[texnum])
+	if (texturecomposite[texnum])
+	{
+		compositecachehits++;
+	}
+	else
+	{
+		compositecachemisses++;
 		R_GenerateComposite(texnum);
+	}
 
+	R_TouchComposite(texnum);
 	return (tallpost_t*)(texturecomposite[texnum] + ofs);
 }
 
@@ -563,6 +727,7 @@ void R_InitTextures (void)
 	// denis - fix memory leaks
 	for (i = 0; i < numtextures; i++)
 	{
+		R_FreeComposite(i);
 		delete[] texturecolumnlump[i];
 		delete[] texturecolumnofs[i];
 	}
@@ -573,6 +738,9 @@ void R_InitTextures (void)
 	delete[] texturecolumnofs;
 	delete[] texturecomposite;
 	delete[] texturecompositesize;
+	delete[] texturecompositeused;
+	delete[] texturecompositeprev;
+	delete[] texturecompositenext;
 	delete[] texturewidthmask;
 	delete[] textureheight;
 	delete[] texturescalex;
@@ -583,8 +751,13 @@ void R_InitTextures (void)
 	textures = new texture_t *[numtextures];
 	texturecolumnlump = new short *[numtextures];
 	texturecolumnofs = new unsigned int *[numtextures];
-	texturecomposite = new byte *[numtextures];
-	texturecompositesize = new int[numtextures];
+	texturecomposite = new byte *[numtextures]();
+	texturecompositesize = new int[numtextures]();
+	texturecompositeused = new int[numtextures]();
+	texturecompositeprev = new int[numtextures];
+	texturecompositenext = new int[numtextures];
+	memset(texturecompositeprev, -1, numtextures * sizeof(*texturecompositeprev));
+	memset(texturecompositenext, -1, numtextures * sizeof(*texturecompositenext));
 	texturewidthmask = new int[numtextures];
 	textureheight = new fixed_t[numtextures];
 	texturescalex = new fixed_t[numtextures];
@@ -1125,6 +1298,20 @@ void R_PrecacheLevel (void)
 		}
 	}
 
+	// Pre-warm the composites of the textures used by the level so
+	// they are not built the first time they come into view, stopping
+	// once the composite cache budget is full.
+	const size_t budget = R_CompositeCacheBudget();
+	for (i = 0; i < numtextures; i++)
+	{
+		if (!hitlist[i] || texturecomposite[i] || texturecompositesize[i] == 0)
+			continue;
+		if (budget && compositecachebytes + texturecompositesize[i] > budget)
+			break;
+
+		R_GenerateComposite(i);
+	}
+
 	// Precache sprites.
 	memset (hitlist, 0, numsprites);
 
@@ -1145,6 +1332,16 @@ void R_PrecacheLevel (void)
 	delete[] hitlist;
 }
 
+BEGIN_COMMAND(r_texturecachestats)
+{
+	std::string buf;
+	StrFormatBytes(buf, compositecachebytes);
+
+	Printf(PRINT_HIGH, "Composite textures: %s used, %u hits, %u misses, %u evictions\n",
+			buf.c_str(), compositecachehits, compositecachemisses, compositecacheevictions);
+}
+END_COMMAND(r_texturecachestats)
+
 // Utility function,
 //	called by R_PointToAngle.
 unsigned int SlopeDiv (unsigned int num, unsigned int den)
@@ -202,6 +202,7 @@ struct sector_s
 	bool moveable;  // [csDoom] mark a sector as moveable if it is moving.
                     // If (sector->moveable) the server sends information
                     // about this sector when a client connects.
+	bool dirty;		// In dirtysectors
 
 	// jff 2/26/98 lockout machinery for stairbuilding
 	int stairlock;		// -2 on first locked -1 after thinker done 0 normally
@@ -654,9 +655,9 @@ struct visplane_s
 	fixed_t		xscale, yscale;		// [RH] Support flat scaling
 	angle_t		angle;				// [RH] Support flat rotation
 
-	unsigned int *bottom;			// [RH] bottom and top arrays are dynamically
-	unsigned int pad;				//		allocated immediately after the
-	unsigned int top[3];			//		visplane.
+	unsigned int *top;				// [RH] top and bottom arrays are allocated
+	unsigned int *bottom;			//		from a per-frame arena and are only
+									//		valid in the range [minx-1, maxx+1].
 };
 typedef struct visplane_s visplane_t;
 
@@ -38,7 +38,6 @@
 BOOL R_AlignFlat (int linenum, int side, int fc);
 
 extern int negonearray[MAXWIDTH];
-extern int viewheightarray[MAXWIDTH];
 
 //
 // POV related.
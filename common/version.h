@@ -72,10 +72,10 @@
 // Used by configuration files.  upversion.py will update thie field
 // deterministically and unambiguously so newer versions always compare
 // greater.
-#define CONFIGVERSIONSTR "93"
+#define CONFIGVERSIONSTR "94"
 
-#define DOTVERSIONSTR "0.9.3"
-#define GAMEVER (MAKEVER(0, 9, 3))
+#define DOTVERSIONSTR "0.9.4"
+#define GAMEVER (MAKEVER(0, 9, 4))
 
 #define COPYRIGHTSTR "Copyright (C) 2006-2021 The Odamex Team"
 
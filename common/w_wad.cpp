@@ -37,6 +37,8 @@
 #endif
 
 #include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "doomtype.h"
 #include "m_swap.h"
@@ -51,6 +53,7 @@
 
 #include <sstream>
 #include <algorithm>
+#include <map>
 #include <vector>
 #include <iomanip>
 
@@ -141,9 +144,32 @@ void uppercopy (char *to, const char *from)
 }
 
 
+// Hashes of files that were already read, so changing to a resource set
+// that shares files with the loaded one doesn't read them all again.  A
+// file is hashed again if its size or modification time changes.
+struct md5cache_t
+{
+	QWORD size;
+	time_t mtime;
+	std::string hash;
+};
+
+static std::map<std::string, md5cache_t> md5cache;
+
 // denis - Standard MD5SUM
 std::string W_MD5(std::string filename)
 {
+	struct stat info;
+	bool known = stat(filename.c_str(), &info) == 0;
+
+	if (known)
+	{
+		std::map<std::string, md5cache_t>::const_iterator it = md5cache.find(filename);
+		if (it != md5cache.end() && it->second.size == (QWORD)info.st_size &&
+		    it->second.mtime == info.st_mtime)
+			return it->second.hash;
+	}
+
 	const int file_chunk_size = 8192;
 	FILE *fp = fopen(filename.c_str(), "rb");
 
@@ -169,6 +195,14 @@ std::string W_MD5(std::string filename)
 	for(int i = 0; i < 16; i++)
 		hash << std::setw(2) << std::setfill('0') << std::hex << std::uppercase << (short)digest[i];
 
+	if (known)
+	{
+		md5cache_t& cached = md5cache[filename];
+		cached.size = info.st_size;
+		cached.mtime = info.st_mtime;
+		cached.hash = hash.str();
+	}
+
 	return hash.str();
 }
 
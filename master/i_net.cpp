@@ -28,6 +28,7 @@
 
 #ifdef _WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #else
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -56,10 +57,22 @@ typedef int socklen_t;
 
 int net_socket;
 int localport;
+static bool net_ipv6;  // socket takes both IPv6 and IPv4-mapped traffic
 netadr_t net_from;   // address of who sent the packet
 
 buf_t net_message(MAX_UDP_PACKET);
 
+// The first 12 bytes of an IPv4-mapped address
+static const byte v4mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+
+// Room for a socket address of either family
+typedef union
+{
+	struct sockaddr sa;
+	struct sockaddr_in sin;
+	struct sockaddr_in6 sin6;
+} sockadr_t;
+
 //
 // UDPsocket
 //
@@ -67,6 +80,23 @@ SOCKET UDPsocket(void)
 {
 	SOCKET s;
 
+	// Prefer one dual-stack socket, IPv4 peers show up on it with
+	// IPv4-mapped addresses
+	s = socket(PF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (s != INVALID_SOCKET)
+	{
+		int v6only = 0;
+		if (setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, (const char *)&v6only, sizeof(v6only)) == 0)
+		{
+			net_ipv6 = true;
+			return s;
+		}
+
+		closesocket(s);
+	}
+
+	net_ipv6 = false;
+
 	// allocate a socket
 	s = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
 	if (s == INVALID_SOCKET)
@@ -81,14 +111,26 @@ SOCKET UDPsocket(void)
 void BindToLocalPort(SOCKET s, u_short port)
 {
 	int v;
-	struct sockaddr_in address;
+	sockadr_t address;
+	socklen_t addrlen;
 
 	memset(&address, 0, sizeof(address));
-	address.sin_family = AF_INET;
-	address.sin_addr.s_addr = INADDR_ANY;
-	address.sin_port = htons(port);
-
-	v = bind(s, (sockaddr *)&address, sizeof(address));
+	if (net_ipv6)
+	{
+		address.sin6.sin6_family = AF_INET6;
+		address.sin6.sin6_addr = in6addr_any;
+		address.sin6.sin6_port = htons(port);
+		addrlen = sizeof(address.sin6);
+	}
+	else
+	{
+		address.sin.sin_family = AF_INET;
+		address.sin.sin_addr.s_addr = INADDR_ANY;
+		address.sin.sin_port = htons(port);
+		addrlen = sizeof(address.sin);
+	}
+
+	v = bind(s, &address.sa, addrlen);
 	if (v == SOCKET_ERROR)
     	   printf("BindToPort: error\n");
 }
@@ -105,9 +147,11 @@ void CloseNetwork(void)
 
 // this is from Quake source code :)
 
+// IPv4 only, for plain IPv4 sockets like the proxy's upstream ones
 void SockadrToNetadr(struct sockaddr_in *s, netadr_t *a)
 {
-	 memcpy(&(a->ip), &(s->sin_addr), sizeof(struct in_addr));
+	 memcpy(a->ip, v4mapped_prefix, sizeof(v4mapped_prefix));
+	 memcpy(a->ip + sizeof(v4mapped_prefix), &(s->sin_addr), sizeof(struct in_addr));
      a->port = s->sin_port;
 }
 
@@ -116,75 +160,153 @@ void NetadrToSockadr(netadr_t *a, struct sockaddr_in *s)
      memset(s, 0, sizeof(*s));
      s->sin_family = AF_INET;
 
-	 memcpy(&(s->sin_addr), &(a->ip), sizeof(struct in_addr));
+	 memcpy(&(s->sin_addr), a->ip + sizeof(v4mapped_prefix), sizeof(struct in_addr));
      s->sin_port = a->port;
 }
 
-char *NET_AdrToString(netadr_t a, bool displayport)
+static void SockadrToNetadr(const sockadr_t *s, netadr_t *a)
 {
-     static char s[64];
+	if (s->sa.sa_family == AF_INET6)
+	{
+		memcpy(a->ip, &s->sin6.sin6_addr, NETADR_IPBYTES);
+		a->port = s->sin6.sin6_port;
+		return;
+	}
+
+	SockadrToNetadr((struct sockaddr_in *)&s->sin, a);
+}
 
-	 if (displayport)
-		sprintf(s, "%i.%i.%i.%i:%i", a.ip[0], a.ip[1], a.ip[2], a.ip[3], ntohs(a.port));
-	 else
-		sprintf(s, "%i.%i.%i.%i", a.ip[0], a.ip[1], a.ip[2], a.ip[3]);
+// Fill in a socket address for our socket's family, returns its length.
+static socklen_t NetadrToSockadr(const netadr_t *a, sockadr_t *s)
+{
+	memset(s, 0, sizeof(*s));
+
+	if (net_ipv6)
+	{
+		s->sin6.sin6_family = AF_INET6;
+		memcpy(&s->sin6.sin6_addr, a->ip, NETADR_IPBYTES);
+		s->sin6.sin6_port = a->port;
+		return sizeof(s->sin6);
+	}
+
+	NetadrToSockadr((netadr_t *)a, &s->sin);
+	return sizeof(s->sin);
+}
 
-     return s;
+bool NET_IsIPv4Adr(const netadr_t &a)
+{
+	return memcmp(a.ip, v4mapped_prefix, sizeof(v4mapped_prefix)) == 0;
 }
 
-bool NET_StringToAdr(char *s, netadr_t *a)
+char *NET_AdrToString(const netadr_t &a, bool displayport)
 {
-     struct hostent  *h;
-     struct sockaddr_in sadr;
-     char *colon;
-     char copy[128];
-
-
-     memset(&sadr, 0, sizeof(sadr));
-     sadr.sin_family = AF_INET;
-
-     sadr.sin_port = 0;
-
-     strcpy(copy, s);
-     // strip off a trailing :port if present
-     for (colon = copy ; *colon ; colon++)
-          if (*colon == ':')
-          {
-             *colon = 0;
-             sadr.sin_port = htons(atoi(colon + 1));
-          }
-
-     if (copy[0] >= '0' && copy[0] <= '9')
-     {
-          *(int *)&sadr.sin_addr = inet_addr(copy);
-     }
-     else
-     {
-          if (!(h = gethostbyname(copy)))
-                return 0;
-          *(int *)&sadr.sin_addr = *(int *)h->h_addr_list[0];
-     }
-
-     SockadrToNetadr(&sadr, a);
-
-     return true;
+	static char s[64];
+	char host[48];
+
+	if (NET_IsIPv4Adr(a))
+	{
+		const byte *ip = a.ip + sizeof(v4mapped_prefix);
+		sprintf(host, "%i.%i.%i.%i", ip[0], ip[1], ip[2], ip[3]);
+	}
+	else
+	{
+		sockadr_t sadr;
+		memset(&sadr, 0, sizeof(sadr));
+		sadr.sin6.sin6_family = AF_INET6;
+		memcpy(&sadr.sin6.sin6_addr, a.ip, NETADR_IPBYTES);
+		if (getnameinfo(&sadr.sa, sizeof(sadr.sin6), host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0)
+			strcpy(host, "?");
+	}
+
+	if (!displayport)
+		sprintf(s, "%s", host);
+	else if (NET_IsIPv4Adr(a))
+		sprintf(s, "%s:%i", host, ntohs(a.port));
+	else
+		sprintf(s, "[%s]:%i", host, ntohs(a.port));
+
+	return s;
 }
 
-bool NET_CompareAdr(netadr_t a, netadr_t b)
+//
+// NET_StringToAdr
+//
+// Takes a host name or address with an optional port: "host:port",
+// "1.2.3.4:port", "[::1]:port" or a bare IPv6 address.  type limits which
+// family a host name may resolve to.
+//
+bool NET_StringToAdr(const char *s, netadr_t *a, netadrtype_t type)
 {
-    if (a.ip[0] == b.ip[0] && a.ip[1] == b.ip[1] && a.ip[2] == b.ip[2] && a.ip[3] == b.ip[3] && a.port == b.port)
-        return true;
+	char copy[256];
+	char *host = copy;
+	const char *portstr = NULL;
+
+	strncpy(copy, s, sizeof(copy) - 1);
+	copy[sizeof(copy) - 1] = 0;
+
+	// strip off a trailing :port if present, IPv6 addresses with a port are
+	// written in brackets
+	if (copy[0] == '[')
+	{
+		char *end = strchr(copy, ']');
+		if (!end)
+			return false;
+
+		*end = 0;
+		host = copy + 1;
 
-	return false;
+		if (end[1] == ':')
+			portstr = end + 2;
+	}
+	else
+	{
+		char *colon = strchr(copy, ':');
+		if (colon && !strchr(colon + 1, ':'))
+		{
+			*colon = 0;
+			portstr = colon + 1;
+		}
+	}
+
+	struct addrinfo hints;
+	struct addrinfo *result = NULL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if (type == NA_IPV4)
+		hints.ai_family = AF_INET;
+	else if (type == NA_IPV6)
+		hints.ai_family = AF_INET6;
+	else
+		hints.ai_family = net_ipv6 ? AF_UNSPEC : AF_INET;
+
+	if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL)
+		return false;
+
+	sockadr_t sadr;
+	memset(&sadr, 0, sizeof(sadr));
+	memcpy(&sadr, result->ai_addr, result->ai_addrlen < sizeof(sadr) ? result->ai_addrlen : sizeof(sadr));
+	freeaddrinfo(result);
+
+	SockadrToNetadr(&sadr, a);
+	a->port = portstr ? htons(atoi(portstr)) : 0;
+
+	return true;
+}
+
+bool NET_CompareAdr(const netadr_t &a, const netadr_t &b)
+{
+	return a.port == b.port && memcmp(a.ip, b.ip, NETADR_IPBYTES) == 0;
 }
 
 int NET_GetPacket(void)
 {
-    struct sockaddr_in from;
+    sockadr_t from;
     socklen_t fromlen = sizeof(from);
 	net_message.clear();
 
-    int ret = recvfrom(net_socket, (char *)net_message.ptr(), net_message.maxsize(), 0, (struct sockaddr *)&from, &fromlen);
+    int ret = recvfrom(net_socket, (char *)net_message.ptr(), net_message.maxsize(), 0, &from.sa, &fromlen);
 
     if (ret == -1)
     {
@@ -220,14 +342,37 @@ int NET_GetPacket(void)
     return ret;
 }
 
+//
+// NET_WaitForPacket
+//
+// Blocks until the socket is readable or timeout_ms has passed.
+//
+bool NET_WaitForPacket(unsigned int timeout_ms)
+{
+	fd_set readfds;
+	struct timeval timeout;
+
+	FD_ZERO(&readfds);
+	FD_SET(net_socket, &readfds);
+
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+	return select(net_socket + 1, &readfds, NULL, NULL, &timeout) > 0;
+}
+
 void NET_SendPacket(int length, byte *data, netadr_t to)
 {
     int ret;
-    struct sockaddr_in addr;
+    sockadr_t addr;
+
+    // An IPv4 socket has no way to reach an IPv6 peer
+    if (!net_ipv6 && !NET_IsIPv4Adr(to))
+        return;
 
-    NetadrToSockadr(&to, &addr);
+    socklen_t addrlen = NetadrToSockadr(&to, &addr);
 
-    ret = sendto(net_socket, (const char*)data, length, 0, (struct sockaddr *)&addr, sizeof(addr) );
+    ret = sendto(net_socket, (const char*)data, length, 0, &addr.sa, addrlen);
 
     if (ret == -1)
     {
@@ -255,7 +400,7 @@ void InitNetCommon(void)
 
 #ifdef _WIN32
    WSADATA wsad;
-   WSAStartup(0x0101, &wsad);
+   WSAStartup(MAKEWORD(2,2), &wsad);
 #endif
 
    net_socket = UDPsocket();
@@ -36,17 +36,30 @@ typedef unsigned char byte;
 #define CHALLENGE          5560020  // challenge
 #define SERVER_CHALLENGE   5560020  // doomsv challenge
 #define LAUNCHER_CHALLENGE 777123  // csdl challenge
+#define LAUNCHER_CHALLENGE_IPV6 777124  // server list with IPv6 servers
 
 extern int localport;
 extern int msg_badread;
 
+// Addresses are held as IPv6 addresses, with IPv4 addresses in their
+// IPv4-mapped form (::ffff:a.b.c.d).  port is in network byte order.
+#define NETADR_IPBYTES 16
+
 typedef struct
 {
-   byte ip[4];
+   byte ip[NETADR_IPBYTES];
    unsigned short port;
    unsigned short pad;
 } netadr_t;
 
+// Address families NET_StringToAdr can be limited to
+enum netadrtype_t
+{
+	NA_ANY,
+	NA_IPV4,
+	NA_IPV6
+};
+
 extern netadr_t net_from;  // address of who sent the packet
 
 class buf_t
@@ -305,10 +318,12 @@ void InitNetCommon(void);
 void I_SetPort(netadr_t &addr, int port);
 void I_DoSelect(void);
 
-char *NET_AdrToString(netadr_t a, bool displayport = true);
-bool NET_StringToAdr(char *s, netadr_t *a);
-bool NET_CompareAdr(netadr_t a, netadr_t b);
+char *NET_AdrToString(const netadr_t &a, bool displayport = true);
+bool NET_StringToAdr(const char *s, netadr_t *a, netadrtype_t type = NA_ANY);
+bool NET_CompareAdr(const netadr_t &a, const netadr_t &b);
+bool NET_IsIPv4Adr(const netadr_t &a);
 int  NET_GetPacket(void);
+bool NET_WaitForPacket(unsigned int timeout_ms);
 void NET_SendPacket(int length, byte *data, netadr_t to);
 
 #endif
@@ -36,6 +36,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <stdint.h>
 
@@ -47,18 +48,35 @@
 
 #ifdef _WIN32
 #include <winsock.h>
-#include <time.h>
 #define usleep(n) Sleep(n/1000)
 #endif
 
 #include "i_net.h"
+#include "hashtable.h"
 
 using namespace std;
 
-#define MAX_SERVERS					1024
+#define MAX_SERVERS					4096
 #define MAX_SERVERS_PER_IP			64
-#define MAX_SERVER_AGE				5000
-#define MAX_UNVERIFIED_SERVER_AGE	1000
+#define MAX_SERVER_AGE				250		// seconds without contact before a verified server is dropped
+#define MAX_UNVERIFIED_SERVER_AGE	50		// seconds an unverified server is kept
+#define SERVER_PING_INTERVAL		60		// seconds between re-verification pings
+#define DUMP_INTERVAL				5		// seconds between writes of the server list file
+
+// Each launcher reply packet carries LAUNCHER_CHALLENGE, a count, as many
+// 6-byte address entries as fit in REPLY_ENTRY_BYTES and a trailing packet
+// index and packet total.  Older launchers stop reading after the entries.  Only IPv4
+// servers can be listed this way.
+//
+// A LAUNCHER_CHALLENGE_IPV6 request gets every server instead, in packets of
+// the same layout whose entries are an address length byte (4 or 16), the
+// address and the port.
+#define REPLY_ENTRY_BYTES			(MAX_UDP_PACKET - 16)
+
+// Expiry and ping deadlines are kept in a wheel of one second slots.  A
+// server whose deadline is further out than the wheel spans is parked at the
+// far end and rescheduled when its slot comes round.
+#define TIMER_WHEEL_SLOTS			256
 
 #define LOGFILE "master_log.txt"
 
@@ -67,7 +85,9 @@ buf_t message(MAX_UDP_PACKET);
 typedef struct server
 {
 	netadr_t addr;
-	int age;
+	uint64_t last_seen;			// master time in seconds of the last contact
+	uint64_t next_ping;			// master time in seconds of the next ping
+	uint64_t wheel_due;			// slot time the server is currently filed under
 
 	// from server itself
 	string hostname;
@@ -83,42 +103,182 @@ typedef struct server
 	unsigned int key_sent;
 	bool pinged, verified;
 
-	server() : age(0), players(0), maxplayers(0), gametype(0), skill(0), teamplay(0), ctfmode(0), key_sent(0), pinged(0), verified(0) { memset(&addr, 0, sizeof(addr)); }
+	server() : last_seen(0), next_ping(0), wheel_due(0), players(0), maxplayers(0), gametype(0), skill(0), teamplay(0), ctfmode(0), key_sent(0), pinged(0), verified(0) { memset(&addr, 0, sizeof(addr)); }
 
 } SServer;
 
-list<SServer> servers;
-list<SServer>::iterator ping_itr = servers.begin(); // this iterator must be updated when servers is changed
+// Servers are looked up by their full address and port
+struct netadrhash
+{
+	unsigned int operator()(const netadr_t &addr) const
+	{
+		// FNV-1a
+		unsigned int h = 2166136261u;
+		for (int i = 0; i < NETADR_IPBYTES; i++)
+			h = (h ^ addr.ip[i]) * 16777619u;
+		h = (h ^ (addr.port & 0xFF)) * 16777619u;
+		return (h ^ (addr.port >> 8)) * 16777619u;
+	}
+};
+
+static inline bool operator!=(const netadr_t &a, const netadr_t &b)
+{
+	return !NET_CompareAdr(a, b);
+}
+
+typedef list<SServer> ServerList;
+typedef OHashTable<netadr_t, ServerList::iterator, netadrhash> ServerIndex;
+typedef OHashTable<uint64_t, int> IPCountTable;
+
+ServerList servers;
+ServerIndex server_index(MAX_SERVERS * 2);		// ip:port -> entry in servers
+IPCountTable verified_per_ip(MAX_SERVERS);		// ip -> number of verified servers
+
+vector<netadr_t> timer_wheel[TIMER_WHEEL_SLOTS];
+uint64_t wheel_time = 0;						// next slot time to be processed
+
+vector<buf_t> reply_packets;					// cached launcher reply
+vector<buf_t> reply_packets6;					// cached reply with IPv6 servers
+bool reply_dirty = true;						// set when the verified set changes
+
+//
+// masterTimeMs
+//
+// Monotonic millisecond clock used for expiry and pings.  Aging is driven
+// by this rather than by counting loop passes, so servers age correctly
+// however busy the socket is.  It is 64-bit so that it doesn't wrap while
+// the master runs for months, and monotonic so that the wall clock being
+// set doesn't expire every server at once.
+//
+uint64_t masterTimeMs(void)
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static uint64_t master_epoch_ms = 0;
+
+uint64_t masterTime(void)
+{
+	return (masterTimeMs() - master_epoch_ms) / 1000;
+}
+
+//
+// ipKey
+//
+// What MAX_SERVERS_PER_IP counts against.  An IPv4 address is one host, but
+// an IPv6 host usually has a whole /64 to pick addresses from, so IPv6
+// servers are counted per /64.  The two can not collide as IPv4 addresses
+// are IPv4-mapped and the key is the half that holds the address.
+//
+static inline uint64_t ipKey(const netadr_t &addr)
+{
+	const byte *ip = NET_IsIPv4Adr(addr) ? addr.ip + 8 : addr.ip;
+
+	uint64_t key = 0;
+	for (int i = 0; i < 8; i++)
+		key = (key << 8) | ip[i];
+	return key;
+}
+
+SServer *findServer(const netadr_t &addr)
+{
+	ServerIndex::iterator it = server_index.find(addr);
+	if (it == server_index.end())
+		return NULL;
+	return &(*it->second);
+}
 
 bool ipReachedLimit(netadr_t addr)
 {
-	list<SServer>::iterator itr;
-	int verifiedservers = 0;
+	IPCountTable::iterator it = verified_per_ip.find(ipKey(addr));
+	return it != verified_per_ip.end() && it->second >= MAX_SERVERS_PER_IP;
+}
 
-	// count verified servers
-	for (itr = servers.begin(); itr != servers.end(); ++itr)
-		if ((*itr).verified && memcmp(&(*itr).addr.ip, &addr.ip, 4) == 0)
-			verifiedservers++;
+void setVerified(SServer &s, bool verified)
+{
+	if (s.verified == verified)
+		return;
+
+	s.verified = verified;
+	reply_dirty = true;
+
+	uint64_t key = ipKey(s.addr);
+	if (verified)
+	{
+		verified_per_ip[key]++;
+	}
+	else
+	{
+		IPCountTable::iterator it = verified_per_ip.find(key);
+		if (it != verified_per_ip.end() && --it->second <= 0)
+			verified_per_ip.erase(it);
+	}
+}
+
+uint64_t serverDeadline(const SServer &s)
+{
+	uint64_t expire = s.last_seen + (s.verified ? MAX_SERVER_AGE : MAX_UNVERIFIED_SERVER_AGE);
+	return expire < s.next_ping ? expire : s.next_ping;
+}
+
+//
+// scheduleServer
+//
+// Files the server under the slot of its next deadline.  Any earlier entry
+// for it becomes stale and is skipped when its slot is processed.
+//
+void scheduleServer(SServer &s)
+{
+	uint64_t due = serverDeadline(s);
 
-	return verifiedservers >= MAX_SERVERS_PER_IP;
+	if (due < wheel_time)
+		due = wheel_time;
+	if (due >= wheel_time + TIMER_WHEEL_SLOTS)
+		due = wheel_time + TIMER_WHEEL_SLOTS - 1;
+
+	s.wheel_due = due;
+	timer_wheel[due % TIMER_WHEEL_SLOTS].push_back(s.addr);
+}
+
+void logRegistration(const netadr_t &addr)
+{
+	FILE *fp = fopen(LOGFILE, "a");
+
+	if(fp)
+	{
+		fprintf(fp, "Server registered: %s, %d total\r\n", NET_AdrToString(addr), (int)servers.size());
+		fclose(fp);
+	}
+	else
+		printf("Failed to write to logfile %s\n", LOGFILE);
 }
 
+void removeServer(ServerIndex::iterator it)
+{
+	ServerList::iterator itr = it->second;
+
+	setVerified(*itr, false);
+	server_index.erase(it);
+	servers.erase(itr);
+}
+
+void pingServer(SServer &s);
+
 void addServer(netadr_t addr)
 {
-	list<SServer>::iterator itr;
-	SServer temp;
+	SServer *existing = findServer(addr);
 
-	for (itr = servers.begin(); itr != servers.end(); ++itr)
+	if (existing)
 	{
-		if (memcmp(&(*itr).addr.ip, &addr.ip, 4) == 0)
-		{
-			if ((*itr).addr.port == addr.port)
-			{
-				(*itr).age = 0;
-				(*itr).pinged = false;
-				return;
-			}
-		}
+		existing->last_seen = masterTime();
+		existing->pinged = false;
+		return;
 	}
 
 	if (servers.size() < MAX_SERVERS)
@@ -126,20 +286,21 @@ void addServer(netadr_t addr)
 		if(ipReachedLimit(addr))
 			return;
 
+		SServer temp;
 		memcpy(&temp.addr, &addr, sizeof(addr));
-		temp.age = 0;
-		servers.push_back(temp);
+		temp.last_seen = masterTime();
+		temp.next_ping = temp.last_seen + SERVER_PING_INTERVAL;
 
-		printf("Added new server: %s, %d total\n", NET_AdrToString(temp.addr), (int)servers.size());
-		FILE *fp = fopen(LOGFILE, "a");
+		ServerList::iterator itr = servers.insert(servers.end(), temp);
+		server_index.insert(make_pair(addr, itr));
 
-		if(fp)
-		{
-			fprintf(fp, "Server registered: %s, %d total\r\n", NET_AdrToString(temp.addr), (int)servers.size());
-			fclose(fp);
-		}
-		else
-			printf("Failed to write to logfile %s\n", LOGFILE);
+		printf("Added new server: %s, %d total\n", NET_AdrToString(addr), (int)servers.size());
+		logRegistration(addr);
+
+		// ask for its details straight away rather than waiting for its
+		// turn to be pinged
+		pingServer(*itr);
+		scheduleServer(*itr);
 		return;
 	}
 
@@ -148,112 +309,111 @@ void addServer(netadr_t addr)
 
 void addServerInfo(netadr_t addr)
 {
-	list<SServer>::iterator itr;
 	size_t i;
 
-	for (itr = servers.begin(); itr != servers.end(); ++itr)
-	{
-		if (memcmp(&(*itr).addr.ip, &addr.ip, 4) != 0)
-			continue;
-
-		if ((*itr).addr.port != addr.port)
-			continue;
-
-		SServer &s = *itr;
+	SServer *found = findServer(addr);
+	if (!found)
+		return;
 
-		if(!s.key_sent)
-			continue;
+	SServer &s = *found;
 
-		net_message.ReadLong();
+	if(!s.key_sent)
+		return;
 
-		// check key against one we issued
-		if((unsigned)net_message.ReadLong() != s.key_sent)
-			continue;
+	net_message.ReadLong();
 
-		// do not allow too many servers
-		if(ipReachedLimit((*itr).addr))
-			continue;
+	// check key against one we issued
+	if((unsigned)net_message.ReadLong() != s.key_sent)
+		return;
 
-		printf("Server info, IP = %s\n", NET_AdrToString(addr));
+	// do not allow too many servers
+	if(!s.verified && ipReachedLimit(s.addr))
+		return;
 
-		s.verified = true;
-		s.age = 0;
+	printf("Server info, IP = %s\n", NET_AdrToString(addr));
 
-		s.hostname = net_message.ReadString();
-		s.players = net_message.ReadByte();
-		s.maxplayers = net_message.ReadByte();
-		s.map = net_message.ReadString();
+	setVerified(s, true);
+	s.last_seen = masterTime();
 
-		int pwadcount = net_message.ReadByte();
-		if(pwadcount < 0)
-			pwadcount = 0;
+	s.hostname = net_message.ReadString();
+	s.players = net_message.ReadByte();
+	s.maxplayers = net_message.ReadByte();
+	s.map = net_message.ReadString();
 
-		s.pwads.resize(pwadcount);
+	int pwadcount = net_message.ReadByte();
+	if(pwadcount < 0)
+		pwadcount = 0;
 
-		for(i = 0; i < s.pwads.size(); i++)
-			s.pwads[i] = net_message.ReadString();
+	s.pwads.resize(pwadcount);
 
-		s.gametype = net_message.ReadByte();
-		s.skill = net_message.ReadByte();
-		s.teamplay = net_message.ReadByte();
-		s.ctfmode = net_message.ReadByte();
+	for(i = 0; i < s.pwads.size(); i++)
+		s.pwads[i] = net_message.ReadString();
 
-		byte playercount = net_message.ReadByte();
+	s.gametype = net_message.ReadByte();
+	s.skill = net_message.ReadByte();
+	s.teamplay = net_message.ReadByte();
+	s.ctfmode = net_message.ReadByte();
 
-		s.playernames.resize(playercount);
-		s.playerfrags.resize(playercount);
-		s.playerpings.resize(playercount);
-		s.playerteams.resize(playercount);
+	byte playercount = net_message.ReadByte();
 
-		for(i = 0; i < playercount; i++)
-		{
-			s.playernames[i] = net_message.ReadString();
-			s.playerfrags[i] = net_message.ReadShort();
-			s.playerpings[i] = net_message.ReadLong();
-			s.playerteams[i] = net_message.ReadByte();
-		}
+	s.playernames.resize(playercount);
+	s.playerfrags.resize(playercount);
+	s.playerpings.resize(playercount);
+	s.playerteams.resize(playercount);
 
-		break;
+	for(i = 0; i < playercount; i++)
+	{
+		s.playernames[i] = net_message.ReadString();
+		s.playerfrags[i] = net_message.ReadShort();
+		s.playerpings[i] = net_message.ReadLong();
+		s.playerteams[i] = net_message.ReadByte();
 	}
-
-	return;
 }
 
-void ageServers(void)
+//
+// runTimers
+//
+// Processes every wheel slot up to the current time, dropping servers that
+// have expired and pinging those that are due.  Entries whose server has
+// been removed or rescheduled since they were filed are discarded.
+//
+void runTimers(void)
 {
-	list<SServer>::iterator itr;
+	uint64_t now = masterTime();
 
-	itr = servers.begin();
-
-	while (itr != servers.end())
+	while (wheel_time <= now)
 	{
-		(*itr).age++;
+		uint64_t slot_time = wheel_time++;
 
-		if((*itr).verified)
+		vector<netadr_t> slot;
+		slot.swap(timer_wheel[slot_time % TIMER_WHEEL_SLOTS]);
+
+		for (size_t i = 0; i < slot.size(); i++)
 		{
-			if ((*itr).age > MAX_SERVER_AGE)
+			ServerIndex::iterator it = server_index.find(slot[i]);
+			if (it == server_index.end())
+				continue;
+
+			SServer &s = *it->second;
+			if (s.wheel_due != slot_time)
+				continue;
+
+			unsigned int max_age = s.verified ? MAX_SERVER_AGE : MAX_UNVERIFIED_SERVER_AGE;
+			if (now - s.last_seen > max_age)
 			{
-				printf("Remote server timed out: %s, ", NET_AdrToString((*itr).addr));
-				if(ping_itr == itr)
-					++ping_itr;
-				itr = servers.erase(itr);
+				printf("Remote server timed out: %s, ", NET_AdrToString(s.addr));
+				removeServer(it);
 				printf("%d total\n", (int)servers.size());
+				continue;
 			}
-			else
-				++itr;
-		}
-		else
-		{
-			if ((*itr).age > MAX_UNVERIFIED_SERVER_AGE)
+
+			if (now >= s.next_ping)
 			{
-				printf("Remote server timed out: %s, ", NET_AdrToString((*itr).addr));
-				if(ping_itr == itr)
-					++ping_itr;
-				itr = servers.erase(itr);
-				printf("%d total\n", (int)servers.size());
+				pingServer(s);
+				s.next_ping = now + SERVER_PING_INTERVAL;
 			}
-			else
-				++itr;
+
+			scheduleServer(s);
 		}
 	}
 }
@@ -317,27 +477,94 @@ void dumpServersToFile(const char *file = "./latest")
     fclose(fp);
 }
 
-void writeServerData(void)
+static size_t replyEntrySize(const SServer &s, bool ipv6)
 {
-	list<SServer>::iterator itr;
-	size_t num_verified = 0;
+	if (!ipv6)
+		return 6;
+	return 1 + (NET_IsIPv4Adr(s.addr) ? 4 : NETADR_IPBYTES) + 2;
+}
 
-	// count verified servers
-	for (itr = servers.begin(); itr != servers.end(); ++itr)
-		if((*itr).verified)
-			num_verified++;
+static void writeReplyEntry(buf_t &packet, const SServer &s, bool ipv6)
+{
+	const bool v4 = NET_IsIPv4Adr(s.addr);
+	const byte *ip = v4 ? s.addr.ip + NETADR_IPBYTES - 4 : s.addr.ip;
+	const int len = v4 ? 4 : NETADR_IPBYTES;
+
+	if (ipv6)
+		packet.WriteByte(len);
+	for (int i = 0; i < len; ++i)
+		packet.WriteByte(ip[i]);
+	packet.WriteShort(htons(s.addr.port));
+}
 
-	message.WriteShort(num_verified);
+//
+// buildReplyPackets
+//
+// Rebuilds a cached launcher reply from the verified servers.  The list
+// only changes when a server is verified or dropped, so the packets are
+// reused for every launcher request in between.
+//
+void buildReplyPackets(vector<buf_t> &packets, bool ipv6)
+{
+	ServerList::iterator itr;
+	vector<ServerList::iterator> verified;
 
 	for (itr = servers.begin(); itr != servers.end(); ++itr)
+		if((*itr).verified && (ipv6 || NET_IsIPv4Adr((*itr).addr)))
+			verified.push_back(itr);
+
+	// Split the list up front, the packet total goes in every packet
+	vector<size_t> counts;
+	size_t bytes = 0;
+	for (size_t i = 0; i < verified.size(); i++)
 	{
-		if(!(*itr).verified)
-			continue;
+		size_t entry = replyEntrySize(*verified[i], ipv6);
+		if (counts.empty() || bytes + entry > REPLY_ENTRY_BYTES)
+		{
+			if (counts.size() == 255)
+				break;
+			counts.push_back(0);
+			bytes = 0;
+		}
+		counts.back()++;
+		bytes += entry;
+	}
+
+	if (counts.empty())
+		counts.push_back(0);
+
+	size_t num_packets = counts.size();
+	packets.assign(num_packets, buf_t(MAX_UDP_PACKET));
+
+	size_t next = 0;
+	for (size_t p = 0; p < num_packets; p++)
+	{
+		buf_t &packet = packets[p];
+
+		packet.WriteLong(ipv6 ? LAUNCHER_CHALLENGE_IPV6 : LAUNCHER_CHALLENGE);
+		packet.WriteShort(counts[p]);
+
+		for (size_t j = 0; j < counts[p]; j++, next++)
+			writeReplyEntry(packet, *verified[next], ipv6);
+
+		packet.WriteByte(p);
+		packet.WriteByte(num_packets);
+	}
+}
 
-		for (int i = 0; i < 4; ++i)
-			message.WriteByte((*itr).addr.ip[i]);
-		message.WriteShort(htons((*itr).addr.port));
+void sendServerList(netadr_t to, bool ipv6)
+{
+	if (reply_dirty)
+	{
+		buildReplyPackets(reply_packets, false);
+		buildReplyPackets(reply_packets6, true);
+		reply_dirty = false;
 	}
+
+	vector<buf_t> &packets = ipv6 ? reply_packets6 : reply_packets;
+
+	for (size_t p = 0; p < packets.size(); p++)
+		NET_SendPacket(packets[p].cursize, packets[p].data, to);
 }
 
 void daemon_init(void)
@@ -389,10 +616,19 @@ int main()
 
 	daemon_init();
 
+	master_epoch_ms = masterTimeMs();
+
 	printf("Odamex Master Started\n");
 
+	uint64_t next_dump = 0;
+
 	while (true)
 	{
+		// sleep until a packet arrives or the next timer slot is due
+		uint64_t elapsed = masterTimeMs() - master_epoch_ms;
+		uint64_t slot_ms = wheel_time * 1000;
+		NET_WaitForPacket(slot_ms > elapsed ? (unsigned int)(slot_ms - elapsed) : 0);
+
 		while (NET_GetPacket())
 		{
 			challenge = net_message.ReadLong();
@@ -426,35 +662,25 @@ int main()
 				else
 				{
 					printf("Client request IP = %s\n", NET_AdrToString(net_from));
-					message.clear();
-					message.WriteLong(LAUNCHER_CHALLENGE);
-					writeServerData();
-					NET_SendPacket(message.cursize, message.data, net_from);
+					sendServerList(net_from, false);
 				}
 			    break;
+			case LAUNCHER_CHALLENGE_IPV6:
+				printf("Client request IP = %s (IPv6 list)\n", NET_AdrToString(net_from));
+				sendServerList(net_from, true);
+			    break;
 			default:
 				break;
 			}
 		}
 
-		static int counter = 0;
-
-		usleep(50*1000); // every 50ms // denis - fixme - use proper timer, age of servers should increase even during packet sending
+		runTimers();
 
-		ageServers();
-
-		if(!(counter%100))
+		if (masterTime() >= next_dump)
 		{
 			dumpServersToFile();
-
-			if (ping_itr == servers.end())
-				ping_itr = servers.begin();
-
-			if(ping_itr != servers.end())
-				pingServer(*(ping_itr++));
+			next_dump = masterTime() + DUMP_INTERVAL;
 		}
-
-		counter++;
 	}
 
 	servers.clear();
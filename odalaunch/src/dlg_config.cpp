@@ -75,8 +75,6 @@ BEGIN_EVENT_TABLE(dlgConfig,wxDialog)
 	EVT_SPINCTRL(XRCID("Id_SpnCtrlMasterTimeout"), dlgConfig::OnSpinValChange)
 	EVT_SPINCTRL(XRCID("Id_SpnCtrlServerTimeout"), dlgConfig::OnSpinValChange)
 	EVT_SPINCTRL(XRCID("Id_SpnCtrlRetry"), dlgConfig::OnSpinValChange)
-	EVT_SPINCTRL(XRCID("Id_SpnCtrlThreadMul"), dlgConfig::OnSpinValChange)
-	EVT_SPINCTRL(XRCID("Id_SpnCtrlThreadMax"), dlgConfig::OnSpinValChange)
 
 	EVT_TEXT(XRCID("Id_TxtCtrlExtraCmdLineArgs"), dlgConfig::OnTextChange)
 
@@ -117,8 +115,6 @@ dlgConfig::dlgConfig(wxWindow* parent, wxWindowID id) :
     m_ClrPickCustomServerHighlight = XRCCTRL(*this, "Id_ClrPickCustomServerHighlight",
 	                                 wxColourPickerCtrl);
 
-    m_SpnCtrlThreadMul = XRCCTRL(*this, "Id_SpnCtrlThreadMul", wxSpinCtrl);
-    m_SpnCtrlThreadMax = XRCCTRL(*this, "Id_SpnCtrlThreadMax", wxSpinCtrl);
 	m_SpnCtrlMasterTimeout = XRCCTRL(*this, "Id_SpnCtrlMasterTimeout", wxSpinCtrl);
 	m_SpnCtrlServerTimeout = XRCCTRL(*this, "Id_SpnCtrlServerTimeout", wxSpinCtrl);
 	m_SpnCtrlRetry = XRCCTRL(*this, "Id_SpnCtrlRetry", wxSpinCtrl);
@@ -461,7 +457,7 @@ void dlgConfig::LoadSettings()
 	bool CustomServersHighlight;
 
 	bool AutoServerRefresh;
-	int ThreadMul, ThreadMax, MasterTimeout, ServerTimeout, RetryCount;
+	int MasterTimeout, ServerTimeout, RetryCount;
     int RefreshInterval;
 	wxString DelimWadPaths, OdamexDirectory, ExtraCmdLineArgs;
 	wxString SoundFile, HighlightColour, CustomServerColour;
@@ -492,8 +488,6 @@ void dlgConfig::LoadSettings()
 	ConfigInfo.Read(POLHLSCOLOUR, &HighlightColour, ODA_UIPOLHSHIGHLIGHTCOLOUR);
 	ConfigInfo.Read(ARTENABLE, &AutoServerRefresh, ODA_UIARTENABLE);
 	ConfigInfo.Read(ARTREFINTERVAL, &RefreshInterval, ODA_UIARTREFINTERVAL);
-    ConfigInfo.Read(QRYTHREADMULTIPLIER, &ThreadMul, ODA_THRMULVAL);
-    ConfigInfo.Read(QRYTHREADMAXIMUM, &ThreadMax, ODA_THRMAXVAL);
 	ConfigInfo.Read(CSHLSERVERS, &CustomServersHighlight, ODA_UICSHIGHTLIGHTSERVERS);
 	ConfigInfo.Read(CSHLCOLOUR, &CustomServerColour, ODA_UICSHSHIGHLIGHTCOLOUR);
 
@@ -532,8 +526,6 @@ void dlgConfig::LoadSettings()
 		m_LstCtrlWadDirectories->AppendString(path);
 	}
 
-    m_SpnCtrlThreadMul->SetValue(ThreadMul);
-    m_SpnCtrlThreadMax->SetValue(ThreadMax);
 	m_SpnCtrlMasterTimeout->SetValue(MasterTimeout);
 	m_SpnCtrlServerTimeout->SetValue(ServerTimeout);
 	m_SpnCtrlRetry->SetValue(RetryCount);
@@ -583,8 +575,6 @@ void dlgConfig::SaveSettings()
 	ConfigInfo.Write(POLHLSCOLOUR, m_ClrPickServerLineHighlighter->GetColour().GetAsString(wxC2S_HTML_SYNTAX));
 	ConfigInfo.Write(ARTENABLE, m_ChkCtrlkAutoServerRefresh->GetValue());
 	ConfigInfo.Write(ARTREFINTERVAL, m_SpnRefreshInterval->GetValue());
-    ConfigInfo.Write(QRYTHREADMULTIPLIER, m_SpnCtrlThreadMul->GetValue());
-    ConfigInfo.Write(QRYTHREADMAXIMUM,  m_SpnCtrlThreadMax->GetValue());
 	ConfigInfo.Write(CSHLSERVERS, m_ChkCtrlHighlightCustomServers->GetValue());
 	ConfigInfo.Write(CSHLCOLOUR, m_ClrPickCustomServerHighlight->GetColour().GetAsString(wxC2S_HTML_SYNTAX));
 
@@ -110,8 +110,6 @@ protected:
 	wxSpinCtrl* m_SpnCtrlMasterTimeout;
 	wxSpinCtrl* m_SpnCtrlServerTimeout;
 	wxSpinCtrl* m_SpnCtrlRetry;
-    wxSpinCtrl* m_SpnCtrlThreadMul;
-    wxSpinCtrl* m_SpnCtrlThreadMax;
 
 	wxSpinCtrl* m_SpnRefreshInterval;
 
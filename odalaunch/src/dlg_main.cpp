@@ -69,15 +69,12 @@
 #include "net_utils.h"
 #include "oda_defs.h"
 #include "plat_utils.h"
-#include "query_thread.h"
 #include "str_utils.h"
 
 #include "md5.h"
 
 using namespace odalpapi;
 
-extern int NUM_THREADS;
-
 // Control ID assignments for events
 // application icon
 
@@ -205,13 +202,6 @@ dlgMain::dlgMain(wxWindow* parent, wxWindowID id)
 
 	QServer = NULL;
 
-	NUM_THREADS = QueryThread::GetIdealThreadCount();
-
-	for(size_t i = 0; i < NUM_THREADS; ++i)
-	{
-		threadVector.push_back(new QueryThread(this));
-	}
-
 	{
 		wxFileConfig ConfigInfo;
 
@@ -354,26 +344,6 @@ void dlgMain::OnClose(wxCloseEvent& event)
     // Wait for the monitor thread to finish
 	if(GetThread() && GetThread()->IsRunning())
 		GetThread()->Wait();
-
-	// Gracefully terminate any running worker threads and then deallocate
-	// their memory
-	{
-        std::vector<QueryThread*>::reverse_iterator it;
-        
-        for(it = threadVector.rbegin(); it != threadVector.rend(); it++)
-        {
-            if((*it)->IsRunning())
-            {
-                (*it)->GracefulExit();
-                delete *it;
-                *it = NULL;
-            }
-        }
-
-        // Clear the vector at the end so we don't play fast and loose with
-        // iterator invalidation.
-        threadVector.clear();
-	}
     
 	// Save the UI layout and shut it all down
 	wxFileConfig ConfigInfo;
@@ -810,15 +780,24 @@ bool dlgMain::MonThrGetMasterList()
 	return (Signal == mtrs_master_success) ? true : false;
 }
 
+void dlgMain::MonThrServerQueried(ServerBase* Query, int32_t Id,
+                                  int32_t Result, void* UserData)
+{
+	wxCommandEvent newEvent(wxEVT_THREAD_WORKER_SIGNAL, wxID_ANY);
+
+	// Same event the main thread always got per server, the id is the result
+	newEvent.SetId(Result);
+	newEvent.SetInt(Id);
+	wxPostEvent((dlgMain*)UserData, newEvent);
+}
+
 void dlgMain::MonThrGetServerList()
 {
 	wxFileConfig ConfigInfo;
 	wxInt32 ServerTimeout;
 	wxInt32 RetryCount;
 	size_t ServerCount;
-
-	size_t count = 0;
-	size_t serverNum = 0;
+	QueryEngine Engine;
 	std::string Address;
 	uint16_t Port = 0;
 
@@ -839,54 +818,28 @@ void dlgMain::MonThrGetServerList()
 	delete[] QServer;
 	QServer = new Server [ServerCount];
 
-	size_t thrvec_size = threadVector.size();
+	Engine.SetTimeout(ServerTimeout);
+	Engine.SetCallback(&dlgMain::MonThrServerQueried, this);
 
-	while(count < ServerCount)
+	// Every server is queried at once from a single socket
+	for(size_t i = 0; i < ServerCount; ++i)
 	{
-		for(size_t i = 0; i < thrvec_size; ++i)
-		{
-			QueryThread* OdaQT = threadVector[i];
-			QueryThread::Status Status = OdaQT->GetStatus();
-
-			// Check if the user wants us to exit
-			if(OdaTH->TestDestroy())
-			{
-				return;
-			}
-
-			if(Status == QueryThread::Running)
-			{
-				// Give up some timeslice for this thread so worker thread slots
-				// become available
-				OdaTH->Sleep(15);
-
-				continue;
-			}
-			else
-				++count;
+		MServer.GetServerAddress(i, Address, Port);
 
-			// If we got this far, it means a thread has finished and needs more
-			// work, give it a job to do
-			if(serverNum < ServerCount)
-			{
-				//OdaTH->Sleep(1);
-				MServer.GetServerAddress(serverNum, Address, Port);
-
-				OdaQT->Signal(&QServer[serverNum], Address, Port, serverNum,
-				              ServerTimeout, RetryCount);
+		QServer[i].SetAddress(Address, Port);
+		QServer[i].SetRetries(RetryCount);
 
-				++serverNum;
-			}
-		}
+		Engine.Add(&QServer[i], i);
 	}
 
-	// Wait until all threads have finished before posting an event
-	for(size_t i = 0; i < thrvec_size; ++i)
+	while(Engine.Poll(50))
 	{
-		QueryThread* OdaQT = threadVector[i];
-
-		while(OdaQT->GetStatus() == QueryThread::Running)
-			OdaTH->Sleep(15);
+		// Check if the user wants us to exit
+		if(OdaTH->TestDestroy())
+		{
+			Engine.Cancel();
+			return;
+		}
 	}
 
 	MonThrPostEvent(wxEVT_THREAD_MONITOR_SIGNAL, -1,
@@ -1122,7 +1075,7 @@ void dlgMain::OnMonitorSignal(wxCommandEvent& event)
 	delete Result;
 }
 
-// worker threads post to this callback
+// the query engine posts to this callback for each server
 void dlgMain::OnWorkerSignal(wxCommandEvent& event)
 {
 	wxInt32 i;
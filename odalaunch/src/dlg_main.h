@@ -50,8 +50,8 @@
 
 #include <vector>
 
-#include "query_thread.h"
 #include "net_packet.h"
+#include "net_query.h"
 
 // custom event declarations
 wxDECLARE_EVENT(wxEVT_THREAD_MONITOR_SIGNAL, wxCommandEvent);
@@ -262,13 +262,15 @@ protected:
 	void MonThrGetServerList();
 	void MonThrGetSingleServer();
 
+	// Called by the query engine as each server finishes
+	static void MonThrServerQueried(odalpapi::ServerBase* Query, int32_t Id,
+	                                int32_t Result, void* UserData);
+
 	void OnMonitorSignal(wxCommandEvent&);
 	void OnWorkerSignal(wxCommandEvent&);
 	// Our monitoring thread entry point, from wxThreadHelper
 	void* Entry();
 
-	std::vector<QueryThread*> threadVector;
-
 private:
 
 	DECLARE_EVENT_TABLE()
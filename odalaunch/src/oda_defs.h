@@ -99,12 +99,6 @@ static const char* def_masterlist[] =
 // Broadcast across all networks for servers
 #define ODA_QRYUSEBROADCAST 0
 
-// Thread multiplier value (this value * number of cores) for querying
-#define ODA_THRMULVAL 12
-
-// Maximum number of threads
-#define ODA_THRMAXVAL 48
-
 // Message for unresponsive servers
 #define ODA_QRYNORESPONSE " << NO RESPONSE >> "
 
@@ -144,8 +138,6 @@ static const char* def_masterlist[] =
 #define ARTENABLE           "UseAutoRefreshTimer"
 #define ARTREFINTERVAL      "AutoRefreshTimerRefreshInterval"
 #define ARTNEWLISTINTERVAL  "AutoRefreshTimerNewListInterval"
-#define QRYTHREADMULTIPLIER "QryThreadMultiplier"
-#define QRYTHREADMAXIMUM    "QryThreadMaximum"
 
 // Master server ids, eg:
 // MasterServer1 "127.0.0.1:15000"
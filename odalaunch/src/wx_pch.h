@@ -46,6 +46,7 @@
 #include "net_error.h"
 #include "net_io.h"
 #include "net_packet.h"
+#include "net_query.h"
 #include "net_utils.h"
 #include "typedefs.h"
 
@@ -53,7 +54,6 @@
 #include "lst_custom.h"
 #include "main.h"
 #include "md5.h"
-#include "query_thread.h"
 #include "resource.h"
 
 #include "dlg_about.h"
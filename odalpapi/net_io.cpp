@@ -57,11 +57,74 @@ using namespace std;
 namespace odalpapi
 {
 
+// Room for a socket address in whichever family the socket uses
+union NativeAddr_t
+{
+	struct sockaddr    sa;
+	struct sockaddr_in sin;
+	SockAddr_t         any;
+};
+
+// Converts a stored address for a socket of either family, returns 0 when
+// an IPv4 socket is asked to reach an IPv6 address
+static socklen_t ToNative(const SockAddr_t& In, const bool& IPv6,
+                          NativeAddr_t& Out)
+{
+	memset(&Out, 0, sizeof(Out));
+
+#ifdef ODALPAPI_IPV6
+	if(!IPv6)
+	{
+		if(!IN6_IS_ADDR_V4MAPPED(&In.sin6_addr))
+			return 0;
+
+		Out.sin.sin_family = AF_INET;
+		Out.sin.sin_port = In.sin6_port;
+		memcpy(&Out.sin.sin_addr, &In.sin6_addr.s6_addr[12], 4);
+
+		return sizeof(Out.sin);
+	}
+#endif
+
+	Out.any = In;
+
+	return sizeof(Out.any);
+}
+
+static void FromNative(const NativeAddr_t& In, SockAddr_t& Out)
+{
+#ifdef ODALPAPI_IPV6
+	if(In.sa.sa_family == AF_INET)
+	{
+		memset(&Out, 0, sizeof(Out));
+		Out.sin6_family = AF_INET6;
+		Out.sin6_port = In.sin.sin_port;
+		Out.sin6_addr.s6_addr[10] = 0xFF;
+		Out.sin6_addr.s6_addr[11] = 0xFF;
+		memcpy(&Out.sin6_addr.s6_addr[12], &In.sin.sin_addr, 4);
+
+		return;
+	}
+#endif
+
+	Out = In.any;
+}
+
+static uint16_t AddressPort(const SockAddr_t& Address)
+{
+#ifdef ODALPAPI_IPV6
+	return ntohs(Address.sin6_port);
+#else
+	return ntohs(Address.sin_port);
+#endif
+}
+
 BufferedSocket::BufferedSocket() :  m_BadRead(false), m_BadWrite(false),
-	m_Socket(0), m_SendPing(0), m_ReceivePing(0)
+	m_Socket(0), m_IPv6(false), m_SendPing(0), m_ReceivePing(0)
 {
 	m_Broadcast = false;
-	memset(&m_RemoteAddress, 0, sizeof(struct sockaddr_in));
+	m_ReceiveBufferSize = 0;
+	memset(&m_RemoteAddress, 0, sizeof(m_RemoteAddress));
 
 	m_SocketBuffer = new byte[MAX_PAYLOAD];
 
@@ -102,7 +165,29 @@ bool BufferedSocket::CreateSocket()
 {
 	DestroySocket();
 
-	m_Socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	m_IPv6 = false;
+
+#ifdef ODALPAPI_IPV6
+	// Prefer a dual-stack socket, broadcasts only exist in IPv4 though
+	if(!m_Broadcast)
+	{
+		m_Socket = socket(PF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+
+		if(m_Socket != INVALID_SOCKET)
+		{
+			int v6only = 0;
+
+			if(setsockopt(m_Socket, IPPROTO_IPV6, IPV6_V6ONLY, (char*)&v6only,
+			              sizeof(v6only)) == 0)
+				m_IPv6 = true;
+			else
+				closesocket(m_Socket);
+		}
+	}
+
+	if(!m_IPv6)
+#endif
+		m_Socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
 
 	if(m_Socket == INVALID_SOCKET)
 	{
@@ -111,6 +196,14 @@ bool BufferedSocket::CreateSocket()
 		return false;
 	}
 
+	if(m_ReceiveBufferSize > 0)
+	{
+		// Not fatal, the system default just drops more of a reply burst
+		if(setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF,
+		              (char*)&m_ReceiveBufferSize, sizeof(m_ReceiveBufferSize)) != 0)
+			NET_ReportError(REPERR_NO_ARGS);
+	}
+
 	if(m_Broadcast)
 	{
 		int optval = m_Broadcast ? 1 : 0;
@@ -129,13 +222,15 @@ bool BufferedSocket::CreateSocket()
 
 		// Need to bind to the local address otherwise it will not receive
 		// anything
-		m_LocalAddress.sin_family = PF_INET;
-		m_LocalAddress.sin_port = htons(11510);
-		m_LocalAddress.sin_addr.s_addr = htonl(INADDR_ANY);
-		memset(m_LocalAddress.sin_zero, '\0', sizeof m_LocalAddress.sin_zero);
+		struct sockaddr_in LocalAddress;
+
+		memset(&LocalAddress, 0, sizeof(LocalAddress));
+		LocalAddress.sin_family = PF_INET;
+		LocalAddress.sin_port = htons(11510);
+		LocalAddress.sin_addr.s_addr = htonl(INADDR_ANY);
 
-		result = ::bind(m_Socket, (sockaddr*)&m_LocalAddress,
-		              sizeof(m_LocalAddress));
+		result = ::bind(m_Socket, (sockaddr*)&LocalAddress,
+		              sizeof(LocalAddress));
 
 		if(result != 0)
 		{
@@ -152,6 +247,11 @@ void BufferedSocket::SetBroadcast(bool enabled)
 	m_Broadcast = enabled;
 }
 
+void BufferedSocket::SetReceiveBufferSize(int Size)
+{
+	m_ReceiveBufferSize = Size;
+}
+
 void BufferedSocket::DestroySocket()
 {
 	if(m_Socket != 0)
@@ -163,7 +263,8 @@ void BufferedSocket::DestroySocket()
 	}
 }
 
-void BufferedSocket::SetRemoteAddress(const string& Address, const uint16_t& Port)
+bool BufferedSocket::ResolveAddress(const string& Address, const uint16_t& Port,
+                                    SockAddr_t& Out)
 {
 #ifdef _XBOX
 	struct hostent *he;
@@ -171,65 +272,107 @@ void BufferedSocket::SetRemoteAddress(const string& Address, const uint16_t& Por
     if((he = gethostbyname((const char *)Address.c_str())) == NULL)
     {
 		NET_ReportError(REPERR_NO_ARGS);
-        return;
+        return false;
     }
 
-    m_RemoteAddress.sin_family = PF_INET;
-    m_RemoteAddress.sin_port = htons(Port);
-    m_RemoteAddress.sin_addr = *((struct in_addr *)he->h_addr);
-    memset(m_RemoteAddress.sin_zero, '\0', sizeof m_RemoteAddress.sin_zero);
+    Out.sin_family = PF_INET;
+    Out.sin_port = htons(Port);
+    Out.sin_addr = *((struct in_addr *)he->h_addr);
+    memset(Out.sin_zero, '\0', sizeof Out.sin_zero);
 #else
 	addrinfo  hints;
 	addrinfo* result = NULL;
 
 	memset(&hints, 0, sizeof(struct addrinfo));
 	hints.ai_flags = AI_ALL;
-	hints.ai_family = PF_INET;
+	hints.ai_family = PF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
 
 	if((getaddrinfo(Address.c_str(), NULL, &hints, &result)) != 0)
 	{
 		NET_ReportError(REPERR_NO_ARGS);
-		return;
+		return false;
 	}
 
-	m_RemoteAddress.sin_family = PF_INET;
-	m_RemoteAddress.sin_port = htons(Port);
-	m_RemoteAddress.sin_addr.s_addr = *((unsigned long*)&(((sockaddr_in*)result->ai_addr)->sin_addr));
-	memset(m_RemoteAddress.sin_zero, '\0', sizeof m_RemoteAddress.sin_zero);
+	NativeAddr_t Native;
+
+	memset(&Native, 0, sizeof(Native));
+	memcpy(&Native, result->ai_addr,
+	       std::min(sizeof(Native), (size_t)result->ai_addrlen));
 
 	freeaddrinfo(result);
+
+	FromNative(Native, Out);
+	Out.sin6_port = htons(Port);
 #endif
+
+	return true;
 }
 
-bool BufferedSocket::SetRemoteAddress(const string& Address)
+void BufferedSocket::SetRemoteAddress(const string& Address, const uint16_t& Port)
 {
-	size_t colon = Address.find(':');
+	ResolveAddress(Address, Port, m_RemoteAddress);
+}
 
-	if(colon == string::npos)
-		return false;
+bool BufferedSocket::SetRemoteAddress(const string& Address)
+{
+	string HostIP;
+	uint16_t Port = 0;
 
-	if(colon + 1 >= Address.length())
+	if(OdaAddrToComponents(Address, HostIP, Port) != 0 || !Port)
 		return false;
 
-	uint16_t Port = atoi(Address.substr(colon + 1).c_str());
-	string HostIP = Address.substr(0, colon);
-
 	SetRemoteAddress(HostIP, Port);
 
 	return true;
 }
 
+string BufferedSocket::FormatAddress(const SockAddr_t& Address)
+{
+#ifdef ODALPAPI_IPV6
+	if(IN6_IS_ADDR_V4MAPPED(&Address.sin6_addr))
+	{
+		struct in_addr v4;
+
+		memcpy(&v4, &Address.sin6_addr.s6_addr[12], sizeof(v4));
+
+		return inet_ntoa(v4);
+	}
+
+	char Host[NI_MAXHOST];
+
+	if(getnameinfo((const struct sockaddr*)&Address, sizeof(Address), Host,
+	               sizeof(Host), NULL, 0, NI_NUMERICHOST) != 0)
+		return "";
+
+	return Host;
+#else
+	return inet_ntoa(Address.sin_addr);
+#endif
+}
+
 void BufferedSocket::GetRemoteAddress(string& Address, uint16_t& Port) const
 {
-	Address = inet_ntoa(m_RemoteAddress.sin_addr);
-	Port = ntohs(m_RemoteAddress.sin_port);
+	Address = FormatAddress(m_RemoteAddress);
+	Port = AddressPort(m_RemoteAddress);
+}
+
+void BufferedSocket::GetRemoteAddress(SockAddr_t& Address) const
+{
+	Address = m_RemoteAddress;
 }
 
 string BufferedSocket::GetRemoteAddress() const
 {
 	ostringstream rmtAddr;
+	string Host = FormatAddress(m_RemoteAddress);
 
-	rmtAddr << inet_ntoa(m_RemoteAddress.sin_addr) << ":" << ntohs(m_RemoteAddress.sin_port);
+	if(Host.find(':') != string::npos)
+		rmtAddr << "[" << Host << "]";
+	else
+		rmtAddr << Host;
+
+	rmtAddr << ":" << AddressPort(m_RemoteAddress);
 
 	return rmtAddr.str();
 }
@@ -246,8 +389,14 @@ int32_t BufferedSocket::SendData(const int32_t& Timeout)
 	if(CreateSocket() == false)
 		return 0;
 
+	NativeAddr_t To;
+	socklen_t ToLen = ToNative(m_RemoteAddress, m_IPv6, To);
+
+	if(!ToLen)
+		return 0;
+
 	BytesSent = sendto(m_Socket, (const char*)m_SocketBuffer, m_BufferSize, 0,
-	                   (struct sockaddr*)&m_RemoteAddress, sizeof(m_RemoteAddress));
+	                   &To.sa, ToLen);
 
 	// set the start ping
 	m_SendPing = GetMillisNow();
@@ -261,6 +410,37 @@ int32_t BufferedSocket::SendData(const int32_t& Timeout)
 	return BytesSent;
 }
 
+int32_t BufferedSocket::SendTo(const SockAddr_t& Address)
+{
+	int32_t BytesSent;
+
+	m_BufferSize = m_BufferPos;
+
+	if(!m_BufferSize)
+		return 0;
+
+	if(m_Socket == 0 && CreateSocket() == false)
+		return 0;
+
+	NativeAddr_t To;
+	socklen_t ToLen = ToNative(Address, m_IPv6, To);
+
+	if(!ToLen)
+		return 0;
+
+	BytesSent = sendto(m_Socket, (const char*)m_SocketBuffer, m_BufferSize, 0,
+	                   &To.sa, ToLen);
+
+	m_SendPing = GetMillisNow();
+
+	if(BytesSent < 0)
+	{
+		NET_ReportError(REPERR_NO_ARGS);
+	}
+
+	return BytesSent;
+}
+
 int32_t BufferedSocket::GetData(const int32_t& Timeout)
 {
 	int32_t BytesReceived;
@@ -269,9 +449,10 @@ int32_t BufferedSocket::GetData(const int32_t& Timeout)
 	struct timeval   tv;
 	bool             DestroyMe = false;
 	socklen_t        fromlen;
+	NativeAddr_t     From;
 
-	// Wait for read with timeout
-	if(Timeout > 0)
+	// Wait for read with timeout, a timeout of 0 only polls
+	if(Timeout >= 0)
 	{
 		FD_ZERO(&readfds);
 		FD_SET(m_Socket, &readfds);
@@ -294,10 +475,10 @@ int32_t BufferedSocket::GetData(const int32_t& Timeout)
 		return -1;
 	}
 
-	fromlen = sizeof(m_RemoteAddress);
+	fromlen = sizeof(From);
 
 	BytesReceived = recvfrom(m_Socket, (char*)m_SocketBuffer, MAX_PAYLOAD, 0,
-	                         (struct sockaddr*)&m_RemoteAddress, &fromlen);
+	                         &From.sa, &fromlen);
 
 	// -1 = Error; 0 = Closed Connection
 	if(BytesReceived <= 0)
@@ -310,6 +491,8 @@ int32_t BufferedSocket::GetData(const int32_t& Timeout)
 		return -2;
 	}
 
+	FromNative(From, m_RemoteAddress);
+
 	m_BufferSize = BytesReceived;
 
 	// Reset buffers position
@@ -519,6 +702,19 @@ bool BufferedSocket::Read8(int8_t& Int8)
 	return true;
 }
 
+bool BufferedSocket::Peek32(const size_t& Offset, uint32_t& Uint32) const
+{
+	if(Offset + 4 > m_BufferSize)
+		return false;
+
+	Uint32 = m_SocketBuffer[Offset] +
+	         (m_SocketBuffer[Offset+1] << 8) +
+	         (m_SocketBuffer[Offset+2] << 16) +
+	         (m_SocketBuffer[Offset+3] << 24);
+
+	return true;
+}
+
 //
 // Unsigned reads
 //
@@ -59,6 +59,18 @@ namespace odalpapi
 typedef int SOCKET;
 #endif
 
+#ifndef _XBOX
+#define ODALPAPI_IPV6
+#endif
+
+// A remote address.  With IPv6 support IPv4 addresses are kept IPv4-mapped
+// (::ffff:a.b.c.d), so addresses of both families compare and hash alike.
+#ifdef ODALPAPI_IPV6
+typedef struct sockaddr_in6 SockAddr_t;
+#else
+typedef struct sockaddr_in SockAddr_t;
+#endif
+
 // Max packet size to send and receive, in bytes
 const size_t MAX_PAYLOAD = 8192;
 
@@ -79,19 +91,37 @@ public:
 	// Set network-wide broadcast ability
 	void SetBroadcast(bool enabled);
 
+	// Set the kernel receive buffer size, 0 leaves the system default
+	void SetReceiveBufferSize(int Size);
+
+	// Resolve a host name, dotted or IPv6 address into a socket address
+	static bool ResolveAddress(const std::string& Address, const uint16_t& Port,
+	                           SockAddr_t& Out);
+
+	// Numeric form of an address without the port, IPv4-mapped addresses
+	// come out dotted
+	static std::string FormatAddress(const SockAddr_t& Address);
+
 	// Set the outgoing address
 	void SetRemoteAddress(const std::string& Address, const uint16_t& Port);
-	// Set the outgoing address in "address:port" format
+	// Set the outgoing address in "address:port" or "[address]:port" format
 	bool SetRemoteAddress(const std::string& Address);
 	// Gets the outgoing address
 	void GetRemoteAddress(std::string& Address, uint16_t& Port) const;
-	// Gets the outgoing address in "address:port" format
+	// Gets the outgoing address in "address:port" format, IPv6 addresses are
+	// put in brackets
 	std::string GetRemoteAddress() const;
+	// Gets the outgoing address as a socket address
+	void GetRemoteAddress(SockAddr_t& Address) const;
 
 	// Send/receive data
 	int32_t SendData(const int32_t& Timeout);
 	int32_t GetData(const int32_t& Timeout);
 
+	// Send the buffer to an address, keeping the socket open between sends so
+	// replies to earlier packets can still be received
+	int32_t SendTo(const SockAddr_t& Address);
+
 	// a method for a round-trip time in milliseconds
 	uint64_t GetPing()
 	{
@@ -116,6 +146,9 @@ public:
 		return m_BadRead;
 	}
 
+	// Look at a value in the received data without moving the read position
+	bool Peek32(const size_t& Offset, uint32_t& Uint32) const;
+
 	// Write values
 	bool WriteString(const std::string&);
 	bool WriteBool(const bool&);
@@ -174,14 +207,16 @@ private:
 	// the socket
 	SOCKET  m_Socket;
 
+	// the socket is dual-stack, otherwise it only reaches IPv4 addresses
+	bool    m_IPv6;
+
 	// broadcast mode
 	bool m_Broadcast;
 
-	// local address
-	struct sockaddr_in m_LocalAddress;
+	int m_ReceiveBufferSize;
 
 	// outgoing address (server)
-	struct sockaddr_in m_RemoteAddress;
+	SockAddr_t m_RemoteAddress;
 
 	uint64_t m_SendPing, m_ReceivePing;
 };
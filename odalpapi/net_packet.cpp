@@ -27,8 +27,10 @@
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
 
 #include "net_packet.h"
+#include "net_query.h"
 #include "net_error.h"
 //#include "net_cvartable.h"
 
@@ -59,7 +61,7 @@ int32_t ServerBase::Query(int32_t Timeout)
 	// If we didn't get it the first time, try again
 	while(Retry)
 	{
-		Socket->Write32(challenge);
+		WriteChallenge(0);
 
 		if(!Socket->SendData(Timeout))
 			return 0;
@@ -102,11 +104,11 @@ ok:
    */
 int32_t MasterServer::Parse()
 {
-    ostringstream ipfmt;
     addr_t address = { "", 0, false };
 	uint32_t temp_response;
 	int16_t server_count;
-    uint8_t ip1, ip2, ip3, ip4;
+
+	m_LastReplyComplete = true;
 
 	// Make sure we have a valid response from the master server
 	Socket->Read32(temp_response);
@@ -131,24 +133,52 @@ int32_t MasterServer::Parse()
 	// Begin processing the list of server addresses that we have received
 	for(int16_t i = 0; i < server_count; i++)
 	{
+		SockAddr_t ip;
+		uint8_t bytes[16];
+		uint8_t length = 4;
+
+		// The IPv6 list gives the length of each address, 4 or 16 bytes
+		if(response == MASTER_RESPONSE_IPV6)
+			Socket->Read8(length);
+
+		if(length != 4 && length != 16)
+		{
+			Socket->ClearBuffer();
+
+			return 0;
+		}
+
         // Get the IP address and port number from the receive buffer
-		Socket->Read8(ip1);
-		Socket->Read8(ip2);
-		Socket->Read8(ip3);
-		Socket->Read8(ip4);
+		for(uint8_t j = 0; j < length; j++)
+			Socket->Read8(bytes[j]);
+
 		Socket->Read16(address.port);
 
-		// Format the IP address into dot notation and copy it into the address
-		// structure
-		ipfmt << (int)ip1 << "." << (int)ip2 << "." << (int)ip3 << "." << (int)ip4;
-		address.ip = ipfmt.str();
+		memset(&ip, 0, sizeof(ip));
 
-		// Finally add the server address to the list and clear out the string 
-		// stream object for further use in the next iteration
-        AddServer(address);
+#ifdef ODALPAPI_IPV6
+		ip.sin6_family = AF_INET6;
+
+		if(length == 4)
+		{
+			ip.sin6_addr.s6_addr[10] = 0xFF;
+			ip.sin6_addr.s6_addr[11] = 0xFF;
+		}
 
-		ipfmt.str("");
-		ipfmt.clear();
+		memcpy(&ip.sin6_addr.s6_addr[16 - length], bytes, length);
+#else
+		// No way to reach an IPv6 server
+		if(length != 4)
+			continue;
+
+		ip.sin_family = AF_INET;
+		memcpy(&ip.sin_addr, bytes, 4);
+#endif
+
+		// Finally add the server address to the list
+		address.ip = BufferedSocket::FormatAddress(ip);
+
+        AddServer(address);
 	}
 
 	// Check previous reading operations that may have failed
@@ -159,11 +189,94 @@ int32_t MasterServer::Parse()
 		return 0;
 	}
 
+	// Large lists are split over several packets, each ending with its index
+	// and the packet total.  Older masters send everything in one packet.
+	if(Socket->CanRead(2))
+	{
+		uint8_t part, total;
+
+		Socket->Read8(part);
+		Socket->Read8(total);
+
+		if(total > 1 && part < total)
+		{
+			std::vector<bool> &parts = m_ReplyParts[Socket->GetRemoteAddress()];
+
+			parts.resize(total, false);
+			parts[part] = true;
+
+			for(size_t i = 0; i < parts.size(); ++i)
+			{
+				if(!parts[i])
+				{
+					m_LastReplyComplete = false;
+					break;
+				}
+			}
+		}
+	}
+
 	Socket->ClearBuffer();
 
 	return 1;
 }
 
+void MasterServer::QueryMasters(const uint32_t& Timeout, const bool& Broadcast,
+                                const int8_t& Retries)
+{
+	QueryEngine Engine;
+
+	DeleteServers();
+
+	m_ReplyParts.clear();
+
+	m_RetryCount = Retries;
+
+	if(Broadcast)
+		QueryBC(Timeout);
+
+	// All masters are asked at once, so a dead one only costs its timeout
+	Engine.SetTimeout(Timeout);
+
+#ifdef ODALPAPI_IPV6
+	// Ask for the list with IPv6 servers in it first.  Older masters ignore
+	// that request, so only give them one try before falling back.
+	challenge = MASTER_CHALLENGE_IPV6;
+	response = MASTER_RESPONSE_IPV6;
+	m_RetryCount = 1;
+
+	for(size_t i = 0; i < masteraddresses.size(); ++i)
+		Engine.Add(this, masteraddresses[i].ip, masteraddresses[i].port, i);
+
+	Engine.Run();
+
+	QueryEngine Fallback;
+	QueryEngine::Result_t Result;
+
+	Fallback.SetTimeout(Timeout);
+
+	challenge = MASTER_CHALLENGE;
+	response = MASTER_RESPONSE;
+	m_RetryCount = Retries;
+
+	while(Engine.GetResult(Result))
+	{
+		if(Result.Result)
+			continue;
+
+		Fallback.Add(this, masteraddresses[Result.Id].ip,
+		             masteraddresses[Result.Id].port, Result.Id);
+	}
+
+	Fallback.Run();
+#else
+	for(size_t i = 0; i < masteraddresses.size(); ++i)
+		Engine.Add(this, masteraddresses[i].ip, masteraddresses[i].port);
+
+	Engine.Run();
+#endif
+}
+
 // Server constructor
 Server::Server()
 {
@@ -606,6 +719,27 @@ int32_t Server::Parse()
 	return 0;
 }
 
+void Server::WriteChallenge(const uint32_t& Tag)
+{
+	Socket->Write32(challenge);
+	Socket->Write32(VERSION);
+	Socket->Write32(PROTOCOL_VERSION);
+	// bond - time
+	// The server echoes this back, so it doubles as a query tag
+	Socket->Write32(Tag);
+}
+
+bool Server::IsResponse(const uint32_t& Tag) const
+{
+	uint32_t Response, Time;
+
+	if(!Socket->Peek32(0, Response) || ((Response >> 20) & 0x0FFF) != TAG_ID)
+		return false;
+
+	// Tag, version and protocol come before the echoed time
+	return Socket->Peek32(12, Time) && Time == Tag;
+}
+
 int32_t Server::Query(int32_t Timeout)
 {
 	int8_t Retry = m_RetryCount;
@@ -622,11 +756,7 @@ int32_t Server::Query(int32_t Timeout)
 	// If we didn't get it the first time, try again
 	while(Retry)
 	{
-		Socket->Write32(challenge);
-		Socket->Write32(VERSION);
-		Socket->Write32(PROTOCOL_VERSION);
-		// bond - time
-		Socket->Write32(Info.PTime);
+		WriteChallenge(Info.PTime);
 
 		if(!Socket->SendData(Timeout))
 			return 0;
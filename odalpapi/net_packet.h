@@ -32,6 +32,7 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <map>
 
 // todo: replace with a generic implementation
 #if 0
@@ -40,6 +41,7 @@
 #endif
 
 #include "net_io.h"
+#include "net_utils.h"
 #include "typedefs.h"
 #include "threads/mutex_factory.h"
 
@@ -66,7 +68,7 @@
 #define VERSIONMINOR(V) ((V % 256) / 10)
 #define VERSIONPATCH(V) ((V % 256) % 10)
 
-#define VERSION (MAKEVER(0, 9, 3))
+#define VERSION (MAKEVER(0, 9, 4))
 #define PROTOCOL_VERSION 8
 
 #define TAG_ID 0xAD0
@@ -82,6 +84,9 @@ namespace odalpapi
 
 const uint32_t MASTER_CHALLENGE = 777123;
 const uint32_t MASTER_RESPONSE  = 777123;
+// Server list including IPv6 servers, older masters do not answer it
+const uint32_t MASTER_CHALLENGE_IPV6 = 777124;
+const uint32_t MASTER_RESPONSE_IPV6  = 777124;
 const uint32_t SERVER_CHALLENGE = 0xAD011002;
 const uint32_t SERVER_VERSION_CHALLENGE = 0xAD011001;
 
@@ -202,6 +207,9 @@ protected:
 	uint8_t m_RetryCount;
 
 	threads::Mutex* m_Mutex;
+
+	// The query engine keeps its own timing and retry count per query
+	friend class QueryEngine;
 public:
 	// Constructor
 	ServerBase()
@@ -233,6 +241,33 @@ public:
 		return -1;
 	}
 
+	// Write the query packet, Tag is echoed back by servers that support it
+	virtual void WriteChallenge(const uint32_t& /*Tag*/)
+	{
+		Socket->Write32(challenge);
+	}
+
+	// Check whether the received packet answers a query sent with Tag
+	virtual bool IsResponse(const uint32_t& /*Tag*/) const
+	{
+		uint32_t Value;
+
+		return Socket->Peek32(0, Value) && Value == response;
+	}
+
+	// False when the last parsed packet was one part of a reply that has more
+	// parts still to come
+	virtual bool IsComplete() const
+	{
+		return true;
+	}
+
+	// Forget data from a previous query
+	virtual void ResetData()
+	{
+
+	}
+
 	// Query the server
 	int32_t Query(int32_t Timeout);
 
@@ -251,7 +286,11 @@ public:
 	{
 		std::ostringstream Address;
 
-		Address << m_Address << ":" << m_Port;
+		// IPv6 addresses go in brackets to keep the port apart
+		if(m_Address.find(':') != std::string::npos)
+			Address << "[" << m_Address << "]:" << m_Port;
+		else
+			Address << m_Address << ":" << m_Port;
 
 		return Address.str();
 	}
@@ -290,23 +329,21 @@ private:
 	std::vector<addr_t> addresses;
 	std::vector<addr_t> masteraddresses;
 
+	// Parts of a split reply received so far, by master address
+	std::map<std::string, std::vector<bool> > m_ReplyParts;
+	bool m_LastReplyComplete;
+
 	void QueryBC(const uint32_t& Timeout);
 
 	// Translates a string address to an addr_t structure
 	// Only modifies ip and port
 	bool StrAddrToAddrT(const std::string &In, addr_t &Out)
 	{
-		size_t colon = In.find(':');
+		Out.port = 0;
 
-		if(colon == std::string::npos)
+		if(OdaAddrToComponents(In, Out.ip, Out.port) != 0 || !Out.port)
 			return false;
 
-		if(colon + 1 >= In.length())
-			return false;
-
-		Out.port = atoi(In.substr(colon + 1).c_str());
-		Out.ip = In.substr(0, colon);
-		
 		return true;
 	}
 public:
@@ -314,6 +351,7 @@ public:
 	{
 		challenge = MASTER_CHALLENGE;
 		response = MASTER_CHALLENGE;
+		m_LastReplyComplete = true;
 	}
 
 	virtual ~MasterServer()
@@ -362,23 +400,7 @@ public:
 	}
 
 	void QueryMasters(const uint32_t& Timeout, const bool& Broadcast,
-	                  const int8_t& Retries)
-	{
-		DeleteServers();
-
-		m_RetryCount = Retries;
-
-		if(Broadcast)
-			QueryBC(Timeout);
-
-		for(size_t i = 0; i < masteraddresses.size(); ++i)
-		{
-			m_Address = masteraddresses[i].ip;
-			m_Port = masteraddresses[i].port;
-
-			Query(Timeout);
-		}
-	}
+	                  const int8_t& Retries);
 
 	size_t GetMasterCount()
 	{
@@ -474,6 +496,11 @@ public:
 	}
 
 	int32_t Parse();
+
+	bool IsComplete() const
+	{
+		return m_LastReplyComplete;
+	}
 };
 
 class Server : public ServerBase  // [Russell] - A single server
@@ -503,6 +530,10 @@ public:
 
 	int32_t Parse();
 
+	void WriteChallenge(const uint32_t& Tag);
+
+	bool IsResponse(const uint32_t& Tag) const;
+
 protected:
 	bool ReadCvars();
 
@@ -0,0 +1,363 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Asynchronous query engine
+//
+//-----------------------------------------------------------------------------
+
+#include "net_query.h"
+
+#include <cstring>
+
+#include "net_utils.h"
+#include "net_error.h"
+
+using namespace std;
+
+namespace odalpapi
+{
+
+// Challenges sent between checks for replies, keeps a large refresh from
+// filling the receive buffer before we start reading it
+const size_t QUERY_SEND_BURST = 32;
+
+// Room for the replies to a full refresh arriving at once
+const int QUERY_RECEIVE_BUFFER = 256 * 1024;
+
+QueryEngine::QueryEngine() : m_SocketOpen(false), m_Callback(NULL),
+	m_UserData(NULL), m_Timeout(500), m_Pending(0)
+{
+	// Start somewhere unpredictable so late replies to a previous refresh
+	// do not match this one
+	m_NextTag = (uint32_t)GetMillisNow() | 1;
+
+	m_Socket.SetReceiveBufferSize(QUERY_RECEIVE_BUFFER);
+}
+
+QueryEngine::~QueryEngine()
+{
+
+}
+
+void QueryEngine::SetTimeout(const uint32_t& Timeout)
+{
+	m_Timeout = Timeout ? Timeout : 1;
+}
+
+void QueryEngine::SetCallback(Callback Func, void* UserData)
+{
+	m_Callback = Func;
+	m_UserData = UserData;
+}
+
+// A reply is only taken by a query whose tag it carries, so two addresses
+// sharing a key just cost an extra check
+uint64_t QueryEngine::AddressKey(const SockAddr_t& Address)
+{
+#ifdef ODALPAPI_IPV6
+	// FNV-1a over the address and port
+	const unsigned char* Bytes = Address.sin6_addr.s6_addr;
+	uint64_t Key = 14695981039346656037ULL;
+
+	for(size_t i = 0; i < sizeof(Address.sin6_addr); ++i)
+		Key = (Key ^ Bytes[i]) * 1099511628211ULL;
+
+	return (Key << 16) ^ ntohs(Address.sin6_port);
+#else
+	return ((uint64_t)ntohl(Address.sin_addr.s_addr) << 16) |
+	       ntohs(Address.sin_port);
+#endif
+}
+
+void QueryEngine::Add(ServerBase* Query, const int32_t& Id)
+{
+	string Address;
+	uint16_t Port;
+
+	Query->GetAddress(Address, Port);
+
+	Add(Query, Address, Port, Id);
+}
+
+void QueryEngine::Add(ServerBase* Query, const string& Address,
+                      const uint16_t& Port, const int32_t& Id)
+{
+	Entry_t Entry;
+
+	Entry.Query = Query;
+	Entry.SendTime = 0;
+	Entry.Tag = m_NextTag++;
+	Entry.Generation = 0;
+	Entry.Id = Id;
+	Entry.Retries = Query->m_RetryCount > 0 ? Query->m_RetryCount : 1;
+	Entry.Parsed = false;
+	Entry.Done = false;
+
+	memset(&Entry.Address, 0, sizeof(Entry.Address));
+
+	size_t Index = m_Entries.size();
+
+	m_Entries.push_back(Entry);
+	++m_Pending;
+
+	if(Address.empty() || !Port ||
+	        !BufferedSocket::ResolveAddress(Address, Port, m_Entries[Index].Address))
+	{
+		Finish(Index, 0);
+		return;
+	}
+
+	m_Index.insert(make_pair(AddressKey(m_Entries[Index].Address), Index));
+	m_SendQueue.push_back(Index);
+}
+
+void QueryEngine::StartTimer(const size_t& Index, const uint64_t& Due)
+{
+	Timer_t Timer;
+
+	Timer.Due = Due;
+	Timer.Entry = Index;
+	Timer.Generation = ++m_Entries[Index].Generation;
+
+	m_Timers.push(Timer);
+}
+
+void QueryEngine::Send(const size_t& Index)
+{
+	Entry_t& Entry = m_Entries[Index];
+
+	if(Entry.Done)
+		return;
+
+	Entry.Query->GetLock();
+
+	// Only clear out old data once, a retry may follow a partial reply
+	if(Entry.Generation == 0)
+		Entry.Query->ResetData();
+
+	Entry.Query->SetSocket(&m_Socket);
+
+	m_Socket.ClearBuffer();
+	Entry.Query->WriteChallenge(Entry.Tag);
+
+	int32_t BytesSent = m_Socket.SendTo(Entry.Address);
+
+	Entry.Query->Unlock();
+
+	// No socket to send from, there is nothing to wait for
+	if(BytesSent == 0)
+	{
+		Finish(Index, 0);
+		return;
+	}
+
+	m_SocketOpen = true;
+
+	Entry.SendTime = GetMillisNow();
+	--Entry.Retries;
+
+	StartTimer(Index, Entry.SendTime + m_Timeout);
+}
+
+void QueryEngine::Receive()
+{
+	SockAddr_t From;
+	pair<multimap<uint64_t, size_t>::iterator,
+	     multimap<uint64_t, size_t>::iterator> Range;
+
+	m_Socket.GetRemoteAddress(From);
+
+	Range = m_Index.equal_range(AddressKey(From));
+
+	for(multimap<uint64_t, size_t>::iterator it = Range.first;
+	        it != Range.second; ++it)
+	{
+		size_t Index = it->second;
+		Entry_t& Entry = m_Entries[Index];
+
+		if(Entry.Done)
+			continue;
+
+		Entry.Query->GetLock();
+
+		Entry.Query->SetSocket(&m_Socket);
+
+		if(!Entry.Query->IsResponse(Entry.Tag))
+		{
+			Entry.Query->Unlock();
+			continue;
+		}
+
+		int32_t Result = Entry.Query->Parse();
+		bool Complete = Entry.Query->IsComplete();
+
+		if(Result)
+		{
+			Entry.Query->Ping = GetMillisNow() - Entry.SendTime;
+			Entry.Parsed = true;
+		}
+
+		Entry.Query->Unlock();
+
+		if(!Result)
+			Finish(Index, 0);
+		else if(Complete)
+			Finish(Index, 1);
+		else
+		{
+			// More parts to come, give them the full timeout again
+			StartTimer(Index, GetMillisNow() + m_Timeout);
+		}
+
+		return;
+	}
+
+	// Nobody asked for this one
+	m_Socket.ClearBuffer();
+}
+
+void QueryEngine::Expire(const uint64_t& Now)
+{
+	while(!m_Timers.empty() && m_Timers.top().Due <= Now)
+	{
+		Timer_t Timer = m_Timers.top();
+		m_Timers.pop();
+
+		Entry_t& Entry = m_Entries[Timer.Entry];
+
+		if(Entry.Done || Timer.Generation != Entry.Generation)
+			continue;
+
+		if(Entry.Retries > 0)
+			m_SendQueue.push_back(Timer.Entry);
+		else
+			Finish(Timer.Entry, Entry.Parsed ? 1 : 0);
+	}
+}
+
+void QueryEngine::Finish(const size_t& Index, const int32_t& Result)
+{
+	Entry_t& Entry = m_Entries[Index];
+
+	Entry.Done = true;
+	--m_Pending;
+
+	if(m_Callback)
+	{
+		m_Callback(Entry.Query, Entry.Id, Result, m_UserData);
+		return;
+	}
+
+	Result_t Finished;
+
+	Finished.Query = Entry.Query;
+	Finished.Id = Entry.Id;
+	Finished.Result = Result;
+
+	m_Results.push(Finished);
+}
+
+size_t QueryEngine::Poll(const uint32_t& Wait)
+{
+	size_t Sent = 0;
+
+	while(!m_SendQueue.empty() && Sent < QUERY_SEND_BURST)
+	{
+		Send(m_SendQueue.front());
+		m_SendQueue.pop_front();
+		++Sent;
+	}
+
+	if(!m_Pending)
+		return 0;
+
+	uint64_t Now = GetMillisNow();
+
+	// Drop finished timers off the top so they do not cut the wait short
+	while(!m_Timers.empty())
+	{
+		const Timer_t& Timer = m_Timers.top();
+		const Entry_t& Entry = m_Entries[Timer.Entry];
+
+		if(!Entry.Done && Timer.Generation == Entry.Generation)
+			break;
+
+		m_Timers.pop();
+	}
+
+	int32_t Timeout = Wait;
+
+	if(!m_SendQueue.empty())
+		Timeout = 0;
+	else if(!m_Timers.empty())
+	{
+		if(m_Timers.top().Due <= Now)
+			Timeout = 0;
+		else if(m_Timers.top().Due - Now < Wait)
+			Timeout = (int32_t)(m_Timers.top().Due - Now);
+	}
+
+	if(m_SocketOpen)
+	{
+		int32_t Received = m_Socket.GetData(Timeout);
+
+		// Drain everything that has arrived before looking at the timers
+		while(Received != -1)
+		{
+			if(Received > 0)
+				Receive();
+
+			Received = m_Socket.GetData(0);
+		}
+	}
+
+	Expire(GetMillisNow());
+
+	return m_Pending;
+}
+
+void QueryEngine::Run()
+{
+	while(Poll(100))
+		;
+}
+
+void QueryEngine::Cancel()
+{
+	m_Entries.clear();
+	m_Index.clear();
+	m_SendQueue.clear();
+
+	while(!m_Timers.empty())
+		m_Timers.pop();
+
+	m_Pending = 0;
+}
+
+bool QueryEngine::GetResult(Result_t& Result)
+{
+	if(m_Results.empty())
+		return false;
+
+	Result = m_Results.front();
+	m_Results.pop();
+
+	return true;
+}
+
+} // namespace
@@ -0,0 +1,153 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Asynchronous query engine
+//
+//  Sends the challenges for any number of queries from a single socket and
+//  matches the replies back to their queries by address and tag, so a full
+//  refresh takes about one round trip plus the timeout instead of needing a
+//  socket and a thread per server in flight.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef NET_QUERY_H
+#define NET_QUERY_H
+
+#include <deque>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "net_io.h"
+#include "net_packet.h"
+#include "typedefs.h"
+
+/**
+ * odalpapi namespace.
+ *
+ * All code for the odamex launcher api is contained within the odalpapi
+ * namespace.
+ */
+namespace odalpapi
+{
+
+class QueryEngine
+{
+public:
+	// Called from Poll() as each query finishes, Result is 1 on success and 0
+	// on failure or timeout, the same as ServerBase::Query()
+	typedef void (*Callback)(ServerBase* Query, int32_t Id, int32_t Result,
+	                         void* UserData);
+
+	// A finished query, returned by GetResult() when there is no callback
+	struct Result_t
+	{
+		ServerBase* Query;
+		int32_t     Id;
+		int32_t     Result;
+	};
+
+	QueryEngine();
+	~QueryEngine();
+
+	// Time to wait for a reply before retrying, in milliseconds
+	void SetTimeout(const uint32_t& Timeout);
+
+	void SetCallback(Callback Func, void* UserData);
+
+	// Queue a query to the address set on it, or to the given address.  The
+	// query object must outlive the engine or the call to Cancel(), and Id is
+	// handed back with the result.
+	void Add(ServerBase* Query, const int32_t& Id = -1);
+	void Add(ServerBase* Query, const std::string& Address,
+	         const uint16_t& Port, const int32_t& Id = -1);
+
+	// Send what is due, wait up to Wait milliseconds for replies and expire
+	// queries that ran out of time, returns the number still pending
+	size_t Poll(const uint32_t& Wait);
+
+	// Poll until every query has finished
+	void Run();
+
+	// Drop every pending query without reporting them
+	void Cancel();
+
+	size_t GetPending() const
+	{
+		return m_Pending;
+	}
+
+	bool GetResult(Result_t& Result);
+
+private:
+	struct Entry_t
+	{
+		ServerBase*        Query;
+		SockAddr_t         Address;
+		uint64_t           SendTime;
+		uint32_t           Tag;
+		uint32_t           Generation;
+		int32_t            Id;
+		int8_t             Retries;
+		bool               Parsed;
+		bool               Done;
+	};
+
+	// Timers are never removed from the heap, a timer whose generation no
+	// longer matches its entry is skipped when it comes up
+	struct Timer_t
+	{
+		uint64_t Due;
+		size_t   Entry;
+		uint32_t Generation;
+
+		bool operator<(const Timer_t& Other) const
+		{
+			return Due > Other.Due;
+		}
+	};
+
+	void Send(const size_t& Index);
+	void Receive();
+	void Expire(const uint64_t& Now);
+	void Finish(const size_t& Index, const int32_t& Result);
+	void StartTimer(const size_t& Index, const uint64_t& Due);
+
+	static uint64_t AddressKey(const SockAddr_t& Address);
+
+	BufferedSocket m_Socket;
+	bool           m_SocketOpen;
+
+	std::vector<Entry_t>             m_Entries;
+	std::multimap<uint64_t, size_t>  m_Index;
+	std::priority_queue<Timer_t>     m_Timers;
+	std::deque<size_t>               m_SendQueue;
+	std::queue<Result_t>             m_Results;
+
+	Callback m_Callback;
+	void*    m_UserData;
+
+	uint32_t m_Timeout;
+	uint32_t m_NextTag;
+	size_t   m_Pending;
+};
+
+} // namespace
+
+#endif // NET_QUERY_H
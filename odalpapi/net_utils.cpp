@@ -111,8 +111,32 @@ int32_t OdaAddrToComponents(const std::string& HostPort, std::string &AddrOut,
 
 	if (HostPort.empty())
         return 1;
-	
-	colon = HostPort.find(':');
+
+	// IPv6 addresses need brackets to be given a port, [::1]:10666
+	if (HostPort[0] == '[')
+	{
+		size_t end = HostPort.find(']');
+
+		if (end == std::string::npos)
+			return 2;
+
+		if (end + 1 < HostPort.length() && HostPort[end + 1] != ':')
+			return 2;
+
+		AddrOut = HostPort.substr(1, end - 1);
+		colon = end + 1 < HostPort.length() ? end + 1 : std::string::npos;
+	}
+	else
+	{
+		colon = HostPort.find(':');
+
+		// More than one colon is a bare IPv6 address, without a port
+		if (colon != std::string::npos &&
+		    HostPort.find(':', colon + 1) != std::string::npos)
+			colon = std::string::npos;
+
+		AddrOut = HostPort.substr(0, colon);
+	}
 
 	if(colon != std::string::npos)
     {
@@ -131,14 +155,6 @@ int32_t OdaAddrToComponents(const std::string& HostPort, std::string &AddrOut,
             return 3;
         }
     }
-    else
-    {
-        AddrOut = HostPort;
-        
-        return 0;
-    }
-    
-	AddrOut = HostPort.substr(0, colon);
 
 	return 0;
 }
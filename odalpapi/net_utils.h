@@ -42,6 +42,10 @@ namespace odalpapi
 {
 
 uint64_t GetMillisNow();
+// Splits "host:port", "[ipv6]:port" or a bare host or IPv6 address, PortOut
+// is left alone when there is no port.  Returns 0 when the address is good,
+// 1 when it is empty, 2 when the port is missing after a colon and 3 when it
+// could not be read.
 int32_t OdaAddrToComponents(const std::string& HostPort, std::string &AddrOut, 
                             uint16_t &PortOut);
 } // namespace
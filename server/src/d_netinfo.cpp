@@ -59,8 +59,7 @@ int D_GenderToInt (const char *gender)
 
 bool SetServerVar (const char *name, const char *value)
 {
-	cvar_t *dummy;
-	cvar_t *var = cvar_t::FindCVar (name, &dummy);
+	cvar_t *var = cvar_t::FindCVar (name);
 
 	if (var)
 	{
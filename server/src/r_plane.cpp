@@ -22,6 +22,7 @@
 //-----------------------------------------------------------------------------
 
 #include "r_local.h"
+#include "p_spec.h"
 
 BOOL R_AlignFlat (int linenum, int side, int fc)
 {
@@ -49,13 +50,13 @@ BOOL R_AlignFlat (int linenum, int side, int fc)
 	{
 		sec->base_ceiling_angle = 0-angle;
 		sec->base_ceiling_yoffs = dist & ((1<<(FRACBITS+8))-1);
-		sec->SectorChanges |= SPC_AlignBase;
+		P_SectorChanged(sec, SPC_AlignBase);
 	}
 	else
 	{
 		sec->base_floor_angle = 0-angle;
 		sec->base_floor_yoffs = dist & ((1<<(FRACBITS+8))-1);
-		sec->SectorChanges |= SPC_AlignBase;
+		P_SectorChanged(sec, SPC_AlignBase);
 	}
 
 	return true;
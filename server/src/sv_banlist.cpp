@@ -21,6 +21,8 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <algorithm>
+#include <functional>
 #include <sstream>
 #include <string>
 
@@ -45,22 +47,55 @@ Banlist banlist;
 
 //// IPRange ////
 
-// Constructor
-IPRange::IPRange()
+// The first 96 bits of an IPv4-mapped key.
+static const byte v4mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+
+// Number of leading bits a and b have in common, up to maxbits.
+static int IPRange_CommonBits(const byte *a, const byte *b, int maxbits)
 {
-	for (byte i = 0; i < 4; i++)
+	for (int i = 0; i * 8 < maxbits; i++)
 	{
-		this->ip[i] = (byte)0;
-		this->mask[i] = false;
+		byte diff = a[i] ^ b[i];
+		if (diff == 0)
+			continue;
+
+		int bits = i * 8;
+		while (!(diff & 0x80))
+		{
+			diff <<= 1;
+			bits++;
+		}
+		return MIN(bits, maxbits);
 	}
+
+	return maxbits;
 }
 
-// Check a given address against the ip + range in the object.
-bool IPRange::check(const netadr_t &address)
+static inline int IPRange_KeyBit(const byte *key, int bit)
 {
-	for (byte i = 0; i < 4; i++)
+	return (key[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+// Constructor
+IPRange::IPRange()
+{
+	memcpy(this->ip, v4mapped, sizeof(v4mapped));
+	memset(this->ip + sizeof(v4mapped), 0, IPRANGE_KEYBYTES - sizeof(v4mapped));
+	memset(this->mask, 0xFF, IPRANGE_KEYBYTES);
+}
+
+// Turn an address into a range key.
+void IPRange::key(const netadr_t &address, byte *key)
+{
+	memcpy(key, address.ip, IPRANGE_KEYBYTES);
+}
+
+// Check a given key against the ip + range in the object.
+bool IPRange::check(const byte *key) const
+{
+	for (size_t i = 0; i < IPRANGE_KEYBYTES; i++)
 	{
-		if (!(this->ip[i] == address.ip[i] || this->mask[i] == true))
+		if ((key[i] ^ this->ip[i]) & this->mask[i])
 		{
 			return false;
 		}
@@ -69,57 +104,92 @@ bool IPRange::check(const netadr_t &address)
 	return true;
 }
 
-// Check a given string address against the ip + range in the object.
-bool IPRange::check(const std::string &address)
+// Check a given address against the ip + range in the object.
+bool IPRange::check(const netadr_t &address) const
 {
-	StringTokens tokens = TokenizeString(address, ".");
+	byte addrkey[IPRANGE_KEYBYTES];
+	IPRange::key(address, addrkey);
+	return this->check(addrkey);
+}
 
-	// An IP address contains 4 octets
-	if (tokens.size() != 4)
+// Check a given string address against the ip + range in the object.  Any
+// part of the address the string leaves open is taken to match.
+bool IPRange::check(const std::string &address) const
+{
+	IPRange query;
+	if (!query.set(address))
 	{
 		return false;
 	}
 
-	for (byte i = 0; i < 4; i++)
+	byte addrkey[IPRANGE_KEYBYTES];
+	for (size_t i = 0; i < IPRANGE_KEYBYTES; i++)
 	{
-		// * means that octet is masked and we will accept any byte
-		if (tokens[i].compare("*") == 0)
+		addrkey[i] = (query.ip[i] & query.mask[i]) |
+		             (this->ip[i] & ~query.mask[i]);
+	}
+
+	return this->check(addrkey);
+}
+
+// Set the object's range to a specific address.
+void IPRange::set(const netadr_t &address)
+{
+	IPRange::key(address, this->ip);
+	memset(this->mask, 0xFF, IPRANGE_KEYBYTES);
+}
+
+// Set the object's range against the given address in string form.  Takes
+// either an address with stars for masked octets (10.0.*.*) or CIDR notation
+// (10.0.0.0/16, 2001:db8::/32).
+bool IPRange::set(const std::string &input)
+{
+	std::string address = input;
+	int bits = -1;
+
+	size_t slash = input.find('/');
+	if (slash != std::string::npos)
+	{
+		std::string length = input.substr(slash + 1);
+		if (length.empty() || length.find_first_not_of("0123456789") != std::string::npos)
 		{
-			continue;
+			return false;
 		}
 
-		// Convert string into byte.
-		unsigned short octet = 0;
-		std::istringstream buffer(tokens[i]);
-		buffer >> octet;
-		if (!buffer)
+		bits = atoi(length.c_str());
+		address = input.substr(0, slash);
+	}
+
+	// IPv6 addresses have no star syntax, only a prefix length.
+	if (address.find(':') != std::string::npos)
+	{
+		byte newip[IPRANGE_KEYBYTES];
+		if (bits > IPRANGE_KEYBITS || !NET_StringToIP(address.c_str(), newip))
 		{
 			return false;
 		}
 
-		if (!(this->ip[i] == octet || this->mask[i] == true))
+		if (bits < 0)
 		{
-			return false;
+			bits = IPRANGE_KEYBITS;
 		}
-	}
 
-	return true;
-}
+		for (int i = 0; i < IPRANGE_KEYBYTES; i++)
+		{
+			const int byte_bits = clamp(bits - i * 8, 0, 8);
+			this->mask[i] = (byte)(0xFF00 >> byte_bits);
+			this->ip[i] = newip[i] & this->mask[i];
+		}
 
-// Set the object's range to a specific address.
-void IPRange::set(const netadr_t &address)
-{
-	for (byte i = 0; i < 4; i++)
+		return true;
+	}
+
+	if (bits > 32)
 	{
-		this->ip[i] = address.ip[i];
-		this->mask[i] = false;
+		return false;
 	}
-}
 
-// Set the object's range against the given address in string form.
-bool IPRange::set(const std::string &input)
-{
-	StringTokens tokens = TokenizeString(input, ".");
+	StringTokens tokens = TokenizeString(address, ".");
 
 	// An IP address contains 4 octets
 	if (tokens.size() != 4)
@@ -127,45 +197,129 @@ bool IPRange::set(const std::string &input)
 		return false;
 	}
 
+	byte newip[IPRANGE_KEYBYTES];
+	byte newmask[IPRANGE_KEYBYTES];
+	memcpy(newip, v4mapped, sizeof(v4mapped));
+	memset(newmask, 0xFF, sizeof(v4mapped));
+
 	for (byte i = 0; i < 4; i++)
 	{
+		const size_t octet_pos = sizeof(v4mapped) + i;
+
 		// * means that octet is masked
 		if (tokens[i].compare("*") == 0)
 		{
-			this->mask[i] = true;
+			// Don't mix stars and a prefix length.
+			if (bits >= 0)
+			{
+				return false;
+			}
+
+			newip[octet_pos] = 0;
+			newmask[octet_pos] = 0;
 			continue;
 		}
-		this->mask[i] = false;
 
 		// Convert string into byte.
 		unsigned short octet = 0;
 		std::istringstream buffer(tokens[i]);
 		buffer >> octet;
-		if (!buffer)
+		if (!buffer || octet > 255)
 		{
 			return false;
 		}
 
-		this->ip[i] = (byte)octet;
+		newip[octet_pos] = (byte)octet;
+		newmask[octet_pos] = 0xFF;
+	}
+
+	if (bits >= 0)
+	{
+		for (byte i = 0; i < 4; i++)
+		{
+			const int octet_bits = clamp(bits - i * 8, 0, 8);
+			newmask[sizeof(v4mapped) + i] = (byte)(0xFF00 >> octet_bits);
+		}
+	}
+
+	for (size_t i = 0; i < IPRANGE_KEYBYTES; i++)
+	{
+		this->ip[i] = newip[i] & newmask[i];
+		this->mask[i] = newmask[i];
 	}
 
 	return true;
 }
 
-// Return the range as a string, with stars representing masked octets.
-std::string IPRange::string()
+// Return the length of the range's prefix in bits, or -1 if the range has
+// masked octets in the middle and is not a prefix at all.
+int IPRange::prefix() const
+{
+	int bits = 0;
+	while (bits < IPRANGE_KEYBITS && IPRange_KeyBit(this->mask, bits))
+	{
+		bits++;
+	}
+
+	for (int i = bits; i < IPRANGE_KEYBITS; i++)
+	{
+		if (IPRange_KeyBit(this->mask, i))
+		{
+			return -1;
+		}
+	}
+
+	return bits;
+}
+
+// Return the range as a string, with stars representing masked octets, or
+// in CIDR notation if the range does not end on an octet.
+std::string IPRange::string() const
 {
 	std::ostringstream buffer;
 
+	bool v4 = memcmp(this->ip, v4mapped, sizeof(v4mapped)) == 0 &&
+	          memcmp(this->mask, this->mask + 1, sizeof(v4mapped) - 1) == 0 &&
+	          this->mask[0] == 0xFF;
+	if (!v4)
+	{
+		netadr_t address;
+		memset(&address, 0, sizeof(address));
+		memcpy(address.ip, this->ip, IPRANGE_KEYBYTES);
+
+		buffer << NET_AdrToString(address, false);
+
+		// Ranges in IPv6 are always prefixes.
+		const int bits = this->prefix();
+		if (bits != IPRANGE_KEYBITS)
+		{
+			buffer << '/' << bits;
+		}
+
+		return buffer.str();
+	}
+
+	const byte* octets = this->ip + sizeof(v4mapped);
+	const byte* masks = this->mask + sizeof(v4mapped);
+
+	bool starred = true;
 	for (byte i = 0; i < 4; i++)
 	{
-		if (mask[i])
+		if (masks[i] != 0 && masks[i] != 0xFF)
+		{
+			starred = false;
+		}
+	}
+
+	for (byte i = 0; i < 4; i++)
+	{
+		if (starred && masks[i] == 0)
 		{
 			buffer << '*';
 		}
 		else
 		{
-			buffer << (unsigned short)this->ip[i];
+			buffer << (unsigned short)octets[i];
 		}
 
 		if (i < 3)
@@ -174,9 +328,293 @@ std::string IPRange::string()
 		}
 	}
 
+	if (!starred)
+	{
+		buffer << '/' << this->prefix() - (int)sizeof(v4mapped) * 8;
+	}
+
 	return buffer.str();
 }
 
+//// IPRangeTrie ////
+
+IPRangeTrie::IPRangeTrie() : root(-1)
+{
+}
+
+int IPRangeTrie::newnode(const byte *key, int bits)
+{
+	int node;
+	if (!this->freenodes.empty())
+	{
+		node = this->freenodes.back();
+		this->freenodes.pop_back();
+	}
+	else
+	{
+		node = (int)this->nodes.size();
+		this->nodes.push_back(Node());
+	}
+
+	// Keep only the bits of the key that are part of the prefix.
+	Node &n = this->nodes[node];
+	memset(n.key, 0, IPRANGE_KEYBYTES);
+	memcpy(n.key, key, (bits + 7) / 8);
+	if (bits & 7)
+	{
+		n.key[bits / 8] &= (byte)(0xFF00 >> (bits & 7));
+	}
+	n.bits = bits;
+	n.child[0] = n.child[1] = -1;
+	n.entries.clear();
+
+	return node;
+}
+
+void IPRangeTrie::freenode(int node)
+{
+	this->nodes[node].entries.clear();
+	this->freenodes.push_back(node);
+}
+
+// Point the given side of parent, or the root if there is no parent, at node.
+void IPRangeTrie::link(int parent, int side, int node)
+{
+	if (parent < 0)
+	{
+		this->root = node;
+	}
+	else
+	{
+		this->nodes[parent].child[side] = node;
+	}
+}
+
+// Add a range to the trie under the given index.
+void IPRangeTrie::insert(const IPRange &range, size_t index)
+{
+	const int bits = range.prefix();
+	if (bits < 0)
+	{
+		this->sparse.push_back(std::make_pair(range, index));
+		return;
+	}
+
+	const byte* key = range.key();
+	int parent = -1;
+	int side = 0;
+	int cur = this->root;
+
+	for (;;)
+	{
+		if (cur < 0)
+		{
+			int leaf = newnode(key, bits);
+			this->nodes[leaf].entries.push_back(index);
+			link(parent, side, leaf);
+			return;
+		}
+
+		const int curbits = this->nodes[cur].bits;
+		const int common = IPRange_CommonBits(this->nodes[cur].key, key, MIN(curbits, bits));
+
+		if (common == curbits)
+		{
+			if (curbits == bits)
+			{
+				this->nodes[cur].entries.push_back(index);
+				return;
+			}
+
+			// This node is a prefix of the new range, keep walking.
+			parent = cur;
+			side = IPRange_KeyBit(key, curbits);
+			cur = this->nodes[cur].child[side];
+			continue;
+		}
+
+		// The new range splits this node's prefix, put a node where they
+		// part ways.
+		int split = newnode(key, common);
+		this->nodes[split].child[IPRange_KeyBit(this->nodes[cur].key, common)] = cur;
+		if (common == bits)
+		{
+			this->nodes[split].entries.push_back(index);
+		}
+		else
+		{
+			int leaf = newnode(key, bits);
+			this->nodes[leaf].entries.push_back(index);
+			this->nodes[split].child[IPRange_KeyBit(key, common)] = leaf;
+		}
+		link(parent, side, split);
+		return;
+	}
+}
+
+// Remove the range added under the given index.  Returns false if it is not
+// in the trie.
+bool IPRangeTrie::remove(const IPRange &range, size_t index)
+{
+	const int bits = range.prefix();
+	if (bits < 0)
+	{
+		for (size_t i = 0; i < this->sparse.size(); i++)
+		{
+			if (this->sparse[i].second == index)
+			{
+				this->sparse.erase(this->sparse.begin() + i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const byte* key = range.key();
+	int grandparent = -1, parent = -1;
+	int grandside = 0, side = 0;
+	int cur = this->root;
+
+	while (cur >= 0)
+	{
+		const Node &n = this->nodes[cur];
+		if (n.bits > bits || IPRange_CommonBits(n.key, key, n.bits) != n.bits)
+		{
+			return false;
+		}
+
+		if (n.bits == bits)
+		{
+			break;
+		}
+
+		grandparent = parent;
+		grandside = side;
+		parent = cur;
+		side = IPRange_KeyBit(key, n.bits);
+		cur = n.child[side];
+	}
+
+	if (cur < 0)
+	{
+		return false;
+	}
+
+	std::vector<size_t> &entries = this->nodes[cur].entries;
+	std::vector<size_t>::iterator it = std::find(entries.begin(), entries.end(), index);
+	if (it == entries.end())
+	{
+		return false;
+	}
+	entries.erase(it);
+
+	if (!entries.empty())
+	{
+		return true;
+	}
+
+	// Nodes without ranges of their own are only kept where two branches
+	// meet.
+	const int left = this->nodes[cur].child[0];
+	const int right = this->nodes[cur].child[1];
+	if (left >= 0 && right >= 0)
+	{
+		return true;
+	}
+
+	link(parent, side, left >= 0 ? left : right);
+	freenode(cur);
+
+	if (left < 0 && right < 0 && parent >= 0 && this->nodes[parent].entries.empty())
+	{
+		link(grandparent, grandside, this->nodes[parent].child[side ^ 1]);
+		freenode(parent);
+	}
+
+	return true;
+}
+
+// Find the most specific range containing the address.  If more than one
+// range was added with that prefix, the lowest index wins.
+bool IPRangeTrie::find(const netadr_t &address, size_t &index) const
+{
+	byte addrkey[IPRANGE_KEYBYTES];
+	IPRange::key(address, addrkey);
+
+	int best = -1;
+	int cur = this->root;
+	while (cur >= 0)
+	{
+		const Node &n = this->nodes[cur];
+		if (IPRange_CommonBits(n.key, addrkey, n.bits) != n.bits)
+		{
+			break;
+		}
+
+		if (!n.entries.empty())
+		{
+			best = cur;
+		}
+
+		if (n.bits >= IPRANGE_KEYBITS)
+		{
+			break;
+		}
+
+		cur = n.child[IPRange_KeyBit(addrkey, n.bits)];
+	}
+
+	if (best >= 0)
+	{
+		const std::vector<size_t> &entries = this->nodes[best].entries;
+		index = *std::min_element(entries.begin(), entries.end());
+		return true;
+	}
+
+	for (size_t i = 0; i < this->sparse.size(); i++)
+	{
+		if (this->sparse[i].first.check(addrkey))
+		{
+			index = this->sparse[i].second;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Shift every index above a removed one down to close the gap.
+void IPRangeTrie::renumber(size_t removed)
+{
+	for (size_t i = 0; i < this->nodes.size(); i++)
+	{
+		std::vector<size_t> &entries = this->nodes[i].entries;
+		for (size_t j = 0; j < entries.size(); j++)
+		{
+			if (entries[j] > removed)
+			{
+				entries[j]--;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < this->sparse.size(); i++)
+	{
+		if (this->sparse[i].second > removed)
+		{
+			this->sparse[i].second--;
+		}
+	}
+}
+
+void IPRangeTrie::clear()
+{
+	this->nodes.clear();
+	this->freenodes.clear();
+	this->sparse.clear();
+	this->root = -1;
+}
+
 //// Banlist ////
 
 size_t Banlist::size()
@@ -184,6 +622,42 @@ size_t Banlist::size()
 	return this->banlist.size();
 }
 
+// Add the ban at the given index to the trie, and to the expire heap if it
+// runs out.  Bans that have already run out are left out of both.
+void Banlist::index_ban(size_t index, time_t now)
+{
+	const Ban &ban = this->banlist[index];
+
+	if (ban.expire != 0)
+	{
+		if (ban.expire <= now)
+		{
+			return;
+		}
+
+		this->expireheap.push_back(expire_t(ban.expire, index));
+		std::push_heap(this->expireheap.begin(), this->expireheap.end(),
+		               std::greater<expire_t>());
+	}
+
+	this->bantrie.insert(ban.range, index);
+}
+
+// Take bans that have run out out of the trie.  They stay in the banlist
+// until somebody deletes them.
+void Banlist::expire(time_t now)
+{
+	while (!this->expireheap.empty() && this->expireheap.front().first <= now)
+	{
+		size_t index = this->expireheap.front().second;
+		std::pop_heap(this->expireheap.begin(), this->expireheap.end(),
+		              std::greater<expire_t>());
+		this->expireheap.pop_back();
+
+		this->bantrie.remove(this->banlist[index].range, index);
+	}
+}
+
 bool Banlist::add(const std::string &address, const time_t expire,
                   const std::string &name, const std::string &reason)
 {
@@ -202,6 +676,7 @@ bool Banlist::add(const std::string &address, const time_t expire,
 
 	// Add the ban to the banlist
 	this->banlist.push_back(ban);
+	this->index_ban(this->banlist.size() - 1, time(NULL));
 
 	return true;
 }
@@ -225,6 +700,7 @@ bool Banlist::add(player_t &player, const time_t expire,
 
 	// Add the ban to the banlist
 	this->banlist.push_back(ban);
+	this->index_ban(this->banlist.size() - 1, time(NULL));
 
 	return true;
 }
@@ -243,6 +719,7 @@ bool Banlist::add_exception(const std::string &address, const std::string &name)
 	// Add the exception to the banlist.
 	exception.name = name;
 	this->exceptionlist.push_back(exception);
+	this->exceptiontrie.insert(exception.range, this->exceptionlist.size() - 1);
 
 	return true;
 }
@@ -263,6 +740,7 @@ bool Banlist::add_exception(player_t &player)
 
 	// Add the exception to the banlist.
 	this->exceptionlist.push_back(exception);
+	this->exceptiontrie.insert(exception.range, this->exceptionlist.size() - 1);
 
 	return true;
 }
@@ -272,26 +750,21 @@ bool Banlist::add_exception(player_t &player)
 // returns false.
 bool Banlist::check(const netadr_t &address, Ban &baninfo)
 {
+	this->expire(time(NULL));
+
+	size_t index;
+
 	// Check against exception list.
-	for (std::vector<Exception>::iterator it = this->exceptionlist.begin();
-	        it != this->exceptionlist.end(); ++it)
+	if (this->exceptiontrie.find(address, index))
 	{
-		if (it->range.check(address))
-		{
-			return false;
-		}
+		return false;
 	}
 
 	// Check against banlist.
-	for (std::vector<Ban>::iterator it = this->banlist.begin();
-	        it != this->banlist.end(); ++it)
+	if (this->bantrie.find(address, index))
 	{
-		if (it->range.check(address) && (it->expire == 0 ||
-		                                 it->expire > time(NULL)))
-		{
-			baninfo = *it;
-			return true;
-		}
+		baninfo = this->banlist[index];
+		return true;
 	}
 
 	return false;
@@ -409,6 +882,29 @@ bool Banlist::remove(size_t index)
 		return false;
 	}
 
+	this->bantrie.remove(this->banlist[index].range, index);
+	this->bantrie.renumber(index);
+
+	// Drop it from the expire heap too.  Lowering the indexes above it
+	// doesn't change the order of the heap, taking an entry out does.
+	for (size_t i = 0; i < this->expireheap.size(); )
+	{
+		if (this->expireheap[i].second == index)
+		{
+			this->expireheap[i] = this->expireheap.back();
+			this->expireheap.pop_back();
+			continue;
+		}
+
+		if (this->expireheap[i].second > index)
+		{
+			this->expireheap[i].second--;
+		}
+		i++;
+	}
+	std::make_heap(this->expireheap.begin(), this->expireheap.end(),
+	               std::greater<expire_t>());
+
 	this->banlist.erase(this->banlist.begin() + index);
 	return true;
 }
@@ -428,6 +924,8 @@ bool Banlist::remove_exception(size_t index)
 		return false;
 	}
 
+	this->exceptiontrie.remove(this->exceptionlist[index].range, index);
+	this->exceptiontrie.renumber(index);
 	this->exceptionlist.erase(this->exceptionlist.begin() + index);
 	return true;
 }
@@ -436,12 +934,15 @@ bool Banlist::remove_exception(size_t index)
 void Banlist::clear()
 {
 	this->banlist.clear();
+	this->bantrie.clear();
+	this->expireheap.clear();
 }
 
 // Clear the exceptionlist.
 void Banlist::clear_exceptions()
 {
 	this->exceptionlist.clear();
+	this->exceptiontrie.clear();
 }
 
 // Fills a JSON array with bans.
@@ -490,6 +991,8 @@ bool Banlist::json_replace(const Json::Value &json_bans)
 	if (json_bans.isNull() || json_bans.empty())
 		return true;
 
+	time_t now = time(NULL);
+
 	Json::ValueConstIterator it;
 	for (it = json_bans.begin(); it != json_bans.end(); ++it)
 	{
@@ -498,10 +1001,8 @@ bool Banlist::json_replace(const Json::Value &json_bans)
 
 		// Range
 		value = (*it).get("range", Json::Value::null);
-		if (value.isNull())
+		if (value.isNull() || !ban.range.set(value.asString()))
 			continue;
-		else
-			ban.range.set((*it).get("range", false).asString());
 
 		// Expire time
 		value = (*it).get("expire", Json::Value::null);
@@ -522,6 +1023,7 @@ bool Banlist::json_replace(const Json::Value &json_bans)
 			ban.reason = value.asString();
 
 		this->banlist.push_back(ban);
+		this->index_ban(this->banlist.size() - 1, now);
 	}
 
 	return true;
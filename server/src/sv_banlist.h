@@ -33,18 +33,60 @@
 #include "d_player.h"
 #include "i_net.h"
 
+// Range keys are netadr_t addresses, so IPv4 ranges are IPv4-mapped
+// (::ffff:a.b.c.d) and sit in the same trie as IPv6 ones.
+#define IPRANGE_KEYBYTES NETADR_IPBYTES
+#define IPRANGE_KEYBITS (IPRANGE_KEYBYTES * 8)
+
 class IPRange
 {
 private:
-	byte ip[4];
-	bool mask[4];
+	byte ip[IPRANGE_KEYBYTES];
+	byte mask[IPRANGE_KEYBYTES];
 public:
 	IPRange(void);
-	bool check(const netadr_t &address);
-	bool check(const std::string &input);
+	bool check(const netadr_t &address) const;
+	bool check(const byte *key) const;
+	bool check(const std::string &input) const;
 	void set(const netadr_t &address);
 	bool set(const std::string &input);
-	std::string string(void);
+	int prefix(void) const;
+	const byte *key(void) const { return ip; }
+	std::string string(void) const;
+
+	static void key(const netadr_t &address, byte *key);
+};
+
+// Prefix trie over range keys.  Each node carries the indexes of the ranges
+// that end exactly at its prefix, so a lookup is one walk down the address
+// bits no matter how many ranges are in the list.  Ranges with wildcards in
+// the middle (1.*.3.4) are not a prefix and are checked one by one.
+class IPRangeTrie
+{
+public:
+	IPRangeTrie();
+	void insert(const IPRange &range, size_t index);
+	bool remove(const IPRange &range, size_t index);
+	bool find(const netadr_t &address, size_t &index) const;
+	void renumber(size_t removed);
+	void clear();
+private:
+	struct Node
+	{
+		byte key[IPRANGE_KEYBYTES];
+		int bits;
+		int child[2];
+		std::vector<size_t> entries;
+	};
+
+	int newnode(const byte *key, int bits);
+	void freenode(int node);
+	void link(int parent, int side, int node);
+
+	std::vector<Node> nodes;
+	std::vector<int> freenodes;
+	int root;
+	std::vector<std::pair<IPRange, size_t> > sparse;
 };
 
 struct Ban
@@ -93,8 +135,17 @@ public:
 	bool json_replace(const Json::Value &json_bans);
 	void json_exceptions();
 private:
+	// Bans waiting to expire, soonest first.
+	typedef std::pair<time_t, size_t> expire_t;
+
+	void index_ban(size_t index, time_t now);
+	void expire(time_t now);
+
 	std::vector<Ban> banlist;
 	std::vector<Exception> exceptionlist;
+	IPRangeTrie bantrie;
+	IPRangeTrie exceptiontrie;
+	std::vector<expire_t> expireheap;
 };
 
 void SV_InitBanlist();
@@ -114,6 +114,12 @@ CVAR_RANGE_FUNC_DECL(sv_maxrate, "200", "Forces clients to be on or below this r
 CVAR_RANGE_FUNC_DECL(sv_waddownloadcap, "200", "Cap wad file downloading to a specific rate",
 				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 7.0f, 100000.0f)
 
+CVAR_RANGE(		sv_qryratelimit, "10", "Launcher queries answered per second from a single address, 0 for no limit",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 1000.0f)
+
+CVAR(			sv_qrythread, "0", "Answer launcher queries from a separate thread",
+				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
+
 #ifdef ODA_HAVE_MINIUPNP
 CVAR(			sv_upnp, "1", "Enable UPnP support",
 				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
@@ -0,0 +1,741 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Serving resource files to clients over the game protocol.
+//
+//	A file is mapped into memory once, however many clients fetch it, and
+//	each chunk is copied from the mapping straight into the packet that
+//	carries it.  Chunks travel outside the reliable stream: every client
+//	has a window of chunks in flight, acknowledges what it holds with
+//	clc_wadack, and only the chunks it is missing are sent again.
+//
+//	All downloads share one budget of sv_waddownloadcap, handed out a
+//	chunk at a time in turn, and the service gives up the rest of a tic
+//	once it has run for DOWNLOAD_TIC_MS.
+//
+//-----------------------------------------------------------------------------
+
+#include "sv_download.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "cmdlib.h"
+#include "doomstat.h"
+#include "i_net.h"
+#include "i_system.h"
+#include "m_fileio.h"
+#include "sv_main.h"
+
+EXTERN_CVAR(sv_waddownloadcap)
+EXTERN_CVAR(port)
+
+// Bytes of file in a chunk, so a chunk packet fits the smallest IPv6 MTU
+static const size_t DOWNLOAD_CHUNK = 1200;
+
+// Bytes a chunk packet adds: sequence, marker, offset and length
+static const size_t DOWNLOAD_HEADER = 4 + 1 + 4 + 2;
+
+// Chunks a client can have in flight
+static const unsigned DOWNLOAD_WINDOW = 128;
+
+// An unacknowledged chunk this far below an acknowledged one that was sent
+// after it is taken to be lost rather than overtaken
+static const unsigned DOWNLOAD_REORDER = 3;
+
+// Bounds of the retransmit timeout, in tics
+static const int DOWNLOAD_MIN_RTO = 3;
+static const int DOWNLOAD_MAX_RTO = 2 * TICRATE;
+
+// Longest the service may spend sending in a tic
+static const int DOWNLOAD_TIC_MS = 2;
+
+//
+// Files being served
+//
+
+struct MappedFile
+{
+	const byte*	data;
+	size_t		length;
+	int			users;
+};
+
+typedef std::map<std::string, MappedFile> MappedFiles;
+static MappedFiles mappedfiles;
+
+static const MappedFile* MapFile(const std::string& path)
+{
+	MappedFiles::iterator it = mappedfiles.find(path);
+
+	if (it == mappedfiles.end())
+	{
+		MappedFile file;
+		file.data = M_MapFile(path, file.length);
+		file.users = 0;
+
+		if (file.data == NULL)
+			return NULL;
+
+		it = mappedfiles.insert(std::make_pair(path, file)).first;
+	}
+
+	it->second.users++;
+	return &it->second;
+}
+
+static void UnmapFile(const std::string& path)
+{
+	MappedFiles::iterator it = mappedfiles.find(path);
+
+	if (it == mappedfiles.end() || --it->second.users > 0)
+		return;
+
+	M_UnmapFile(it->second.data, it->second.length);
+	mappedfiles.erase(it);
+}
+
+//
+// Downloads
+//
+
+enum chunkstate_t
+{
+	CHUNK_INFLIGHT,
+	CHUNK_LOST,
+	CHUNK_ACKED
+};
+
+struct chunkslot_t
+{
+	int		sent;		// download tic it was last sent
+	byte	tries;
+	byte	state;
+};
+
+struct DownloadSession
+{
+	client_t*	client;
+	int			id;			// player id, -1 in downloadbench
+
+	std::string	name;
+	std::string	path;		// empty until the client asks for a file
+	const byte*	data;
+	size_t		length;
+	unsigned	chunks;
+
+	unsigned	base;		// chunks below this are acknowledged
+	unsigned	next;		// first chunk never sent
+	unsigned	lost;		// chunks in the window waiting to be resent
+	chunkslot_t	window[DOWNLOAD_WINDOW];	// by chunk % DOWNLOAD_WINDOW
+
+	int			srtt;		// smoothed round trip, in eighths of a tic
+	int			rto;		// retransmit timeout, in tics
+
+	int			starttic;
+	unsigned	resent;
+	bool		finished;
+
+	DownloadSession(client_t& cl, int pid) :
+		client(&cl), id(pid), name(""), path(""), data(NULL), length(0),
+		chunks(0), base(0), next(0), lost(0), srtt(0), rto(0), starttic(0),
+		resent(0), finished(false)
+	{
+	}
+};
+
+class DownloadService
+{
+  public:
+	DownloadService() : m_tic(0), m_tokens(0), m_fair(0) {}
+	~DownloadService();
+
+	DownloadSession* find(const client_t* cl);
+	DownloadSession& connect(client_t& cl, int id);
+	DownloadSession* start(client_t& cl, int id, const std::string& name,
+	                       const std::string& path, size_t offset);
+	void stop(const client_t* cl);
+
+	bool ack(DownloadSession& s, unsigned base, const byte* bits, size_t count);
+	void tic(int rate);
+
+	int getTic() const { return m_tic; }
+
+  private:
+	std::vector<DownloadSession*> m_sessions;
+	int m_tic;
+	int m_tokens;		// bytes, negative when the last tic overdrew
+	size_t m_fair;
+
+	void acked(DownloadSession& s, unsigned chunk);
+	void timeouts(DownloadSession& s);
+	static int nextChunk(const DownloadSession& s);
+	size_t send(DownloadSession& s, unsigned chunk);
+};
+
+DownloadService::~DownloadService()
+{
+	while (!m_sessions.empty())
+		stop(m_sessions.back()->client);
+}
+
+DownloadSession* DownloadService::find(const client_t* cl)
+{
+	for (size_t i = 0; i < m_sessions.size(); i++)
+	{
+		if (m_sessions[i]->client == cl)
+			return m_sessions[i];
+	}
+
+	return NULL;
+}
+
+DownloadSession& DownloadService::connect(client_t& cl, int id)
+{
+	DownloadSession* s = find(&cl);
+
+	if (s == NULL)
+	{
+		s = new DownloadSession(cl, id);
+		m_sessions.push_back(s);
+	}
+
+	return *s;
+}
+
+DownloadSession* DownloadService::start(client_t& cl, int id, const std::string& name,
+                                        const std::string& path, size_t offset)
+{
+	DownloadSession& s = connect(cl, id);
+
+	const MappedFile* file = MapFile(path);
+	if (file == NULL)
+		return NULL;
+
+	// Map the new file before letting go of the old one, in case they are
+	// the same
+	if (!s.path.empty())
+		UnmapFile(s.path);
+
+	s.name = name;
+	s.path = path;
+	s.data = file->data;
+	s.length = file->length;
+	s.chunks = (s.length + DOWNLOAD_CHUNK - 1) / DOWNLOAD_CHUNK;
+
+	s.base = s.next = MIN(offset / DOWNLOAD_CHUNK, (size_t)s.chunks);
+	s.lost = 0;
+	s.srtt = 0;
+	s.rto = TICRATE / 2;
+	s.starttic = m_tic;
+	s.resent = 0;
+	s.finished = false;
+
+	MSG_WriteMarker(&cl.reliablebuf, svc_wadinfo);
+	MSG_WriteString(&cl.reliablebuf, name.c_str());
+	MSG_WriteLong(&cl.reliablebuf, s.length);
+	MSG_WriteShort(&cl.reliablebuf, DOWNLOAD_CHUNK);
+
+	return &s;
+}
+
+void DownloadService::stop(const client_t* cl)
+{
+	for (size_t i = 0; i < m_sessions.size(); i++)
+	{
+		if (m_sessions[i]->client != cl)
+			continue;
+
+		if (!m_sessions[i]->path.empty())
+			UnmapFile(m_sessions[i]->path);
+
+		delete m_sessions[i];
+		m_sessions.erase(m_sessions.begin() + i);
+		return;
+	}
+}
+
+void DownloadService::acked(DownloadSession& s, unsigned chunk)
+{
+	chunkslot_t& slot = s.window[chunk % DOWNLOAD_WINDOW];
+
+	if (slot.state == CHUNK_ACKED)
+		return;
+
+	if (slot.state == CHUNK_LOST)
+		s.lost--;
+
+	// Only a chunk sent once tells how long the trip took
+	if (slot.state == CHUNK_INFLIGHT && slot.tries == 1)
+	{
+		int sample = (m_tic - slot.sent) * 8;
+
+		if (s.srtt == 0)
+			s.srtt = sample;
+		else
+			s.srtt += (sample - s.srtt) / 8;
+
+		s.rto = clamp((s.srtt + 3) / 4 + 1, DOWNLOAD_MIN_RTO, DOWNLOAD_MAX_RTO);
+	}
+
+	slot.state = CHUNK_ACKED;
+}
+
+//
+// DownloadService::ack
+//
+// The client holds every chunk below base, and of the chunks after base
+// the ones set in bits.  Returns true when that completes the file.
+//
+bool DownloadService::ack(DownloadSession& s, unsigned base, const byte* bits,
+                          size_t count)
+{
+	if (s.data == NULL || s.finished)
+		return false;
+
+	// The client can't hold what was never sent
+	base = MIN(base, s.next);
+
+	for (; s.base < base; s.base++)
+		acked(s, s.base);
+
+	// A late ack can start below chunks that have been acked since, and
+	// whose slots now hold chunks a window further on
+	size_t first = base < s.base ? s.base - base - 1 : 0;
+
+	for (size_t i = first; i < count * 8; i++)
+	{
+		unsigned chunk = base + 1 + i;
+		if (chunk >= s.next)
+			break;
+
+		if (bits[i >> 3] & (1 << (i & 7)))
+			acked(s, chunk);
+	}
+
+	// Anything sent before the newest chunk the client holds, and well
+	// below it, went missing
+	unsigned newest = s.next;
+	while (newest > s.base && s.window[(newest - 1) % DOWNLOAD_WINDOW].state != CHUNK_ACKED)
+		newest--;
+
+	if (newest > s.base + DOWNLOAD_REORDER)
+	{
+		int newestsent = s.window[(newest - 1) % DOWNLOAD_WINDOW].sent;
+
+		for (unsigned chunk = s.base; chunk + DOWNLOAD_REORDER < newest; chunk++)
+		{
+			chunkslot_t& slot = s.window[chunk % DOWNLOAD_WINDOW];
+
+			if (slot.state == CHUNK_INFLIGHT && slot.sent <= newestsent)
+			{
+				slot.state = CHUNK_LOST;
+				s.lost++;
+			}
+		}
+	}
+
+	if (s.base < s.chunks)
+		return false;
+
+	s.finished = true;
+	return true;
+}
+
+void DownloadService::timeouts(DownloadSession& s)
+{
+	bool expired = false;
+
+	for (unsigned chunk = s.base; chunk < s.next; chunk++)
+	{
+		chunkslot_t& slot = s.window[chunk % DOWNLOAD_WINDOW];
+
+		if (slot.state == CHUNK_INFLIGHT && m_tic - slot.sent > s.rto)
+		{
+			slot.state = CHUNK_LOST;
+			s.lost++;
+			expired = true;
+		}
+	}
+
+	if (expired)
+		s.rto = MIN(s.rto * 2, DOWNLOAD_MAX_RTO);
+}
+
+//
+// DownloadService::nextChunk
+//
+// Lost chunks go first, then new ones while the window has room.  Returns
+// -1 if the download has nothing to send.
+//
+int DownloadService::nextChunk(const DownloadSession& s)
+{
+	if (s.lost)
+	{
+		for (unsigned chunk = s.base; chunk < s.next; chunk++)
+		{
+			if (s.window[chunk % DOWNLOAD_WINDOW].state == CHUNK_LOST)
+				return chunk;
+		}
+	}
+
+	if (s.next < s.chunks && s.next < s.base + DOWNLOAD_WINDOW)
+		return s.next;
+
+	return -1;
+}
+
+size_t DownloadService::send(DownloadSession& s, unsigned chunk)
+{
+	chunkslot_t& slot = s.window[chunk % DOWNLOAD_WINDOW];
+
+	if (chunk == s.next)
+	{
+		s.next++;
+		slot.tries = 0;
+	}
+	else
+	{
+		s.lost--;
+		s.resent++;
+	}
+
+	slot.state = CHUNK_INFLIGHT;
+	slot.sent = m_tic;
+	if (slot.tries < 255)
+		slot.tries++;
+
+	size_t offset = (size_t)chunk * DOWNLOAD_CHUNK;
+	size_t length = MIN(DOWNLOAD_CHUNK, s.length - offset);
+
+	SV_SendDownloadPacket(*s.client, offset, s.data + offset, length);
+
+	return length + DOWNLOAD_HEADER;
+}
+
+//
+// DownloadService::tic
+//
+// Sends what the downloads have due, at most rate bytes a second between
+// them.  Each download gets one chunk in turn until the tic's share of the
+// rate is spent, starting from a different one every tic.
+//
+void DownloadService::tic(int rate)
+{
+	m_tic++;
+
+	if (m_sessions.empty())
+	{
+		m_tokens = 0;
+		return;
+	}
+
+	for (size_t i = 0; i < m_sessions.size(); i++)
+	{
+		if (m_sessions[i]->data != NULL)
+			timeouts(*m_sessions[i]);
+	}
+
+	// Hold no more than a tic's worth, so an idle spell doesn't turn into
+	// a burst
+	int pertic = MAX(rate / TICRATE, 1);
+	m_tokens = MIN(m_tokens + pertic, pertic);
+
+	const dtime_t start = I_GetTime();
+	const dtime_t budget = I_ConvertTimeFromMs(DOWNLOAD_TIC_MS);
+
+	size_t count = m_sessions.size();
+	m_fair = (m_fair + 1) % count;
+
+	int packets = 0;
+	bool sending = true;
+
+	while (sending && m_tokens > 0)
+	{
+		sending = false;
+
+		for (size_t i = 0; i < count && m_tokens > 0; i++)
+		{
+			DownloadSession& s = *m_sessions[(m_fair + i) % count];
+
+			if (s.data == NULL)
+				continue;
+
+			int chunk = nextChunk(s);
+			if (chunk < 0)
+				continue;
+
+			m_tokens -= send(s, chunk);
+			sending = true;
+
+			if (++packets % 16 == 0 && I_GetTime() - start > budget)
+				return;
+		}
+	}
+}
+
+static DownloadService downloads;
+
+void SV_DownloadConnect(player_t& player)
+{
+	downloads.connect(player.client, player.id);
+}
+
+bool SV_IsDownloadConnection(player_t& player)
+{
+	return downloads.find(&player.client) != NULL;
+}
+
+void SV_DownloadStart(player_t& player, const OResFile& file, size_t offset)
+{
+	client_t* cl = &player.client;
+
+	if (downloads.start(*cl, player.id, file.getBasename(), file.getFullpath(), offset))
+		return;
+
+	MSG_WriteMarker(&cl->reliablebuf, svc_print);
+	MSG_WriteByte(&cl->reliablebuf, PRINT_HIGH);
+	std::string message;
+	StrFormat(message, "Server: %s could not be read\n", file.getBasename().c_str());
+	MSG_WriteString(&cl->reliablebuf, message.c_str());
+
+	SV_DropClient(player);
+}
+
+void SV_DownloadStop(player_t& player)
+{
+	downloads.stop(&player.client);
+}
+
+void SV_DownloadAck(player_t& player)
+{
+	unsigned base = MSG_ReadLong();
+	size_t count = MSG_ReadByte();
+	const byte* bits = (const byte*)MSG_ReadChunk(count);
+
+	DownloadSession* s = downloads.find(&player.client);
+	if (s == NULL || bits == NULL)
+		return;
+
+	if (!downloads.ack(*s, base, bits, count))
+		return;
+
+	double seconds = double(downloads.getTic() - s->starttic) / TICRATE;
+	std::string rate;
+	StrFormatBytes(rate, seconds > 0.0 ? size_t(s->length / seconds) : s->length);
+
+	Printf("> client %d downloaded %s at %s/s, %u chunks resent\n", player.id,
+	       s->name.c_str(), rate.c_str(), s->resent);
+}
+
+void SV_SendDownloads()
+{
+	downloads.tic(sv_waddownloadcap.asInt() * 1000);
+}
+
+//
+// downloadbench
+//
+// Serves a file to clients simulated on the loopback interface.  Chunk
+// packets go out through the server's socket and back in, some of them
+// dropped on the way if asked to, and the acknowledgements are handed
+// straight to the service.  Prints the transfer rate at TICRATE tics a
+// second and what the service costs the main loop every tic.
+//
+// With a late ack percentage, each client's acknowledgement from a few
+// tics earlier also reaches the service that often, after the current
+// one, as a reordered or duplicated clc_wadack would.
+//
+BEGIN_COMMAND(downloadbench)
+{
+	if (argc < 2)
+	{
+		Printf(PRINT_HIGH, "Usage: downloadbench <clients> [loss percent] [file] [late ack percent]\n");
+		return;
+	}
+
+	// The bench reads the server's socket itself
+	if (!players.empty())
+	{
+		Printf(PRINT_HIGH, "downloadbench: Can't run with clients connected.\n");
+		return;
+	}
+
+	int count = clamp(atoi(argv[1]), 1, 64);
+	int loss = argc > 2 ? clamp(atoi(argv[2]), 0, 90) : 0;
+	int late = argc > 4 ? clamp(atoi(argv[4]), 0, 100) : 0;
+
+	std::string path;
+	if (argc > 3)
+		path = argv[3];
+	else if (!wadfiles.empty())
+		path = wadfiles.back().getFullpath();
+
+	netadr_t loopback;
+	NET_StringToAdr("127.0.0.1", &loopback);
+	I_SetPort(loopback, port.asInt());
+
+	DownloadService service;
+	std::vector<client_t> clients(count);
+	std::vector<DownloadSession*> sessions(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		// They share one address, so the sequence tells them apart
+		clients[i].address = loopback;
+		clients[i].sequence = i << 24;
+
+		sessions[i] = service.start(clients[i], -1, path, path, 0);
+		if (sessions[i] == NULL)
+		{
+			Printf(PRINT_HIGH, "downloadbench: Could not map \"%s\".\n", path.c_str());
+			return;
+		}
+	}
+
+	const size_t length = sessions[0]->length;
+	const unsigned chunks = sessions[0]->chunks;
+
+	std::vector<std::vector<byte> > received(count, std::vector<byte>(length));
+	std::vector<std::vector<bool> > held(count, std::vector<bool>(chunks, false));
+	std::vector<unsigned> heldbase(count, 0);
+
+	// The acknowledgements each client sent the last few tics
+	static const int LATE_TICS = 8;
+	std::vector<std::vector<byte> > sentbits(count * LATE_TICS,
+	                                         std::vector<byte>(DOWNLOAD_WINDOW / 8));
+	std::vector<unsigned> sentbase(count * LATE_TICS, 0);
+	unsigned lateacks = 0;
+
+	const int rate = sv_waddownloadcap.asInt() * 1000;
+	const int maxtics = TICRATE * 60 * 60;
+
+	unsigned lossrng = 1, laterng = 1;
+	int finished = 0;
+	int tics = 0;
+	dtime_t total = 0, worst = 0;
+	dtime_t wallstart = I_GetTime();
+
+	while (finished < count && tics < maxtics)
+	{
+		dtime_t ticstart = I_GetTime();
+		service.tic(rate);
+		dtime_t elapsed = I_GetTime() - ticstart;
+
+		total += elapsed;
+		worst = MAX(worst, elapsed);
+		tics++;
+
+		while (NET_GetPacket())
+		{
+			if (!NET_CompareAdr(net_from, loopback))
+				continue;
+
+			lossrng = lossrng * 1103515245 + 12345;
+			if ((int)((lossrng >> 16) % 100) < loss)
+				continue;
+
+			size_t i = (unsigned)MSG_ReadLong() >> 24;
+			if (i >= (size_t)count || MSG_ReadByte() != svc_wadchunk)
+				continue;
+
+			size_t offset = MSG_ReadLong();
+			size_t len = (unsigned short)MSG_ReadShort();
+			const byte* data = (const byte*)MSG_ReadChunk(len);
+
+			unsigned chunk = offset / DOWNLOAD_CHUNK;
+			if (data == NULL || chunk >= chunks || held[i][chunk] || offset + len > length)
+				continue;
+
+			memcpy(&received[i][offset], data, len);
+			held[i][chunk] = true;
+
+			while (heldbase[i] < chunks && held[i][heldbase[i]])
+				heldbase[i]++;
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			byte bits[DOWNLOAD_WINDOW / 8] = { 0 };
+
+			for (unsigned b = 0; b < DOWNLOAD_WINDOW; b++)
+			{
+				unsigned chunk = heldbase[i] + 1 + b;
+				if (chunk < chunks && held[i][chunk])
+					bits[b >> 3] |= 1 << (b & 7);
+			}
+
+			if (service.ack(*sessions[i], heldbase[i], bits, sizeof(bits)))
+				finished++;
+
+			size_t slot = i * LATE_TICS + tics % LATE_TICS;
+
+			laterng = laterng * 1103515245 + 12345;
+			if (tics > LATE_TICS && (int)((laterng >> 16) % 100) < late)
+			{
+				// The oldest one remembered, LATE_TICS - 1 tics old
+				size_t oldest = i * LATE_TICS + (tics + 1) % LATE_TICS;
+				if (service.ack(*sessions[i], sentbase[oldest], &sentbits[oldest][0],
+				                sentbits[oldest].size()))
+					finished++;
+				lateacks++;
+			}
+
+			sentbase[slot] = heldbase[i];
+			memcpy(&sentbits[slot][0], bits, sizeof(bits));
+		}
+	}
+
+	double wallms = double(I_GetTime() - wallstart) / I_ConvertTimeFromMs(1);
+	double ticms = 1000.0 / TICRATE;
+	double avgms = double(total) / I_ConvertTimeFromMs(1) / MAX(tics, 1);
+	double worstms = double(worst) / I_ConvertTimeFromMs(1);
+
+	int intact = 0;
+	unsigned resent = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (length && !memcmp(&received[i][0], sessions[i]->data, length))
+			intact++;
+
+		resent += sessions[i]->resent;
+	}
+
+	std::string size, delivered;
+	StrFormatBytes(size, length);
+	StrFormatBytes(delivered, size_t(double(length) * count * TICRATE / MAX(tics, 1)));
+
+	Printf(PRINT_HIGH, "downloadbench: %d client%s fetching %s (%s), cap %d KB/s, %d%% loss, "
+	       "%d%% late acks\n",
+	       count, count == 1 ? "" : "s", path.c_str(), size.c_str(),
+	       sv_waddownloadcap.asInt(), loss, late);
+	Printf(PRINT_HIGH, "%d of %d finished in %d tics, %s/s at %d tics a second, "
+	       "%u chunks resent, %d intact\n",
+	       finished, count, tics, delivered.c_str(), TICRATE, resent, intact);
+	if (late)
+		Printf(PRINT_HIGH, "%u late acks delivered\n", lateacks);
+	Printf(PRINT_HIGH, "service: %.3f ms a tic on average (%.1f%% of a tic), %.3f ms at worst\n",
+	       avgms, 100.0 * avgms / ticms, worstms);
+	Printf(PRINT_HIGH, "wall time: %.0f ms\n", wallms);
+}
+END_COMMAND(downloadbench)
+
+VERSION_CONTROL(sv_download_cpp, "$Id$")
@@ -0,0 +1,45 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Serving resource files to clients over the game protocol.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __SV_DOWNLOAD_H__
+#define __SV_DOWNLOAD_H__
+
+#include <stddef.h>
+
+#include "d_player.h"
+#include "m_resfile.h"
+
+// The client connected only to download a file
+void SV_DownloadConnect(player_t& player);
+bool SV_IsDownloadConnection(player_t& player);
+
+// Start or resume sending file, from the chunk holding offset on
+void SV_DownloadStart(player_t& player, const OResFile& file, size_t offset);
+void SV_DownloadStop(player_t& player);
+
+// clc_wadack
+void SV_DownloadAck(player_t& player);
+
+// Sends the chunks due this tic to every downloading client
+void SV_SendDownloads();
+
+#endif // __SV_DOWNLOAD_H__
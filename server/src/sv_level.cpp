@@ -47,6 +47,7 @@
 #include "s_sound.h"
 #include "sv_main.h"
 #include "sv_maplist.h"
+#include "sv_sqp.h"
 #include "w_wad.h"
 #include "z_zone.h"
 #include "g_levelstate.h"
@@ -319,6 +320,64 @@ void G_DoNewGame (void)
 	}
 }
 
+//
+// mapbench
+//
+// Changes to each map in the maplist in turn and reports how long changing
+// the resource files and loading the level took, the stall every player
+// sees on a map change.  Entries that use the loaded WADs should spend no
+// time on resources.
+//
+BEGIN_COMMAND (mapbench)
+{
+	std::vector<std::pair<size_t, maplist_entry_t*> > result;
+	if (!Maplist::instance().query(result))
+	{
+		Printf(PRINT_HIGH, "mapbench: %s\n", Maplist::instance().get_error().c_str());
+		return;
+	}
+
+	// Copied, the maplist can change under a map change
+	std::vector<maplist_entry_t> entries;
+	for (size_t i = 0; i < result.size(); i++)
+		entries.push_back(*result[i].second);
+
+	int passes = argc > 1 ? MAX(atoi(argv[1]), 1) : 1;
+
+	dtime_t total = 0, worst = 0, resourcestotal = 0;
+	int changes = 0;
+
+	for (int pass = 0; pass < passes; pass++)
+	{
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			dtime_t start = I_GetTime();
+			G_ChangeMap(i);
+			dtime_t resources = I_GetTime() - start;
+
+			if (gameaction == ga_newgame)
+				G_DoNewGame();
+			dtime_t elapsed = I_GetTime() - start;
+
+			Printf(PRINT_HIGH, "%-8s %8.2f ms resources %8.2f ms level  %s\n",
+			       entries[i].map.c_str(), (double)resources / I_ConvertTimeFromMs(1),
+			       (double)(elapsed - resources) / I_ConvertTimeFromMs(1),
+			       JoinStrings(entries[i].wads, " ").c_str());
+
+			total += elapsed;
+			resourcestotal += resources;
+			worst = MAX(worst, elapsed);
+			changes++;
+		}
+	}
+
+	Printf(PRINT_HIGH, "%d map changes, %.2f ms average (%.2f ms resources), %.2f ms worst\n",
+	       changes, (double)total / changes / I_ConvertTimeFromMs(1),
+	       (double)resourcestotal / changes / I_ConvertTimeFromMs(1),
+	       (double)worst / I_ConvertTimeFromMs(1));
+}
+END_COMMAND (mapbench)
+
 EXTERN_CVAR (sv_skill)
 EXTERN_CVAR (sv_monstersrespawn)
 EXTERN_CVAR (sv_fastmonsters)
@@ -683,6 +742,8 @@ void G_DoLoadLevel (int position)
 		wipegamestate = GS_FORCEWIPE;
 
 	gamestate = GS_LEVEL;
+
+	SV_QryInvalidate();
 	
 	// Reset all keys found
 	for (size_t j = 0; j < NUMCARDS; j++)
@@ -60,6 +60,7 @@
 #include "p_unlag.h"
 #include "sv_vote.h"
 #include "sv_maplist.h"
+#include "sv_download.h"
 #include "g_levelstate.h"
 #include "g_gametype.h"
 #include "sv_banlist.h"
@@ -505,8 +506,94 @@ void SV_InitNetwork (void)
 	SV_InitMasters();
 }
 
+//
+// Address lookup for incoming packets.  Every datagram has to be matched to a
+// player, so instead of walking the player list this keeps an open addressing
+// table of players by address.  The table is more than twice the size of the
+// player limit, so it never fills and probes stay short.
+//
+static const size_t ADDRMAP_SIZE = 512;
+static player_t* addrmap[ADDRMAP_SIZE];
+
+static size_t SV_AddrMapHash(const netadr_t& address)
+{
+	DWORD hash = address.port;
+	for (size_t i = 0; i < NETADR_IPBYTES; i += 4)
+	{
+		DWORD ip = address.ip[i] | (address.ip[i + 1] << 8) | (address.ip[i + 2] << 16) |
+		           ((DWORD)address.ip[i + 3] << 24);
+		hash = (hash ^ ip) * 0x9E3779B1u;
+	}
+	return (hash >> 16) & (ADDRMAP_SIZE - 1);
+}
+
+static player_t* SV_AddrMapFind(const netadr_t& address)
+{
+	for (size_t i = SV_AddrMapHash(address); addrmap[i]; i = (i + 1) & (ADDRMAP_SIZE - 1))
+	{
+		if (NET_CompareAdr(addrmap[i]->client.address, address))
+			return addrmap[i];
+	}
+
+	return NULL;
+}
+
+// If a player with the same address is already in the table, it keeps
+// the address, the same as the first match of a list walk would.
+static void SV_AddrMapInsert(player_t* player)
+{
+	size_t i = SV_AddrMapHash(player->client.address);
+	for (; addrmap[i]; i = (i + 1) & (ADDRMAP_SIZE - 1))
+	{
+		if (NET_CompareAdr(addrmap[i]->client.address, player->client.address))
+			return;
+	}
+
+	addrmap[i] = player;
+}
+
+static void SV_AddrMapRemove(player_t* player)
+{
+	size_t i = SV_AddrMapHash(player->client.address);
+	for (; addrmap[i] != player; i = (i + 1) & (ADDRMAP_SIZE - 1))
+	{
+		if (!addrmap[i])
+			return;
+	}
+
+	// Shift the rest of the probe run back over the hole, so lookups never
+	// have to step over deleted slots.
+	addrmap[i] = NULL;
+	for (size_t j = (i + 1) & (ADDRMAP_SIZE - 1); addrmap[j]; j = (j + 1) & (ADDRMAP_SIZE - 1))
+	{
+		size_t home = SV_AddrMapHash(addrmap[j]->client.address);
+		bool between = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+		if (between)
+			continue;
+
+		addrmap[i] = addrmap[j];
+		addrmap[j] = NULL;
+		i = j;
+	}
+
+	// Another player connecting from the same address takes over.
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		if (&*it != player && NET_CompareAdr(it->client.address, player->client.address))
+		{
+			SV_AddrMapInsert(&*it);
+			break;
+		}
+	}
+}
+
+static void SV_AddrMapClear()
+{
+	memset(addrmap, 0, sizeof(addrmap));
+}
+
 //Get next free player. Will use the lowest available player id.
-Players::iterator SV_GetFreeClient(void)
+Players::iterator SV_GetFreeClient(const netadr_t& address)
 {
 	if (players.size() >= sv_maxclients)
 		return players.end();
@@ -520,6 +607,8 @@ Players::iterator SV_GetFreeClient(void)
 
 	players.push_back(player_t());
 	players.back().playerstate = PST_CONTACT;
+	players.back().client.address = address;
+	SV_AddrMapInsert(&players.back());
 
 	// generate player id
 	std::set<byte>::iterator id = free_player_ids.begin();
@@ -534,16 +623,6 @@ Players::iterator SV_GetFreeClient(void)
 	return --it;
 }
 
-player_t &SV_FindPlayerByAddr(void)
-{
-	for (Players::iterator it = players.begin();it != players.end();++it)
-	{
-		if (NET_CompareAdr(it->client.address, net_from))
-		   return *it;
-	}
-
-	return idplayer(0);
-}
 
 //
 // SV_CheckTimeouts
@@ -573,6 +652,9 @@ Players::iterator SV_RemoveDisconnectedPlayer(Players::iterator it)
 
 	int player_id = it->id;
 
+	SV_QryInvalidate();
+	SV_DownloadStop(*it);
+
 	if (!it->spectator)
 	{
 		P_PlayerLeavesGame(&(*it));
@@ -602,6 +684,8 @@ Players::iterator SV_RemoveDisconnectedPlayer(Players::iterator it)
 	}
 
 	// remove this player from the global players vector
+	SV_AddrMapRemove(&(*it));
+
 	Players::iterator next;
 	next = players.erase(it);
 	free_player_ids.insert(player_id);
@@ -621,23 +705,31 @@ void SV_GetPackets()
 {
 	while (NET_GetPacket())
 	{
-		player_t &player = SV_FindPlayerByAddr();
+		player_t* player = SV_AddrMapFind(net_from);
 
-		if (!validplayer(player)) // no client with net_from address
+		if (player == NULL) // no client with net_from address
 		{
-			// apparently, someone is trying to connect
-			if (gamestate == GS_LEVEL || gamestate == GS_INTERMISSION)
+			if (gamestate != GS_LEVEL && gamestate != GS_INTERMISSION)
+				continue;
+
+			// Anybody else is querying the server or trying to connect,
+			// the challenge says which.
+			int challenge = MSG_ReadLong();
+
+			if (challenge == CHALLENGE)
 				SV_ConnectClient();
+			else if (challenge == LAUNCHER_CHALLENGE)
+				SV_SendServerInfo();
+			else
+				SV_QryParseEnquiry(challenge);
 
 			continue;
 		}
-		else
+
+		if (player->playerstate != PST_DISCONNECT)
 		{
-			if(player.playerstate != PST_DISCONNECT)
-			{
-				player.client.last_received = gametic;
-				SV_ParseCommands(player);
-			}
+			player->client.last_received = gametic;
+			SV_ParseCommands(*player);
 		}
 	}
 }
@@ -879,6 +971,8 @@ Spreads a player's userinfo to every client.
  */
 void SV_BroadcastUserInfo(player_t &player)
 {
+	SV_QryInvalidate();
+
 	for (Players::iterator it = players.begin();it != players.end();++it)
 		SV_SendUserInfo(player, &(it->client));
 }
@@ -1362,13 +1456,25 @@ void SV_BroadcastSector(int sectornum)
 // SV_UpdateSectors
 // Update doors, floors, ceilings etc... that have at some point moved
 //
+// Only sectors that ever changed can differ from how the client loaded
+// the map, and of those, sectors that have come to rest where they started
+// need no svc_sector either.
+//
 void SV_UpdateSectors(client_t* cl)
 {
-	for (int sectornum = 0; sectornum < numsectors; sectornum++)
+	for (size_t i = 0; i < dirtysectors.size(); i++)
 	{
-		SV_UpdateSector(cl, sectornum);
+		const dirtysector_t& dirty = dirtysectors[i];
+		sector_s* sector = dirty.sector;
+		int sectornum = sector - sectors;
+
+		if (sector->floordata || sector->ceilingdata ||
+		    P_FloorHeight(sector) != dirty.floorheight ||
+		    P_CeilingHeight(sector) != dirty.ceilingheight ||
+		    sector->floorpic != dirty.floorpic || sector->ceilingpic != dirty.ceilingpic ||
+		    sector->special != dirty.special)
+			SV_UpdateSector(cl, sectornum);
 
-		sector_s* sector = &sectors[sectornum];
 		if (!sector->SectorChanges)
 			continue;
 
@@ -1647,6 +1753,23 @@ void SV_SendGametic(client_t* cl)
 	MSG_WriteByte	(&cl->netbuf, (byte)(gametic & 0xFF));
 }
 
+//
+// SV_SendCmdAck
+//
+// Tells the client the newest of its ticcmds that has arrived, so it only
+// has to send the ones after it, and how many of its packets go missing so
+// it knows how many of those to repeat.
+//
+void SV_SendCmdAck(client_t* cl)
+{
+	if (cl->lastclientcmdtic <= 0 || cl->packedversion < MAKEVER(0, 9, 4))
+		return;
+
+	MSG_WriteMarker	(&cl->netbuf, svc_cmdack);
+	MSG_WriteUnVarint(&cl->netbuf, cl->lastclientcmdtic);
+	MSG_WriteByte	(&cl->netbuf, (byte)(cl->cmdloss * 255.0f + 0.5f));
+}
+
 short P_GetButtonTexture(line_t* line);
 
 void SV_LineStateUpdate(client_t *cl)
@@ -1705,100 +1828,124 @@ void SV_LineStateUpdate(client_t *cl)
 	}
 }
 
-void SV_ThinkerUpdate(client_t* cl)
+//
+// SV_ThinkerType
+//
+// The ThinkerType a full update sends for a thinker, or -1 for thinkers
+// clients learn about some other way.  Looked up by the thinker's class,
+// none of these are subclassed.
+//
+static int SV_ThinkerType(DThinker* thinker)
 {
-	TThinkerIterator<DScroller> scrollIter;
-	TThinkerIterator<DFireFlicker> fireIter;
-	TThinkerIterator<DFlicker> flickerIter;
-	TThinkerIterator<DLightFlash> lightFlashIter;
-	TThinkerIterator<DStrobe> strobeIter;
-	TThinkerIterator<DGlow>	glowIter;
-	TThinkerIterator<DGlow2> glow2Iter;
-	TThinkerIterator<DPhased> phasedIter;
-
-	DScroller *scroller;
-	DFireFlicker* fireFlicker;
-	DFlicker* flicker;
-	DLightFlash* lightFlash;
-	DStrobe* strobe;
-	DGlow* glow;
-	DGlow2* glow2;
-	DPhased* phased;
-
-	while ((scroller = scrollIter.Next()))
-	{
-		MSG_WriteMarker(&cl->reliablebuf, svc_thinkerupdate);
-		MSG_WriteByte(&cl->reliablebuf, TT_Scroller);
-		MSG_WriteByte(&cl->reliablebuf, scroller->GetType());
-		MSG_WriteLong(&cl->reliablebuf, scroller->GetScrollX());
-		MSG_WriteLong(&cl->reliablebuf, scroller->GetScrollY());
-		MSG_WriteLong(&cl->reliablebuf, scroller->GetAffectee());
-	}
-
-	while ((fireFlicker = fireIter.Next()))
-	{
-		MSG_WriteMarker(&cl->reliablebuf, svc_thinkerupdate);
-		MSG_WriteByte(&cl->reliablebuf, TT_FireFlicker);
-		MSG_WriteShort(&cl->reliablebuf, fireFlicker->GetSector() - sectors);
-		MSG_WriteShort(&cl->reliablebuf, fireFlicker->GetMinLight());
-		MSG_WriteShort(&cl->reliablebuf, fireFlicker->GetMaxLight());
-	}
+	static std::vector<int> types;
 
-	while ((flicker = flickerIter.Next()))
+	if (types.size() != TypeInfo::m_NumTypes)
 	{
-		MSG_WriteMarker(&cl->reliablebuf, svc_thinkerupdate);
-		MSG_WriteByte(&cl->reliablebuf, TT_Flicker);
-		MSG_WriteShort(&cl->reliablebuf, flicker->GetSector() - sectors);
-		MSG_WriteShort(&cl->reliablebuf, flicker->GetMinLight());
-		MSG_WriteShort(&cl->reliablebuf, flicker->GetMaxLight());
+		types.assign(TypeInfo::m_NumTypes, -1);
+		types[RUNTIME_CLASS(DScroller)->TypeIndex] = TT_Scroller;
+		types[RUNTIME_CLASS(DFireFlicker)->TypeIndex] = TT_FireFlicker;
+		types[RUNTIME_CLASS(DFlicker)->TypeIndex] = TT_Flicker;
+		types[RUNTIME_CLASS(DLightFlash)->TypeIndex] = TT_LightFlash;
+		types[RUNTIME_CLASS(DStrobe)->TypeIndex] = TT_Strobe;
+		types[RUNTIME_CLASS(DGlow)->TypeIndex] = TT_Glow;
+		types[RUNTIME_CLASS(DGlow2)->TypeIndex] = TT_Glow2;
+		types[RUNTIME_CLASS(DPhased)->TypeIndex] = TT_Phased;
 	}
 
-	while ((lightFlash = lightFlashIter.Next()))
-	{
-		MSG_WriteMarker(&cl->reliablebuf, svc_thinkerupdate);
-		MSG_WriteByte(&cl->reliablebuf, TT_LightFlash);
-		MSG_WriteShort(&cl->reliablebuf, lightFlash->GetSector() - sectors);
-		MSG_WriteShort(&cl->reliablebuf, lightFlash->GetMinLight());
-		MSG_WriteShort(&cl->reliablebuf, lightFlash->GetMaxLight());
-	}
+	return types[RUNTIME_TYPE(thinker)->TypeIndex];
+}
 
-	while ((strobe = strobeIter.Next()))
-	{
-		MSG_WriteMarker(&cl->reliablebuf, svc_thinkerupdate);
-		MSG_WriteByte(&cl->reliablebuf, TT_Strobe);
-		MSG_WriteShort(&cl->reliablebuf, strobe->GetSector() - sectors);
-		MSG_WriteShort(&cl->reliablebuf, strobe->GetMinLight());
-		MSG_WriteShort(&cl->reliablebuf, strobe->GetMaxLight());
-		MSG_WriteShort(&cl->reliablebuf, strobe->GetDarkTime());
-		MSG_WriteShort(&cl->reliablebuf, strobe->GetBrightTime());
-		MSG_WriteByte(&cl->reliablebuf, strobe->GetCount());
-	}
+//
+// SV_ThinkerUpdate
+//
+// Sends the state of every scroller and lighting effect in one pass over
+// the thinkers.
+//
+void SV_ThinkerUpdate(client_t* cl)
+{
+	TThinkerIterator<DThinker> iterator;
+	DThinker* thinker;
 
-	while ((glow = glowIter.Next()))
+	while ((thinker = iterator.Next()))
 	{
-		MSG_WriteMarker(&cl->reliablebuf, svc_thinkerupdate);
-		MSG_WriteByte(&cl->reliablebuf, TT_Glow);
-		MSG_WriteShort(&cl->reliablebuf, glow->GetSector() - sectors);
-	}
+		int type = SV_ThinkerType(thinker);
+		if (type < 0)
+			continue;
 
-	while ((glow2 = glow2Iter.Next()))
-	{
 		MSG_WriteMarker(&cl->reliablebuf, svc_thinkerupdate);
-		MSG_WriteByte(&cl->reliablebuf, TT_Glow2);
-		MSG_WriteShort(&cl->reliablebuf, glow2->GetSector() - sectors);
-		MSG_WriteShort(&cl->reliablebuf, glow2->GetStart());
-		MSG_WriteShort(&cl->reliablebuf, glow2->GetEnd());
-		MSG_WriteShort(&cl->reliablebuf, glow2->GetMaxTics());
-		MSG_WriteByte(&cl->reliablebuf, glow2->GetOneShot());
-	}
+		MSG_WriteByte(&cl->reliablebuf, type);
 
-	while ((phased = phasedIter.Next()))
-	{
-		MSG_WriteMarker(&cl->reliablebuf, svc_thinkerupdate);
-		MSG_WriteByte(&cl->reliablebuf, TT_Phased);
-		MSG_WriteShort(&cl->reliablebuf, phased->GetSector() - sectors);
-		MSG_WriteShort(&cl->reliablebuf, phased->GetBaseLevel());
-		MSG_WriteByte(&cl->reliablebuf, phased->GetPhase());
+		switch (type)
+		{
+		case TT_Scroller:
+		{
+			DScroller* scroller = static_cast<DScroller*>(thinker);
+			MSG_WriteByte(&cl->reliablebuf, scroller->GetType());
+			MSG_WriteLong(&cl->reliablebuf, scroller->GetScrollX());
+			MSG_WriteLong(&cl->reliablebuf, scroller->GetScrollY());
+			MSG_WriteLong(&cl->reliablebuf, scroller->GetAffectee());
+			break;
+		}
+		case TT_FireFlicker:
+		{
+			DFireFlicker* fireFlicker = static_cast<DFireFlicker*>(thinker);
+			MSG_WriteShort(&cl->reliablebuf, fireFlicker->GetSector() - sectors);
+			MSG_WriteShort(&cl->reliablebuf, fireFlicker->GetMinLight());
+			MSG_WriteShort(&cl->reliablebuf, fireFlicker->GetMaxLight());
+			break;
+		}
+		case TT_Flicker:
+		{
+			DFlicker* flicker = static_cast<DFlicker*>(thinker);
+			MSG_WriteShort(&cl->reliablebuf, flicker->GetSector() - sectors);
+			MSG_WriteShort(&cl->reliablebuf, flicker->GetMinLight());
+			MSG_WriteShort(&cl->reliablebuf, flicker->GetMaxLight());
+			break;
+		}
+		case TT_LightFlash:
+		{
+			DLightFlash* lightFlash = static_cast<DLightFlash*>(thinker);
+			MSG_WriteShort(&cl->reliablebuf, lightFlash->GetSector() - sectors);
+			MSG_WriteShort(&cl->reliablebuf, lightFlash->GetMinLight());
+			MSG_WriteShort(&cl->reliablebuf, lightFlash->GetMaxLight());
+			break;
+		}
+		case TT_Strobe:
+		{
+			DStrobe* strobe = static_cast<DStrobe*>(thinker);
+			MSG_WriteShort(&cl->reliablebuf, strobe->GetSector() - sectors);
+			MSG_WriteShort(&cl->reliablebuf, strobe->GetMinLight());
+			MSG_WriteShort(&cl->reliablebuf, strobe->GetMaxLight());
+			MSG_WriteShort(&cl->reliablebuf, strobe->GetDarkTime());
+			MSG_WriteShort(&cl->reliablebuf, strobe->GetBrightTime());
+			MSG_WriteByte(&cl->reliablebuf, strobe->GetCount());
+			break;
+		}
+		case TT_Glow:
+		{
+			DGlow* glow = static_cast<DGlow*>(thinker);
+			MSG_WriteShort(&cl->reliablebuf, glow->GetSector() - sectors);
+			break;
+		}
+		case TT_Glow2:
+		{
+			DGlow2* glow2 = static_cast<DGlow2*>(thinker);
+			MSG_WriteShort(&cl->reliablebuf, glow2->GetSector() - sectors);
+			MSG_WriteShort(&cl->reliablebuf, glow2->GetStart());
+			MSG_WriteShort(&cl->reliablebuf, glow2->GetEnd());
+			MSG_WriteShort(&cl->reliablebuf, glow2->GetMaxTics());
+			MSG_WriteByte(&cl->reliablebuf, glow2->GetOneShot());
+			break;
+		}
+		case TT_Phased:
+		{
+			DPhased* phased = static_cast<DPhased*>(thinker);
+			MSG_WriteShort(&cl->reliablebuf, phased->GetSector() - sectors);
+			MSG_WriteShort(&cl->reliablebuf, phased->GetBaseLevel());
+			MSG_WriteByte(&cl->reliablebuf, phased->GetPhase());
+			break;
+		}
+		}
 	}
 }
 
@@ -1866,6 +2013,78 @@ void SV_ClientFullUpdate(player_t &pl)
 	SV_SendPacket(pl);
 }
 
+//
+// joinbench
+//
+// Writes the part of a full update that describes the level, sectors,
+// switches, lines and thinkers, for clients joining the current map all
+// at once, as after a map change.  Nothing is sent, the buffers are only
+// counted and emptied where a real full update would send a packet.  Best
+// run on a large map that has been played on for a while.
+//
+BEGIN_COMMAND(joinbench)
+{
+	int count = argc > 1 ? clamp(atoi(argv[1]), 1, MAXPLAYERS) : 32;
+
+	if (gamestate != GS_LEVEL)
+	{
+		Printf(PRINT_HIGH, "joinbench: No level loaded.\n");
+		return;
+	}
+
+	// Roomy enough that nothing is lost on maps with a lot going on
+	client_t scratch;
+	scratch.reliablebuf = MAX_UDP_PACKET * 64;
+	client_t* cl = &scratch;
+
+	size_t bytes = 0;
+	dtime_t total = 0, worst = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		dtime_t start = I_GetTime();
+
+		SV_UpdateSectors(cl);
+		bytes += cl->reliablebuf.cursize;
+		cl->reliablebuf.clear();
+
+		P_UpdateButtons(cl);
+		bytes += cl->reliablebuf.cursize;
+		cl->reliablebuf.clear();
+
+		SV_LineStateUpdate(cl);
+		bytes += cl->reliablebuf.cursize;
+		cl->reliablebuf.clear();
+
+		SV_ThinkerUpdate(cl);
+		bytes += cl->reliablebuf.cursize;
+		cl->reliablebuf.clear();
+
+		dtime_t elapsed = I_GetTime() - start;
+		total += elapsed;
+		worst = MAX(worst, elapsed);
+	}
+
+	int thinkers = 0, updated = 0;
+	TThinkerIterator<DThinker> iterator;
+	DThinker* thinker;
+	while ((thinker = iterator.Next()))
+	{
+		thinkers++;
+		if (SV_ThinkerType(thinker) >= 0)
+			updated++;
+	}
+
+	Printf(PRINT_HIGH, "joinbench: %d clients joining %s\n", count, level.mapname);
+	Printf(PRINT_HIGH, "%d sectors, %u changed since the map loaded\n", numsectors,
+	       (unsigned)dirtysectors.size());
+	Printf(PRINT_HIGH, "%d thinkers, %d of them sent\n", thinkers, updated);
+	Printf(PRINT_HIGH, "%u bytes a client, %.3f ms a client, %.3f ms at worst, %.3f ms in all\n",
+	       (unsigned)(bytes / count), (double)total / count / I_ConvertTimeFromMs(1),
+	       (double)worst / I_ConvertTimeFromMs(1), (double)total / I_ConvertTimeFromMs(1));
+}
+END_COMMAND(joinbench)
+
 //===========================
 // SV_UpdateSecret
 // Updates a sector to a client and the number of secrets found.
@@ -1904,27 +2123,44 @@ void SV_SendServerSettings (player_t &pl)
 	// GhostlyDeath <June 19, 2008> -- Loop through all CVARs and send the CVAR_SERVERINFO stuff only
 	cvar_t *var = GetFirstCvar();
 
-    client_t *cl = &pl.client;
+	client_t *cl = &pl.client;
+
+	// As many settings to a message as fit in a packet, so the client sets
+	// them and runs their callbacks together
+	bool open = false;
 
 	while (var)
 	{
 		if (var->flags() & CVAR_SERVERINFO)
 		{
-            if ((cl->reliablebuf.cursize + 1 + 1 + (strlen(var->name()) + 1) + (strlen(var->cstring()) + 1) + 1) >= 512)
-                SV_SendPacket(pl);
+			size_t size = 1 + (strlen(var->name()) + 1) + (strlen(var->cstring()) + 1);
 
-            MSG_WriteMarker(&cl->reliablebuf, svc_serversettings);
+			if ((cl->reliablebuf.cursize + (open ? 0 : 1) + size + 1) >= 512)
+			{
+				if (open)
+					MSG_WriteByte(&cl->reliablebuf, 2);
+				open = false;
 
-            MSG_WriteByte(&cl->reliablebuf, 1); // TODO: REMOVE IN 0.7
+				SV_SendPacket(pl);
+			}
+
+			if (!open)
+			{
+				MSG_WriteMarker(&cl->reliablebuf, svc_serversettings);
+				open = true;
+			}
+
+			MSG_WriteByte(&cl->reliablebuf, 1); // TODO: REMOVE IN 0.7
 
 			MSG_WriteString(&cl->reliablebuf, var->name());
 			MSG_WriteString(&cl->reliablebuf, var->cstring());
-
-            MSG_WriteByte(&cl->reliablebuf, 2); // TODO: REMOVE IN 0.7
 		}
 
 		var = var->GetNext();
 	}
+
+	if (open)
+		MSG_WriteByte(&cl->reliablebuf, 2); // TODO: REMOVE IN 0.7
 }
 
 //
@@ -1934,6 +2170,8 @@ void SV_SendServerSettings (player_t &pl)
 //
 void SV_ServerSettingChange (void)
 {
+	SV_QryInvalidate();
+
 	if (gamestate != GS_LEVEL)
 		return;
 
@@ -2083,34 +2321,19 @@ bool SV_CheckClientVersion(client_t *cl, Players::iterator it)
 //
 //	SV_ConnectClient
 //
-//	Called when a client connects
+//	Called when a client connects, after SV_GetPackets has read the challenge
 //
 void G_DoReborn (player_t &playernum);
 
 void SV_ConnectClient()
 {
-	int challenge = MSG_ReadLong();
-
-	// New querying system
-	if (SV_QryParseEnquiry(challenge) == 0)
-		return;
-
-	if (challenge == LAUNCHER_CHALLENGE)  // for Launcher
-	{
-		SV_SendServerInfo();
-		return;
-	}
-
-	if (challenge != CHALLENGE)
-		return;
-
 	if (!SV_IsValidToken(MSG_ReadLong()))
 		return;
 
 	Printf("%s is trying to connect...\n", NET_AdrToString (net_from));
 
 	// find an open slot
-	Players::iterator it = SV_GetFreeClient();
+	Players::iterator it = SV_GetFreeClient(net_from);
 
 	if (it == players.end()) // a server is full
 	{
@@ -2128,12 +2351,13 @@ void SV_ConnectClient()
 	client_t* cl = &(player->client);
 
 	// clear and reinitialize client network info
-	cl->address = net_from;
 	cl->last_received = gametic;
 	cl->reliable_bps = 0;
 	cl->unreliable_bps = 0;
 	cl->lastcmdtic = 0;
 	cl->lastclientcmdtic = 0;
+	cl->lastcmdpackettic = 0;
+	cl->cmdloss = 0.0f;
 	cl->allow_rcon = false;
 	cl->displaydisconnect = false;
 
@@ -2160,6 +2384,8 @@ void SV_ConnectClient()
 	cl->version = MSG_ReadShort();
 	byte connection_type = MSG_ReadByte();
 
+	SV_DownloadStop(*player);
+
 	// [SL] 2011-05-11 - Register the player with the reconciliation system
 	// for unlagging
 	Unlag::getInstance().registerPlayer(player->id);
@@ -2171,6 +2397,10 @@ void SV_ConnectClient()
 		return;
 	}
 
+	// Only clients from 0.9.4 on understand svc_wadinfo and svc_wadchunk
+	if (connection_type == CONNECT_DOWNLOAD && cl->packedversion >= MAKEVER(0, 9, 4))
+		SV_DownloadConnect(*player);
+
 	// Get the userinfo from the client.
 	clc_t userinfo = (clc_t)MSG_ReadByte();
 	if (userinfo != clc_userinfo)
@@ -2227,11 +2457,21 @@ void SV_ConnectClient2(player_t& player)
 	// [Toke] send server settings
 	SV_SendServerSettings(player);
 
+	SV_QryInvalidate();
+
 	cl->displaydisconnect = true;
 
 	cl->download.name = "";
 	cl->download.md5 = "";
 
+	// Only here for a file, which the client asks for next
+	if (SV_IsDownloadConnection(player))
+	{
+		player.playerstate = PST_DOWNLOAD;
+		player.spectator = true;
+		return;
+	}
+
 	SV_BroadcastUserInfo(player);
 
 	// Newly connected players get ENTER state.
@@ -2294,6 +2534,7 @@ void SV_DisconnectClient(player_t &who)
 
 	Maplist_Disconnect(who);
 	Vote_Disconnect(who);
+	SV_DownloadStop(who);
 
 	if (who.client.displaydisconnect)
 	{
@@ -2373,12 +2614,14 @@ void SV_SendDisconnectSignal()
 
 		MSG_WriteMarker(&cl->reliablebuf, svc_disconnect);
 		SV_SendPacket(*it);
+		SV_DownloadStop(*it);
 
 		if (it->mo)
 			it->mo->Destroy();
 	}
 
 	players.clear();
+	SV_AddrMapClear();
 }
 
 //
@@ -2392,12 +2635,14 @@ void SV_SendReconnectSignal()
 	{
 		MSG_WriteMarker(&(it->client.reliablebuf), svc_reconnect);
 		SV_SendPacket(*it);
+		SV_DownloadStop(*it);
 
 		if (it->mo)
 			it->mo->Destroy();
 	}
 
 	players.clear();
+	SV_AddrMapClear();
 }
 
 //
@@ -2407,7 +2652,10 @@ void SV_SendReconnectSignal()
 void SV_ExitLevel()
 {
 	for (Players::iterator it = players.begin(); it != players.end(); ++it)
-		MSG_WriteMarker(&(it->client.reliablebuf), svc_exitlevel);
+	{
+		if (it->playerstate != PST_DOWNLOAD)
+			MSG_WriteMarker(&(it->client.reliablebuf), svc_exitlevel);
+	}
 }
 
 //
@@ -3460,11 +3708,18 @@ void SV_WriteCommands(void)
 	{
 		client_t *cl = &(it->client);
 
+		// Downloaders have no level to update
+		if (it->playerstate == PST_DOWNLOAD)
+			continue;
+
 		// [SL] 2011-05-11 - Send the client the server's gametic
 		// this gametic is returned to the server with the client's
 		// next cmd
 		if (it->ingame())
+		{
 			SV_SendGametic(cl);
+			SV_SendCmdAck(cl);
+		}
 
 		for (Players::iterator pit = players.begin();pit != players.end();++pit)
 		{
@@ -3680,25 +3935,56 @@ void SV_ProcessPlayerCmd(player_t &player)
 // SV_GetPlayerCmd
 //
 // Extracts a player's ticcmd message from their network buffer and queues
-// the ticcmd for later processing.  The client always sends its previous
-// ticcmd followed by its current ticcmd just in case there is a dropped
-// packet.
-
+// the ticcmd for later processing.  The client sends the ticcmds the server
+// has not acknowledged yet, as many of them as the packet loss calls for,
+// oldest first and each one after the first delta encoded against the one
+// before it.  Clients older than 0.9.4 always send their last ten ticcmds
+// in full.
+//
 void SV_GetPlayerCmd(player_t &player)
 {
+	// Weight of each client packet in the running packet loss average
+	static const float LOSS_WEIGHT = 1.0f / TICRATE;
+
 	client_t *cl = &player.client;
 
 	// The client-tic at the time this message was sent.  The server stores
 	// this and sends it back the next time it tells the client
 	int tic = MSG_ReadLong();
 
-	// Read the last 10 ticcmds from the client and add any new ones
-	// to the cmdqueue
-	for (int i = 9; i >= 0; i--)
+	const bool delta = cl->packedversion >= MAKEVER(0, 9, 4);
+	int count = delta ? MSG_ReadByte() : MAX_NETCMDS_PER_PACKET;
+
+	// The client sends a packet every tic, so a jump in the client-tic means
+	// packets were lost.  Longer gaps are the client stalling, not loss.
+	if (tic > cl->lastcmdpackettic)
+	{
+		int missed = tic - cl->lastcmdpackettic - 1;
+		if (cl->lastcmdpackettic > 0 && missed <= TICRATE)
+		{
+			for (int i = 0; i < missed; i++)
+				cl->cmdloss += (1.0f - cl->cmdloss) * LOSS_WEIGHT;
+			cl->cmdloss -= cl->cmdloss * LOSS_WEIGHT;
+		}
+
+		cl->lastcmdpackettic = tic;
+	}
+
+	// Add any new ticcmds to the cmdqueue
+	NetCommand netcmd, prevcmd;
+	for (int i = 0; i < count; i++)
 	{
-		NetCommand netcmd;
-		netcmd.read(&net_message);
-		netcmd.setTic(tic - i);
+		if (i == 0 || !delta)
+		{
+			netcmd.read(&net_message);
+		}
+		else
+		{
+			prevcmd = netcmd;
+			netcmd.read(&net_message, prevcmd);
+		}
+
+		netcmd.setTic(tic - (count - 1 - i));
 
 		if (netcmd.getTic() > cl->lastclientcmdtic && gamestate == GS_LEVEL)
 		{
@@ -3817,6 +4103,8 @@ void SV_SetPlayerSpec(player_t &player, bool setting, bool silent)
 	if (player.ingame() == false)
 		return;
 
+	SV_QryInvalidate();
+
 	if (!setting && player.spectator)
 	{
 		// Join delay means they're mashing buttons too fast.
@@ -4314,7 +4602,8 @@ void SV_WantWad(player_t &player)
 {
 	client_t *cl = &player.client;
 
-	if(!sv_waddownload)
+	// Clients older than 0.9.4 can't read svc_wadinfo and svc_wadchunk
+	if(!sv_waddownload || cl->packedversion < MAKEVER(0, 9, 4))
 	{
 		// read and ignore the rest of the wad request
 		MSG_ReadString();
@@ -4323,7 +4612,9 @@ void SV_WantWad(player_t &player)
 
 		MSG_WriteMarker(&cl->reliablebuf, svc_print);
 		MSG_WriteByte(&cl->reliablebuf, PRINT_HIGH);
-		MSG_WriteString(&cl->reliablebuf, "Server: Downloading is disabled\n");
+		MSG_WriteString(&cl->reliablebuf, !sv_waddownload ?
+		                "Server: Downloading is disabled\n" :
+		                "Server: Your client is too old to download from this server\n");
 
 		SV_DropClient(player);
 		return;
@@ -4336,23 +4627,6 @@ void SV_WantWad(player_t &player)
 	std::string md5 = MSG_ReadString();
 	size_t next_offset = MSG_ReadLong();
 
-	std::string curr_request = D_CleanseFileName(cl->download.name);
-
-	//DPrintf("pre-check client requesting {name: \"%s\", hash: \"%s\"} against {name: \"%s\", hash: \"%s\"}\n",
-	//		request.c_str(), md5.c_str(),
-	//		curr_request.c_str(), cl->download.md5.c_str()
-	//);
-
-	// [jsd] quick check for continuation of download:
-	if (curr_request == request &&
-		cl->download.md5 == md5)
-	{
-		cl->download.next_offset = next_offset;
-		player.playerstate = PST_DOWNLOAD;
-
-		return;
-	}
-
 	std::transform(md5.begin(), md5.end(), md5.begin(), toupper);
 
 	//DPrintf("client requesting {name: \"%s\", hash: \"%s\"}\n", request.c_str(), md5.c_str());
@@ -4397,6 +4671,9 @@ void SV_WantWad(player_t &player)
 	cl->download.md5 = md5;
 	cl->download.next_offset = next_offset;
 	player.playerstate = PST_DOWNLOAD;
+
+	// A repeated request resumes from where the client got to
+	SV_DownloadStart(player, wadfiles[i], next_offset);
 }
 
 //
@@ -4522,6 +4799,10 @@ void SV_ParseCommands(player_t &player)
 			SV_WantWad(player);
 			break;
 
+		case clc_wadack:
+			SV_DownloadAck(player);
+			break;
+
 		case clc_cheat:
 			SV_Cheat(player);
 			break;
@@ -4732,12 +5013,17 @@ void SV_RunTics()
 
 	SV_BanlistTics();
 	SV_UpdateMaster();
+	SV_QryTicker();
 
 	// only run game-related tickers if the server isn't frozen
 	// (sv_emptyfreeze enabled and no clients)
 	if (!step_mode && !SV_Frozen())
 		SV_StepTics(1);
 
+	// Downloads go out after the tic's game packets, in what is left of
+	// sv_waddownloadcap
+	SV_SendDownloads();
+
 	// Remove any recently disconnected clients
 	for (Players::iterator it = players.begin(); it != players.end();)
 	{
@@ -4817,10 +5103,7 @@ BEGIN_COMMAND (playerinfo)
 		return;
 	}
 
-	char ip[16];
-	sprintf(ip, "%d.%d.%d.%d",
-			player->client.address.ip[0], player->client.address.ip[1],
-			player->client.address.ip[2], player->client.address.ip[3]);
+	const char* ip = NET_AdrToString(player->client.address, false);
 
 	char color[8];
 	sprintf(color, "#%02X%02X%02X",
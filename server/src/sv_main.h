@@ -65,6 +65,7 @@ void SV_ConnectClient2(player_t& player);
 void SV_WriteCommands(void);
 void SV_ClearClientsBPS(void);
 bool SV_SendPacket(player_t &pl);
+void SV_SendDownloadPacket(client_t &cl, size_t offset, const byte *data, size_t length);
 void SV_AcknowledgePacket(player_t &player);
 void SV_DisplayTics();
 void SV_RunTics();
@@ -43,13 +43,17 @@ class masterserver
 public:
 	std::string	masterip;
 	netadr_t	masteraddr; // address of the master server
+	netadr_t	masteraddr6; // its IPv6 address, if it has one we can reach
 
 	masterserver()
 	{
+		memset(&masteraddr, 0, sizeof(masteraddr));
+		memset(&masteraddr6, 0, sizeof(masteraddr6));
 	}
 	
 	masterserver(const masterserver &other)
-		: masterip(other.masterip), masteraddr(other.masteraddr)
+		: masterip(other.masterip), masteraddr(other.masteraddr),
+		  masteraddr6(other.masteraddr6)
 	{
 	}
 
@@ -57,6 +61,7 @@ public:
 	{
 		masterip = other.masterip;
 		masteraddr = other.masteraddr;
+		masteraddr6 = other.masteraddr6;
 		return *this;
 	}
 };
@@ -129,6 +134,61 @@ void SV_InitMasters(void)
 }
 
 
+//
+// SV_ResolveMaster
+//
+// Look up the master's address for each family we can send on, so the
+// server is listed with both its IPv4 and IPv6 addresses.  Returns false if
+// neither could be found.
+//
+static bool SV_ResolveMaster(masterserver &m)
+{
+	netadr_t *addrs[2] = { &m.masteraddr, &m.masteraddr6 };
+	netadrtype_t types[2] = { NA_IPV4, NA_IPV6 };
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		memset(addrs[i], 0, sizeof(netadr_t));
+
+		if (types[i] == NA_IPV6 && !NET_HaveIPv6())
+			continue;
+
+		if (!NET_StringToAdr(m.masterip.c_str(), addrs[i], types[i]))
+		{
+			memset(addrs[i], 0, sizeof(netadr_t));
+			continue;
+		}
+
+		if (!addrs[i]->port)
+			I_SetPort(*addrs[i], MASTERPORT);
+	}
+
+	// A master that only has an IPv6 address goes in the main slot.
+	if (NET_IsNullAdr(m.masteraddr))
+	{
+		m.masteraddr = m.masteraddr6;
+		memset(&m.masteraddr6, 0, sizeof(m.masteraddr6));
+	}
+
+	return !NET_IsNullAdr(m.masteraddr);
+}
+
+//
+// SV_MasterAdrToString
+//
+static std::string SV_MasterAdrToString(const masterserver &m)
+{
+	std::string str = NET_AdrToString(m.masteraddr);
+
+	if (!NET_IsNullAdr(m.masteraddr6))
+	{
+		str += ", ";
+		str += NET_AdrToString(m.masteraddr6);
+	}
+
+	return str;
+}
+
 //
 // SV_AddMaster
 //
@@ -140,28 +200,25 @@ bool SV_AddMaster(const char *masterip)
 	masterserver m;
 	m.masterip = masterip;
 
-	NET_StringToAdr (m.masterip.c_str(), &m.masteraddr);
-
-	if(!m.masteraddr.port)
-		I_SetPort(m.masteraddr, MASTERPORT);
+	bool resolved = SV_ResolveMaster(m);
 
 	for(size_t i = 0; i < masters.size(); i++)
 	{
 		if(masters[i].masterip == m.masterip)
 		{
-			Printf("Master %s [%s] is already on the list", m.masterip.c_str(), NET_AdrToString(m.masteraddr));
+			Printf("Master %s [%s] is already on the list", m.masterip.c_str(), SV_MasterAdrToString(m).c_str());
 			return false;
 		}
 	}
 	
-	if(m.masteraddr.ip[0] == 0 && m.masteraddr.ip[1] == 0 && m.masteraddr.ip[2] == 0 && m.masteraddr.ip[3] == 0)
+	if(!resolved)
 	{
 		Printf("Failed to resolve master server: %s, not added", m.masterip.c_str());
 		return false;
 	}
 	else
 	{
-		Printf("Added master: %s [%s]", m.masterip.c_str(), NET_AdrToString(m.masteraddr));
+		Printf("Added master: %s [%s]", m.masterip.c_str(), SV_MasterAdrToString(m).c_str());
 		masters.push_back(m);
 	}
 
@@ -185,7 +242,7 @@ void SV_ListMasters(void)
 	Printf("Use addmaster/delmaster commands to modify this list");
 
 	for(size_t index = 0; index < masters.size(); index++)
-		Printf("%s [%s]", masters[index].masterip.c_str(), NET_AdrToString(masters[index].masteraddr));
+		Printf("%s [%s]", masters[index].masterip.c_str(), SV_MasterAdrToString(masters[index]).c_str());
 }
 
 //
@@ -212,6 +269,13 @@ bool SV_RemoveMaster(const char *masterip)
 //
 void SV_UpdateMasterServer(masterserver &m)
 {
+	netadr_t *addrs[2] = { &m.masteraddr, &m.masteraddr6 };
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (NET_IsNullAdr(*addrs[i]))
+			continue;
+
 		SZ_Clear(&ml_message);
 		MSG_WriteLong(&ml_message, CHALLENGE);
 
@@ -221,7 +285,8 @@ void SV_UpdateMasterServer(masterserver &m)
 		else
 			MSG_WriteShort(&ml_message, port);
 
-		NET_SendPacket(ml_message, m.masteraddr);
+		NET_SendPacket(ml_message, *addrs[i]);
+	}
 }
 
 //
@@ -249,10 +314,7 @@ void SV_UpdateMaster(void)
 	if (current_time - last_address_resolution >= I_ConvertTimeFromMs(1000 * 60 * 60 * 3))
 	{
 		for (size_t index = 0; index < masters.size(); index++)
-		{
-			NET_StringToAdr(masters[index].masterip.c_str(), &masters[index].masteraddr);
-			I_SetPort(masters[index].masteraddr, MASTERPORT);
-		}
+			SV_ResolveMaster(masters[index]);
 
 		last_address_resolution = current_time;
 	}
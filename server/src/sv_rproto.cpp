@@ -230,6 +230,28 @@ bool SV_SendPacket(player_t &pl)
 	return true;
 }
 
+//
+// SV_SendDownloadPacket
+//
+// Sends one svc_wadchunk in a packet of its own, copying the chunk straight
+// from data into the packet.  It is neither compressed nor kept for the
+// reliable protocol, and takes no sequence number of its own, so the
+// client doesn't acknowledge it: downloads resend what goes missing
+// themselves.
+//
+void SV_SendDownloadPacket(client_t &cl, size_t offset, const byte *data, size_t length)
+{
+	sendd.clear();
+
+	MSG_WriteLong(&sendd, cl.sequence);
+	MSG_WriteMarker(&sendd, svc_wadchunk);
+	MSG_WriteLong(&sendd, offset);
+	MSG_WriteShort(&sendd, length);
+	MSG_WriteChunk(&sendd, data, length);
+
+	NET_SendPacket(sendd, cl.address);
+}
+
 //
 // SV_AcknowledgePacket
 //
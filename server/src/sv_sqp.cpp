@@ -33,12 +33,21 @@
 #include "p_ctf.h"
 #include "version.h"
 #include "g_gametype.h"
+#include "i_system.h"
+
+#ifdef _WIN32
+#include "win32inc.h"
+#else
+#include <pthread.h>
+#endif
 
 static buf_t ml_message(MAX_UDP_PACKET);
 
 EXTERN_CVAR(join_password)
 EXTERN_CVAR(sv_timelimit)
 EXTERN_CVAR(sv_teamsinplay)
+EXTERN_CVAR(sv_qryratelimit)
+EXTERN_CVAR(sv_qrythread)
 
 struct CvarField_t
 {
@@ -73,29 +82,26 @@ struct CvarField_t
 //
 // IntQryBuildInformation()
 //
-// Protocol building routine, the passed parameter is the enquirer version
-static void IntQryBuildInformation(const DWORD& EqProtocolVersion,
-                                   const DWORD& EqTime)
+// Protocol building routine, the passed parameter is the enquirer version.
+// Everything after the echoed enquirer time is built here so it can be cached.
+static void IntQryBuildInformation(buf_t& out, const DWORD& EqProtocolVersion)
 {
 	std::vector<CvarField_t> Cvars;
 
-	// bond - time
-	MSG_WriteLong(&ml_message, EqTime);
-
 	// The servers real protocol version
 	// bond - real protocol
-	MSG_WriteLong(&ml_message, PROTOCOL_VERSION);
+	MSG_WriteLong(&out, PROTOCOL_VERSION);
 
 	// Built revision of server
 	// TODO: Remove guard before next release
 	QRYNEWINFO(7)
 	{
 		// Send the detailed version - version number was in PROTOCOL_VERSION.
-		MSG_WriteString(&ml_message, NiceVersionDetails());
+		MSG_WriteString(&out, NiceVersionDetails());
 	}
 	else
 	{
-		MSG_WriteLong(&ml_message, -1);
+		MSG_WriteLong(&out, -1);
 	}
 
 	cvar_t* var = GetFirstCvar();
@@ -126,40 +132,40 @@ next:
 	}
 
 	// Cvar count
-	MSG_WriteByte(&ml_message, (BYTE)Cvars.size());
+	MSG_WriteByte(&out, (BYTE)Cvars.size());
 
 	// Write cvars
 	for(size_t i = 0; i < Cvars.size(); ++i)
 	{
-		MSG_WriteString(&ml_message, Cvars[i].Name.c_str());
+		MSG_WriteString(&out, Cvars[i].Name.c_str());
 
 		// Type field
-		MSG_WriteByte(&ml_message, (byte)Cvars[i].Type);
+		MSG_WriteByte(&out, (byte)Cvars[i].Type);
 
 		switch(Cvars[i].Type)
 		{
 		case CVARTYPE_BYTE:
 		{
-			MSG_WriteByte(&ml_message, (byte)atoi(Cvars[i].Value.c_str()));
+			MSG_WriteByte(&out, (byte)atoi(Cvars[i].Value.c_str()));
 		}
 		break;
 
 		case CVARTYPE_WORD:
 		{
-			MSG_WriteShort(&ml_message, (short)atoi(Cvars[i].Value.c_str()));
+			MSG_WriteShort(&out, (short)atoi(Cvars[i].Value.c_str()));
 		}
 		break;
 
 		case CVARTYPE_INT:
 		{
-			MSG_WriteLong(&ml_message, (int)atoi(Cvars[i].Value.c_str()));
+			MSG_WriteLong(&out, (int)atoi(Cvars[i].Value.c_str()));
 		}
 		break;
 
 		case CVARTYPE_FLOAT:
 		case CVARTYPE_STRING:
 		{
-			MSG_WriteString(&ml_message, Cvars[i].Value.c_str());
+			MSG_WriteString(&out, Cvars[i].Value.c_str());
 		}
 		break;
 
@@ -170,9 +176,9 @@ next:
 		}
 	}
 
-	MSG_WriteHexString(&ml_message, strlen(join_password.cstring()) ? MD5SUM(join_password.cstring()).c_str() : "");
+	MSG_WriteHexString(&out, strlen(join_password.cstring()) ? MD5SUM(join_password.cstring()).c_str() : "");
 
-	MSG_WriteString(&ml_message, level.mapname);
+	MSG_WriteString(&out, level.mapname);
 
 	int timeleft = (int)(sv_timelimit - level.time/(TICRATE*60));
 
@@ -185,67 +191,67 @@ next:
 	QRYNEWINFO(6)
 	{
 		if (sv_timelimit.asInt())
-			MSG_WriteShort(&ml_message, timeleft);
+			MSG_WriteShort(&out, timeleft);
 	}
 	else
-		MSG_WriteShort(&ml_message, timeleft);
+		MSG_WriteShort(&out, timeleft);
 	
 	// Teams
 	if(G_IsTeamGame())
 	{
 		// Team data
 		int teams = sv_teamsinplay.asInt();
-		MSG_WriteByte(&ml_message, teams);
+		MSG_WriteByte(&out, teams);
 
 		for (int i = 0; i < teams; i++)
 		{
 			TeamInfo* teamInfo = GetTeamInfo((team_t)i);
-			MSG_WriteString(&ml_message, teamInfo->ColorString.c_str());
-			MSG_WriteLong(&ml_message, teamInfo->Color);
-			MSG_WriteShort(&ml_message, teamInfo->Points);
+			MSG_WriteString(&out, teamInfo->ColorString.c_str());
+			MSG_WriteLong(&out, teamInfo->Color);
+			MSG_WriteShort(&out, teamInfo->Points);
 		}
 	}
 
 	// Patch files
-	MSG_WriteByte(&ml_message, patchfiles.size());
+	MSG_WriteByte(&out, patchfiles.size());
 
 	for(size_t i = 0; i < patchfiles.size(); ++i)
 	{
-		MSG_WriteString(&ml_message,
+		MSG_WriteString(&out,
 		                D_CleanseFileName(::patchfiles[i].getBasename()).c_str());
 	}
 
 	// Wad files
-	MSG_WriteByte(&ml_message, wadfiles.size());
+	MSG_WriteByte(&out, wadfiles.size());
 
 	for(size_t i = 0; i < wadfiles.size(); ++i)
 	{
-		MSG_WriteString(&ml_message,
+		MSG_WriteString(&out,
 		                D_CleanseFileName(::wadfiles[i].getBasename(), "wad").c_str());
-		MSG_WriteHexString(&ml_message, ::wadfiles[i].getHash().c_str());
+		MSG_WriteHexString(&out, ::wadfiles[i].getHash().c_str());
 	}
 
-	MSG_WriteByte(&ml_message, players.size());
+	MSG_WriteByte(&out, players.size());
 
 	// Player info
 	for(Players::iterator it = players.begin(); it != players.end(); ++it)
 	{
-		MSG_WriteString(&ml_message, it->userinfo.netname.c_str());
+		MSG_WriteString(&out, it->userinfo.netname.c_str());
 
 		for (int i = 3; i >= 0; i--)
-			MSG_WriteByte(&ml_message, it->userinfo.color[i]);
+			MSG_WriteByte(&out, it->userinfo.color[i]);
 
 		if(G_IsTeamGame())
-			MSG_WriteByte(&ml_message, it->userinfo.team);
+			MSG_WriteByte(&out, it->userinfo.team);
 
-		MSG_WriteShort(&ml_message, it->ping);
+		MSG_WriteShort(&out, it->ping);
 
 		int timeingame = (time(NULL) - it->JoinTime) / 60;
 
 		if(timeingame < 0)
 			timeingame = 0;
 
-		MSG_WriteShort(&ml_message, timeingame);
+		MSG_WriteShort(&out, timeingame);
 
 		// FIXME - Treat non-players (downloaders/others) as spectators too for now
 		bool spectator;
@@ -255,12 +261,413 @@ next:
 					  (it->playerstate != PST_DEAD) &&
 					  (it->playerstate != PST_REBORN)));
 
-		MSG_WriteBool(&ml_message, spectator);
+		MSG_WriteBool(&out, spectator);
+
+		MSG_WriteShort(&out, it->fragcount);
+		MSG_WriteShort(&out, it->killcount);
+		MSG_WriteShort(&out, it->deathcount);
+	}
+}
+
+//
+// Response cache
+//
+// Building the response walks every cvar, wad and player, so the part after
+// the echoed time is kept per enquirer protocol version.  It is rebuilt when
+// something it shows changes, and at most every QRY_REFRESH_MS for the
+// scores, pings and time left that change all the time.
+//
+
+#define QRY_REFRESH_MS		1000
+#define QRY_RATE_SLOTS		256
+#define QRY_MAX_QUEUED		1024
+
+struct QryCache_t
+{
+	buf_t body;
+	dtime_t built;
+	bool valid;
+	bool wanted;		// asked for by the query thread since the last build
+};
+
+static QryCache_t qry_cache[PROTOCOL_VERSION + 1];
+
+struct QryRequest_t
+{
+	netadr_t From;
+	DWORD Tag;
+	WORD PacketType;
+	DWORD EqProtocolVersion;
+	DWORD EqTime;
+};
+
+struct QryReply_t
+{
+	netadr_t To;
+	buf_t Body;
+};
+
+// Requests for the query thread, and those waiting on a rebuild
+static std::vector<QryRequest_t> qry_queue;
+static std::vector<QryRequest_t> qry_waiting;
+
+// Answers from the query thread, sent by the game thread since sending can
+// print to the console
+static std::vector<QryReply_t> qry_replies;
+static bool qry_thread_started = false;
+
+#ifdef _WIN32
+static CRITICAL_SECTION qry_lock;
+static HANDLE qry_event;
+static bool qry_lock_init = false;
+
+static void IntQryLock()
+{
+	if(!qry_lock_init)
+	{
+		InitializeCriticalSection(&qry_lock);
+		qry_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+		qry_lock_init = true;
+	}
+	EnterCriticalSection(&qry_lock);
+}
+
+static void IntQryUnlock()
+{
+	LeaveCriticalSection(&qry_lock);
+}
+
+// Called with the lock held, returns with it held
+static void IntQryWait()
+{
+	LeaveCriticalSection(&qry_lock);
+	WaitForSingleObject(qry_event, INFINITE);
+	EnterCriticalSection(&qry_lock);
+}
+
+static void IntQrySignal()
+{
+	SetEvent(qry_event);
+}
+#else
+static pthread_mutex_t qry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t qry_cond = PTHREAD_COND_INITIALIZER;
+
+static void IntQryLock()
+{
+	pthread_mutex_lock(&qry_lock);
+}
+
+static void IntQryUnlock()
+{
+	pthread_mutex_unlock(&qry_lock);
+}
+
+static void IntQryWait()
+{
+	pthread_cond_wait(&qry_cond, &qry_lock);
+}
+
+static void IntQrySignal()
+{
+	pthread_cond_signal(&qry_cond);
+}
+#endif
+
+//
+// IntQryRebuild()
+//
+// Game thread only.  Builds outside the lock so the query thread can keep
+// answering from the old copy meanwhile.
+//
+static void IntQryRebuild(DWORD EqProtocolVersion)
+{
+	static buf_t fresh(MAX_UDP_PACKET);
+
+	SZ_Clear(&fresh);
+	IntQryBuildInformation(fresh, EqProtocolVersion);
+
+	IntQryLock();
+
+	QryCache_t &cache = qry_cache[EqProtocolVersion];
+
+	cache.body = fresh;
+	cache.built = I_MSTime();
+	cache.valid = true;
+	cache.wanted = false;
+
+	IntQryUnlock();
+}
+
+static bool IntQryIsFresh(const QryCache_t &cache)
+{
+	return cache.valid && I_MSTime() - cache.built < QRY_REFRESH_MS;
+}
+
+//
+// IntQryAnswer()
+//
+// Writes the response for a request into out, called with the lock held.
+// Returns false when the cached information is not there yet, which only
+// happens on the query thread since the game thread can build it.
+//
+static bool IntQryAnswer(const QryRequest_t &Request, buf_t &out, bool CanBuild)
+{
+	DWORD EqProtocolVersion = Request.EqProtocolVersion;
+
+	SZ_Clear(&out);
+
+	MSG_WriteLong(&out, Request.Tag);
+	MSG_WriteLong(&out, GAMEVER);
+
+	// Enquirer requested the version info of the server or the server
+	// determined it is an old version
+	if(Request.PacketType == 1 || Request.PacketType == 2)
+	{
+		// bond - real protocol
+		MSG_WriteLong(&out, PROTOCOL_VERSION);
+
+		MSG_WriteLong(&out, Request.EqTime);
+
+		//Printf(PRINT_HIGH, "Application is old version\n");
+
+		return true;
+	}
+
+	// If the enquirer protocol is newer, send the latest information the
+	// server supports, otherwise send information built to the their version
+	if(EqProtocolVersion > PROTOCOL_VERSION)
+		EqProtocolVersion = PROTOCOL_VERSION;
+
+	QryCache_t &cache = qry_cache[EqProtocolVersion];
+
+	if(!IntQryIsFresh(cache))
+	{
+		if(!CanBuild)
+		{
+			cache.wanted = true;
+			if(!cache.valid)
+				return false;
+		}
+		else
+		{
+			IntQryUnlock();
+			IntQryRebuild(EqProtocolVersion);
+			IntQryLock();
+		}
+	}
+
+	MSG_WriteLong(&out, EqProtocolVersion);
+
+	// bond - time
+	MSG_WriteLong(&out, Request.EqTime);
+
+	SZ_Write(&out, cache.body.ptr(), cache.body.size());
+
+	return true;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI IntQryThread(LPVOID)
+#else
+static void *IntQryThread(void *)
+#endif
+{
+	static buf_t reply(MAX_UDP_PACKET);
+	std::vector<QryRequest_t> work;
+
+	IntQryLock();
+
+	for(;;)
+	{
+		while(qry_queue.empty())
+			IntQryWait();
+
+		work.swap(qry_queue);
+
+		for(size_t i = 0; i < work.size(); i++)
+		{
+			if(!IntQryAnswer(work[i], reply, false))
+			{
+				// The game thread picks these up after its next rebuild
+				if(qry_waiting.size() < QRY_MAX_QUEUED)
+					qry_waiting.push_back(work[i]);
+				continue;
+			}
+
+			if(qry_replies.size() < QRY_MAX_QUEUED)
+			{
+				qry_replies.push_back(QryReply_t());
+				qry_replies.back().To = work[i].From;
+				qry_replies.back().Body = reply;
+			}
+		}
 
-		MSG_WriteShort(&ml_message, it->fragcount);
-		MSG_WriteShort(&ml_message, it->killcount);
-		MSG_WriteShort(&ml_message, it->deathcount);
+		work.clear();
 	}
+
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
+
+//
+// IntQryQueue()
+//
+// Hands a request to the query thread, starting it the first time.
+//
+static void IntQryQueue(const QryRequest_t &Request)
+{
+	IntQryLock();
+
+	if(!qry_thread_started)
+	{
+#ifdef _WIN32
+		HANDLE thread = CreateThread(NULL, 0, IntQryThread, NULL, 0, NULL);
+		qry_thread_started = (thread != NULL);
+		if(thread != NULL)
+			CloseHandle(thread);
+#else
+		pthread_t thread;
+		qry_thread_started = (pthread_create(&thread, NULL, IntQryThread, NULL) == 0);
+		if(qry_thread_started)
+			pthread_detach(thread);
+#endif
+
+		if(!qry_thread_started)
+		{
+			IntQryUnlock();
+			Printf(PRINT_HIGH, "Could not start the query thread, answering queries on the game thread\n");
+			sv_qrythread.Set(0.0f);
+			return;
+		}
+	}
+
+	if(qry_queue.size() < QRY_MAX_QUEUED)
+		qry_queue.push_back(Request);
+
+	IntQrySignal();
+
+	IntQryUnlock();
+}
+
+//
+// IntQryAllowSource()
+//
+// Per-address rate limit.  Each slot remembers the theoretical arrival time
+// of the next query from one address; queries may run up to a second ahead
+// of it, so an address gets sv_qryratelimit queries in a burst and then that
+// many a second.  Addresses sharing a slot just take it over.  IPv6 sources
+// are limited per /64, the smallest block a host is normally given.
+//
+static bool IntQryAllowSource(const netadr_t &from)
+{
+	static struct
+	{
+		QWORD ip;
+		dtime_t tat;
+	} slots[QRY_RATE_SLOTS];
+
+	int limit = sv_qryratelimit.asInt();
+
+	if(limit <= 0)
+		return true;
+
+	QWORD ip = 0;
+	const byte *key = NET_IsIPv4Adr(from) ? from.ip + NETADR_IPBYTES - 4 : from.ip;
+	const size_t keylen = NET_IsIPv4Adr(from) ? 4 : 8;
+	for(size_t i = 0; i < keylen; i++)
+		ip = (ip << 8) | key[i];
+
+	size_t slot = (((DWORD)(ip ^ (ip >> 32)) * 2654435761u) >> 24) % QRY_RATE_SLOTS;
+
+	dtime_t now = I_MSTime();
+	dtime_t interval = 1000 / limit;
+
+	if(slots[slot].ip != ip)
+	{
+		slots[slot].ip = ip;
+		slots[slot].tat = now;
+	}
+
+	if(slots[slot].tat < now)
+		slots[slot].tat = now;
+
+	if(slots[slot].tat - now >= 1000)
+		return false;
+
+	slots[slot].tat += interval ? interval : 1;
+
+	return true;
+}
+
+//
+// SV_QryInvalidate()
+//
+// Something a launcher shows has changed, rebuild the responses next time.
+//
+void SV_QryInvalidate()
+{
+	IntQryLock();
+
+	for(size_t i = 0; i <= PROTOCOL_VERSION; i++)
+		qry_cache[i].valid = false;
+
+	IntQryUnlock();
+}
+
+//
+// SV_QryTicker()
+//
+// Sends the answers the query thread has finished, rebuilds responses it
+// asked for and releases the requests that were waiting on them.
+//
+void SV_QryTicker()
+{
+	if(!qry_thread_started)
+		return;
+
+	static std::vector<QryReply_t> replies;
+
+	bool rebuild[PROTOCOL_VERSION + 1];
+	bool any = false;
+
+	IntQryLock();
+
+	replies.swap(qry_replies);
+
+	for(size_t i = 0; i <= PROTOCOL_VERSION; i++)
+	{
+		rebuild[i] = qry_cache[i].wanted && !IntQryIsFresh(qry_cache[i]);
+		any = any || rebuild[i];
+	}
+
+	IntQryUnlock();
+
+	for(size_t i = 0; i < replies.size(); i++)
+		NET_SendPacket(replies[i].Body, replies[i].To);
+
+	replies.clear();
+
+	if(any)
+	{
+		for(size_t i = 0; i <= PROTOCOL_VERSION; i++)
+			if(rebuild[i])
+				IntQryRebuild(i);
+	}
+
+	IntQryLock();
+
+	if(!qry_waiting.empty())
+	{
+		qry_queue.insert(qry_queue.end(), qry_waiting.begin(), qry_waiting.end());
+		qry_waiting.clear();
+		IntQrySignal();
+	}
+
+	IntQryUnlock();
 }
 
 //
@@ -361,42 +768,31 @@ static DWORD IntQrySendResponse(const WORD& TagId,
 	         ((ReApplication << 16) & 0x000F0000) |
 	         ((ReQRId << 12) & 0x0000F000) | (RePacketType & 0x00000FFF));
 
-	// Clear our message buffer for a response
-	SZ_Clear(&ml_message);
-
-	MSG_WriteLong(&ml_message, ReTag);
-	MSG_WriteLong(&ml_message, GAMEVER);
-
-	// Enquirer requested the version info of the server or the server
-	// determined it is an old version
-	if(RePacketType == 1 || RePacketType == 2)
-	{
-		// bond - real protocol
-		MSG_WriteLong(&ml_message, PROTOCOL_VERSION);
-
-		MSG_WriteLong(&ml_message, EqTime);
+	// Still ours, just not answered
+	if(!IntQryAllowSource(net_from))
+		return 0;
 
-		NET_SendPacket(ml_message, net_from);
+	QryRequest_t Request;
 
-		//Printf(PRINT_HIGH, "Application is old version\n");
+	Request.From = net_from;
+	Request.Tag = ReTag;
+	Request.PacketType = RePacketType;
+	Request.EqProtocolVersion = EqProtocolVersion;
+	Request.EqTime = EqTime;
 
+	if(sv_qrythread)
+	{
+		IntQryQueue(Request);
 		return 0;
 	}
 
-	// If the enquirer protocol is newer, send the latest information the
-	// server supports, otherwise send information built to the their version
-	if(EqProtocolVersion > PROTOCOL_VERSION)
-	{
-		EqProtocolVersion = PROTOCOL_VERSION;
+	IntQryLock();
 
-		MSG_WriteLong(&ml_message, PROTOCOL_VERSION);
-	}
-	else
-		MSG_WriteLong(&ml_message, EqProtocolVersion);
+	IntQryAnswer(Request, ml_message, true);
 
-	IntQryBuildInformation(EqProtocolVersion, EqTime);
+	IntQryUnlock();
 
-	NET_SendPacket(ml_message, net_from);
+	NET_SendPacket(ml_message, Request.From);
 
 	//Printf(PRINT_HIGH, "Success, data sent\n");
 
@@ -27,5 +27,7 @@
 #include "doomtype.h"
 
 DWORD SV_QryParseEnquiry(const DWORD &Tag);
+void SV_QryInvalidate();
+void SV_QryTicker();
 
 #endif // __SV_SQP_H__
@@ -41,7 +41,7 @@ set (GCONSOLE 1)
 # NACP info
 set (APP_TITLE "Odamex for Nintendo Switch")
 set (APP_AUTHOR "The Odamex Team")
-set (APP_VERSION "0.9.3")
+set (APP_VERSION "0.9.4")
 
 # Compiler stuff
 set(NACP_TOOL "${DEVKITPRO}/tools/bin/nacptool"  CACHE PATH "nacp-tool")
@@ -0,0 +1,311 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Master server load generator.  Simulates a large number of game servers
+//	heartbeating and answering verification pings, plus a flood of launcher
+//	list requests, and reports what the master sends back.
+//
+//	Each simulated server gets its own socket bound to an address in
+//	127.0.0.0/8 so the master's per-IP limit is not hit.  Linux routes the
+//	whole block to the loopback interface; other systems may need aliases.
+//
+//-----------------------------------------------------------------------------
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "../../master/i_net.h"
+
+#define HEARTBEAT_INTERVAL	25000	// ms, same as the game server
+#define SERVERS_PER_IP		60		// stay under the master's per-IP limit
+
+struct FakeServer
+{
+	int sock;
+	unsigned int next_heartbeat;
+	int pings_answered;
+};
+
+static unsigned int nowMs(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (unsigned int)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+static int openSocket(const char *ip)
+{
+	int s = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s < 0)
+		return -1;
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr(ip);
+	addr.sin_port = 0;
+
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(s);
+		return -1;
+	}
+
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	return s;
+}
+
+static void sendTo(int s, buf_t &buf, const struct sockaddr_in &to)
+{
+	sendto(s, (const char *)buf.data, buf.cursize, 0, (const struct sockaddr *)&to, sizeof(to));
+}
+
+//
+// answerPing
+//
+// Replies to a master verification ping with the same layout a game server
+// uses for its launcher reply, echoing the key the master issued.
+//
+static void answerPing(FakeServer &fs, int index, byte *data, int len, const struct sockaddr_in &from)
+{
+	static buf_t reply(MAX_UDP_PACKET);
+
+	if (len != 8)
+		return;
+
+	int challenge = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+	if (challenge != LAUNCHER_CHALLENGE)
+		return;
+
+	int key = data[4] | (data[5] << 8) | (data[6] << 16) | (data[7] << 24);
+
+	char hostname[64];
+	sprintf(hostname, "masterload server %d", index);
+
+	reply.clear();
+	reply.WriteLong(SERVER_CHALLENGE);
+	reply.WriteLong(0);
+	reply.WriteLong(key);
+	reply.WriteString(hostname);
+	reply.WriteByte(0);		// players
+	reply.WriteByte(8);		// maxplayers
+	reply.WriteString("MAP01");
+	reply.WriteByte(0);		// pwads
+	reply.WriteByte(1);		// gametype
+	reply.WriteByte(3);		// skill
+	reply.WriteByte(0);		// teamplay
+	reply.WriteByte(0);		// ctfmode
+	reply.WriteByte(0);		// players
+
+	sendTo(fs.sock, reply, from);
+	fs.pings_answered++;
+}
+
+static void usage(const char *argv0)
+{
+	printf("usage: %s [-m master_ip] [-p master_port] [-s servers] [-l launcher_requests_per_sec] [-t seconds]\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *master_ip = "127.0.0.1";
+	int master_port = MASTERPORT;
+	int num_servers = 2000;
+	int launcher_rate = 100;
+	int duration = 60;
+
+	int c;
+	while ((c = getopt(argc, argv, "m:p:s:l:t:h")) != -1)
+	{
+		switch (c)
+		{
+		case 'm': master_ip = optarg; break;
+		case 'p': master_port = atoi(optarg); break;
+		case 's': num_servers = atoi(optarg); break;
+		case 'l': launcher_rate = atoi(optarg); break;
+		case 't': duration = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+
+	// one descriptor per simulated server
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)num_servers + 16)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	struct sockaddr_in master;
+	memset(&master, 0, sizeof(master));
+	master.sin_family = AF_INET;
+	master.sin_addr.s_addr = inet_addr(master_ip);
+	master.sin_port = htons(master_port);
+
+	std::vector<FakeServer> fakes;
+	unsigned int start = nowMs();
+
+	for (int i = 0; i < num_servers; i++)
+	{
+		int group = i / SERVERS_PER_IP;
+		char ip[32];
+		sprintf(ip, "127.%d.%d.%d", 1 + group / 250, 1 + group % 250, 1 + i % SERVERS_PER_IP);
+
+		FakeServer fs;
+		fs.sock = openSocket(ip);
+		if (fs.sock < 0)
+		{
+			printf("could not bind %s, stopping at %d servers\n", ip, i);
+			break;
+		}
+
+		// spread the first heartbeats over the first interval
+		fs.next_heartbeat = start + (unsigned int)((long long)HEARTBEAT_INTERVAL * i / num_servers);
+		fs.pings_answered = 0;
+		fakes.push_back(fs);
+	}
+
+	int launcher = openSocket("127.0.0.1");
+	if (launcher < 0)
+	{
+		printf("could not open launcher socket\n");
+		return 1;
+	}
+
+	std::vector<struct pollfd> pfds(fakes.size() + 1);
+	for (size_t i = 0; i < fakes.size(); i++)
+	{
+		pfds[i].fd = fakes[i].sock;
+		pfds[i].events = POLLIN;
+	}
+	pfds[fakes.size()].fd = launcher;
+	pfds[fakes.size()].events = POLLIN;
+
+	buf_t heartbeat(16), request(16);
+	heartbeat.WriteLong(SERVER_CHALLENGE);
+	request.WriteLong(LAUNCHER_CHALLENGE);
+
+	byte data[MAX_UDP_PACKET];
+	unsigned int heartbeats = 0, requests = 0, reply_packets = 0;
+	unsigned int listed = 0, last_listed = 0, lists_complete = 0;
+	unsigned int next_request = start, next_report = start + 1000;
+	unsigned int request_sent_at = 0, worst_latency = 0;
+
+	printf("simulating %d servers against %s:%d, %d launcher requests/sec\n",
+	       (int)fakes.size(), master_ip, master_port, launcher_rate);
+
+	while (nowMs() - start < (unsigned int)duration * 1000)
+	{
+		poll(&pfds[0], pfds.size(), 10);
+		unsigned int now = nowMs();
+
+		for (size_t i = 0; i < fakes.size(); i++)
+		{
+			if (!(pfds[i].revents & POLLIN))
+				continue;
+
+			struct sockaddr_in from;
+			socklen_t fromlen = sizeof(from);
+			int len;
+			while ((len = recvfrom(fakes[i].sock, data, sizeof(data), 0, (struct sockaddr *)&from, &fromlen)) > 0)
+				answerPing(fakes[i], i, data, len, from);
+		}
+
+		if (pfds[fakes.size()].revents & POLLIN)
+		{
+			int len;
+			while ((len = recv(launcher, data, sizeof(data), 0)) >= 8)
+			{
+				reply_packets++;
+				unsigned int count = data[4] | (data[5] << 8);
+				listed += count;
+
+				// trailing packet index and packet total
+				if (len >= (int)(6 + count * 6 + 2))
+				{
+					int index = data[6 + count * 6];
+					int total = data[6 + count * 6 + 1];
+					if (index == total - 1)
+					{
+						last_listed = listed;
+						listed = 0;
+						lists_complete++;
+						if (now - request_sent_at > worst_latency)
+							worst_latency = now - request_sent_at;
+					}
+				}
+			}
+		}
+
+		for (size_t i = 0; i < fakes.size(); i++)
+		{
+			if ((int)(now - fakes[i].next_heartbeat) >= 0)
+			{
+				sendTo(fakes[i].sock, heartbeat, master);
+				fakes[i].next_heartbeat += HEARTBEAT_INTERVAL;
+				heartbeats++;
+			}
+		}
+
+		if (launcher_rate > 0)
+		{
+			while ((int)(now - next_request) >= 0)
+			{
+				sendTo(launcher, request, master);
+				request_sent_at = now;
+				next_request += 1000 / launcher_rate > 0 ? 1000 / launcher_rate : 1;
+				requests++;
+			}
+		}
+
+		if ((int)(now - next_report) >= 0)
+		{
+			unsigned int answered = 0;
+			for (size_t i = 0; i < fakes.size(); i++)
+				if (fakes[i].pings_answered)
+					answered++;
+
+			printf("%3us: heartbeats %u, verified %u/%u, requests %u, reply packets %u, "
+			       "lists %u, last list %u servers, worst latency %u ms\n",
+			       (now - start) / 1000, heartbeats, answered, (unsigned int)fakes.size(),
+			       requests, reply_packets, lists_complete, last_listed, worst_latency);
+
+			worst_latency = 0;
+			next_report += 1000;
+		}
+	}
+
+	for (size_t i = 0; i < fakes.size(); i++)
+		close(fakes[i].sock);
+	close(launcher);
+
+	return 0;
+}
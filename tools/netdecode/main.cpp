@@ -0,0 +1,338 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Replays the server packets recorded in a netdemo through the message
+//	layouts the client checks messages against, without running the game.
+//
+//	The handlers need a level to apply messages to, so a packet is walked
+//	until the first message without a layout and the rest of it is counted
+//	as unframed.  Prints how much of the demo the layouts cover, and can
+//	time the walk (-b) or feed it corrupted packets (-f) to check that a
+//	bad packet can never be read past its end.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../../common/i_netmsg.h"
+
+// From client/src/cl_demo.h
+static const size_t HEADER_SIZE = 64;
+static const size_t MESSAGE_HEADER_SIZE = 9;
+static const unsigned char MSG_PACKET = 0xAA;
+static const unsigned char MSG_SNAPSHOT = 0xAB;
+
+// From common/i_net.h
+static const unsigned int CHALLENGE = 5560020;
+
+typedef std::vector<unsigned char> packet_t;
+
+struct stats_t
+{
+	size_t messages;
+	size_t framed;		// bytes of messages with a layout
+	size_t unframed;	// bytes left after a message without one
+	size_t truncated;	// packets that end inside a message
+	size_t count[256];
+	size_t bytes[256];
+	size_t stops[256];
+
+	stats_t()
+	{
+		messages = framed = unframed = truncated = 0;
+		memset(count, 0, sizeof(count));
+		memset(bytes, 0, sizeof(bytes));
+		memset(stops, 0, sizeof(stops));
+	}
+};
+
+static const char *layouts[256];
+static const char *names[256];
+
+static unsigned int ReadLE(const unsigned char *p, size_t size)
+{
+	unsigned int v = 0;
+	for (size_t i = 0; i < size; i++)
+		v |= (unsigned int)p[i] << (8 * i);
+	return v;
+}
+
+//
+// LoadPackets
+//
+// Reads the packet chunks out of a netdemo.  The connection handshake at the
+// start is not made of server messages and is left out, as the client does.
+//
+static bool LoadPackets(const char *path, std::vector<packet_t> &packets)
+{
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+	{
+		printf("%s: can not open\n", path);
+		return false;
+	}
+
+	std::vector<unsigned char> file;
+	unsigned char block[4096];
+	size_t got;
+	while ((got = fread(block, 1, sizeof(block), fp)) > 0)
+		file.insert(file.end(), block, block + got);
+	fclose(fp);
+
+	if (file.size() < HEADER_SIZE || memcmp(&file[0], "ODAD", 4) != 0)
+	{
+		printf("%s: not a netdemo\n", path);
+		return false;
+	}
+
+	// The indices follow the messages once a recording is finished
+	size_t end = file.size();
+	size_t snapindex = ReadLE(&file[8], 4);
+	size_t mapindex = ReadLE(&file[14], 4);
+	if (snapindex >= HEADER_SIZE && snapindex < end)
+		end = snapindex;
+	if (mapindex >= HEADER_SIZE && mapindex < end)
+		end = mapindex;
+
+	bool connected = false;
+	size_t pos = HEADER_SIZE;
+
+	while (pos + MESSAGE_HEADER_SIZE <= end)
+	{
+		unsigned char type = file[pos];
+		size_t len = ReadLE(&file[pos + 1], 4);
+		pos += MESSAGE_HEADER_SIZE;
+
+		if ((type != MSG_PACKET && type != MSG_SNAPSHOT) || len > end - pos)
+		{
+			printf("%s: bad message header at offset %u\n", path, (unsigned)(pos - MESSAGE_HEADER_SIZE));
+			break;
+		}
+
+		if (type == MSG_PACKET)
+		{
+			size_t start = pos;
+
+			if (!connected && len >= 4)
+			{
+				unsigned int seq = ReadLE(&file[pos], 4);
+				if (seq == CHALLENGE)
+					start = pos + len;
+				else if (seq == 0)
+				{
+					connected = true;
+					start = pos + 4;
+				}
+			}
+
+			if (connected && start < pos + len)
+				packets.push_back(packet_t(file.begin() + start, file.begin() + pos + len));
+		}
+
+		pos += len;
+	}
+
+	return true;
+}
+
+//
+// Decode
+//
+// Walks the messages of one packet, returns how many bytes were framed.
+//
+static size_t Decode(const unsigned char *data, size_t len, stats_t &stats)
+{
+	size_t pos = 0;
+
+	while (pos < len)
+	{
+		unsigned char id = data[pos];
+		const char *layout = layouts[id];
+
+		if (layout == NULL)
+		{
+			stats.stops[id]++;
+			stats.unframed += len - pos;
+			break;
+		}
+
+		int size = NET_MeasureLayout(layout, data + pos + 1, len - pos - 1);
+		if (size < 0)
+		{
+			stats.truncated++;
+			stats.unframed += len - pos;
+			break;
+		}
+
+		stats.messages++;
+		stats.count[id]++;
+		stats.bytes[id] += 1 + size;
+		stats.framed += 1 + size;
+		pos += 1 + size;
+	}
+
+	return pos;
+}
+
+static bool ByCount(const std::pair<size_t, int> &a, const std::pair<size_t, int> &b)
+{
+	return a.first > b.first;
+}
+
+static void Report(const std::vector<packet_t> &packets, const stats_t &stats)
+{
+	size_t total = stats.framed + stats.unframed;
+
+	printf("%u packets, %u bytes, %u messages\n", (unsigned)packets.size(),
+	       (unsigned)total, (unsigned)stats.messages);
+	printf("%.1f%% of bytes framed, %u packets truncated\n\n",
+	       total ? 100.0 * stats.framed / total : 0.0, (unsigned)stats.truncated);
+
+	std::vector<std::pair<size_t, int> > order;
+	for (int id = 0; id < 256; id++)
+	{
+		if (stats.count[id] || stats.stops[id])
+			order.push_back(std::make_pair(stats.count[id] + stats.stops[id], id));
+	}
+	std::sort(order.begin(), order.end(), ByCount);
+
+	printf("%4s %-24s %10s %10s %10s\n", "id", "message", "count", "bytes", "stops");
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		int id = order[i].second;
+		printf("%4d %-24s %10u %10u %10u\n", id, names[id] ? names[id] : "?",
+		       (unsigned)stats.count[id], (unsigned)stats.bytes[id],
+		       (unsigned)stats.stops[id]);
+	}
+}
+
+static void Benchmark(const std::vector<packet_t> &packets, int repeats)
+{
+	stats_t stats;
+
+	clock_t start = clock();
+	for (int r = 0; r < repeats; r++)
+	{
+		for (size_t i = 0; i < packets.size(); i++)
+			Decode(&packets[i][0], packets[i].size(), stats);
+	}
+	double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("\n%d passes in %.3f s, %.1f ns per message, %.1f MB/s\n", repeats, seconds,
+	       stats.messages ? seconds * 1e9 / stats.messages : 0.0,
+	       seconds > 0 ? (stats.framed + stats.unframed) / seconds / 1e6 : 0.0);
+}
+
+//
+// Fuzz
+//
+// Corrupts or cuts short recorded packets and checks the walk stays inside
+// each one.
+//
+static bool Fuzz(const std::vector<packet_t> &packets, int iterations)
+{
+	srand(1);
+
+	for (int n = 0; n < iterations; n++)
+	{
+		packet_t packet = packets[rand() % packets.size()];
+
+		int edits = 1 + rand() % 4;
+		for (int e = 0; e < edits && !packet.empty(); e++)
+			packet[rand() % packet.size()] = (unsigned char)rand();
+
+		if (rand() % 4 == 0)
+			packet.resize(rand() % (packet.size() + 1));
+
+		if (packet.empty())
+			continue;
+
+		// An exact sized copy so a read past the end is caught by a checker
+		unsigned char *copy = new unsigned char[packet.size()];
+		memcpy(copy, &packet[0], packet.size());
+
+		stats_t stats;
+		size_t pos = Decode(copy, packet.size(), stats);
+		delete[] copy;
+
+		if (pos > packet.size() || stats.framed + stats.unframed != packet.size())
+		{
+			printf("\nfuzz: iteration %d walked %u bytes of a %u byte packet\n", n,
+			       (unsigned)pos, (unsigned)packet.size());
+			return false;
+		}
+	}
+
+	printf("\n%d corrupted packets walked within bounds\n", iterations);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	int repeats = 0, iterations = 0;
+	const char *path = NULL;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			repeats = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			iterations = atoi(argv[++i]);
+		else if (!path && argv[i][0] != '-')
+			path = argv[i];
+		else
+			usage = true;
+	}
+
+	if (!path || usage)
+	{
+		printf("usage: netdecode [-b passes] [-f iterations] <netdemo.odd>\n");
+		return 1;
+	}
+
+	for (size_t i = 0; i < svc_layouts_count; i++)
+	{
+		layouts[svc_layouts[i].id] = svc_layouts[i].layout;
+		names[svc_layouts[i].id] = svc_layouts[i].name;
+	}
+
+	std::vector<packet_t> packets;
+	if (!LoadPackets(path, packets))
+		return 1;
+
+	stats_t stats;
+	for (size_t i = 0; i < packets.size(); i++)
+		Decode(&packets[i][0], packets[i].size(), stats);
+
+	Report(packets, stats);
+
+	if (repeats > 0)
+		Benchmark(packets, repeats);
+
+	if (iterations > 0 && !packets.empty() && !Fuzz(packets, iterations))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,454 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Builds the nodes, blockmap and reject of every map in a WAD with the
+//	engine's builder and reports how long each took.
+//
+//	With -o the results are written as cache files the engine picks up
+//	from its nodecache directory, so a server can be handed raw editor
+//	maps without building them the first time they are played.  -v builds
+//	everything twice to check the output is the same, and walks the BSP
+//	tree to check every seg is on the side of each partition above it.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "../../common/p_nodebuild.h"
+
+// md5.cpp and p_nodebuild.cpp register themselves with the engine's list
+// of source versions
+file_version::file_version(const char*, const char*, const char*, int,
+                           const char*, const char*)
+{
+}
+
+struct lump_t
+{
+	std::string name;
+	size_t pos;
+	size_t size;
+};
+
+// From common/doomdata.h
+enum
+{
+	ML_LABEL, ML_THINGS, ML_LINEDEFS, ML_SIDEDEFS, ML_VERTEXES, ML_SEGS,
+	ML_SSECTORS, ML_NODES, ML_SECTORS, ML_REJECT, ML_BLOCKMAP, ML_BEHAVIOR
+};
+
+static unsigned int ReadULong(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static int ReadShort(const unsigned char* p)
+{
+	return (short)(p[0] | (p[1] << 8));
+}
+
+static bool ReadWad(const char* path, std::vector<unsigned char>& data,
+                    std::vector<lump_t>& lumps)
+{
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		printf("%s: can not open\n", path);
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	data.resize(ftell(fp));
+	fseek(fp, 0, SEEK_SET);
+	bool ok = !data.empty() && fread(&data[0], 1, data.size(), fp) == data.size();
+	fclose(fp);
+
+	if (!ok || data.size() < 12 || (memcmp(&data[0], "IWAD", 4) && memcmp(&data[0], "PWAD", 4)))
+	{
+		printf("%s: not a WAD\n", path);
+		return false;
+	}
+
+	size_t numlumps = ReadULong(&data[4]);
+	size_t dir = ReadULong(&data[8]);
+	if (dir > data.size() || numlumps > (data.size() - dir) / 16)
+	{
+		printf("%s: bad directory\n", path);
+		return false;
+	}
+
+	for (size_t i = 0; i < numlumps; i++)
+	{
+		const unsigned char* entry = &data[dir + i * 16];
+
+		lump_t lump;
+		lump.pos = ReadULong(entry);
+		lump.size = ReadULong(entry + 4);
+		lump.name = std::string((const char*)entry + 8, strnlen((const char*)entry + 8, 8));
+
+		if (lump.pos > data.size() || lump.size > data.size() - lump.pos)
+		{
+			printf("%s: lump %s is outside the file\n", path, lump.name.c_str());
+			return false;
+		}
+
+		lumps.push_back(lump);
+	}
+
+	return true;
+}
+
+static bool IsMap(const std::vector<lump_t>& lumps, size_t i)
+{
+	static const char* names[] = {
+		"THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS",
+		"SSECTORS", "NODES", "SECTORS"
+	};
+
+	for (size_t j = 0; j < sizeof(names) / sizeof(*names); j++)
+		if (i + 1 + j >= lumps.size() || lumps[i + 1 + j].name != names[j])
+			return false;
+
+	return true;
+}
+
+static double Milliseconds(clock_t start)
+{
+	return double(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+struct xnod_t
+{
+	std::vector<int> vx, vy;			// fixed point
+	std::vector<unsigned int> firstseg, numsegs;
+	std::vector<unsigned int> segv1, segv2, seglinedef, segside;
+	std::vector<int> nodes;				// x, y, dx, dy per node
+	std::vector<unsigned int> children;	// two per node
+	unsigned int numnewvert;
+};
+
+static bool ParseXNOD(const maplumps_t& map, const std::vector<unsigned char>& data, xnod_t& x)
+{
+	const unsigned char* p = &data[0] + 4;
+
+	unsigned int numorgvert = ReadULong(p); p += 4;
+	x.numnewvert = ReadULong(p); p += 4;
+
+	for (unsigned int i = 0; i < numorgvert; i++)
+	{
+		x.vx.push_back(ReadShort(map.vertexes + i * 4) << 16);
+		x.vy.push_back(ReadShort(map.vertexes + i * 4 + 2) << 16);
+	}
+	for (unsigned int i = 0; i < x.numnewvert; i++)
+	{
+		x.vx.push_back((int)ReadULong(p)); p += 4;
+		x.vy.push_back((int)ReadULong(p)); p += 4;
+	}
+
+	unsigned int numsubsectors = ReadULong(p); p += 4;
+	unsigned int first = 0;
+	for (unsigned int i = 0; i < numsubsectors; i++)
+	{
+		x.firstseg.push_back(first);
+		x.numsegs.push_back(ReadULong(p)); p += 4;
+		first += x.numsegs.back();
+	}
+
+	unsigned int numsegs = ReadULong(p); p += 4;
+	if (numsegs != first)
+		return false;
+
+	for (unsigned int i = 0; i < numsegs; i++)
+	{
+		x.segv1.push_back(ReadULong(p)); p += 4;
+		x.segv2.push_back(ReadULong(p)); p += 4;
+		x.seglinedef.push_back(p[0] | (p[1] << 8)); p += 2;
+		x.segside.push_back(*p); p += 1;
+
+		if (x.segv1.back() >= x.vx.size() || x.segv2.back() >= x.vx.size())
+			return false;
+	}
+
+	unsigned int numnodes = ReadULong(p); p += 4;
+	for (unsigned int i = 0; i < numnodes; i++)
+	{
+		for (int j = 0; j < 4; j++)
+			x.nodes.push_back(ReadShort(p + j * 2));
+		p += 8 + 16;
+		x.children.push_back(ReadULong(p)); p += 4;
+		x.children.push_back(ReadULong(p)); p += 4;
+	}
+
+	return p == &data[0] + data.size();
+}
+
+struct ancestor_t
+{
+	int x, y, dx, dy;
+	int side;
+};
+
+//
+// CheckSubtree
+//
+// Every seg under a node has to be on the node's side of each partition
+// above it, give or take the builder's epsilon.
+//
+static bool CheckSubtree(const xnod_t& x, unsigned int child,
+                         std::vector<ancestor_t>& ancestors, std::vector<int>& visits)
+{
+	if (child & 0x80000000u)
+	{
+		unsigned int ss = child & 0x7FFFFFFF;
+		if (ss >= x.firstseg.size())
+			return false;
+		visits[ss]++;
+
+		for (unsigned int i = 0; i < x.numsegs[ss]; i++)
+		{
+			unsigned int seg = x.firstseg[ss] + i;
+			const unsigned int vs[2] = { x.segv1[seg], x.segv2[seg] };
+
+			for (size_t a = 0; a < ancestors.size(); a++)
+			{
+				const ancestor_t& n = ancestors[a];
+				double length = sqrt((double)n.dx * n.dx + (double)n.dy * n.dy);
+
+				for (int j = 0; j < 2; j++)
+				{
+					double cross = ((double)x.vx[vs[j]] - n.x * 65536.0) * n.dy -
+					               ((double)x.vy[vs[j]] - n.y * 65536.0) * n.dx;
+					double dist = cross / length;
+					if ((n.side == 0 && dist < -16.0) || (n.side == 1 && dist > 16.0))
+						return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	if (child * 4 >= x.nodes.size())
+		return false;
+
+	for (int side = 0; side < 2; side++)
+	{
+		ancestor_t n;
+		n.x = x.nodes[child * 4];
+		n.y = x.nodes[child * 4 + 1];
+		n.dx = x.nodes[child * 4 + 2];
+		n.dy = x.nodes[child * 4 + 3];
+		n.side = side;
+
+		ancestors.push_back(n);
+		bool ok = CheckSubtree(x, x.children[child * 2 + side], ancestors, visits);
+		ancestors.pop_back();
+
+		if (!ok)
+			return false;
+	}
+
+	return true;
+}
+
+//
+// VerifyNodes
+//
+// Walks the tree, then checks the segs of each side of each line add up to
+// the length of the line.
+//
+static const char* VerifyNodes(const maplumps_t& map, const std::vector<unsigned char>& data)
+{
+	xnod_t x;
+	if (!ParseXNOD(map, data, x))
+		return "malformed XNOD";
+
+	std::vector<ancestor_t> ancestors;
+	std::vector<int> visits(x.firstseg.size(), 0);
+
+	unsigned int root = x.nodes.empty() ? 0x80000000u : (unsigned int)(x.nodes.size() / 4 - 1);
+	if (!CheckSubtree(x, root, ancestors, visits))
+		return "seg on the wrong side of a partition";
+
+	for (size_t i = 0; i < visits.size(); i++)
+		if (visits[i] != 1)
+			return "subsector not reached exactly once";
+
+	const size_t linesize = map.hexen ? 16 : 14;
+	const size_t numlines = map.linedefs_len / linesize;
+	std::vector<double> covered(numlines * 2, 0.0);
+
+	for (size_t i = 0; i < x.segv1.size(); i++)
+	{
+		double dx = (double)x.vx[x.segv2[i]] - x.vx[x.segv1[i]];
+		double dy = (double)x.vy[x.segv2[i]] - x.vy[x.segv1[i]];
+		covered[x.seglinedef[i] * 2 + x.segside[i]] += sqrt(dx * dx + dy * dy) / 65536.0;
+	}
+
+	for (size_t i = 0; i < numlines; i++)
+	{
+		const unsigned char* line = map.linedefs + i * linesize;
+		const unsigned char* v1 = map.vertexes + (line[0] | (line[1] << 8)) * 4;
+		const unsigned char* v2 = map.vertexes + (line[2] | (line[3] << 8)) * 4;
+		double dx = ReadShort(v2) - ReadShort(v1);
+		double dy = ReadShort(v2 + 2) - ReadShort(v1 + 2);
+		double length = sqrt(dx * dx + dy * dy);
+
+		for (int side = 0; side < 2; side++)
+		{
+			double c = covered[i * 2 + side];
+			if (c != 0.0 && fabs(c - length) > 1.0)
+				return "segs do not cover their line";
+		}
+	}
+
+	return NULL;
+}
+
+static bool SameMapData(const mapdata_t& a, const mapdata_t& b)
+{
+	return a.parts == b.parts && a.nodes == b.nodes && a.blockmap == b.blockmap &&
+	       a.reject == b.reject;
+}
+
+int main(int argc, char **argv)
+{
+	const char* path = NULL;
+	const char* outdir = NULL;
+	bool verify = false;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			outdir = argv[++i];
+		else if (!strcmp(argv[i], "-v"))
+			verify = true;
+		else if (!path && argv[i][0] != '-')
+			path = argv[i];
+		else
+			usage = true;
+	}
+
+	if (!path || usage)
+	{
+		printf("usage: nodecache [-o cachedir] [-v] <file.wad>\n");
+		return 1;
+	}
+
+	std::vector<unsigned char> wad;
+	std::vector<lump_t> lumps;
+	if (!ReadWad(path, wad, lumps))
+		return 1;
+
+	printf("%-8s %7s %7s %7s %7s %7s %10s %10s %10s\n", "map", "lines", "segs",
+	       "subsecs", "nodes", "newvert", "nodes ms", "bmap ms", "reject ms");
+
+	int maps = 0, failed = 0;
+	double total[3] = { 0.0, 0.0, 0.0 };
+
+	for (size_t i = 0; i < lumps.size(); i++)
+	{
+		if (!IsMap(lumps, i))
+			continue;
+
+		maplumps_t map;
+		const unsigned char* base = wad.empty() ? NULL : &wad[0];
+		map.vertexes = base + lumps[i + ML_VERTEXES].pos;
+		map.vertexes_len = lumps[i + ML_VERTEXES].size;
+		map.linedefs = base + lumps[i + ML_LINEDEFS].pos;
+		map.linedefs_len = lumps[i + ML_LINEDEFS].size;
+		map.sidedefs = base + lumps[i + ML_SIDEDEFS].pos;
+		map.sidedefs_len = lumps[i + ML_SIDEDEFS].size;
+		map.sectors = base + lumps[i + ML_SECTORS].pos;
+		map.sectors_len = lumps[i + ML_SECTORS].size;
+		map.hexen = i + ML_BEHAVIOR < lumps.size() && lumps[i + ML_BEHAVIOR].name == "BEHAVIOR";
+
+		mapdata_t data;
+		double ms[3];
+
+		clock_t start = clock();
+		bool nodes = P_BuildNodes(map, data.nodes);
+		ms[0] = Milliseconds(start);
+
+		start = clock();
+		P_BuildBlockMap(map, data.blockmap);
+		ms[1] = Milliseconds(start);
+
+		start = clock();
+		P_BuildReject(map, data.reject);
+		ms[2] = Milliseconds(start);
+
+		maps++;
+		for (int j = 0; j < 3; j++)
+			total[j] += ms[j];
+
+		if (!nodes)
+		{
+			printf("%-8s could not build nodes\n", lumps[i].name.c_str());
+			failed++;
+			continue;
+		}
+
+		data.parts = MAPDATA_ALL;
+
+		xnod_t x;
+		ParseXNOD(map, data.nodes, x);
+		printf("%-8s %7u %7u %7u %7u %7u %10.2f %10.2f %10.2f\n", lumps[i].name.c_str(),
+		       (unsigned)(map.linedefs_len / (map.hexen ? 16 : 14)), (unsigned)x.segv1.size(),
+		       (unsigned)x.firstseg.size(), (unsigned)(x.nodes.size() / 4), x.numnewvert,
+		       ms[0], ms[1], ms[2]);
+
+		if (verify)
+		{
+			mapdata_t again;
+			P_BuildMapData(map, MAPDATA_ALL, again);
+
+			const char* error = VerifyNodes(map, data.nodes);
+			if (!error && !SameMapData(data, again))
+				error = "second build differs";
+
+			if (error)
+			{
+				printf("%-8s verify failed: %s\n", lumps[i].name.c_str(), error);
+				failed++;
+			}
+		}
+
+		if (outdir)
+		{
+			std::string filename = std::string(outdir) + "/" + P_MapDataKey(map) + MAPDATA_EXT;
+			if (!P_WriteMapDataCache(filename, data))
+			{
+				printf("%s: can not write\n", filename.c_str());
+				failed++;
+			}
+		}
+	}
+
+	printf("\n%d maps, %d failed, %.2f ms nodes, %.2f ms blockmap, %.2f ms reject\n",
+	       maps, failed, total[0], total[1], total[2]);
+
+	return failed ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdlib.h>
 #include <vector>
 
 #ifdef UNIX
@@ -13,11 +14,11 @@
 #define usleep(n) Sleep(n/1000)
 #endif
 
-#include "../master/i_net.h"
+#include "../../master/i_net.h"
 
 netadr_t net_local, net_remote;
 
-void OnInit()
+void OnInit(int argc, char **argv)
 {
 	NET_StringToAdr("127.0.0.1:10667", &net_local);
 	NET_StringToAdr("voxelsoft.com:10666", &net_remote);
@@ -40,34 +41,48 @@ typedef void (*fp)();
 struct protocol_t
 {
 	const char *name;
-	fp onInit;
+	void (*onInit)(int argc, char **argv);
 	fp onPacket;
+	unsigned int (*onWait)(unsigned int timeout_ms);	// optional, waits on extra sockets
+	fp onTick;											// optional, called every pass
 };
 
 void OnPacketTV();
-void OnInitTV();
+void OnInitTV(int argc, char **argv);
+unsigned int OnWaitTV(unsigned int timeout_ms);
+void OnTickTV();
 
-int main()
+int main(int argc, char **argv)
 {
-	//protocol_t protocol = {"transparent", OnInit, OnPacket};
-	protocol_t protocol = {"odatv", OnInitTV, OnPacketTV};
+	//protocol_t protocol = {"transparent", OnInit, OnPacket, NULL, NULL};
+	protocol_t protocol = {"odatv", OnInitTV, OnPacketTV, OnWaitTV, OnTickTV};
 
 	// Create a UDP socket
 	localport = 10999;
+	for (int i = 1; i + 1 < argc; i += 2)
+		if (!strcmp(argv[i], "-p"))
+			localport = atoi(argv[i + 1]);
+
 	InitNetCommon();
 
-	protocol.onInit();
+	protocol.onInit(argc, argv);
 
 	while (true)
 	{
+		// sleep until there is something to do instead of spinning
+		if (protocol.onWait)
+			protocol.onWait(100);
+		else
+			NET_WaitForPacket(100);
+
 		while (NET_GetPacket())
 		{
 			protocol.onPacket();
 		}
 
-		usleep(1);
+		if (protocol.onTick)
+			protocol.onTick();
 	}
 
 	CloseNetwork();
 }
-
@@ -0,0 +1,412 @@
+//
+// OdaTV test harness
+//
+// Runs a fake game server and a crowd of fake viewers on localhost around a
+// real proxy process.  The fake server speaks just enough of the protocol
+// for the relay: launcher replies with a token, a sequenced console player
+// packet after connect, a full update burst ending in svc_fullupdatedone
+// once packet 0 is acknowledged, and one delta per tic carrying the world
+// tic number.
+//
+// Every viewer checks that it receives a console player packet, a full
+// update, and then every world tic after the full update's tic exactly
+// once and in order, including across keyframe rolls.  Viewers join at
+// staggered times, some after the relay has rolled its keyframe.
+//
+// usage: tvtest [viewers] [seconds] [proxy binary] [broadcast delay]
+//
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+
+#define SERVER_PORT		10966
+#define PROXY_PORT		10967
+#define VIEWER_RATE		64		// KB/s, passed to the proxy
+
+#include "../tv/tv_msgids.h"
+
+#define CHALLENGE			5560020
+#define LAUNCHER_CHALLENGE	777123
+
+using tv::svc_consoleplayer;
+using tv::svc_fullupdatedone;
+using tv::clc_disconnect;
+using tv::clc_ack;
+
+enum
+{
+	// payload tags used by the fake server
+	TAG_PRELUDE = 0xf0,
+	TAG_DELTA = 0xf2,
+	TAG_END = 0xee
+};
+
+typedef unsigned char byte;
+
+static unsigned int nowMs()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (unsigned int)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+static int openSocket(int port)
+{
+	int s = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	int big = 1 << 20;
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, &big, sizeof(big));
+
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		perror("bind");
+		exit(2);
+	}
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	return s;
+}
+
+static struct sockaddr_in loopback(int port)
+{
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	return addr;
+}
+
+static void putLong(std::vector<byte> &b, int l)
+{
+	b.push_back(l & 0xff);
+	b.push_back((l >> 8) & 0xff);
+	b.push_back((l >> 16) & 0xff);
+	b.push_back((l >> 24) & 0xff);
+}
+
+static int getLong(const byte *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+static void sendTo(int s, const std::vector<byte> &b, const struct sockaddr_in &to)
+{
+	sendto(s, (const char *)&b[0], b.size(), 0, (const struct sockaddr *)&to, sizeof(to));
+}
+
+//
+// Fake server
+//
+
+struct FakeClient
+{
+	struct sockaddr_in addr;
+	int sequence;
+	bool connected;
+};
+
+static int server_sock;
+static std::vector<FakeClient> clients;
+static int world_tic = 0;
+static int connects = 0;
+
+static void serverSend(FakeClient &c, std::vector<byte> payload)
+{
+	std::vector<byte> packet;
+	putLong(packet, c.sequence++);
+	packet.insert(packet.end(), payload.begin(), payload.end());
+	sendTo(server_sock, packet, c.addr);
+}
+
+static void serverPacket(const byte *data, int len, const struct sockaddr_in &from)
+{
+	FakeClient *c = NULL;
+	for (size_t i = 0; i < clients.size(); i++)
+		if (clients[i].addr.sin_port == from.sin_port && clients[i].addr.sin_addr.s_addr == from.sin_addr.s_addr)
+			c = &clients[i];
+
+	if (len == 4 && getLong(data) == LAUNCHER_CHALLENGE)
+	{
+		std::vector<byte> reply;
+		putLong(reply, CHALLENGE);
+		putLong(reply, 0x1234);
+		const char *name = "tvtest";
+		reply.insert(reply.end(), name, name + strlen(name) + 1);
+		sendTo(server_sock, reply, from);
+		return;
+	}
+
+	if (!c && len >= 8 && getLong(data) == CHALLENGE)
+	{
+		if (getLong(data + 4) != 0x1234)
+			return;
+
+		FakeClient nc;
+		nc.addr = from;
+		nc.sequence = 0;
+		nc.connected = false;
+		clients.push_back(nc);
+		connects++;
+
+		std::vector<byte> payload;
+		payload.push_back(svc_consoleplayer);
+		payload.push_back((byte)clients.size());
+		payload.push_back(TAG_END);
+		serverSend(clients.back(), payload);
+		return;
+	}
+
+	if (!c)
+		return;
+
+	if (len == 1 && data[0] == clc_disconnect)
+	{
+		clients.erase(clients.begin() + (c - &clients[0]));
+		return;
+	}
+
+	if (len == 5 && data[0] == clc_ack && getLong(data + 1) == 0 && !c->connected)
+	{
+		// full update burst, state as of the current world tic
+		c->connected = true;
+		for (int i = 0; i < 8; i++)
+		{
+			std::vector<byte> payload;
+			payload.push_back(TAG_PRELUDE);
+			putLong(payload, world_tic);
+			payload.resize(900, 0);
+			payload.push_back(i == 7 ? (byte)svc_fullupdatedone : (byte)TAG_END);
+			serverSend(*c, payload);
+		}
+	}
+}
+
+static void serverTic()
+{
+	world_tic++;
+	for (size_t i = 0; i < clients.size(); i++)
+	{
+		if (!clients[i].connected)
+			continue;
+		std::vector<byte> payload;
+		payload.push_back(TAG_DELTA);
+		putLong(payload, world_tic);
+		payload.resize(200, 0);
+		payload.push_back(TAG_END);
+		serverSend(clients[i], payload);
+	}
+}
+
+//
+// Fake viewers
+//
+
+struct Viewer
+{
+	int sock;
+	unsigned int join_time;
+	int state;				// 0 not started, 1 asked for info, 2 connected
+	bool got_consoleplayer, got_fullupdate;
+	int expect;				// next world tic expected
+	int deltas, errors;
+	unsigned int bytes_this_second, second_start, peak_rate;
+};
+
+static void viewerPacket(Viewer &v, const byte *data, int len)
+{
+	v.bytes_this_second += len;
+
+	if (v.state == 1)
+	{
+		if (len >= 8 && getLong(data) == CHALLENGE)
+		{
+			std::vector<byte> connect;
+			putLong(connect, CHALLENGE);
+			putLong(connect, getLong(data + 4));
+			connect.push_back(0);
+			sendTo(v.sock, connect, loopback(PROXY_PORT));
+			v.state = 2;
+		}
+		return;
+	}
+
+	if (len < 6)
+		return;
+
+	std::vector<byte> ack;
+	ack.push_back(clc_ack);
+	ack.insert(ack.end(), data, data + 4);
+	sendTo(v.sock, ack, loopback(PROXY_PORT));
+
+	const byte *payload = data + 4;
+	if (payload[0] == svc_consoleplayer)
+	{
+		if (v.got_consoleplayer)
+			v.errors++;
+		v.got_consoleplayer = true;
+	}
+	else if (payload[0] == TAG_PRELUDE)
+	{
+		if (!v.got_consoleplayer || v.got_fullupdate)
+			v.errors++;
+		if (data[len - 1] == svc_fullupdatedone)
+		{
+			v.got_fullupdate = true;
+			v.expect = getLong(payload + 1) + 1;
+		}
+	}
+	else if (payload[0] == TAG_DELTA)
+	{
+		int tic = getLong(payload + 1);
+		if (!v.got_fullupdate || tic != v.expect)
+		{
+			if (v.errors < 5)
+				printf("viewer %d: got tic %d, expected %d\n", v.sock, tic, v.expect);
+			v.errors++;
+		}
+		v.expect = tic + 1;
+		v.deltas++;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int num_viewers = argc > 1 ? atoi(argv[1]) : 50;
+	int seconds = argc > 2 ? atoi(argv[2]) : 12;
+	const char *proxy = argc > 3 ? argv[3] : "./proxy";
+	const char *delay = argc > 4 ? argv[4] : "0";
+
+	server_sock = openSocket(SERVER_PORT);
+
+	// start the relay, rolling its keyframe every 3 seconds
+	char server[32], rate[16];
+	sprintf(server, "127.0.0.1:%d", SERVER_PORT);
+	sprintf(rate, "%d", VIEWER_RATE);
+	char port[16];
+	sprintf(port, "%d", PROXY_PORT);
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		freopen("/dev/null", "w", stdout);
+		execl(proxy, proxy, "-p", port, "-s", server, "-r", rate, "-k", "3", "-d", delay, (char *)NULL);
+		perror("execl");
+		_exit(1);
+	}
+	usleep(200 * 1000);
+
+	unsigned int start = nowMs();
+
+	std::vector<Viewer> viewers(num_viewers);
+	for (int i = 0; i < num_viewers; i++)
+	{
+		Viewer &v = viewers[i];
+		v.sock = openSocket(0);
+		// half join at once, the rest spread over the run
+		v.join_time = start + (i < num_viewers / 2 ? 0 : (unsigned int)(seconds * 1200 * (i - num_viewers / 2) / num_viewers));
+		v.state = 0;
+		v.got_consoleplayer = v.got_fullupdate = false;
+		v.expect = 0;
+		v.deltas = v.errors = 0;
+		v.bytes_this_second = v.peak_rate = 0;
+		v.second_start = start;
+	}
+
+	std::vector<struct pollfd> pfds(num_viewers + 1);
+	pfds[0].fd = server_sock;
+	pfds[0].events = POLLIN;
+	for (int i = 0; i < num_viewers; i++)
+	{
+		pfds[i + 1].fd = viewers[i].sock;
+		pfds[i + 1].events = POLLIN;
+	}
+
+	byte data[8192];
+	unsigned int next_tic = start;
+
+	while (nowMs() - start < (unsigned int)seconds * 1000)
+	{
+		poll(&pfds[0], pfds.size(), 2);
+		unsigned int now = nowMs();
+
+		struct sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+		int len;
+		while ((len = recvfrom(server_sock, data, sizeof(data), 0, (struct sockaddr *)&from, &fromlen)) > 0)
+			serverPacket(data, len, from);
+
+		if ((int)(now - next_tic) >= 0)
+		{
+			serverTic();
+			next_tic += 28;
+		}
+
+		for (int i = 0; i < num_viewers; i++)
+		{
+			Viewer &v = viewers[i];
+
+			while ((len = recv(v.sock, data, sizeof(data), 0)) > 0)
+				viewerPacket(v, data, len);
+
+			if (v.state == 0 && (int)(now - v.join_time) >= 0)
+			{
+				std::vector<byte> query;
+				putLong(query, LAUNCHER_CHALLENGE);
+				sendTo(v.sock, query, loopback(PROXY_PORT));
+				v.state = 1;
+			}
+			else if (v.state == 1 && now - v.join_time > 1000)
+			{
+				// the relay has no server info yet, ask again
+				v.join_time = now;
+				v.state = 0;
+			}
+
+			if (now - v.second_start >= 1000)
+			{
+				if (v.bytes_this_second > v.peak_rate)
+					v.peak_rate = v.bytes_this_second;
+				v.bytes_this_second = 0;
+				v.second_start = now;
+			}
+		}
+	}
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	int failed = 0;
+	unsigned int peak = 0;
+	for (int i = 0; i < num_viewers; i++)
+	{
+		Viewer &v = viewers[i];
+		if (!v.got_fullupdate || v.deltas == 0 || v.errors)
+			failed++;
+		if (v.peak_rate > peak)
+			peak = v.peak_rate;
+	}
+
+	printf("%d viewers, %d server connects, %d world tics, peak viewer rate %u KB/s (limit %d)\n",
+	       num_viewers, connects, world_tic, peak / 1024, VIEWER_RATE);
+	printf("%s: %d of %d viewers failed\n", failed ? "FAIL" : "PASS", failed, num_viewers);
+
+	return failed ? 1 : 0;
+}
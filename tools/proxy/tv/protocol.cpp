@@ -1,451 +1,645 @@
 //
-// OdaTV - Allow multiple clients to watch the same server
+// OdaTV - Allow many clients to watch the same server
 // without creating extra traffic on that server
 //
-// This proxy will create the first connection transparently,
-// but other connections will be hidden from the server
+// The relay holds a single spectator connection to the game server and
+// re-serves the packets it receives, unmodified, to any number of viewers.
+// Every upstream packet is appended to a timeline.  A keyframe marks where
+// an upstream session's connection prelude (console player, map load and
+// the full update) begins and where its live stream starts; a viewer that
+// joins late is sent the latest keyframe's prelude followed by everything
+// that session has received since, so it reaches the live state without the
+// server knowing it exists.
+//
+// Keyframes roll: every keyframe_interval seconds the relay opens a second
+// upstream session, records its full update and then drops the old session.
+// Viewers already watching switch to the new session's stream at that
+// point; only new viewers replay the new prelude.  This keeps the amount a
+// joining viewer has to replay bounded at the cost of one spectator
+// reconnect per interval.
+//
+// The first viewer's connect packet is captured and reused (with a fresh
+// server token) for every upstream session, so the relay needs no
+// knowledge of wads or client versions.
+//
+// Viewers are paced individually with a token bucket, and the whole
+// broadcast can be held back by a fixed delay.
 //
 
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <vector>
+#include <deque>
 #include <iostream>
 
-#include "../../master/i_net.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../../../master/i_net.h"
+#include "minilzo.h"
+#include "tv_msgids.h"
+
+void SockadrToNetadr(struct sockaddr_in *s, netadr_t *a);
+void NetadrToSockadr(netadr_t *a, struct sockaddr_in *s);
+
+extern int net_socket;
+
+using tv::svc_disconnect;
+using tv::svc_fullupdatedone;
+using tv::svc_compressed;
+using tv::clc_disconnect;
+using tv::clc_ack;
+using tv::minilzo_mask;
+
+#define TV_SESSION_TIMEOUT		5000	// ms to establish an upstream session
+#define TV_UPSTREAM_TIMEOUT		10000	// ms of upstream silence before reconnecting
+#define TV_VIEWER_TIMEOUT		10000	// ms of viewer silence before dropping it
+#define TV_MAX_VIEWER_LAG		30000	// ms a viewer may fall behind before being dropped
+#define TV_INFO_REFRESH			5000	// ms between launcher info refreshes
+#define TV_MAX_VIEWERS			1024
+
+static netadr_t net_server;
+
+static unsigned int viewer_rate = 128 * 1024;	// bytes per second per viewer
+static unsigned int broadcast_delay = 0;		// ms
+static unsigned int keyframe_interval = 600;	// seconds, 0 to never roll
+
+static unsigned int TV_Time()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (unsigned int)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+//
+// Timeline
+//
+
+struct TVPacket
+{
+	unsigned int time;
+	int session;
+	std::vector<byte> data;
+};
+
+struct TVKeyframe
+{
+	int session;
+	size_t start;	// timeline index of the session's first packet
+	size_t live;	// timeline index at which the session becomes the broadcast
+};
+
+static std::deque<TVPacket> timeline;
+static size_t timeline_base = 0;		// absolute index of timeline.front()
+static std::deque<TVKeyframe> keyframes;
+
+static size_t TV_TimelineEnd()
+{
+	return timeline_base + timeline.size();
+}
+
+static const TVPacket &TV_TimelineAt(size_t index)
+{
+	return timeline[index - timeline_base];
+}
 
-std::vector<netadr_t> spectators;
-netadr_t net_server;
+//
+// TV_VisibleEnd
+//
+// Index one past the last packet old enough to be broadcast.
+//
+static size_t TV_VisibleEnd(unsigned int now)
+{
+	if (!broadcast_delay)
+		return TV_TimelineEnd();
 
-buf_t challenge_message(MAX_UDP_PACKET), first_message(MAX_UDP_PACKET);
+	size_t end = TV_TimelineEnd();
+	while (end > timeline_base && (int)(now - broadcast_delay - TV_TimelineAt(end - 1).time) < 0)
+		end--;
+	return end;
+}
 
-class MessageTranslator
+//
+// TV_JoinKeyframe
+//
+// Latest keyframe a new viewer can start from, or -1 if none is visible yet.
+//
+static int TV_JoinKeyframe(size_t visible_end)
 {
-protected:
-	void Copy(buf_t &in, buf_t &out, int len)
+	for (int k = (int)keyframes.size() - 1; k >= 0; k--)
+		if (keyframes[k].live <= visible_end)
+			return k;
+	return -1;
+}
+
+//
+// Upstream sessions
+//
+
+enum session_state_t
+{
+	SESSION_CHALLENGING,	// waiting for the server's launcher reply (token)
+	SESSION_CONNECTING,		// connect sent, waiting for the first sequenced packet
+	SESSION_PRELUDE,		// receiving the full update
+	SESSION_LIVE			// the session being broadcast
+};
+
+struct TVSession
+{
+	int id;
+	int sock;
+	session_state_t state;
+	unsigned int started, last_heard;
+	size_t start;
+};
+
+static std::vector<TVSession> sessions;
+static int next_session_id = 1;
+static unsigned int last_roll = 0;
+
+static buf_t connect_template(MAX_UDP_PACKET);
+static buf_t launcher_reply(MAX_UDP_PACKET);
+static unsigned int last_info_request = 0;
+
+static void TV_SendFrom(int sock, const byte *data, size_t len, netadr_t to)
+{
+	struct sockaddr_in addr;
+	NetadrToSockadr(&to, &addr);
+	sendto(sock, (const char *)data, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+static void TV_SendLong(int sock, int l)
+{
+	byte buf[4] = { (byte)(l & 0xff), (byte)((l >> 8) & 0xff), (byte)((l >> 16) & 0xff), (byte)(l >> 24) };
+	TV_SendFrom(sock, buf, sizeof(buf), net_server);
+}
+
+static int TV_ReadLong(const byte *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+static void TV_OpenSession()
+{
+	TVSession s;
+
+	s.sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s.sock < 0)
 	{
-		byte *p = in.ReadChunk(len);
-		if(p)
-			out.WriteChunk((const char *)p, len);
+		std::cout << "could not open upstream socket" << std::endl;
+		return;
 	}
+	fcntl(s.sock, F_SETFL, O_NONBLOCK);
+
+	s.id = next_session_id++;
+	s.state = SESSION_CHALLENGING;
+	s.started = s.last_heard = TV_Time();
+	s.start = 0;
+
+	// ask for a fresh token, the connect follows the reply
+	TV_SendLong(s.sock, LAUNCHER_CHALLENGE);
 
-	void CopyString(buf_t &in, buf_t &out)
+	sessions.push_back(s);
+	last_roll = s.started;
+
+	std::cout << "opening upstream session " << s.id << std::endl;
+}
+
+static void TV_CloseSession(size_t i, bool notify)
+{
+	if (notify)
 	{
-		const char *p = in.ReadString();
-		if(p)
-			out.WriteString(p);
+		byte msg = clc_disconnect;
+		TV_SendFrom(sessions[i].sock, &msg, 1, net_server);
 	}
-};
 
-class Translate_ServerToTV : public MessageTranslator
+	std::cout << "closing upstream session " << sessions[i].id << std::endl;
+
+	close(sessions[i].sock);
+	sessions.erase(sessions.begin() + i);
+}
+
+//
+// TV_EndsFullUpdate
+//
+// The server flushes a packet right after writing svc_fullupdatedone, so the
+// last packet of the full update ends with that marker once decompressed.
+//
+static bool TV_EndsFullUpdate(const byte *data, size_t len)
 {
-public:
-// network messages
-enum svc_t
+	static byte decompressed[MAX_UDP_PACKET * 8];
+
+	if (len <= 4)
+		return false;
+
+	if (len > 6 && data[4] == svc_compressed && (data[5] & minilzo_mask))
+	{
+		lzo_uint newlen = sizeof(decompressed);
+		if (lzo1x_decompress_safe(data + 6, len - 6, decompressed, &newlen, NULL) != LZO_E_OK || !newlen)
+			return false;
+		return decompressed[newlen - 1] == svc_fullupdatedone;
+	}
+
+	return data[len - 1] == svc_fullupdatedone;
+}
+
+static void TV_SessionPacket(size_t i, const byte *data, size_t len)
 {
-	svc_abort,
-	svc_full,
-	svc_disconnect,
-	svc_reserved3,
-	svc_playerinfo,			// weapons, ammo, maxammo, raisedweapon for local player
-	svc_moveplayer,			// [byte] [int] [int] [int] [int] [byte]
-	svc_updatelocalplayer,	// [int] [int] [int] [int] [int]
-	svc_svgametic,			// [int]
-	svc_updateping,			// [byte] [byte]
-	svc_spawnmobj,			//
-	svc_disconnectclient,
-	svc_loadmap,
-	svc_consoleplayer,
-	svc_mobjspeedangle,
-	svc_explodemissile,		// [short] - netid
-	svc_removemobj,
-	svc_userinfo,
-	svc_movemobj,			// [short] [byte] [int] [int] [int]
-	svc_spawnplayer,
-	svc_damageplayer,
-	svc_killmobj,
-	svc_firepistol,			// [byte] - playernum
-	svc_fireshotgun,		// [byte] - playernum
-	svc_firessg,			// [byte] - playernum
-	svc_firechaingun,		// [byte] - playernum
-	svc_fireweapon,			// [byte]
-	svc_sector,
-	svc_print,
-	svc_mobjinfo,
-	svc_playermembers,
-	svc_teampoints,
-	svc_activateline,
-	svc_movingsector,
-	svc_startsound,
-	svc_reconnect,
-	svc_exitlevel,
-	svc_touchspecial,
-	svc_changeweapon,
-	svc_reserved42,
-	svc_corpse,
-	svc_missedpacket,
-	svc_soundorigin,
-	svc_reserved46,
-	svc_reserved47,
-	svc_forceteam,			// [Toke] Allows server to change a clients team setting.
-	svc_switch,
-	svc_say,
-	svc_reserved51,
-	svc_spawnhiddenplayer,	// [denis] when client can't see player
-	svc_updatedeaths,		// [byte] [short]
-	svc_ctfevent,			// [Toke - CTF] - [int]
-	svc_serversettings,		// 55 [Toke] - informs clients of server settings
-	svc_spectate,			// [Nes] - [byte:state], [short:playernum]
-
-	// for co-op
-	svc_mobjstate = 70,
-	svc_actor_movedir,
-	svc_actor_target,
-	svc_actor_tracer,
-	svc_damagemobj,
-	
-	// for compressed packets
-	svc_compressed = 200,
-
-	// for when launcher packets go astray
-	svc_launcher_challenge = 212,
-	svc_challenge = 163,
-	svc_max = 255
-};
+	TVSession &s = sessions[i];
+	unsigned int now = TV_Time();
+
+	if (len < 4)
+		return;
+
+	s.last_heard = now;
+
+	if (s.state == SESSION_CHALLENGING)
+	{
+		if (TV_ReadLong(data) != CHALLENGE || len < 8)
+			return;
+
+		// keep the server's info for viewers' launcher queries
+		launcher_reply.clear();
+		launcher_reply.WriteChunk((const char *)data, len);
 
-public:
+		// present the new token in the captured connect packet
+		buf_t connect = connect_template;
+		memcpy(connect.data + 4, data + 4, 4);
+		TV_SendFrom(s.sock, connect.data, connect.cursize, net_server);
 
-	std::string map, digest;
-	byte consoleplayer;
-	int playermobj;
-	int spawnpos[3];
-	unsigned int spawnang;
+		s.state = SESSION_CONNECTING;
+		return;
+	}
+
+	int sequence = TV_ReadLong(data);
+
+	// svc_full / svc_disconnect sent in place of a connection
+	if (s.state == SESSION_CONNECTING && len == 5 && data[4] == svc_disconnect)
+	{
+		std::cout << "server refused upstream session " << s.id << std::endl;
+		TV_CloseSession(i, false);
+		return;
+	}
+
+	// acknowledge every packet ourselves; viewer acks never reach the server
+	byte ack[5] = { clc_ack, data[0], data[1], data[2], data[3] };
+	TV_SendFrom(s.sock, ack, sizeof(ack), net_server);
 
-	void Go(buf_t &in, buf_t &out)
+	if (s.state == SESSION_CONNECTING)
 	{
-		while(in.BytesLeftToRead())
+		s.state = SESSION_PRELUDE;
+		s.start = TV_TimelineEnd();
+	}
+
+	TVPacket packet;
+	packet.time = now;
+	packet.session = s.id;
+	packet.data.assign(data, data + len);
+	timeline.push_back(packet);
+
+	if (s.state == SESSION_PRELUDE && TV_EndsFullUpdate(data, len))
+	{
+		TVKeyframe k;
+		k.session = s.id;
+		k.start = s.start;
+		k.live = TV_TimelineEnd();
+		keyframes.push_back(k);
+
+		s.state = SESSION_LIVE;
+		int id = s.id;
+
+		std::cout << "keyframe from session " << id << ": " << (k.live - k.start)
+		          << " packets, sequence " << sequence << std::endl;
+
+		// make-before-break: drop the session this one replaces
+		for (size_t j = 0; j < sessions.size(); j++)
 		{
-			byte cmd = in.NextByte();
-//std::cout << cmd << " " << (int)cmd << std::endl;
-			switch(cmd)
-			{
-				case svc_loadmap:
-					{
-						Copy(in, out, 1);
-						map = in.ReadString();
-						out.WriteString(map.c_str());
-						std::cout<< "map " << map << std::endl; // todo unsafe
-					}
-					break;
-				case svc_playerinfo:
-					Copy(in, out, 1+ 9 + 4*4 + 5);
-					break;
-				case svc_consoleplayer:
-					Copy(in, out, 1);
-					consoleplayer = in.ReadByte();
-					out.WriteByte(consoleplayer);
-					digest = in.ReadString();
-					out.WriteString(digest.c_str());
-					break;
-				case svc_updatefrags:
-					Copy(in, out, 1+ 7);
-					break;
-				case svc_moveplayer:
-					Copy(in, out, 1+ 37);
-					break;
-				case svc_updatelocalplayer:
-					//in.ReadChunk(28);
-					Copy(in, out, 1+ 28);
-					break;
-				case svc_userinfo:
-					Copy(in, out, 1+ 1);
-					CopyString(in, out);
-					Copy(in, out, 9);
-					CopyString(in, out);
-					Copy(in, out, 2);
-					break;
-				case svc_teampoints:
-					Copy(in, out, 1+ 3*2);
-					break;
-				case svc_svgametic:
-					Copy(in, out, 1+ 4);
-					break;
-				case svc_updateping:
-					Copy(in, out, 1+ 5);
-					break;
-				case svc_spawnmobj:
-					{
-						Copy(in, out, 1+ 16);
-						unsigned short type = in.ReadShort();
-						out.WriteShort(type); // todo: if this line is missing, odamex client crashes
-						Copy(in, out, 5);
-						if(type == 0x10000/*MF_MISSILE*/)
-						{
-							out.WriteShort(type);
-							Copy(in, out, 16); //SpeedAndAngle
-						}
-					}
-					break;
-				case svc_mobjspeedangle:
-					Copy(in, out, 1+ 18);
-					break;
-				case svc_mobjinfo:
-					Copy(in, out, 1+ 6);
-					break;
-				case svc_explodemissile:
-					Copy(in, out, 1+ 2);
-					break;
-				case svc_removemobj:
-					Copy(in, out, 1+ 2);
-					break;
-				case svc_killmobj:
-					Copy(in, out, 1+ 13);
-					break;
-				case svc_movemobj:
-					Copy(in, out, 1+ 15);
-					break;
-				case svc_damagemobj:
-					Copy(in, out, 1+ 5);
-					break;
-				case svc_corpse:
-					Copy(in, out, 1+ 4);
-					break;
-				case svc_spawnplayer:
-					{
-						Copy(in, out, 1);
-						byte player = in.ReadByte();
-						out.WriteByte(player);
-						unsigned short netid = in.ReadShort();
-						if(player == consoleplayer)
-							playermobj = netid;
-						out.WriteShort(netid);
-						spawnang = in.ReadLong();
-						out.WriteLong(spawnang);
-						spawnpos[0] = in.ReadLong();
-						out.WriteLong(spawnpos[0]);
-						spawnpos[1] = in.ReadLong();
-						out.WriteLong(spawnpos[1]);
-						spawnpos[2] = in.ReadLong();
-						out.WriteLong(spawnpos[2]);
-					}
-					break;
-				case svc_damageplayer:
-					Copy(in, out, 1+ 4);
-					break;
-				case svc_firepistol:
-				case svc_fireshotgun:
-				case svc_firessg:
-				case svc_firechaingun:
-					Copy(in, out, 1+ 1);
-					break;
-				case svc_disconnectclient:
-					Copy(in, out, 1+ 1);
-					break;
-				case svc_activateline:
-					Copy(in, out, 1+ 8);
-					break;
-				case svc_sector:
-					Copy(in, out, 1+ 10);
-					break;
-				case svc_movingsector:
-					Copy(in, out, 1+ 19);
-					break;
-				case svc_switch:
-					Copy(in, out, 1+ 10);
-					break;
-				case svc_print:
-					Copy(in, out, 1+ 1);
-					CopyString(in ,out);
-					break;
-				case svc_startsound:
-					Copy(in, out, 1+ 14);
-					break;
-				case svc_soundorigin:
-					Copy(in, out, 1+ 12);
-					break;
-				case svc_mobjstate:
-					Copy(in, out, 1+ 4);
-					break;
-				case svc_actor_movedir:
-					Copy(in, out, 1+ 7);
-					break;
-				case svc_actor_target:
-				case svc_actor_tracer:
-					Copy(in, out, 1+ 4);
-					break;
-				case svc_missedpacket:
-					Copy(in, out, 1+ 6);
-					break;
-				case svc_forceteam:
-					Copy(in, out, 1+ 2);
-					break;
-				case svc_ctfevent:
-					{
-						byte event = in.ReadByte();
-					}
-					break;
-				case svc_serversettings:
-					{
-						Copy(in, out, 1);;
-						while(true)
-						{
-							byte type = in.ReadByte();
-							out.WriteByte(type);
-							if(type == 1)
-							{
-								CopyString(in, out);
-								CopyString(in, out);
-							}
-							else break;
-						}
-					}
-					break;
-				case svc_disconnect:
-					Copy(in, out, 1);
-					break;
-				case svc_full:
-					Copy(in, out, 1);
-					break;
-				case svc_reconnect:
-					Copy(in, out, 1);
-					break;
-				case svc_exitlevel:
-					Copy(in, out, 1);
-					break;
-				case svc_challenge:
-					Copy(in, out, 1);
-					break;
-				case svc_launcher_challenge:
-					Copy(in, out, 1);
-					break;
-				case svc_spectate:
-					Copy(in, out, 1+ 2);
-					break;
-				case svc_abort:
-				default:
-					std::cout << "abort" << (int)cmd << std::endl;
-					in.ReadByte();
-					break;
-			}
-			if(in.overflowed)
+			if (sessions[j].id != id && sessions[j].state == SESSION_LIVE)
 			{
-				std::cout << "overflowed on cmd " << (int)cmd << std::endl;
+				TV_CloseSession(j, true);
+				break;
 			}
 		}
 	}
+}
+
+//
+// Viewers
+//
+
+struct TVViewer
+{
+	netadr_t addr;
+	int session;			// session whose packets the viewer receives, 0 while waiting
+	size_t cursor;			// next timeline index to consider
+	bool caught_up;			// has reached the broadcast point since joining
+	unsigned int last_heard, last_fill;
+	double tokens;
 };
 
-void OnInitTV()
+static std::vector<TVViewer> viewers;
+
+static TVViewer *TV_FindViewer(const netadr_t &addr)
 {
-	NET_StringToAdr("voxelsoft.com:10666", &net_server);
-	NET_StringToAdr("127.0.0.1:10666", &net_server);	
+	for (size_t i = 0; i < viewers.size(); i++)
+		if (NET_CompareAdr(viewers[i].addr, addr))
+			return &viewers[i];
+	return NULL;
 }
 
-void OnClientTV(int i)
+static void TV_DropViewer(size_t i, bool notify)
 {
-	if(i == 0)
+	if (notify)
 	{
-		// only forward the first client's packet
-		NET_SendPacket(net_message.cursize, net_message.data, net_server);
+		// same layout as the server's svc_disconnect
+		byte msg[5] = { 0, 0, 0, 0, svc_disconnect };
+		NET_SendPacket(sizeof(msg), msg, viewers[i].addr);
 	}
-	else	
+
+	std::cout << "viewer " << NET_AdrToString(viewers[i].addr) << " left, "
+	          << viewers.size() - 1 << " watching" << std::endl;
+	viewers.erase(viewers.begin() + i);
+}
+
+static void TV_NewViewer()
+{
+	if (viewers.size() >= TV_MAX_VIEWERS)
+		return;
+
+	if (!connect_template.cursize)
 	{
-		// TODO should keep client's tick info
-		// TODO and also catch client disconnect messages
+		connect_template.clear();
+		connect_template.WriteChunk((const char *)net_message.data, net_message.cursize);
 	}
-}
 
-Translate_ServerToTV tr;
+	if (sessions.empty())
+		TV_OpenSession();
+
+	TVViewer v;
+	v.addr = net_from;
+	v.session = 0;
+	v.cursor = 0;
+	v.caught_up = false;
+	v.last_heard = v.last_fill = TV_Time();
+	v.tokens = MAX_UDP_PACKET;
+	viewers.push_back(v);
+
+	std::cout << "viewer " << NET_AdrToString(net_from) << " joined, "
+	          << viewers.size() << " watching" << std::endl;
+}
 
-void OnNewClientTV()
+//
+// TV_ServeViewer
+//
+// Sends the viewer whatever its token bucket allows, starting it at the
+// latest keyframe if it has not been placed on the timeline yet.
+//
+static bool TV_ServeViewer(TVViewer &v, unsigned int now, size_t visible_end)
 {
-	spectators.push_back(net_from);
+	if (!v.session)
+	{
+		int k = TV_JoinKeyframe(visible_end);
+		if (k < 0)
+			return true;
+
+		v.session = keyframes[k].session;
+		v.cursor = keyframes[k].start;
+	}
 
-	if(spectators.size() == 1)
+	if ((int)(now - v.last_fill) > 0)
+		v.tokens += (double)viewer_rate * (now - v.last_fill) / 1000.0;
+	if (v.tokens > viewer_rate / 4 + MAX_UDP_PACKET)
+		v.tokens = viewer_rate / 4 + MAX_UDP_PACKET;
+	v.last_fill = now;
+
+	while (v.cursor < visible_end && v.tokens > 0)
 	{
-		// only forward the first client's packets
-		NET_SendPacket(net_message.cursize, net_message.data, net_server);
+		// switch streams where a newer session took over
+		for (size_t k = 0; k < keyframes.size(); k++)
+			if (keyframes[k].live == v.cursor && keyframes[k].session > v.session)
+				v.session = keyframes[k].session;
 
-		// pass messages through the translator so it discovers maps, etc
-		buf_t tmp;
-		net_message.ReadLong();
-		tr.Go(net_message, tmp);
+		const TVPacket &packet = TV_TimelineAt(v.cursor++);
+		if (packet.session != v.session)
+			continue;
 
-		std::cout << "first client connect from " << NET_AdrToString(net_from) << std::endl;
+		NET_SendPacket(packet.data.size(), (byte *)&packet.data[0], v.addr);
+		v.tokens -= packet.data.size();
 	}
-	else
+
+	if (v.cursor >= visible_end)
+		v.caught_up = true;
+	else if (v.caught_up && (int)(now - broadcast_delay - TV_TimelineAt(v.cursor).time) > TV_MAX_VIEWER_LAG)
+		return false;
+
+	return true;
+}
+
+//
+// TV_TrimTimeline
+//
+// Releases packets no viewer still needs and no new viewer could start from.
+//
+static void TV_TrimTimeline(size_t visible_end)
+{
+	int k = TV_JoinKeyframe(visible_end);
+	if (k < 0)
+		return;
+
+	size_t keep = keyframes[k].start;
+
+	for (size_t i = 0; i < viewers.size(); i++)
 	{
-		// send back to the non-first client a fake challenge
-		NET_SendPacket(challenge_message.cursize, challenge_message.data, net_from);
-
-		// to the first message, add map load command
-		buf_t out(8196);// = first_message;
-		out.WriteLong(0);
-		out.WriteByte(Translate_ServerToTV::svc_consoleplayer);
-		out.WriteByte(tr.consoleplayer);
-		out.WriteString(tr.digest.c_str());
-
-		out.WriteByte(Translate_ServerToTV::svc_loadmap);
-		out.WriteString(tr.map.c_str());
-
-		out.WriteByte(Translate_ServerToTV::svc_spawnplayer);
-		out.WriteByte(tr.consoleplayer);
-		out.WriteShort(tr.playermobj);
-		out.WriteLong(tr.spawnang);
-		out.WriteLong(tr.spawnpos[0]);
-		out.WriteLong(tr.spawnpos[1]);
-		out.WriteLong(tr.spawnpos[2]);
-
-		out.WriteByte(Translate_ServerToTV::svc_spectate);
-		out.WriteByte(tr.consoleplayer);
-		out.WriteByte(true);
-
-		NET_SendPacket(out.cursize, out.data, net_from);
-		std::cout << "shadow client connect from " <<(int)tr.consoleplayer<< NET_AdrToString(net_from) << std::endl;
+		if (viewers[i].session && viewers[i].cursor < keep)
+			keep = viewers[i].cursor;
 	}
+
+	while (timeline_base < keep)
+	{
+		timeline.pop_front();
+		timeline_base++;
+	}
+
+	while (keyframes.size() > 1 && keyframes[0].live < timeline_base)
+		keyframes.pop_front();
+}
+
+//
+// Protocol entry points
+//
+
+void OnInitTV(int argc, char **argv)
+{
+	char server[64] = "127.0.0.1:10666";
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "-s"))
+			strncpy(server, argv[i + 1], sizeof(server) - 1);
+		else if (!strcmp(argv[i], "-r"))
+			viewer_rate = atoi(argv[i + 1]) * 1024;
+		else if (!strcmp(argv[i], "-d"))
+			broadcast_delay = atoi(argv[i + 1]) * 1000;
+		else if (!strcmp(argv[i], "-k"))
+			keyframe_interval = atoi(argv[i + 1]);
+	}
+
+	// upstream sessions use their own IPv4 sockets
+	NET_StringToAdr(server, &net_server, NA_IPV4);
+	lzo_init();
+
+	connect_template.clear();
+	launcher_reply.clear();
+
+	std::cout << "relaying " << NET_AdrToString(net_server) << ", " << viewer_rate / 1024
+	          << " KB/s per viewer, " << broadcast_delay / 1000 << "s delay" << std::endl;
 }
 
 void OnPacketTV()
 {
-	if(NET_CompareAdr(net_from, net_server))
+	if (NET_CompareAdr(net_from, net_server))
 	{
-		buf_t out = net_message;
-		// if this is a server connect message, keep a copy for other clients
-		int t = net_message.ReadLong();
-		if(t == CHALLENGE)
+		// launcher info for our own queries
+		if (net_message.cursize >= 8 && TV_ReadLong(net_message.data) == CHALLENGE)
 		{
-			std::cout << "first client connected" << std::endl;
-			challenge_message = net_message;
+			launcher_reply.clear();
+			launcher_reply.WriteChunk((const char *)net_message.data, net_message.cursize);
 		}
-		else if(t == 0)
+		return;
+	}
+
+	TVViewer *v = TV_FindViewer(net_from);
+
+	if (v)
+	{
+		v->last_heard = TV_Time();
+
+		if (net_message.cursize >= 1 && net_message.data[0] == clc_disconnect)
+			TV_DropViewer(v - &viewers[0], false);
+		return;
+	}
+
+	if (net_message.cursize < 4)
+		return;
+
+	int challenge = TV_ReadLong(net_message.data);
+
+	if (challenge == LAUNCHER_CHALLENGE && net_message.cursize == 4)
+	{
+		// answer launchers and connecting clients from the cached reply
+		if (launcher_reply.cursize)
+			NET_SendPacket(launcher_reply.cursize, launcher_reply.data, net_from);
+	}
+	else if (challenge == CHALLENGE)
+	{
+		TV_NewViewer();
+	}
+}
+
+unsigned int OnWaitTV(unsigned int timeout_ms)
+{
+	fd_set readfds;
+	int maxfd = net_socket;
+
+	FD_ZERO(&readfds);
+	FD_SET(net_socket, &readfds);
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		FD_SET(sessions[i].sock, &readfds);
+		if (sessions[i].sock > maxfd)
+			maxfd = sessions[i].sock;
+	}
+
+	// viewers with queued packets are served at least every few ms
+	if (!viewers.empty() && timeout_ms > 5)
+		timeout_ms = 5;
+
+	struct timeval timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+	return select(maxfd + 1, &readfds, NULL, NULL, &timeout) > 0;
+}
+
+void OnTickTV()
+{
+	static byte data[MAX_UDP_PACKET];
+	unsigned int now = TV_Time();
+
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		int id = sessions[i].id;
+		struct sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+		int len;
+
+		while (i < sessions.size() && sessions[i].id == id &&
+		       (len = recvfrom(sessions[i].sock, (char *)data, sizeof(data), 0, (struct sockaddr *)&from, &fromlen)) > 0)
 		{
-			first_message = net_message;
-			buf_t tmp;
-			tr.Go(net_message, tmp);
+			netadr_t adr;
+			SockadrToNetadr(&from, &adr);
+			if (NET_CompareAdr(adr, net_server))
+				TV_SessionPacket(i, data, len);
 		}
-		else
+	}
+
+	for (size_t i = 0; i < sessions.size(); )
+	{
+		TVSession &s = sessions[i];
+		if ((s.state != SESSION_LIVE && (int)(now - s.started) > TV_SESSION_TIMEOUT) ||
+		    (s.state == SESSION_LIVE && (int)(now - s.last_heard) > TV_UPSTREAM_TIMEOUT))
 		{
-			out.clear();
-			out.WriteLong(t);
-			tr.Go(net_message, out);
+			std::cout << "upstream session " << s.id << " timed out" << std::endl;
+			TV_CloseSession(i, true);
 		}
-		// replicate server packet to all connected clients
-		for(int i = 0; i < spectators.size(); i++)
+		else
+			i++;
+	}
+
+	if (connect_template.cursize)
+	{
+		bool live = false, opening = false;
+		for (size_t i = 0; i < sessions.size(); i++)
 		{
-			NET_SendPacket(out.cursize, out.data, spectators[i]);
+			if (sessions[i].state == SESSION_LIVE)
+				live = true;
+			else
+				opening = true;
 		}
+
+		// reconnect after losing the server, and roll the keyframe
+		if (!opening && (!live || (keyframe_interval && (int)(now - last_roll) > (int)keyframe_interval * 1000)))
+			TV_OpenSession();
+	}
+
+	// keep the launcher reply reasonably fresh for viewers
+	if ((int)(now - last_info_request) > TV_INFO_REFRESH)
+	{
+		byte query[4] = { LAUNCHER_CHALLENGE & 0xff, (LAUNCHER_CHALLENGE >> 8) & 0xff, (LAUNCHER_CHALLENGE >> 16) & 0xff, (byte)(LAUNCHER_CHALLENGE >> 24) };
+		NET_SendPacket(sizeof(query), query, net_server);
+		last_info_request = now;
 	}
-	else
+
+	size_t visible_end = TV_VisibleEnd(now);
+
+	for (size_t i = 0; i < viewers.size(); )
 	{
-		// is this an existing client?
-		for(int i = 0; i < spectators.size(); i++)
+		if ((int)(now - viewers[i].last_heard) > TV_VIEWER_TIMEOUT)
+			TV_DropViewer(i, false);
+		else if (!TV_ServeViewer(viewers[i], now, visible_end))
 		{
-			if(NET_CompareAdr(net_from, spectators[i]))
-			{
-				OnClientTV(i);
-				return;
-			}
+			std::cout << "viewer " << NET_AdrToString(viewers[i].addr) << " cannot keep up" << std::endl;
+			TV_DropViewer(i, true);
 		}
-
-		// must be a new client
-		OnNewClientTV();
+		else
+			i++;
 	}
+
+	TV_TrimTimeline(visible_end);
 }
@@ -0,0 +1,39 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Checks the relay's copy of the message ids against common/i_net.h.
+//	Nothing in here is linked in; it only has to compile.
+//
+//-----------------------------------------------------------------------------
+
+// common/version.h insists on knowing which side it is built for
+#define SERVER_APP
+#include "../../../common/i_net.h"
+#include "tv_msgids.h"
+
+// An array of negative size stops the build if a copy no longer matches
+#define TV_CHECK_ID(name) \
+	typedef char tv_check_##name[(int)tv::name == (int)::name ? 1 : -1]
+
+TV_CHECK_ID(svc_disconnect);
+TV_CHECK_ID(svc_consoleplayer);
+TV_CHECK_ID(svc_fullupdatedone);
+TV_CHECK_ID(svc_compressed);
+TV_CHECK_ID(clc_disconnect);
+TV_CHECK_ID(clc_ack);
+TV_CHECK_ID(minilzo_mask);
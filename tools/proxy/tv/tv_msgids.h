@@ -0,0 +1,47 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Message ids from common/i_net.h that the relay needs to recognise.
+//	The relay is built against master/i_net.h, which shares its include
+//	guard, so they are repeated here and tv_msgids.cpp checks them
+//	against the originals at compile time.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __TV_MSGIDS_H__
+#define __TV_MSGIDS_H__
+
+namespace tv
+{
+
+enum
+{
+	svc_disconnect = 2,
+	svc_consoleplayer = 13,
+	svc_fullupdatedone = 59,
+	svc_compressed = 200,
+
+	clc_disconnect = 2,
+	clc_ack = 8,
+
+	minilzo_mask = 8
+};
+
+}
+
+#endif // __TV_MSGIDS_H__
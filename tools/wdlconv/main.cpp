@@ -0,0 +1,65 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Converts binary WDL stats logs to the text format.  The server does this
+//	itself when a log is finished; this is for logs left partial by a crash
+//	or a map that never ended.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string>
+
+#include "../../common/m_wdlconv.h"
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || argc > 3)
+	{
+		printf("usage: %s <binary log> [text log]\n", argv[0]);
+		return 1;
+	}
+
+	std::string binpath = argv[1];
+	std::string textpath;
+
+	if (argc > 2)
+	{
+		textpath = argv[2];
+	}
+	else
+	{
+		// wdl_<time>.wdl becomes wdl_<time>.log
+		textpath = binpath;
+		size_t dot = textpath.rfind('.');
+		if (dot != std::string::npos && textpath.find_first_of("/\\", dot) == std::string::npos)
+			textpath.erase(dot);
+		textpath += ".log";
+	}
+
+	bool partial;
+	std::string error;
+	if (!M_ConvertWDLLog(binpath, textpath, partial, error))
+	{
+		printf("wdlconv: %s\n", error.c_str());
+		return 1;
+	}
+
+	printf("wrote %s%s\n", textpath.c_str(), partial ? " (log is partial)" : "");
+	return 0;
+}